@@ -35,6 +35,7 @@
 #undef HAVE_UNSETENV
 #undef HAVE_XINERAMA
 #undef HAVE_XFREE_XINERAMA
+#undef HAVE_XCB
 #undef HAVE_XINPUT
 #undef UTMP_LINE_ATTACHED
 #undef UTMP_PSEUDO_DEVICE
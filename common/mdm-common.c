@@ -25,6 +25,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <locale.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 
 #ifdef HAVE_CRT_EXTERNS_H
@@ -251,6 +253,54 @@ int mdm_vector_len (char * const *v) {
     }
 }
 
+/* Reads a file that only root may have written.  Anything else, a symlink,
+ * something not owned by root or writable by group or others, or larger
+ * than max_size, is refused. */
+gboolean mdm_common_read_root_file (const char *file, gsize max_size, char **contents, gsize *length) {
+    struct stat st;
+    char *data;
+    gsize done = 0;
+    ssize_t n;
+    int fd;
+
+    VE_IGNORE_EINTR (fd = open (file, O_RDONLY | O_NOFOLLOW | O_NOCTTY | O_CLOEXEC));
+    if (fd < 0) {
+        return FALSE;
+    }
+
+    if (fstat (fd, &st) < 0 ||
+        ! S_ISREG (st.st_mode) ||
+        st.st_uid != 0 ||
+        (st.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+        (gsize) st.st_size > max_size) {
+        g_debug ("Not trusting %s", file);
+        close (fd);
+        return FALSE;
+    }
+
+    data = g_malloc (st.st_size + 1);
+    while (done < (gsize) st.st_size) {
+        VE_IGNORE_EINTR (n = read (fd, data + done, st.st_size - done));
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    close (fd);
+
+    if (done != (gsize) st.st_size) {
+        g_free (data);
+        return FALSE;
+    }
+
+    data[done] = '\0';
+    *contents = data;
+    if (length != NULL) {
+        *length = done;
+    }
+    return TRUE;
+}
+
 static gboolean check_file (const char *path, guint uid) {
     if (path == NULL || (g_access (path, R_OK) != 0)) {
         return FALSE;
@@ -78,6 +78,10 @@ gboolean       ve_locale_exists (const char *loc);
 
 char *         mdm_common_get_facefile (const char *homedir, const char *username, guint uid);
 
+/* For caches kept in ServAuthDir, which the mdm group can write to */
+gboolean       mdm_common_read_root_file (const char *file, gsize max_size,
+					  char **contents, gsize *length);
+
 #define VE_IGNORE_EINTR(expr) \
 	do {		\
 		errno = 0;	\
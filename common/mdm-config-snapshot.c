@@ -0,0 +1,349 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Read-only copy of the daemon configuration for the greeters.
+ *
+ * The daemon writes every key, as GET_CONFIG would answer it, into a
+ * memfd and seals it, so that nobody can change it afterwards.  The
+ * layout is a header, the entries sorted by "group/key" and then the
+ * strings.  A greeter maps it and looks keys up with a binary search
+ * instead of a socket round trip per key.
+ *
+ * A new snapshot is a new memfd.  Next to it the daemon keeps one shared
+ * page with the generation of its newest snapshot, readers compare it
+ * with the generation in their header and stop using a snapshot that
+ * was replaced.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include "mdm-config-snapshot.h"
+
+#define SNAPSHOT_MAGIC		"MDMCFGS1"
+#define SNAPSHOT_SEALS		(F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW)
+
+typedef struct {
+	char    magic[8];
+	guint32 n_entries;
+	guint32 size;
+	guint64 generation;
+} SnapshotHeader;
+
+typedef struct {
+	guint32 key;		/* offsets from the start of the snapshot */
+	guint32 value;
+} SnapshotEntry;
+
+struct _MdmConfigSnapshot {
+	const char             *data;
+	gsize                   size;
+	const SnapshotHeader   *header;
+	const SnapshotEntry    *entries;
+	const volatile guint64 *generation;
+	gsize                   generation_size;
+};
+
+#ifdef HAVE_MEMFD_CREATE
+
+static gint
+compare_keys (gconstpointer a, gconstpointer b)
+{
+	return strcmp (a, b);
+}
+
+int
+mdm_config_snapshot_write (GHashTable *values,
+			   guint64     generation)
+{
+	SnapshotHeader header;
+	SnapshotEntry *entries;
+	GString *strings;
+	GList *keys, *li;
+	gsize offset;
+	guint n, i;
+	ssize_t written;
+	int fd;
+
+	keys = g_list_sort (g_hash_table_get_keys (values), compare_keys);
+	n = g_list_length (keys);
+
+	offset = sizeof (SnapshotHeader) + n * sizeof (SnapshotEntry);
+	entries = g_new0 (SnapshotEntry, MAX (n, 1));
+	strings = g_string_new (NULL);
+
+	for (li = keys, i = 0; li != NULL; li = li->next, i++) {
+		const char *value = g_hash_table_lookup (values, li->data);
+
+		entries[i].key = offset + strings->len;
+		g_string_append_len (strings, li->data, strlen (li->data) + 1);
+		entries[i].value = offset + strings->len;
+		g_string_append_len (strings, value ? value : "",
+				     strlen (value ? value : "") + 1);
+	}
+	g_list_free (keys);
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+	header.n_entries = n;
+	header.size = offset + strings->len;
+	header.generation = generation;
+
+	fd = memfd_create ("mdm-config", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		goto out;
+
+	written = write (fd, &header, sizeof (header));
+	if (written == sizeof (header) && n > 0)
+		written = write (fd, entries, n * sizeof (SnapshotEntry));
+	if (written >= 0)
+		written = write (fd, strings->str, strings->len);
+
+	if (written < 0 ||
+	    lseek (fd, 0, SEEK_END) != (off_t) header.size ||
+	    fcntl (fd, F_ADD_SEALS, SNAPSHOT_SEALS | F_SEAL_SEAL) < 0) {
+		close (fd);
+		fd = -1;
+	}
+
+ out:
+	g_free (entries);
+	g_string_free (strings, TRUE);
+
+	return fd;
+}
+
+/*
+ * The page is written through the creator's mapping only.  Where the
+ * kernel knows F_SEAL_FUTURE_WRITE the memfd is sealed against any other
+ * writer once that mapping exists, and in any case the descriptor handed
+ * out is a read-only reopen, which cannot be mapped writable or write.
+ */
+volatile guint64 *
+mdm_config_snapshot_generation_new (int *fd)
+{
+	void *page;
+	char *path;
+	int rdonly;
+	long size = sysconf (_SC_PAGESIZE);
+
+	*fd = memfd_create ("mdm-config-generation", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (*fd < 0)
+		return NULL;
+
+	if (ftruncate (*fd, size) < 0 ||
+	    fcntl (*fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+		close (*fd);
+		*fd = -1;
+		return NULL;
+	}
+
+	page = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (page == MAP_FAILED) {
+		close (*fd);
+		*fd = -1;
+		return NULL;
+	}
+
+#ifdef F_SEAL_FUTURE_WRITE
+	/* older kernels refuse it, the read-only reopen still holds */
+	fcntl (*fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE);
+#endif
+	fcntl (*fd, F_ADD_SEALS, F_SEAL_SEAL);
+
+	path = g_strdup_printf ("/proc/self/fd/%d", *fd);
+	rdonly = open (path, O_RDONLY | O_CLOEXEC);
+	g_free (path);
+
+	close (*fd);
+	*fd = rdonly;
+	if (rdonly < 0) {
+		munmap (page, size);
+		return NULL;
+	}
+
+	return page;
+}
+
+/* Only a snapshot that really cannot change may be trusted */
+static gboolean
+is_sealed (int fd, int seals)
+{
+	int r = fcntl (fd, F_GET_SEALS);
+
+	return r >= 0 && (r & seals) == seals;
+}
+
+MdmConfigSnapshot *
+mdm_config_snapshot_open (int fd,
+			  int generation_fd)
+{
+	MdmConfigSnapshot *snapshot;
+	const SnapshotHeader *header;
+	struct stat st;
+	void *data, *generation;
+	long page_size = sysconf (_SC_PAGESIZE);
+	guint i;
+
+	if (fd < 0 || generation_fd < 0 ||
+	    ! is_sealed (fd, SNAPSHOT_SEALS) ||
+	    ! is_sealed (generation_fd, F_SEAL_SHRINK | F_SEAL_GROW))
+		return NULL;
+
+	if (fstat (fd, &st) < 0 ||
+	    st.st_size < (off_t) sizeof (SnapshotHeader) ||
+	    st.st_size > G_MAXUINT32)
+		return NULL;
+
+	data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	generation = mmap (NULL, page_size, PROT_READ, MAP_SHARED, generation_fd, 0);
+	if (generation == MAP_FAILED) {
+		munmap (data, st.st_size);
+		return NULL;
+	}
+
+	snapshot = g_new0 (MdmConfigSnapshot, 1);
+	snapshot->data = data;
+	snapshot->size = st.st_size;
+	snapshot->generation = generation;
+	snapshot->generation_size = page_size;
+
+	/* Check it all once, lookups can then trust every offset */
+	header = snapshot->header = data;
+	snapshot->entries = (const SnapshotEntry *) (snapshot->data + sizeof (SnapshotHeader));
+
+	if (memcmp (header->magic, SNAPSHOT_MAGIC, sizeof (header->magic)) != 0 ||
+	    header->size != snapshot->size ||
+	    header->n_entries > (snapshot->size - sizeof (SnapshotHeader)) / sizeof (SnapshotEntry) ||
+	    snapshot->data[snapshot->size - 1] != '\0')
+		goto fail;
+
+	for (i = 0; i < header->n_entries; i++) {
+		if (snapshot->entries[i].key >= snapshot->size ||
+		    snapshot->entries[i].value >= snapshot->size)
+			goto fail;
+	}
+
+	return snapshot;
+
+ fail:
+	mdm_config_snapshot_close (snapshot);
+	return NULL;
+}
+
+#else /* ! HAVE_MEMFD_CREATE */
+
+int
+mdm_config_snapshot_write (GHashTable *values,
+			   guint64     generation)
+{
+	return -1;
+}
+
+volatile guint64 *
+mdm_config_snapshot_generation_new (int *fd)
+{
+	*fd = -1;
+	return NULL;
+}
+
+MdmConfigSnapshot *
+mdm_config_snapshot_open (int fd,
+			  int generation_fd)
+{
+	return NULL;
+}
+
+#endif /* HAVE_MEMFD_CREATE */
+
+MdmConfigSnapshot *
+mdm_config_snapshot_open_from_env (void)
+{
+	const char *env;
+	int fd, generation_fd;
+
+	env = g_getenv (MDM_CONFIG_SNAPSHOT_ENV);
+	if (env == NULL || sscanf (env, "%d,%d", &fd, &generation_fd) != 2)
+		return NULL;
+
+	return mdm_config_snapshot_open (fd, generation_fd);
+}
+
+void
+mdm_config_snapshot_close (MdmConfigSnapshot *snapshot)
+{
+	if (snapshot == NULL)
+		return;
+
+	munmap ((void *) snapshot->data, snapshot->size);
+	munmap ((void *) snapshot->generation, snapshot->generation_size);
+	g_free (snapshot);
+}
+
+gboolean
+mdm_config_snapshot_is_current (MdmConfigSnapshot *snapshot)
+{
+	return snapshot != NULL &&
+		*snapshot->generation == snapshot->header->generation;
+}
+
+const char *
+mdm_config_snapshot_lookup (MdmConfigSnapshot *snapshot,
+			    const char        *key)
+{
+	size_t len;
+	guint lo, hi;
+
+	if ( ! mdm_config_snapshot_is_current (snapshot))
+		return NULL;
+
+	len = strcspn (key, "=");
+	lo = 0;
+	hi = snapshot->header->n_entries;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		const char *k = snapshot->data + snapshot->entries[mid].key;
+		int cmp = strncmp (k, key, len);
+
+		if (cmp == 0 && k[len] != '\0')
+			cmp = 1;
+
+		if (cmp == 0)
+			return snapshot->data + snapshot->entries[mid].value;
+		else if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MDM_CONFIG_SNAPSHOT_H
+#define _MDM_CONFIG_SNAPSHOT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Set by the slave for the greeter to "<snapshot fd>,<generation fd>" */
+#define MDM_CONFIG_SNAPSHOT_ENV "MDM_CONFIG_SNAPSHOT"
+
+typedef struct _MdmConfigSnapshot MdmConfigSnapshot;
+
+/* Daemon side.  values maps "group/key" to the value as GET_CONFIG would
+ * return it.  Returns a sealed memfd, or -1. */
+int                mdm_config_snapshot_write        (GHashTable        *values,
+						     guint64            generation);
+
+/* A shared page holding the generation of the newest snapshot, which
+ * only the creator can change.  *fd is read-only. */
+volatile guint64 * mdm_config_snapshot_generation_new (int             *fd);
+
+/* Reader side */
+MdmConfigSnapshot *mdm_config_snapshot_open         (int                fd,
+						     int                generation_fd);
+MdmConfigSnapshot *mdm_config_snapshot_open_from_env (void);
+void               mdm_config_snapshot_close        (MdmConfigSnapshot *snapshot);
+gboolean           mdm_config_snapshot_is_current   (MdmConfigSnapshot *snapshot);
+
+/* key may carry a "=default" suffix like the MDM_KEY_ defines.  Returns
+ * NULL if the key is not in the snapshot or the snapshot is out of date.
+ * The string lives as long as the snapshot. */
+const char *       mdm_config_snapshot_lookup       (MdmConfigSnapshot *snapshot,
+						     const char        *key);
+
+G_END_DECLS
+
+#endif /* _MDM_CONFIG_SNAPSHOT_H */
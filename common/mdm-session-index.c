@@ -0,0 +1,525 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Index of the session .desktop files found in SessionDesktopDir.
+ *
+ * Parsing every .desktop file and looking up every TryExec in the PATH
+ * is done only when the mtime of one of the session directories changes.
+ * The result is kept as a small key file which the slave saves in
+ * ServAuthDir so that the greeters can pick it up without rescanning.
+ * All Name and Comment translations are kept, so one index serves
+ * every locale.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "mdm-common.h"
+#include "mdm-common-config.h"
+#include "mdm-session-index.h"
+
+#define INDEX_VERSION		1
+#define INDEX_GROUP		"Index"
+#define SESSION_GROUP_PREFIX	"Session "
+#define DESKTOP_ENTRY_GROUP	"Desktop Entry"
+#define MAX_INDEX_SIZE		(4 * 1024 * 1024)
+
+struct _MdmSessionIndex {
+	char      *search_path;
+	char      *cache_file;
+	char     **dirs;
+	char     **mtimes;
+	char     **files;
+	gboolean   some_dir_exists;
+	GKeyFile  *keyfile;
+};
+
+static char **
+get_dir_mtimes (char **dirs, gboolean *some_dir_exists)
+{
+	char **mtimes;
+	int    i;
+
+	*some_dir_exists = FALSE;
+	mtimes = g_new0 (char *, g_strv_length (dirs) + 1);
+
+	for (i = 0; dirs[i] != NULL; i++) {
+		struct stat s;
+
+		if (dirs[i][0] == '\0' ||
+		    access (dirs[i], R_OK|X_OK) != 0 ||
+		    g_stat (dirs[i], &s) != 0) {
+			mtimes[i] = g_strdup ("-1");
+			continue;
+		}
+
+		*some_dir_exists = TRUE;
+		mtimes[i] = g_strdup_printf ("%ld", (long) s.st_mtime);
+	}
+
+	return mtimes;
+}
+
+static gboolean
+strv_equal (char **a, char **b)
+{
+	int i;
+
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	for (i = 0; a[i] != NULL && b[i] != NULL; i++) {
+		if (strcmp (a[i], b[i]) != 0)
+			return FALSE;
+	}
+
+	return a[i] == NULL && b[i] == NULL;
+}
+
+static gboolean
+keyfile_is_current (GKeyFile *keyfile, MdmSessionIndex *index)
+{
+	char   *search_path;
+	char  **mtimes;
+	int     version;
+	gboolean ret;
+
+	if (keyfile == NULL)
+		return FALSE;
+
+	version = g_key_file_get_integer (keyfile, INDEX_GROUP, "Version", NULL);
+	if (version != INDEX_VERSION)
+		return FALSE;
+
+	search_path = g_key_file_get_string (keyfile, INDEX_GROUP, "SearchPath", NULL);
+	mtimes = g_key_file_get_string_list (keyfile, INDEX_GROUP, "Mtimes", NULL, NULL);
+
+	ret = (search_path != NULL &&
+	       strcmp (search_path, index->search_path) == 0 &&
+	       strv_equal (mtimes, index->mtimes));
+
+	g_free (search_path);
+	g_strfreev (mtimes);
+
+	return ret;
+}
+
+static void
+copy_translated_keys (GKeyFile *from, GKeyFile *to, const char *group, const char *name)
+{
+	char  **keys;
+	gsize   len;
+	int     i;
+
+	keys = g_key_file_get_keys (from, DESKTOP_ENTRY_GROUP, NULL, NULL);
+	if (keys == NULL)
+		return;
+
+	len = strlen (name);
+	for (i = 0; keys[i] != NULL; i++) {
+		char *value;
+
+		if (strncmp (keys[i], name, len) != 0 ||
+		    (keys[i][len] != '\0' && keys[i][len] != '['))
+			continue;
+
+		value = g_key_file_get_value (from, DESKTOP_ENTRY_GROUP, keys[i], NULL);
+		if (value != NULL)
+			g_key_file_set_value (to, group, keys[i], value);
+		g_free (value);
+	}
+
+	g_strfreev (keys);
+}
+
+static void
+index_session_file (GKeyFile *keyfile, const char *group, const char *path)
+{
+	GKeyFile             *cfg;
+	MdmSessionIndexStatus status;
+	gboolean              hidden;
+	char                 *tryexec;
+	char                 *exec;
+	char                 *name;
+
+	status = MDM_SESSION_INDEX_OK;
+
+	cfg = mdm_common_config_load (path, NULL);
+	if (cfg == NULL) {
+		g_key_file_set_integer (keyfile, group, "Status", MDM_SESSION_INDEX_INCOMPLETE);
+		return;
+	}
+
+	hidden = FALSE;
+	mdm_common_config_get_boolean (cfg, DESKTOP_ENTRY_GROUP "/Hidden=false", &hidden, NULL);
+	if (hidden) {
+		g_key_file_set_integer (keyfile, group, "Status", MDM_SESSION_INDEX_HIDDEN);
+		g_key_file_free (cfg);
+		return;
+	}
+
+	tryexec = NULL;
+	mdm_common_config_get_string (cfg, DESKTOP_ENTRY_GROUP "/TryExec", &tryexec, NULL);
+	if (tryexec != NULL && tryexec[0] != '\0') {
+		char **tryexecvec = g_strsplit (tryexec, " ", -1);
+		char  *full = NULL;
+
+		/* Do not pass any arguments to g_find_program_in_path */
+		if (tryexecvec != NULL && tryexecvec[0] != NULL)
+			full = g_find_program_in_path (tryexecvec[0]);
+
+		if (full == NULL)
+			status = MDM_SESSION_INDEX_NO_TRYEXEC;
+		else
+			g_key_file_set_string (keyfile, group, "TryExec", full);
+
+		g_strfreev (tryexecvec);
+		g_free (full);
+	}
+	g_free (tryexec);
+
+	exec = NULL;
+	name = NULL;
+	mdm_common_config_get_string (cfg, DESKTOP_ENTRY_GROUP "/Exec", &exec, NULL);
+	mdm_common_config_get_string (cfg, DESKTOP_ENTRY_GROUP "/Name", &name, NULL);
+
+	if (status == MDM_SESSION_INDEX_OK &&
+	    (exec == NULL || exec[0] == '\0' || name == NULL || name[0] == '\0'))
+		status = MDM_SESSION_INDEX_INCOMPLETE;
+
+	if (exec != NULL)
+		g_key_file_set_string (keyfile, group, "Exec", exec);
+	copy_translated_keys (cfg, keyfile, group, "Name");
+	copy_translated_keys (cfg, keyfile, group, "Comment");
+	g_key_file_set_integer (keyfile, group, "Status", status);
+
+	g_free (exec);
+	g_free (name);
+	g_key_file_free (cfg);
+}
+
+static GKeyFile *
+build_index (MdmSessionIndex *index)
+{
+	GKeyFile   *keyfile;
+	GHashTable *seen;
+	GPtrArray  *files;
+	int         i;
+
+	keyfile = g_key_file_new ();
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+	files = g_ptr_array_new ();
+
+	for (i = 0; index->dirs[i] != NULL; i++) {
+		const char    *dir = index->dirs[i];
+		struct dirent *dent;
+		DIR           *sessdir;
+
+		if (strcmp (index->mtimes[i], "-1") == 0)
+			continue;
+
+		sessdir = opendir (dir);
+		if (sessdir == NULL)
+			continue;
+
+		while ((dent = readdir (sessdir)) != NULL) {
+			char *ext;
+			char *group;
+			char *path;
+
+			/* ignore everything but the .desktop files */
+			ext = strstr (dent->d_name, ".desktop");
+			if (ext == NULL || strcmp (ext, ".desktop") != 0)
+				continue;
+
+			/* the first directory in the path wins */
+			if (g_hash_table_lookup (seen, dent->d_name) != NULL)
+				continue;
+
+			g_ptr_array_add (files, g_strdup (dent->d_name));
+			g_hash_table_insert (seen, g_ptr_array_index (files, files->len - 1), GINT_TO_POINTER (1));
+
+			group = g_strconcat (SESSION_GROUP_PREFIX, dent->d_name, NULL);
+			path = g_build_filename (dir, dent->d_name, NULL);
+			index_session_file (keyfile, group, path);
+			g_free (path);
+			g_free (group);
+		}
+
+		closedir (sessdir);
+	}
+
+	g_key_file_set_integer (keyfile, INDEX_GROUP, "Version", INDEX_VERSION);
+	g_key_file_set_string (keyfile, INDEX_GROUP, "SearchPath", index->search_path);
+	g_key_file_set_string_list (keyfile, INDEX_GROUP, "Mtimes",
+				    (const char * const *) index->mtimes,
+				    g_strv_length (index->mtimes));
+	g_key_file_set_string_list (keyfile, INDEX_GROUP, "Files",
+				    (const char * const *) files->pdata,
+				    files->len);
+
+	g_hash_table_destroy (seen);
+	g_ptr_array_foreach (files, (GFunc) g_free, NULL);
+	g_ptr_array_free (files, TRUE);
+
+	return keyfile;
+}
+
+static void
+save_index (MdmSessionIndex *index)
+{
+	char   *data;
+	gsize   len;
+	GError *error;
+
+	data = g_key_file_to_data (index->keyfile, &len, NULL);
+	if (data == NULL)
+		return;
+
+	error = NULL;
+	if (g_file_set_contents (index->cache_file, data, len, &error)) {
+		g_chmod (index->cache_file, 0644);
+	} else {
+		g_debug ("Cannot write session index %s: %s",
+			 index->cache_file, error->message);
+		g_error_free (error);
+	}
+
+	g_free (data);
+}
+
+static void
+set_keyfile (MdmSessionIndex *index, GKeyFile *keyfile)
+{
+	if (index->keyfile != NULL)
+		g_key_file_free (index->keyfile);
+	index->keyfile = keyfile;
+
+	g_strfreev (index->files);
+	index->files = g_key_file_get_string_list (keyfile, INDEX_GROUP, "Files", NULL, NULL);
+	if (index->files == NULL)
+		index->files = g_new0 (char *, 1);
+}
+
+MdmSessionIndex *
+mdm_session_index_new (const char *search_path,
+		       const char *cache_file)
+{
+	MdmSessionIndex *index;
+
+	index = g_new0 (MdmSessionIndex, 1);
+	index->search_path = g_strdup (search_path != NULL ? search_path : "");
+	index->cache_file = g_strdup (cache_file);
+	index->dirs = g_strsplit (index->search_path, ":", -1);
+	index->files = g_new0 (char *, 1);
+
+	return index;
+}
+
+void
+mdm_session_index_free (MdmSessionIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_free (index->search_path);
+	g_free (index->cache_file);
+	g_strfreev (index->dirs);
+	g_strfreev (index->mtimes);
+	g_strfreev (index->files);
+	if (index->keyfile != NULL)
+		g_key_file_free (index->keyfile);
+	g_free (index);
+}
+
+/**
+ * mdm_session_index_refresh
+ *
+ * Stats the session directories and brings the index up to date.  The
+ * cache file is tried before scanning the directories, and a rescanned
+ * index is written back to it if save is TRUE.  Returns TRUE if the
+ * directories had to be rescanned.
+ */
+gboolean
+mdm_session_index_refresh (MdmSessionIndex *index,
+			   gboolean         save)
+{
+	GKeyFile *keyfile;
+	char     *data;
+	gsize     len;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+
+	g_strfreev (index->mtimes);
+	index->mtimes = get_dir_mtimes (index->dirs, &index->some_dir_exists);
+
+	if (keyfile_is_current (index->keyfile, index))
+		return FALSE;
+
+	/* The root slave trusts the TryExec results in there, so only a
+	 * file it wrote itself will do */
+	if (index->cache_file != NULL &&
+	    mdm_common_read_root_file (index->cache_file, MAX_INDEX_SIZE,
+				       &data, &len)) {
+		keyfile = g_key_file_new ();
+		if (g_key_file_load_from_data (keyfile, data, len,
+					       G_KEY_FILE_KEEP_TRANSLATIONS, NULL) &&
+		    keyfile_is_current (keyfile, index)) {
+			g_free (data);
+			set_keyfile (index, keyfile);
+			return FALSE;
+		}
+		g_key_file_free (keyfile);
+		g_free (data);
+	}
+
+	g_debug ("Rebuilding session index for %s", index->search_path);
+
+	set_keyfile (index, build_index (index));
+
+	if (save && index->cache_file != NULL)
+		save_index (index);
+
+	return TRUE;
+}
+
+char **
+mdm_session_index_get_files (MdmSessionIndex *index)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+
+	return index->files;
+}
+
+gboolean
+mdm_session_index_has_dirs (MdmSessionIndex *index)
+{
+	g_return_val_if_fail (index != NULL, FALSE);
+
+	return index->some_dir_exists;
+}
+
+static char *
+session_group (const char *session)
+{
+	if (g_str_has_suffix (session, ".desktop"))
+		return g_strconcat (SESSION_GROUP_PREFIX, session, NULL);
+	else
+		return g_strconcat (SESSION_GROUP_PREFIX, session, ".desktop", NULL);
+}
+
+MdmSessionIndexStatus
+mdm_session_index_get_status (MdmSessionIndex *index,
+			      const char      *session)
+{
+	MdmSessionIndexStatus status;
+	char                 *group;
+	char                 *tryexec;
+
+	g_return_val_if_fail (index != NULL, MDM_SESSION_INDEX_MISSING);
+
+	if (session == NULL || session[0] == '\0' || index->keyfile == NULL)
+		return MDM_SESSION_INDEX_MISSING;
+
+	group = session_group (session);
+
+	if (! g_key_file_has_group (index->keyfile, group)) {
+		g_free (group);
+		return MDM_SESSION_INDEX_MISSING;
+	}
+
+	status = g_key_file_get_integer (index->keyfile, group, "Status", NULL);
+
+	/* The program may have been removed without touching the session
+	 * directory, so make sure the resolved TryExec is still there */
+	if (status == MDM_SESSION_INDEX_OK) {
+		tryexec = g_key_file_get_string (index->keyfile, group, "TryExec", NULL);
+		if (tryexec != NULL &&
+		    ! g_file_test (tryexec, G_FILE_TEST_IS_EXECUTABLE))
+			status = MDM_SESSION_INDEX_NO_TRYEXEC;
+		g_free (tryexec);
+	}
+
+	g_free (group);
+
+	return status;
+}
+
+char *
+mdm_session_index_get_exec (MdmSessionIndex *index,
+			    const char      *session)
+{
+	char *group;
+	char *exec;
+
+	g_return_val_if_fail (index != NULL, NULL);
+
+	if (session == NULL || index->keyfile == NULL)
+		return NULL;
+
+	group = session_group (session);
+	exec = g_key_file_get_string (index->keyfile, group, "Exec", NULL);
+	g_free (group);
+
+	return exec;
+}
+
+static char *
+get_translated (MdmSessionIndex *index,
+		const char      *session,
+		const char      *key)
+{
+	char *group;
+	char *value;
+
+	if (session == NULL || index->keyfile == NULL)
+		return NULL;
+
+	group = session_group (session);
+	value = g_key_file_get_locale_string (index->keyfile, group, key, NULL, NULL);
+	g_free (group);
+
+	return value;
+}
+
+char *
+mdm_session_index_get_name (MdmSessionIndex *index,
+			    const char      *session)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+
+	return get_translated (index, session, "Name");
+}
+
+char *
+mdm_session_index_get_comment (MdmSessionIndex *index,
+			       const char      *session)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+
+	return get_translated (index, session, "Comment");
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MDM_SESSION_INDEX_H
+#define _MDM_SESSION_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Name of the index file inside ServAuthDir.  It is written by the slave
+ * (which runs as root) and only read by the greeters. */
+#define MDM_SESSION_INDEX_FILE ".session-index"
+
+typedef enum {
+	MDM_SESSION_INDEX_MISSING = 0,	/* no such session file */
+	MDM_SESSION_INDEX_OK,		/* usable session */
+	MDM_SESSION_INDEX_HIDDEN,	/* Hidden=true */
+	MDM_SESSION_INDEX_NO_TRYEXEC,	/* TryExec not found in PATH */
+	MDM_SESSION_INDEX_INCOMPLETE	/* Exec or Name is missing */
+} MdmSessionIndexStatus;
+
+typedef struct _MdmSessionIndex MdmSessionIndex;
+
+MdmSessionIndex *     mdm_session_index_new         (const char      *search_path,
+						     const char      *cache_file);
+void                  mdm_session_index_free        (MdmSessionIndex *index);
+gboolean              mdm_session_index_refresh     (MdmSessionIndex *index,
+						     gboolean         save);
+
+/* Session files in SessionDesktopDir order, owned by the index */
+char **               mdm_session_index_get_files   (MdmSessionIndex *index);
+gboolean              mdm_session_index_has_dirs    (MdmSessionIndex *index);
+MdmSessionIndexStatus mdm_session_index_get_status  (MdmSessionIndex *index,
+						     const char      *session);
+char *                mdm_session_index_get_exec    (MdmSessionIndex *index,
+						     const char      *session);
+char *                mdm_session_index_get_name    (MdmSessionIndex *index,
+						     const char      *session);
+char *                mdm_session_index_get_comment (MdmSessionIndex *index,
+						     const char      *session);
+
+G_END_DECLS
+
+#endif /* _MDM_SESSION_INDEX_H */
@@ -0,0 +1,959 @@
+/* MDM - The MDM Display Manager
+ *
+ * Starts the daemon headless against a generated configuration and
+ * measures how long it takes to get to a usable greeter and from a
+ * login to a running session.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Run as root on a machine where no MDM is running, the supervisor
+ * socket is not configurable.  See --help for the knobs.
+ *
+ * Everything lives in a scratch directory:  a defaults file naming an
+ * Xvfb (or Xephyr) server, N users with a ~/.face each, M session files,
+ * a locale.alias with L entries and a stub Xsession.  The users come
+ * from nss_wrapper, which is required.  Logins go through a PAM service
+ * that only has pam_permit, set up with pam_wrapper; without it the
+ * login runs are skipped.  Note that the daemon still reads the custom
+ * configuration file, keep it empty on the benchmark machine.
+ *
+ * For every greeter there is a cold run, with the daemon's caches in
+ * ServAuthDir removed, and then warm runs.  The page cache is the
+ * host's, so it is only dropped for the cold run with --drop-page-cache.
+ * Each run measures, from the daemon's fork:
+ *
+ *	time_to_greeter_ms	the greeter answered the slave for the first time
+ *	time_to_user_list_ms	the greeter got its GET_USERS answer
+ *	time_to_idle_ms		the greeter stopped using CPU, so the faces
+ *				are loaded
+ *
+ * and the resident memory of the daemon, its slaves, the greeter and
+ * the X server once the greeter is idle.  Login runs use automatic
+ * login and measure the time from the LOGIN event to the stub Xsession
+ * being started.  Latencies the daemon keeps itself, see the STATS
+ * command, are added to every run.
+ *
+ * Every run prints one JSON object on a line of its own.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "mdm-socket-protocol.h"
+
+#define FIRST_UID	20000
+/* A greeter that used no CPU for this long is considered idle */
+#define IDLE_USEC	(300 * 1000)
+#define POLL_USEC	(10 * 1000)
+
+static int users = 200;
+static int sessions = 50;
+static int locales = 2000;
+static int rounds = 3;
+static int display = 20;
+static int timeout = 60;
+static char *daemon_binary = SBINDIR "/mdm-binary";
+static char *xserver = "Xvfb -screen 0 1024x768x24 -nolisten tcp";
+static char **greeters = NULL;
+static char *face = PIXMAPDIR "/nobody.png";
+static char *nss_wrapper = "libnss_wrapper.so";
+static char *pam_wrapper = "libpam_wrapper.so";
+static char *output = NULL;
+static gboolean drop_page_cache = FALSE;
+
+static GOptionEntry options[] = {
+	{ "users", 0, 0, G_OPTION_ARG_INT, &users, "Number of users with a face", "N" },
+	{ "sessions", 0, 0, G_OPTION_ARG_INT, &sessions, "Number of session files", "M" },
+	{ "locales", 0, 0, G_OPTION_ARG_INT, &locales, "Number of locale.alias entries", "L" },
+	{ "rounds", 0, 0, G_OPTION_ARG_INT, &rounds, "Warm runs per greeter, and login runs", "R" },
+	{ "display", 0, 0, G_OPTION_ARG_INT, &display, "Display number to use", "NUM" },
+	{ "timeout", 0, 0, G_OPTION_ARG_INT, &timeout, "Seconds to wait for each run", "SECS" },
+	{ "daemon", 0, 0, G_OPTION_ARG_FILENAME, &daemon_binary, "The mdm-binary to run", "PATH" },
+	{ "xserver", 0, 0, G_OPTION_ARG_STRING, &xserver, "X server command line", "CMD" },
+	{ "greeter", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &greeters, "Greeter to run, may be repeated", "PATH" },
+	{ "face", 0, 0, G_OPTION_ARG_FILENAME, &face, "Image used for every face", "FILE" },
+	{ "nss-wrapper", 0, 0, G_OPTION_ARG_FILENAME, &nss_wrapper, "nss_wrapper library", "LIB" },
+	{ "pam-wrapper", 0, 0, G_OPTION_ARG_FILENAME, &pam_wrapper, "pam_wrapper library", "LIB" },
+	{ "output", 0, 0, G_OPTION_ARG_FILENAME, &output, "Append the results to FILE", "FILE" },
+	{ "drop-page-cache", 0, 0, G_OPTION_ARG_NONE, &drop_page_cache, "Drop the host's page cache before cold runs", NULL },
+	{ NULL }
+};
+
+static char *workdir = NULL;
+static FILE *out = NULL;
+
+static char *
+find_library (const char *name)
+{
+	const char *dirs[] = { LIBDIR, "/usr/lib", "/usr/lib64", "/usr/local/lib",
+			       "/usr/lib/x86_64-linux-gnu", "/usr/lib/i386-linux-gnu",
+			       "/usr/lib/aarch64-linux-gnu", NULL };
+	int i;
+
+	if (g_path_is_absolute (name))
+		return g_file_test (name, G_FILE_TEST_EXISTS) ? g_strdup (name) : NULL;
+
+	for (i = 0; dirs[i] != NULL; i++) {
+		char *path = g_build_filename (dirs[i], name, NULL);
+
+		if (g_file_test (path, G_FILE_TEST_EXISTS))
+			return path;
+		g_free (path);
+	}
+
+	return NULL;
+}
+
+static void
+write_file (const char *name, const char *contents, mode_t mode)
+{
+	char *path = g_build_filename (workdir, name, NULL);
+	GError *error = NULL;
+
+	if ( ! g_file_set_contents (path, contents, -1, &error)) {
+		g_printerr ("%s\n", error->message);
+		exit (1);
+	}
+	g_chmod (path, mode);
+	g_free (path);
+}
+
+static void
+setup_users (void)
+{
+	GString *passwd, *group;
+	char *contents, *face_data;
+	gsize face_len;
+	int i;
+
+	if ( ! g_file_get_contents (face, &face_data, &face_len, NULL)) {
+		g_printerr ("Cannot read %s\n", face);
+		exit (1);
+	}
+
+	/* Keep the real users, the daemon needs root and its own user */
+	passwd = g_string_new (NULL);
+	if (g_file_get_contents ("/etc/passwd", &contents, NULL, NULL)) {
+		g_string_append (passwd, contents);
+		g_free (contents);
+	}
+	group = g_string_new (NULL);
+	if (g_file_get_contents ("/etc/group", &contents, NULL, NULL)) {
+		g_string_append (group, contents);
+		g_free (contents);
+	}
+	g_string_append_printf (group, "bench:x:%d:\n", FIRST_UID);
+
+	for (i = 0; i < users; i++) {
+		char *home, *face_file;
+
+		home = g_strdup_printf ("%s/home/bench%04d", workdir, i);
+		g_mkdir_with_parents (home, 0755);
+		face_file = g_build_filename (home, ".face", NULL);
+		g_file_set_contents (face_file, face_data, face_len, NULL);
+		chown (face_file, FIRST_UID + i, FIRST_UID);
+		chown (home, FIRST_UID + i, FIRST_UID);
+		g_free (face_file);
+
+		g_string_append_printf (passwd, "bench%04d:x:%d:%d:Bench User %d:%s:/bin/sh\n",
+					i, FIRST_UID + i, FIRST_UID, i, home);
+		g_free (home);
+	}
+
+	write_file ("passwd", passwd->str, 0644);
+	write_file ("group", group->str, 0644);
+	g_string_free (passwd, TRUE);
+	g_string_free (group, TRUE);
+	g_free (face_data);
+}
+
+static void
+setup_files (void)
+{
+	const char *langs[] = { "de_DE", "en_GB", "en_US", "es_ES", "fi_FI", "fr_FR",
+				"it_IT", "ja_JP", "nl_NL", "pl_PL", "pt_BR", "ru_RU",
+				"sv_SE", "tr_TR", "zh_CN", "zh_TW" };
+	GString *str;
+	char *dir;
+	int i;
+
+	dir = g_build_filename (workdir, "sessions", NULL);
+	g_mkdir (dir, 0755);
+	for (i = 0; i < sessions; i++) {
+		char *name, *contents;
+
+		name = g_strdup_printf ("sessions/bench-%03d.desktop", i);
+		contents = g_strdup_printf ("[Desktop Entry]\n"
+					    "Name=Bench session %d\n"
+					    "Comment=Synthetic session for benchmarks\n"
+					    "Exec=/bin/true\n"
+					    "Type=Application\n", i);
+		write_file (name, contents, 0644);
+		g_free (name);
+		g_free (contents);
+	}
+	g_free (dir);
+
+	str = g_string_new ("C(POSIX)\t\tC,POSIX\n");
+	for (i = 0; i < locales; i++) {
+		const char *lang = langs[i % G_N_ELEMENTS (langs)];
+
+		g_string_append_printf (str, "Bench%05d\t\t%s.UTF-8,%s\n", i, lang, lang);
+	}
+	write_file ("locale.alias", str->str, 0644);
+	g_string_free (str, TRUE);
+
+	/* The session tells us it started through a fifo */
+	dir = g_build_filename (workdir, "session-started", NULL);
+	mkfifo (dir, 0666);
+	g_chmod (dir, 0666);
+	g_free (dir);
+
+	str = g_string_new (NULL);
+	g_string_printf (str, "#!/bin/sh\necho started > %s/session-started\nexec sleep %d\n",
+			 workdir, timeout);
+	write_file ("Xsession", str->str, 0755);
+	g_string_free (str, TRUE);
+
+	dir = g_build_filename (workdir, "pam", NULL);
+	g_mkdir (dir, 0755);
+	g_free (dir);
+	write_file ("pam/mdm-bench",
+		    "auth\trequired\tpam_permit.so\n"
+		    "account\trequired\tpam_permit.so\n"
+		    "password\trequired\tpam_permit.so\n"
+		    "session\trequired\tpam_permit.so\n", 0644);
+	write_file ("pam/mdm-bench-autologin",
+		    "auth\trequired\tpam_permit.so\n"
+		    "account\trequired\tpam_permit.so\n"
+		    "session\trequired\tpam_permit.so\n", 0644);
+
+	dir = g_build_filename (workdir, "auth", NULL);
+	g_mkdir (dir, 0700);
+	g_free (dir);
+	dir = g_build_filename (workdir, "log", NULL);
+	g_mkdir (dir, 0755);
+	g_free (dir);
+}
+
+static char *
+write_config (const char *greeter, gboolean autologin)
+{
+	char *contents, *path;
+
+	contents = g_strdup_printf ("[daemon]\n"
+				    "Greeter=%s\n"
+				    "ServAuthDir=%s/auth\n"
+				    "LogDir=%s/log\n"
+				    "PidFile=%s/mdm.pid\n"
+				    "SessionDesktopDir=%s/sessions/\n"
+				    "DefaultSession=bench-000.desktop\n"
+				    "BaseXsession=%s/Xsession\n"
+				    "VTAllocation=false\n"
+				    "AutomaticLoginEnable=%s\n"
+				    "AutomaticLogin=bench0000\n"
+				    "[security]\n"
+				    "PamStack=mdm-bench\n"
+				    "[greeter]\n"
+				    "Browser=true\n"
+				    "IncludeAll=true\n"
+				    "MinimalUID=%d\n"
+				    "LocaleFile=%s/locale.alias\n"
+				    "[servers]\n"
+				    "%d=Bench\n"
+				    "[server-Bench]\n"
+				    "name=Benchmark server\n"
+				    "command=%s\n"
+				    "flexible=false\n",
+				    greeter, workdir, workdir, workdir, workdir, workdir,
+				    autologin ? "true" : "false",
+				    FIRST_UID, workdir, display, xserver);
+	write_file ("mdm.conf", contents, 0644);
+	g_free (contents);
+
+	path = g_build_filename (workdir, "mdm.conf", NULL);
+	return path;
+}
+
+static pid_t
+start_daemon (const char *config, const char *preload)
+{
+	char *config_arg;
+	pid_t pid;
+
+	config_arg = g_strconcat ("--config=", config, NULL);
+
+	pid = fork ();
+	if (pid == 0) {
+		char *file;
+
+		file = g_build_filename (workdir, "passwd", NULL);
+		g_setenv ("NSS_WRAPPER_PASSWD", file, TRUE);
+		g_free (file);
+		file = g_build_filename (workdir, "group", NULL);
+		g_setenv ("NSS_WRAPPER_GROUP", file, TRUE);
+		g_free (file);
+		file = g_build_filename (workdir, "pam", NULL);
+		g_setenv ("PAM_WRAPPER_SERVICE_DIR", file, TRUE);
+		g_free (file);
+		g_setenv ("PAM_WRAPPER", "1", TRUE);
+		g_setenv ("LD_PRELOAD", preload, TRUE);
+
+		execl (daemon_binary, daemon_binary, "--nodaemon", config_arg,
+		       "--preserve-ld-vars", NULL);
+		_exit (127);
+	}
+	g_free (config_arg);
+
+	return pid;
+}
+
+static void
+stop_daemon (pid_t pid)
+{
+	gint64 end = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+
+	kill (pid, SIGTERM);
+	while (waitpid (pid, NULL, WNOHANG) == 0) {
+		if (g_get_monotonic_time () > end) {
+			kill (pid, SIGKILL);
+			waitpid (pid, NULL, 0);
+			break;
+		}
+		g_usleep (POLL_USEC);
+	}
+}
+
+static int
+sup_connect (void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, MDM_SUP_SOCKET);
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static char *
+sup_read_line (int fd)
+{
+	GString *line = g_string_new (NULL);
+	char c;
+
+	while (read (fd, &c, 1) == 1) {
+		if (c == '\n')
+			return g_string_free (line, FALSE);
+		g_string_append_c (line, c);
+	}
+	g_string_free (line, TRUE);
+
+	return NULL;
+}
+
+/* A fresh connection per call, the daemon limits messages per connection */
+static char *
+sup_call (const char *cmd)
+{
+	char *line, *answer = NULL;
+	int fd;
+
+	fd = sup_connect ();
+	if (fd < 0)
+		return NULL;
+
+	line = g_strconcat (cmd, "\n", NULL);
+	if (write (fd, line, strlen (line)) == (ssize_t) strlen (line))
+		answer = sup_read_line (fd);
+	g_free (line);
+	close (fd);
+
+	return answer;
+}
+
+/* The STATS answer as name -> value */
+static GHashTable *
+get_stats (void)
+{
+	GHashTable *stats;
+	char *answer;
+	char **fields;
+	int i;
+
+	stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	answer = sup_call (MDM_SUP_STATS);
+	if (answer == NULL || strncmp (answer, "OK ", 3) != 0) {
+		g_free (answer);
+		return stats;
+	}
+
+	fields = g_strsplit (answer + 3, ";", -1);
+	for (i = 0; fields[i] != NULL; i++) {
+		char *value = strchr (fields[i], '=');
+
+		if (value != NULL) {
+			*value = '\0';
+			g_hash_table_insert (stats, g_strdup (fields[i]),
+					     g_strdup (value + 1));
+		}
+	}
+	g_strfreev (fields);
+	g_free (answer);
+
+	return stats;
+}
+
+static guint64
+histogram_count (GHashTable *stats, const char *name)
+{
+	const char *value = g_hash_table_lookup (stats, name);
+
+	return value != NULL ? g_ascii_strtoull (value, NULL, 10) : 0;
+}
+
+/* Appends the mean of a histogram in ms, or null */
+static void
+append_latency (GString *json, GHashTable *stats, const char *name, const char *key)
+{
+	const char *value = g_hash_table_lookup (stats, name);
+	guint64 count, sum;
+	char *end;
+
+	if (value == NULL) {
+		g_string_append_printf (json, ", \"%s\": null", key);
+		return;
+	}
+
+	count = g_ascii_strtoull (value, &end, 10);
+	sum = (*end == ',') ? g_ascii_strtoull (end + 1, NULL, 10) : 0;
+	g_string_append_printf (json, ", \"%s\": %.2f", key,
+				count > 0 ? sum / 1000.0 / count : 0.0);
+}
+
+static void
+append_ms (GString *json, const char *key, gint64 usec)
+{
+	if (usec < 0)
+		g_string_append_printf (json, ", \"%s\": null", key);
+	else
+		g_string_append_printf (json, ", \"%s\": %.2f", key, usec / 1000.0);
+}
+
+static gboolean
+read_proc_stat (pid_t pid, pid_t *ppid, guint64 *ticks, char **comm)
+{
+	char *file, *contents, *p;
+	unsigned long utime, stime;
+	int parent;
+	gboolean ret = FALSE;
+
+	file = g_strdup_printf ("/proc/%d/stat", (int) pid);
+	if (g_file_get_contents (file, &contents, NULL, NULL)) {
+		/* pid (comm) state ppid pgrp session tty tpgid flags
+		 * minflt cminflt majflt cmajflt utime stime ... */
+		p = strrchr (contents, ')');
+		if (p != NULL &&
+		    sscanf (p + 1, " %*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			    &parent, &utime, &stime) == 3) {
+			if (ppid != NULL)
+				*ppid = parent;
+			if (ticks != NULL)
+				*ticks = utime + stime;
+			if (comm != NULL) {
+				char *start = strchr (contents, '(');
+
+				*comm = g_strndup (start + 1, p - start - 1);
+			}
+			ret = TRUE;
+		}
+		g_free (contents);
+	}
+	g_free (file);
+
+	return ret;
+}
+
+static guint64
+read_rss_kb (pid_t pid)
+{
+	char *file, *contents, *p;
+	guint64 rss = 0;
+
+	file = g_strdup_printf ("/proc/%d/status", (int) pid);
+	if (g_file_get_contents (file, &contents, NULL, NULL)) {
+		p = strstr (contents, "VmRSS:");
+		if (p != NULL)
+			rss = g_ascii_strtoull (p + strlen ("VmRSS:"), NULL, 10);
+		g_free (contents);
+	}
+	g_free (file);
+
+	return rss;
+}
+
+/* Whether pid is ancestor or one of its descendants */
+static gboolean
+descends_from (GHashTable *parents, pid_t pid, pid_t ancestor)
+{
+	while (pid > 1) {
+		if (pid == ancestor)
+			return TRUE;
+		pid = GPOINTER_TO_INT (g_hash_table_lookup (parents, GINT_TO_POINTER (pid)));
+	}
+
+	return FALSE;
+}
+
+/* Resident memory of everything the daemon started, by role */
+static void
+append_memory (GString *json, pid_t master, pid_t greeter)
+{
+	GHashTable *parents;
+	guint64 rss_master = 0, rss_slaves = 0, rss_greeter = 0;
+	guint64 rss_xserver = 0, rss_other = 0;
+	char *master_comm = NULL;
+	struct dirent *ent;
+	GList *pids = NULL, *li;
+	DIR *dir;
+
+	parents = g_hash_table_new (NULL, NULL);
+	dir = opendir ("/proc");
+	while (dir != NULL && (ent = readdir (dir)) != NULL) {
+		pid_t pid, ppid;
+
+		if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+			continue;
+		pid = atoi (ent->d_name);
+		if (read_proc_stat (pid, &ppid, NULL, NULL)) {
+			g_hash_table_insert (parents, GINT_TO_POINTER (pid),
+					     GINT_TO_POINTER (ppid));
+			pids = g_list_prepend (pids, GINT_TO_POINTER (pid));
+		}
+	}
+	if (dir != NULL)
+		closedir (dir);
+
+	read_proc_stat (master, NULL, NULL, &master_comm);
+
+	for (li = pids; li != NULL; li = li->next) {
+		pid_t pid = GPOINTER_TO_INT (li->data);
+		char *comm = NULL;
+
+		if ( ! descends_from (parents, pid, master))
+			continue;
+
+		read_proc_stat (pid, NULL, NULL, &comm);
+		if (pid == master)
+			rss_master += read_rss_kb (pid);
+		else if (greeter > 0 && descends_from (parents, pid, greeter))
+			rss_greeter += read_rss_kb (pid);
+		else if (comm != NULL && comm[0] == 'X')
+			rss_xserver += read_rss_kb (pid);
+		else if (comm != NULL && master_comm != NULL &&
+			 strcmp (comm, master_comm) == 0)
+			rss_slaves += read_rss_kb (pid);
+		else
+			rss_other += read_rss_kb (pid);
+		g_free (comm);
+	}
+
+	g_string_append_printf (json, ", \"rss_kb\": { \"master\": %" G_GUINT64_FORMAT
+				", \"slaves\": %" G_GUINT64_FORMAT
+				", \"greeter\": %" G_GUINT64_FORMAT
+				", \"xserver\": %" G_GUINT64_FORMAT
+				", \"other\": %" G_GUINT64_FORMAT " }",
+				rss_master, rss_slaves, rss_greeter, rss_xserver, rss_other);
+
+	g_list_free (pids);
+	g_hash_table_destroy (parents);
+	g_free (master_comm);
+}
+
+static pid_t
+get_greeter_pid (void)
+{
+	char *answer = sup_call (MDM_SUP_GREETERPIDS);
+	pid_t pid = -1;
+
+	if (answer != NULL && strncmp (answer, "OK ", 3) == 0)
+		pid = atoi (answer + 3);
+	g_free (answer);
+
+	return pid;
+}
+
+static gboolean
+wait_for_socket (pid_t master, gint64 end)
+{
+	int fd;
+
+	while ((fd = sup_connect ()) < 0) {
+		if (g_get_monotonic_time () > end ||
+		    waitpid (master, NULL, WNOHANG) != 0)
+			return FALSE;
+		g_usleep (POLL_USEC);
+	}
+	close (fd);
+
+	return TRUE;
+}
+
+static void
+emit (GString *json)
+{
+	fprintf (out, "%s }\n", json->str);
+	fflush (out);
+}
+
+static void
+json_start (GString *json, const char *phase, const char *greeter,
+	    const char *run, int round)
+{
+	g_string_printf (json, "{ \"phase\": \"%s\", \"greeter\": \"%s\", \"run\": \"%s\", "
+			 "\"round\": %d, \"users\": %d, \"sessions\": %d, \"locales\": %d",
+			 phase, greeter, run, round, users, sessions, locales);
+}
+
+/* Returns TRUE if the page cache was dropped too */
+static gboolean
+drop_caches (void)
+{
+	char *dir = g_build_filename (workdir, "auth", NULL);
+	GDir *d;
+	const char *name;
+	int fd;
+
+	/* The daemon's own caches, the user and session indexes and the
+	 * compiled theme */
+	d = g_dir_open (dir, 0, NULL);
+	while (d != NULL && (name = g_dir_read_name (d)) != NULL) {
+		if (name[0] == '.') {
+			char *file = g_build_filename (dir, name, NULL);
+
+			g_unlink (file);
+			g_free (file);
+		}
+	}
+	if (d != NULL)
+		g_dir_close (d);
+	g_free (dir);
+
+	if ( ! drop_page_cache)
+		return FALSE;
+
+	sync ();
+	fd = open ("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		return FALSE;
+	if (write (fd, "3\n", 2) != 2) {
+		close (fd);
+		return FALSE;
+	}
+	close (fd);
+
+	return TRUE;
+}
+
+static void
+run_greeter (const char *greeter, const char *preload, const char *run, int round)
+{
+	GString *json = g_string_new (NULL);
+	GHashTable *stats = NULL;
+	gint64 t0, end, now;
+	gint64 to_greeter = -1, to_user_list = -1, to_idle = -1;
+	gint64 last_busy = 0;
+	guint64 last_ticks = 0;
+	pid_t master, greeter_pid = -1;
+	gboolean dropped = FALSE;
+	char *config;
+
+	if (strcmp (run, "cold") == 0)
+		dropped = drop_caches ();
+
+	config = write_config (greeter, FALSE);
+	t0 = g_get_monotonic_time ();
+	end = t0 + timeout * G_USEC_PER_SEC;
+	master = start_daemon (config, preload);
+	g_free (config);
+
+	if (wait_for_socket (master, end)) {
+		while ((now = g_get_monotonic_time ()) < end) {
+			if (stats != NULL)
+				g_hash_table_destroy (stats);
+			stats = get_stats ();
+
+			if (to_greeter < 0 &&
+			    histogram_count (stats, "latency.greeter_start") > 0) {
+				to_greeter = now - t0;
+				greeter_pid = get_greeter_pid ();
+			}
+			if (to_user_list < 0 &&
+			    histogram_count (stats, "latency.sup." MDM_SUP_GET_USERS) > 0)
+				to_user_list = now - t0;
+
+			if (greeter_pid > 0) {
+				guint64 ticks = 0;
+
+				read_proc_stat (greeter_pid, NULL, &ticks, NULL);
+				if (ticks != last_ticks || last_busy == 0) {
+					last_ticks = ticks;
+					last_busy = now;
+				} else if (now - last_busy >= IDLE_USEC) {
+					to_idle = last_busy - t0;
+					break;
+				}
+			}
+			g_usleep (POLL_USEC);
+		}
+	}
+
+	json_start (json, "greeter", greeter, run, round);
+	g_string_append_printf (json, ", \"dropped_page_cache\": %s",
+				dropped ? "true" : "false");
+	append_ms (json, "time_to_greeter_ms", to_greeter);
+	append_ms (json, "time_to_user_list_ms", to_user_list);
+	append_ms (json, "time_to_idle_ms", to_idle);
+	if (stats != NULL) {
+		append_latency (json, stats, "latency.x_start", "x_start_ms");
+		append_latency (json, stats, "latency.greeter_start", "greeter_start_ms");
+		append_latency (json, stats, "latency.sup." MDM_SUP_GET_USERS, "get_users_ms");
+		g_hash_table_destroy (stats);
+	}
+	append_memory (json, master, greeter_pid);
+	emit (json);
+
+	stop_daemon (master);
+	g_string_free (json, TRUE);
+}
+
+static void
+run_login (const char *greeter, const char *preload, int round)
+{
+	GString *json = g_string_new (NULL);
+	GHashTable *stats;
+	gint64 t0, end;
+	gint64 login = -1, session = -1;
+	char *config, *fifo, *line;
+	pid_t master;
+	int watch = -1, started;
+
+	/* Nobody writes until the session starts, so this does not block */
+	fifo = g_build_filename (workdir, "session-started", NULL);
+	started = open (fifo, O_RDONLY | O_NONBLOCK);
+	g_free (fifo);
+
+	config = write_config (greeter, TRUE);
+	t0 = g_get_monotonic_time ();
+	end = t0 + timeout * G_USEC_PER_SEC;
+	master = start_daemon (config, preload);
+	g_free (config);
+
+	if (wait_for_socket (master, end)) {
+		watch = sup_connect ();
+		line = g_strconcat (MDM_SUP_WATCH_DISPLAYS "\n", NULL);
+		if (watch >= 0)
+			write (watch, line, strlen (line));
+		g_free (line);
+	}
+
+	while (watch >= 0 && started >= 0 && session < 0) {
+		struct timeval tv;
+		fd_set rfds;
+		gint64 left = end - g_get_monotonic_time ();
+
+		if (left <= 0)
+			break;
+		tv.tv_sec = left / G_USEC_PER_SEC;
+		tv.tv_usec = left % G_USEC_PER_SEC;
+
+		FD_ZERO (&rfds);
+		FD_SET (watch, &rfds);
+		FD_SET (started, &rfds);
+		if (select (MAX (watch, started) + 1, &rfds, NULL, NULL, &tv) <= 0)
+			continue;
+
+		if (FD_ISSET (watch, &rfds)) {
+			line = sup_read_line (watch);
+			if (line == NULL) {
+				close (watch);
+				watch = -1;
+			} else if (login < 0 &&
+				   g_str_has_prefix (line, MDM_SUP_EVENT " " MDM_SUP_EVENT_LOGIN " ")) {
+				login = g_get_monotonic_time () - t0;
+			}
+			g_free (line);
+		}
+		if (FD_ISSET (started, &rfds)) {
+			char buf[64];
+
+			if (read (started, buf, sizeof (buf)) > 0)
+				session = g_get_monotonic_time () - t0;
+		}
+	}
+
+	stats = get_stats ();
+
+	json_start (json, "login", greeter, "warm", round);
+	append_ms (json, "time_to_login_ms", login);
+	append_ms (json, "time_to_session_ms", session);
+	append_ms (json, "login_to_session_ms",
+		   (login >= 0 && session >= 0) ? session - login : -1);
+	append_latency (json, stats, "latency.x_start", "x_start_ms");
+	append_latency (json, stats, "latency.pam_start", "pam_start_ms");
+	append_latency (json, stats, "latency.pam_session", "pam_session_ms");
+	append_memory (json, master, -1);
+	emit (json);
+
+	g_hash_table_destroy (stats);
+	if (watch >= 0)
+		close (watch);
+	if (started >= 0)
+		close (started);
+	stop_daemon (master);
+	g_string_free (json, TRUE);
+}
+
+static void
+remove_tree (const char *path)
+{
+	GDir *dir = g_dir_open (path, 0, NULL);
+	const char *name;
+
+	while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+		char *child = g_build_filename (path, name, NULL);
+
+		if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+		    ! g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+			remove_tree (child);
+		else
+			g_unlink (child);
+		g_free (child);
+	}
+	if (dir != NULL)
+		g_dir_close (dir);
+	g_rmdir (path);
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *ctx;
+	GError *error = NULL;
+	char *nss_lib, *pam_lib, *preload;
+	const char *default_greeters[] = { LIBEXECDIR "/mdmlogin",
+					   LIBEXECDIR "/mdmwebkit", NULL };
+	int i, j, fd;
+
+	ctx = g_option_context_new ("- benchmark greeter start and login");
+	g_option_context_add_main_entries (ctx, options, NULL);
+	if ( ! g_option_context_parse (ctx, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (ctx);
+
+	if (greeters == NULL)
+		greeters = g_strdupv ((char **) default_greeters);
+
+	if (geteuid () != 0) {
+		g_printerr ("%s: needs root\n", argv[0]);
+		return 77;
+	}
+	fd = sup_connect ();
+	if (fd >= 0) {
+		close (fd);
+		g_printerr ("%s: a display manager is already running\n", argv[0]);
+		return 77;
+	}
+	nss_lib = find_library (nss_wrapper);
+	if (nss_lib == NULL) {
+		g_printerr ("%s: needs nss_wrapper for the users\n", argv[0]);
+		return 77;
+	}
+	pam_lib = find_library (pam_wrapper);
+	if (pam_lib == NULL)
+		g_printerr ("%s: no pam_wrapper, skipping the login runs\n", argv[0]);
+	preload = g_strjoin (" ", nss_lib, pam_lib, NULL);
+
+	out = stdout;
+	if (output != NULL) {
+		out = fopen (output, "a");
+		if (out == NULL) {
+			g_printerr ("%s: %s: %s\n", argv[0], output, g_strerror (errno));
+			return 1;
+		}
+	}
+
+	workdir = g_build_filename (g_get_tmp_dir (), "mdm-bench-XXXXXX", NULL);
+	if (g_mkdtemp (workdir) == NULL) {
+		g_printerr ("%s: cannot create a scratch directory\n", argv[0]);
+		return 1;
+	}
+	/* The greeter and the users need to get in */
+	g_chmod (workdir, 0755);
+
+	setup_users ();
+	setup_files ();
+
+	for (i = 0; greeters[i] != NULL; i++) {
+		run_greeter (greeters[i], preload, "cold", 0);
+		for (j = 1; j <= rounds; j++)
+			run_greeter (greeters[i], preload, "warm", j);
+	}
+
+	if (pam_lib != NULL) {
+		for (j = 1; j <= rounds; j++)
+			run_login (greeters[0], preload, j);
+	}
+
+	remove_tree (workdir);
+
+	if (out != stdout)
+		fclose (out);
+
+	return 0;
+}
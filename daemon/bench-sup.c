@@ -0,0 +1,307 @@
+/* MDM - The MDM Display Manager
+ *
+ * Measures how many supervisor socket requests a running daemon answers
+ * per second with several clients at once.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Every client has one request outstanding at a time and sends the next
+ * one as soon as the answer is in, GET_CONFIG and ATTACHED_SERVERS in
+ * turn.  The daemon drops a connection after MDM_SUP_MAX_MESSAGES
+ * requests, so a client reconnects before that; the reconnects are part
+ * of the measured time.  Beyond 15 clients the daemon starts closing
+ * the oldest connections, which shows up as errors.  See --help for the
+ * knobs.
+ *
+ * Needs a running daemon, nothing is changed on it.  Exits with 77 when
+ * there is none.  Not built by default, "make bench" builds it.  The result is one JSON object on a line:
+ *
+ *	clients		number of clients
+ *	ops_per_sec	answers per second, over all clients
+ *	p50_ms, p99_ms, max_ms
+ *			time from sending a request to the end of its answer
+ *	reconnects	connections opened after the first ones
+ *	errors		answers that were not OK
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include "mdm-socket-protocol.h"
+
+/* Leave the daemon's limit some room, it counts from one */
+#define REQUESTS_PER_CONNECTION (MDM_SUP_MAX_MESSAGES - 1)
+
+static int clients = 8;
+static int seconds = 10;
+static char *socket_path = MDM_SUP_SOCKET;
+static char *config_key = "greeter/Welcome";
+static char *output = NULL;
+
+static GOptionEntry options[] = {
+	{ "clients", 0, 0, G_OPTION_ARG_INT, &clients, "Number of concurrent clients", "K" },
+	{ "seconds", 0, 0, G_OPTION_ARG_INT, &seconds, "How long to run", "SECS" },
+	{ "socket", 0, 0, G_OPTION_ARG_FILENAME, &socket_path, "Supervisor socket", "PATH" },
+	{ "key", 0, 0, G_OPTION_ARG_STRING, &config_key, "Key asked for with GET_CONFIG", "KEY" },
+	{ "output", 0, 0, G_OPTION_ARG_FILENAME, &output, "Append the result to FILE", "FILE" },
+	{ NULL }
+};
+
+typedef struct {
+	int      fd;
+	int      sent;		/* requests on this connection */
+	gint64   start;		/* when the outstanding request was sent */
+	GString *answer;
+} Client;
+
+static GArray *times = NULL;
+static guint64 reconnects = 0;
+static guint64 errors = 0;
+
+static int
+sup_connect (void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strncpy (addr.sun_path, socket_path, sizeof (addr.sun_path) - 1);
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Sends the next request, on a new connection if this one is used up */
+static gboolean
+client_send (Client *c)
+{
+	char *req;
+	gboolean ok;
+
+	if (c->fd >= 0 && c->sent >= REQUESTS_PER_CONNECTION) {
+		close (c->fd);
+		c->fd = -1;
+	}
+	if (c->fd < 0) {
+		c->fd = sup_connect ();
+		if (c->fd < 0)
+			return FALSE;
+		c->sent = 0;
+		reconnects++;
+	}
+
+	if (c->sent % 2 == 0)
+		req = g_strdup_printf ("%s %s\n", MDM_SUP_GET_CONFIG, config_key);
+	else
+		req = g_strdup_printf ("%s\n", MDM_SUP_ATTACHED_SERVERS);
+
+	g_string_truncate (c->answer, 0);
+	c->start = g_get_monotonic_time ();
+	ok = (write (c->fd, req, strlen (req)) == (ssize_t) strlen (req));
+	c->sent++;
+	g_free (req);
+
+	return ok;
+}
+
+/* Reads what is there, returns FALSE if the connection broke */
+static gboolean
+client_read (Client *c)
+{
+	char buf[4096];
+	char *nl;
+	ssize_t n;
+
+	n = read (c->fd, buf, sizeof (buf));
+	if (n <= 0)
+		return FALSE;
+	g_string_append_len (c->answer, buf, n);
+
+	nl = memchr (c->answer->str, '\n', c->answer->len);
+	if (nl != NULL) {
+		gint64 t = g_get_monotonic_time () - c->start;
+
+		g_array_append_val (times, t);
+		if (strncmp (c->answer->str, "OK", 2) != 0)
+			errors++;
+
+		return client_send (c);
+	}
+
+	return TRUE;
+}
+
+static int
+compare_times (const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+static double
+percentile_ms (int p)
+{
+	guint i = MIN (times->len - 1, times->len * p / 100);
+
+	return g_array_index (times, gint64, i) / 1000.0;
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *ctx;
+	GError *error = NULL;
+	Client *client;
+	struct pollfd *pfds;
+	gint64 begin, end, elapsed;
+	FILE *out;
+	int fd, i;
+
+	ctx = g_option_context_new ("- benchmark supervisor socket throughput");
+	g_option_context_add_main_entries (ctx, options, NULL);
+	if ( ! g_option_context_parse (ctx, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (ctx);
+
+	clients = MAX (1, clients);
+	signal (SIGPIPE, SIG_IGN);
+
+	fd = sup_connect ();
+	if (fd < 0) {
+		g_printerr ("%s: needs a running daemon on %s\n", argv[0], socket_path);
+		return 77;
+	}
+	close (fd);
+
+	out = stdout;
+	if (output != NULL) {
+		out = fopen (output, "a");
+		if (out == NULL) {
+			g_printerr ("%s: %s: %s\n", argv[0], output, g_strerror (errno));
+			return 1;
+		}
+	}
+
+	times = g_array_new (FALSE, FALSE, sizeof (gint64));
+	client = g_new0 (Client, clients);
+	pfds = g_new0 (struct pollfd, clients);
+
+	begin = g_get_monotonic_time ();
+	end = begin + (gint64) seconds * G_USEC_PER_SEC;
+
+	for (i = 0; i < clients; i++) {
+		client[i].fd = -1;
+		client[i].answer = g_string_new (NULL);
+		if ( ! client_send (&client[i])) {
+			g_printerr ("%s: cannot connect client %d\n", argv[0], i);
+			return 1;
+		}
+	}
+	/* Only count the connections opened after these */
+	reconnects = 0;
+
+	while (g_get_monotonic_time () < end) {
+		int left = (end - g_get_monotonic_time ()) / 1000;
+
+		for (i = 0; i < clients; i++) {
+			pfds[i].fd = client[i].fd;
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+		}
+
+		if (poll (pfds, clients, MAX (left, 1)) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < clients; i++) {
+			if (pfds[i].revents == 0)
+				continue;
+
+			/* The daemon dropped us, count it and start over */
+			if ( ! client_read (&client[i])) {
+				errors++;
+				if (client[i].fd >= 0)
+					close (client[i].fd);
+				client[i].fd = -1;
+				if ( ! client_send (&client[i])) {
+					g_printerr ("%s: lost the daemon\n", argv[0]);
+					return 1;
+				}
+			}
+		}
+	}
+	elapsed = g_get_monotonic_time () - begin;
+
+	for (i = 0; i < clients; i++) {
+		if (client[i].fd >= 0)
+			close (client[i].fd);
+		g_string_free (client[i].answer, TRUE);
+	}
+	g_free (client);
+	g_free (pfds);
+
+	if (times->len == 0) {
+		g_printerr ("%s: no answers\n", argv[0]);
+		return 1;
+	}
+
+	qsort (times->data, times->len, sizeof (gint64), compare_times);
+
+	fprintf (out, "{ \"clients\": %d, \"seconds\": %d, \"requests\": %u, "
+		 "\"ops_per_sec\": %.1f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+		 "\"max_ms\": %.3f, \"reconnects\": %" G_GUINT64_FORMAT ", "
+		 "\"errors\": %" G_GUINT64_FORMAT " }\n",
+		 clients, seconds, times->len,
+		 times->len * (double) G_USEC_PER_SEC / elapsed,
+		 percentile_ms (50), percentile_ms (99), percentile_ms (100),
+		 reconnects, errors);
+	fflush (out);
+
+	if (out != stdout)
+		fclose (out);
+	g_array_free (times, TRUE);
+
+	return 0;
+}
@@ -42,6 +42,8 @@
 #include "mdm-common.h"
 #include "mdm-log.h"
 #include "mdm-daemon-config.h"
+#include "mdm-socket-protocol.h"
+#include "mdm-stats.h"
 
 /* External vars */
 extern MdmConnection *pipeconn;
@@ -241,11 +243,101 @@ mdm_display_check_loop (MdmDisplay *disp)
   return TRUE;
 }
 
+/* Slaves that were told to go away but have not been reaped yet */
+typedef struct {
+	pid_t slavepid;
+	pid_t sesspid;
+	pid_t greetpid;
+	pid_t chooserpid;
+	pid_t servpid;
+	guint kill_id;
+	/* to be managed again once this slave is gone */
+	MdmDisplay *display;
+} DyingSlave;
+
+static GSList *dying_slaves = NULL;
+
+/* How long a slave gets between SIGTERM and SIGKILL */
+#define SLAVE_KILL_TIMEOUT 10
+
+static gboolean display_start_slave (MdmDisplay *d);
+
+static gboolean
+dying_slave_kill (gpointer data)
+{
+    DyingSlave *ds = data;
+
+    mdm_debug ("whack_old_slave: Slave %d still there after %d seconds, killing it with SIGKILL",
+	       (int)ds->slavepid, SLAVE_KILL_TIMEOUT);
+    kill (ds->slavepid, SIGKILL);
+    ds->kill_id = 0;
+
+    return FALSE;
+}
+
 static void
+dying_slave_finish (DyingSlave *ds, int exitstatus)
+{
+    MdmDisplay *d = ds->display;
+
+    if (WIFSIGNALED (exitstatus)) {
+	    mdm_debug ("whack_old_slave: Slave crashed (signal %d), killing its children",
+		       (int)WTERMSIG (exitstatus));
+
+	    if (ds->sesspid > 1)
+		    kill (-(ds->sesspid), SIGTERM);
+	    if (ds->greetpid > 1)
+		    kill (-(ds->greetpid), SIGTERM);
+	    if (ds->chooserpid > 1)
+		    kill (-(ds->chooserpid), SIGTERM);
+	    if (ds->servpid > 1)
+		    kill (ds->servpid, SIGTERM);
+    }
+
+    if (ds->kill_id != 0)
+	    g_source_remove (ds->kill_id);
+    g_free (ds);
+
+    /* Only now that the old slave and its server are gone can the new
+     * one start, or it would find the server still running */
+    if (d != NULL) {
+	    mdm_debug ("whack_old_slave: Old slave gone, starting a new one for %s",
+		       d->name);
+	    if ( ! display_start_slave (d))
+		    mdm_display_unmanage (d);
+    }
+}
+
+/* Returns the slave still on its way out that d is waiting for */
+static DyingSlave *
+dying_slave_for_display (MdmDisplay *d)
+{
+    GSList *li;
+
+    for (li = dying_slaves; li != NULL; li = li->next) {
+	    DyingSlave *ds = li->data;
+
+	    if (ds->display == d)
+		    return ds;
+    }
+
+    return NULL;
+}
+
+/*
+ * Tells the slave to go away without waiting for it, so that the rest
+ * of the daemon keeps running.  It is reaped through
+ * mdm_display_reap_slave, and gets SIGKILL if it takes too long.
+ * Returns the slave if it is still around, NULL if it is gone already.
+ */
+static DyingSlave *
 whack_old_slave (MdmDisplay *d, gboolean kill_connection)
 {
-    time_t t = time (NULL);
-    gboolean waitsleep = TRUE;
+    DyingSlave *ds = NULL;
+
+    /* Whatever start was waiting on an older slave is off */
+    while ((ds = dying_slave_for_display (d)) != NULL)
+	    ds->display = NULL;
 
     if (kill_connection) {
 	    /* This should never happen, but just in case */
@@ -261,59 +353,111 @@ whack_old_slave (MdmDisplay *d, gboolean kill_connection)
 	    d->master_notify_fd = -1;
     }
 
-    /* if we have DISPLAY_DEAD set, then this has already been killed */
-    if (d->dispstat == DISPLAY_DEAD)
-	    waitsleep = FALSE;
-
-    /* Kill slave */
+    /* Kill slave, if we have DISPLAY_DEAD set then this has already
+     * been killed */
     if (d->slavepid > 1 &&
 	(d->dispstat == DISPLAY_DEAD || kill (d->slavepid, SIGTERM) == 0)) {
-	    int exitstatus;
+	    int exitstatus = 0;
 	    int ret;
-wait_again:
-		
-	    if (waitsleep) {
-		    /* wait for some signal, yes this is a race */
-		    mdm_debug ("mdm whack_old_slave: sleeping for 10 seconds");
-		    sleep (10);
-		  }
-	    waitsleep = TRUE;
-	    errno = 0;
-	    ret = waitpid (d->slavepid, &exitstatus, WNOHANG);
-	    if (ret <= 0) {
-		    /* rekill the slave to tell it to
-		       hurry up and die if we're getting
-		       killed ourselves */
-		    if ((mdm_daemon_config_signal_terminthup_was_notified ()) ||
-			(t + 10 <= time (NULL))) {
-			    mdm_debug ("whack_old_slave: GOT ANOTHER SIGTERM (or it was 10 secs already), killing slave again with SIGKILL");
-			    t = time (NULL);
-			    kill (d->slavepid, SIGKILL);
-			    goto wait_again;
-		    } else if (ret < 0 && errno == EINTR) {
-			    goto wait_again;
-		    }
-	    }
 
-	    if (WIFSIGNALED (exitstatus)) {
-		    mdm_debug ("whack_old_slave: Slave crashed (signal %d), killing its children",
-			       (int)WTERMSIG (exitstatus));
-
-		    if (d->sesspid > 1)
-			    kill (-(d->sesspid), SIGTERM);
-		    d->sesspid = 0;
-		    if (d->greetpid > 1)
-			    kill (-(d->greetpid), SIGTERM);
-		    d->greetpid = 0;
-		    if (d->chooserpid > 1)
-			    kill (-(d->chooserpid), SIGTERM);
-		    d->chooserpid = 0;
-		    if (d->servpid > 1)
-			    kill (d->servpid, SIGTERM);
-		    d->servpid = 0;
+	    ds = g_new0 (DyingSlave, 1);
+	    ds->slavepid = d->slavepid;
+	    ds->sesspid = d->sesspid;
+	    ds->greetpid = d->greetpid;
+	    ds->chooserpid = d->chooserpid;
+	    ds->servpid = d->servpid;
+
+	    /* These belong to the old slave now */
+	    d->sesspid = 0;
+	    d->greetpid = 0;
+	    d->chooserpid = 0;
+	    d->servpid = 0;
+
+	    VE_IGNORE_EINTR (ret = waitpid (ds->slavepid, &exitstatus, WNOHANG));
+	    if (ret == ds->slavepid) {
+		    dying_slave_finish (ds, exitstatus);
+		    ds = NULL;
+	    } else if (ret < 0) {
+		    /* Already reaped */
+		    g_free (ds);
+		    ds = NULL;
+	    } else {
+		    ds->kill_id = g_timeout_add_seconds (SLAVE_KILL_TIMEOUT,
+							 dying_slave_kill,
+							 ds);
+		    dying_slaves = g_slist_prepend (dying_slaves, ds);
 	    }
     }
     d->slavepid = 0;
+
+    return ds;
+}
+
+gboolean
+mdm_display_reap_slave (pid_t pid, int exitstatus)
+{
+    GSList *li;
+
+    for (li = dying_slaves; li != NULL; li = li->next) {
+	    DyingSlave *ds = li->data;
+
+	    if (ds->slavepid == pid) {
+		    dying_slaves = g_slist_delete_link (dying_slaves, li);
+		    dying_slave_finish (ds, exitstatus);
+		    return TRUE;
+	    }
+    }
+
+    return FALSE;
+}
+
+void
+mdm_display_wait_for_slaves (void)
+{
+    while (dying_slaves != NULL) {
+	    DyingSlave *ds = dying_slaves->data;
+	    int exitstatus = 0;
+	    int ret = 0;
+	    int i;
+
+	    for (i = 0; i < SLAVE_KILL_TIMEOUT * 10; i++) {
+		    errno = 0;
+		    ret = waitpid (ds->slavepid, &exitstatus, WNOHANG);
+		    if (ret > 0 || (ret < 0 && errno != EINTR))
+			    break;
+		    /* hurry up if we're getting killed ourselves */
+		    if (mdm_daemon_config_signal_terminthup_was_notified ())
+			    break;
+		    g_usleep (100 * 1000);
+	    }
+
+	    if (ret <= 0 && errno != ECHILD) {
+		    mdm_debug ("mdm_display_wait_for_slaves: Killing slave %d with SIGKILL",
+			       (int)ds->slavepid);
+		    kill (ds->slavepid, SIGKILL);
+		    VE_IGNORE_EINTR (ret = waitpid (ds->slavepid, &exitstatus, 0));
+	    }
+
+	    /* We are going down, nothing gets started again */
+	    ds->display = NULL;
+	    dying_slaves = g_slist_remove (dying_slaves, ds);
+	    dying_slave_finish (ds, ret > 0 ? exitstatus : 0);
+    }
+}
+
+/* Drops whatever the main daemon still had scheduled for d */
+static void
+cancel_recovery (MdmDisplay *d)
+{
+    if (d->recovery_id != 0) {
+	    g_source_remove (d->recovery_id);
+	    d->recovery_id = 0;
+    }
+
+    if (d->crash_script_pid > 1) {
+	    kill (-(d->crash_script_pid), SIGTERM);
+	    d->crash_script_pid = 0;
+    }
 }
 
 /**
@@ -326,17 +470,16 @@ wait_again:
 gboolean 
 mdm_display_manage (MdmDisplay *d)
 {
-    pid_t pid;
-    int fds[2];
+    DyingSlave *ds;
 
     if (!d) 
 	return FALSE;
 
     mdm_debug ("mdm_display_manage: Managing %s", d->name);
 
-    if (pipe (fds) < 0) {
-	    mdm_error ("mdm_display_manage: Cannot create pipe");
-    }
+    /* Already waiting for the old slave to go */
+    if (dying_slave_for_display (d) != NULL)
+	    return TRUE;
 
     if ( ! mdm_display_check_loop (d))
 	    return FALSE;
@@ -344,10 +487,30 @@ mdm_display_manage (MdmDisplay *d)
     if (d->slavepid != 0)
 	    mdm_debug ("mdm_display_manage: Old slave pid is %d", (int)d->slavepid);
 
-    /* If we have an old slave process hanging around, kill it */
-    /* This shouldn't be a normal code path however, so it doesn't matter
-     * that we are hanging */
-    whack_old_slave (d, FALSE /* kill_connection */);
+    cancel_recovery (d);
+
+    /* If we have an old slave process hanging around, kill it, and
+     * start the new one when it is gone */
+    ds = whack_old_slave (d, FALSE /* kill_connection */);
+    if (ds != NULL) {
+	    mdm_debug ("mdm_display_manage: Waiting for old slave %d to exit",
+		       (int)ds->slavepid);
+	    ds->display = d;
+	    return TRUE;
+    }
+
+    return display_start_slave (d);
+}
+
+static gboolean
+display_start_slave (MdmDisplay *d)
+{
+    pid_t pid;
+    int fds[2];
+
+    if (pipe (fds) < 0) {
+	    mdm_error ("mdm_display_manage: Cannot create pipe");
+    }
 
     /* Ensure that /tmp/.ICE-unix and /tmp/.X11-unix exist and have the
      * correct permissions */
@@ -355,6 +518,9 @@ mdm_display_manage (MdmDisplay *d)
 
     d->managetime = time (NULL);
 
+    /* The slave passes it on to the greeter */
+    mdm_daemon_config_prepare_snapshot ();
+
     mdm_debug ("Forking slave process");
 
     /* Fork slave process */
@@ -381,6 +547,7 @@ mdm_display_manage (MdmDisplay *d)
 	pipeconn = NULL;
 	mdm_connection_close (unixconn);
 	unixconn = NULL;
+	mdm_daemon_config_unwatch ();
 
 	mdm_log_shutdown ();
 
@@ -425,6 +592,7 @@ mdm_display_manage (MdmDisplay *d)
 
     default:
 	mdm_debug ("mdm_display_manage: Forked slave: %d", (int)pid);
+	mdm_stats_add (MDM_STAT_SLAVES_STARTED, 1);
 	d->master_notify_fd = fds[1];
 	VE_IGNORE_EINTR (close (fds[0]));
 	break;
@@ -469,11 +637,13 @@ mdm_display_unmanage (MdmDisplay *d)
     if (unixconn != NULL)
       mdm_kill_subconnections_with_display (unixconn, d);
 
-    /* Kill slave, this may in fact hang for a bit at least until the
-     * slave dies, which should be ASAP though */
+    cancel_recovery (d);
+
+    /* Kill slave, it is reaped later */
     whack_old_slave (d, TRUE /* kill_connection */);
     
     d->dispstat = DISPLAY_DEAD;
+    d->starting = FALSE;
     if (d->type != TYPE_STATIC)
 		mdm_display_dispose (d);
 
@@ -537,6 +707,9 @@ mdm_display_dispose (MdmDisplay *d)
 	    d->master_notify_fd = -1;
     }
 
+    cancel_recovery (d);
+
+    mdm_display_watchers_notify (d, MDM_SUP_EVENT_REMOVED);
     mdm_daemon_config_display_list_remove (d);
 
     d->dispstat = DISPLAY_DEAD;
@@ -146,6 +146,9 @@ struct _MdmDisplay
 
 	/* Only set in the main daemon as that's the only place that cares */
 	MdmLogoutAction logout_action;
+	/* Pending deferred handling of a dead slave, main daemon only */
+	guint recovery_id;
+	int recovery_status;
 
 	/* XDMCP TYPE */
 	
@@ -171,8 +174,10 @@ struct _MdmDisplay
 	/* STATIC TYPE */
 
 	gboolean busy_display; /* only needed on static displays since flexi try another */
+	gboolean starting; /* managed, but its X server is not up yet */
 	time_t last_x_failed;
 	int x_faileds;
+	pid_t crash_script_pid; /* XKeepsCrashing script we are waiting for */
 
 	/* FLEXI TYPE */
 
@@ -188,5 +193,14 @@ void        mdm_display_dispose  (MdmDisplay *d);
 void        mdm_display_unmanage (MdmDisplay *d);
 MdmDisplay *mdm_display_lookup   (pid_t pid);
 
+/* Slaves are not waited for when a display is unmanaged.  Returns TRUE
+ * if pid was such a slave, which is then done with. */
+gboolean    mdm_display_reap_slave     (pid_t pid, int exitstatus);
+/* Blocks until every slave that is still going away has exited */
+void        mdm_display_wait_for_slaves (void);
+
+/* Sends event to the WATCH_DISPLAYS subscribers of d, in mdm.c */
+void        mdm_display_watchers_notify (MdmDisplay *d, const char *event);
+
 #endif /* _MDM_DISPLAY_H */
 
@@ -20,15 +20,163 @@
 
 #include "config.h"
 
-#include <glib/gi18n.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
 #include "mdm.h"
 #include "mdm-common.h"
 #include "mdm-daemon-config.h"
 #include "mdm-log.h"
 
 #include "filecheck.h"
+#include "fstype.h"
+
+/* Where opening automount points does not mount them, the automount
+ * point is what dir turns up as, rather than the home directory.  It
+ * has to be used through '/.' then, as with MdmSupportAutomount. */
+static gboolean
+filecheck_is_automount (const gchar *dir, struct stat *s)
+{
+	return strcmp (filesystem_type ((char *) dir, (char *) dir, s),
+		       "autofs") == 0;
+}
+
+/* Only used to look the directory up once, 0711 homes must work too */
+#if defined (O_PATH)
+#define FILECHECK_DIR_FLAGS	(O_PATH | O_DIRECTORY)
+#elif defined (O_SEARCH)
+#define FILECHECK_DIR_FLAGS	(O_SEARCH | O_DIRECTORY)
+#endif
+
+#ifdef FILECHECK_DIR_FLAGS
+
+/* Opens dir for the fstatat calls below.  With automount support the
+ * open goes through '/.' so that the mount point is dereferenced. */
+static int
+filecheck_open_dir (const gchar *dir)
+{
+	gchar *dirautofs;
+	struct stat s;
+	int fd;
+
+	/* Stat on automounted directory - append the '/.' to dereference mount point.
+	   Do this only if MdmSupportAutomount is true (default is false)
+	   2006-09-22, Jerzy Borkowski, CAMK */
+	if G_UNLIKELY (mdm_daemon_config_get_value_bool (MDM_KEY_SUPPORT_AUTOMOUNT)) {
+		dirautofs = g_strconcat (dir, "/.", NULL);
+		VE_IGNORE_EINTR (fd = open (dirautofs, FILECHECK_DIR_FLAGS));
+		g_free (dirautofs);
+	} else {
+		VE_IGNORE_EINTR (fd = open (dir, FILECHECK_DIR_FLAGS));
+
+		if (fd >= 0 && fstat (fd, &s) == 0 &&
+		    filecheck_is_automount (dir, &s)) {
+			VE_IGNORE_EINTR (close (fd));
+			dirautofs = g_strconcat (dir, "/.", NULL);
+			VE_IGNORE_EINTR (fd = open (dirautofs, FILECHECK_DIR_FLAGS));
+			g_free (dirautofs);
+		}
+	}
+
+	if (fd >= 0)
+		fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+	return fd;
+}
+
+/* Stats dir, which is opened into *dirfd for filecheck_stat_at.
+ * Returns 0 or -1 with errno set. */
+static int
+filecheck_stat_dir (const gchar *dir, int *dirfd, struct stat *statbuf)
+{
+	int r;
+
+	*dirfd = filecheck_open_dir (dir);
+	if (*dirfd < 0)
+		return -1;
+
+	VE_IGNORE_EINTR (r = fstat (*dirfd, statbuf));
+
+	return r;
+}
+
+/* Stats file in dir, which is opened into *dirfd if it is not yet.
+ * Returns 0 or -1 with errno set. */
+static int
+filecheck_stat_at (const gchar *dir, int *dirfd,
+		   const gchar *file, gboolean follow, struct stat *statbuf)
+{
+	int r;
+
+	if (*dirfd < 0) {
+		*dirfd = filecheck_open_dir (dir);
+		if (*dirfd < 0)
+			return -1;
+	}
+
+	VE_IGNORE_EINTR (r = fstatat (*dirfd, file, statbuf,
+				      follow ? 0 : AT_SYMLINK_NOFOLLOW));
+
+	return r;
+}
+
+#else /* FILECHECK_DIR_FLAGS */
+
+/* Without O_PATH or O_SEARCH a directory can only be opened for
+ * reading, which 0711 homes do not allow.  Everything is looked up by
+ * path then, and *dirfd stays -1. */
+
+static int
+filecheck_stat_dir (const gchar *dir, int *dirfd, struct stat *statbuf)
+{
+	gchar *dirautofs;
+	int r;
+
+	/* Stat on automounted directory - append the '/.' to dereference mount point.
+	   Do this only if MdmSupportAutomount is true (default is false)
+	   2006-09-22, Jerzy Borkowski, CAMK */
+	if G_UNLIKELY (mdm_daemon_config_get_value_bool (MDM_KEY_SUPPORT_AUTOMOUNT)) {
+		dirautofs = g_strconcat (dir, "/.", NULL);
+		VE_IGNORE_EINTR (r = g_stat (dirautofs, statbuf));
+		g_free (dirautofs);
+	} else {
+		VE_IGNORE_EINTR (r = g_stat (dir, statbuf));
+
+		if (r == 0 && filecheck_is_automount (dir, statbuf)) {
+			dirautofs = g_strconcat (dir, "/.", NULL);
+			VE_IGNORE_EINTR (r = g_stat (dirautofs, statbuf));
+			g_free (dirautofs);
+		}
+	}
+
+	return r;
+}
+
+static int
+filecheck_stat_at (const gchar *dir, int *dirfd,
+		   const gchar *file, gboolean follow, struct stat *statbuf)
+{
+	gchar *path;
+	int r;
+
+	path = g_build_filename (dir, file, NULL);
+	if (follow)
+		VE_IGNORE_EINTR (r = g_stat (path, statbuf));
+	else
+		VE_IGNORE_EINTR (r = g_lstat (path, statbuf));
+	g_free (path);
+
+	return r;
+}
+
+#endif /* FILECHECK_DIR_FLAGS */
 
 /**
  * mdm_file_check:
@@ -42,6 +190,9 @@
  * @perms: 0 to allow user writable file/dir only. 1 to allow group and 2 to allow global writable file/dir.
  *
  * Examines a file to determine whether it is safe for the daemon to write to it.
+ * Where the system has O_PATH or O_SEARCH, the directory is only looked up
+ * once for both checks.  The caller opens the file by name afterwards, so
+ * this is a sanity check, not a guarantee.
  */
 
 /* we should be euid the user BTW */
@@ -57,30 +208,23 @@ mdm_file_check (const gchar *caller,
 {
 	struct stat statbuf;
 	gchar *fullpath;
-	gchar *dirautofs;
+	gboolean ret = FALSE;
+	int dirfd = -1;
 	int r;
 
 	if (ve_string_empty (dir) ||
 	    ve_string_empty (file))
 		return FALSE;
 
-	/* Stat on automounted directory - append the '/.' to dereference mount point.
-	   Do this only if MdmSupportAutomount is true (default is false)
-	   2006-09-22, Jerzy Borkowski, CAMK */
-	if G_UNLIKELY (mdm_daemon_config_get_value_bool (MDM_KEY_SUPPORT_AUTOMOUNT)) {
-		dirautofs = g_strconcat(dir, "/.", NULL);
-		VE_IGNORE_EINTR (r = stat (dirautofs, &statbuf));
-		g_free(dirautofs);
-	}
 	/* Stat directory */
-	else {
-		VE_IGNORE_EINTR (r = stat (dir, &statbuf));
-	}
-
-	if (r < 0) {
-		if ( ! absentdirok)
+	if (filecheck_stat_dir (dir, &dirfd, &statbuf) < 0) {
+		if (dirfd >= 0) {
+			mdm_debug ("%s: Cannot stat directory %s.", caller, dir);
+			VE_IGNORE_EINTR (close (dirfd));
+		} else if ( ! absentdirok) {
 			mdm_debug ("%s: Directory %s does not exist.",
 				   caller, dir);
+		}
 		return FALSE;
 	}
 
@@ -92,78 +236,73 @@ mdm_file_check (const gchar *caller,
 
 	if G_UNLIKELY (mdm_daemon_config_get_value_bool (MDM_KEY_CHECK_DIR_OWNER) && (statbuf.st_uid != user)) {
 		mdm_debug ("%s: %s is not owned by uid %d.", caller, dir, user);
-		return FALSE;
+		goto out;
 	}
 
 	/* ... if group has write permission ... */
 	if G_UNLIKELY (perms < 1 && (statbuf.st_mode & S_IWGRP) == S_IWGRP) {
 		mdm_debug ("%s: %s is writable by group.", caller, dir);
-		return FALSE;
+		goto out;
 	}
 
 	/* ... and if others have write permission. */
 	if G_UNLIKELY (perms < 2 && (statbuf.st_mode & S_IWOTH) == S_IWOTH) {
 		mdm_debug ("%s: %s is writable by other.", caller, dir);
-		return FALSE;
+		goto out;
 	}
 
 	fullpath = g_build_filename (dir, file, NULL);
 
 	/* Stat file */
-	VE_IGNORE_EINTR (r = g_stat (fullpath, &statbuf));
+	r = filecheck_stat_at (dir, &dirfd, file, TRUE, &statbuf);
 	if (r < 0) {
 		/* Return true if file does not exist and that is ok */
 		if (absentok) {
-			g_free (fullpath);
-			return TRUE;
+			ret = TRUE;
 		}
 		else {
 			mdm_debug ("%s: %s does not exist but must exist.", caller, fullpath);
-			g_free (fullpath);
-			return FALSE;
 		}
 	}
 
 	/* Check that it is a regular file ... */
-	if G_UNLIKELY (! S_ISREG (statbuf.st_mode)) {
+	else if G_UNLIKELY (! S_ISREG (statbuf.st_mode)) {
 		mdm_debug ("%s: %s is not a regular file.", caller, fullpath);
-		g_free (fullpath);
-		return FALSE;
 	}
 
 	/* ... owned by the user ... */
-	if G_UNLIKELY (statbuf.st_uid != user) {
+	else if G_UNLIKELY (statbuf.st_uid != user) {
 		mdm_debug ("%s: %s is not owned by uid %d.", caller, fullpath, user);
-		g_free (fullpath);
-		return FALSE;
 	}
 
 	/* ... unwritable by group ... */
-	if G_UNLIKELY (perms < 1 && (statbuf.st_mode & S_IWGRP) == S_IWGRP) {
+	else if G_UNLIKELY (perms < 1 && (statbuf.st_mode & S_IWGRP) == S_IWGRP) {
 		mdm_debug ("%s: %s is writable by group.", caller, fullpath);
-		g_free (fullpath);
-		return FALSE;
 	}
 
 	/* ... unwritable by others ... */
-	if G_UNLIKELY (perms < 2 && (statbuf.st_mode & S_IWOTH) == S_IWOTH) {
+	else if G_UNLIKELY (perms < 2 && (statbuf.st_mode & S_IWOTH) == S_IWOTH) {
 		mdm_debug ("%s: %s is writable by group/other.", caller, fullpath);
-		g_free (fullpath);
-		return FALSE;
 	}
 
 	/* ... and smaller than sysadmin specified limit. */
-	if G_UNLIKELY (maxsize && statbuf.st_size > maxsize) {
+	else if G_UNLIKELY (maxsize && statbuf.st_size > maxsize) {
 		mdm_debug ("%s: %s is bigger than sysadmin specified maximum file size.",
 			   caller, fullpath);
-		g_free (fullpath);
-		return FALSE;
+	}
+
+	/* Yeap, this file is ok */
+	else {
+		ret = TRUE;
 	}
 
 	g_free (fullpath);
 
-	/* Yeap, this file is ok */
-	return TRUE;
+ out:
+	if (dirfd >= 0)
+		VE_IGNORE_EINTR (close (dirfd));
+
+	return ret;
 }
 
 /* we should be euid the user BTW */
@@ -175,14 +314,24 @@ mdm_auth_file_check (const gchar *caller,
                      struct stat *s)
 {
 	struct stat statbuf;
+	gchar *dir, *file;
 	gint usermaxfile;
+	int dirfd = -1;
 	int r;
 
 	if (ve_string_empty (authfile))
 		return FALSE;
 
-	/* Stat file */
-	VE_IGNORE_EINTR (r = g_lstat (authfile, &statbuf));
+	/* Stat file, without following a symlink in its place */
+	dir = g_path_get_dirname (authfile);
+	file = g_path_get_basename (authfile);
+	memset (&statbuf, 0, sizeof (statbuf));
+	r = filecheck_stat_at (dir, &dirfd, file, FALSE, &statbuf);
+	if (dirfd >= 0)
+		VE_IGNORE_EINTR (close (dirfd));
+	g_free (dir);
+	g_free (file);
+
 	if (s != NULL)
 		*s = statbuf;
 	if (r < 0) {
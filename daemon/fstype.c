@@ -213,12 +213,173 @@ in_afs (path)
 #include <glib.h>
 #include <glib/gstdio.h>
 
+#include "fstype.h"
+
+#if defined(FSTYPE_MNTENT) && defined(__linux__)
+#define FSTYPE_MOUNTINFO
+#endif
+
+#ifdef FSTYPE_MOUNTINFO		/* Linux.  */
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/sysmacros.h>
+
+#define MOUNTINFO "/proc/self/mountinfo"
+
+/* Device number to filesystem type for every mount in MOUNTINFO.  The
+   kernel flags that file with POLLPRI whenever a filesystem is mounted
+   or unmounted, so the map is only reread after the mount table has
+   changed.  */
+static GHashTable *mountinfo_types = NULL;
+static int mountinfo_fd = -1;
+/* The pending change flag lives in the open file, which a forked child
+   shares with its parent; each process opens its own.  */
+static pid_t mountinfo_pid = -1;
+
+/* Adds one line of MOUNTINFO, which looks like
+   "36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw".
+   Spaces inside the paths are escaped, so " - " only ever appears
+   before the filesystem type.  */
+static void
+mountinfo_add_line (char *line)
+{
+  unsigned int major, minor;
+  gint64 *dev;
+  char *type, *end;
+
+  if (sscanf (line, "%*d %*d %u:%u", &major, &minor) != 2)
+    return;
+
+  type = strstr (line, " - ");
+  if (type == NULL)
+    return;
+  type += 3;
+  end = strchr (type, ' ');
+  if (end == NULL || end == type)
+    return;
+
+  /* Bind mounts repeat the device, with the same type.  */
+  dev = g_new (gint64, 1);
+  *dev = makedev (major, minor);
+  if (g_hash_table_lookup (mountinfo_types, dev) != NULL)
+    {
+      g_free (dev);
+      return;
+    }
+  g_hash_table_insert (mountinfo_types, dev, g_strndup (type, end - type));
+}
+
+static gboolean
+mountinfo_read (void)
+{
+  GString *contents;
+  char buf[4096];
+  char *line, *next;
+  ssize_t n;
+
+  if (lseek (mountinfo_fd, 0, SEEK_SET) < 0)
+    return FALSE;
+
+  contents = g_string_new (NULL);
+  for (;;)
+    {
+      n = read (mountinfo_fd, buf, sizeof (buf));
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+      g_string_append_len (contents, buf, n);
+    }
+  if (n < 0)
+    {
+      g_string_free (contents, TRUE);
+      return FALSE;
+    }
+
+  g_hash_table_remove_all (mountinfo_types);
+  for (line = contents->str; *line != '\0'; line = next)
+    {
+      next = strchr (line, '\n');
+      if (next == NULL)
+	next = line + strlen (line);
+      else
+	*next++ = '\0';
+      mountinfo_add_line (line);
+    }
+
+  g_string_free (contents, TRUE);
+  return TRUE;
+}
+
+static gboolean
+mountinfo_changed (void)
+{
+  struct pollfd pfd;
+  int r;
+
+  pfd.fd = mountinfo_fd;
+  pfd.events = POLLPRI;
+  pfd.revents = 0;
+
+  do
+    r = poll (&pfd, 1, 0);
+  while (r < 0 && errno == EINTR);
+
+  return r != 0 && (r < 0 || (pfd.revents & (POLLPRI | POLLERR)));
+}
+
+/* Return the type of the filesystem on device DEV from the mount table,
+   or NULL if the device is not in it (or there is no MOUNTINFO).  */
+static char *
+mountinfo_lookup (dev_t dev)
+{
+  gint64 key = dev;
+
+  if (mountinfo_fd >= 0 && mountinfo_pid != getpid ())
+    {
+      close (mountinfo_fd);
+      mountinfo_fd = -1;
+    }
+
+  if (mountinfo_fd < 0)
+    {
+      if (mountinfo_types == NULL)
+	mountinfo_types = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+						 g_free, g_free);
+
+      mountinfo_fd = open (MOUNTINFO, O_RDONLY);
+      if (mountinfo_fd < 0)
+	return NULL;
+      fcntl (mountinfo_fd, F_SETFD, FD_CLOEXEC);
+      mountinfo_pid = getpid ();
+
+      /* Swallow the change flag, the whole table is read right now.  */
+      mountinfo_changed ();
+      if (! mountinfo_read ())
+	{
+	  close (mountinfo_fd);
+	  mountinfo_fd = -1;
+	  return NULL;
+	}
+    }
+  else if (mountinfo_changed () && ! mountinfo_read ())
+    {
+      close (mountinfo_fd);
+      mountinfo_fd = -1;
+      g_hash_table_remove_all (mountinfo_types);
+      return NULL;
+    }
+
+  return g_hash_table_lookup (mountinfo_types, &key);
+}
+#endif /* FSTYPE_MOUNTINFO */
+
 /* Nonzero if the current filesystem's type is known.  */
 static int fstype_known = 0;
 
-char *filesystem_type (char *path, char *relpath, struct stat *statp);
 /* Return a static string naming the type of filesystem that the file PATH,
-   described by STATP, is on.
+   described by STATP, is on.  The string is only valid until the next call.
    RELPATH is the file name relative to the current directory.
    Return "unknown" if its filesystem type is unknown.  */
 
@@ -228,6 +389,16 @@ filesystem_type (char *path, char *relpath, struct stat *statp)
   static char *current_fstype = NULL;
   static dev_t current_dev;
 
+#ifdef FSTYPE_MOUNTINFO
+  char *type;
+
+  /* Devices missing from the table (btrfs subvolumes and the like, which
+     have their own st_dev) go the slow way below.  */
+  type = mountinfo_lookup (statp->st_dev);
+  if (type != NULL)
+    return type;
+#endif
+
   if (current_fstype != NULL)
     {
       if (fstype_known && statp->st_dev == current_dev)
@@ -0,0 +1,29 @@
+/* fstype.h -- determine type of filesystems that files are on
+   Copyright (C) 1990, 91, 92, 93, 94 Free Software Foundation, Inc.
+
+   This file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   this file is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+ */
+
+#ifndef MDM_FSTYPE_H
+#define MDM_FSTYPE_H
+
+/* Returns a static string naming the type of filesystem that PATH,
+   described by STATP, is on, or "unknown".  */
+char *filesystem_type (char *path, char *relpath, struct stat *statp);
+
+#endif /* MDM_FSTYPE_H */
+
+/* EOF */
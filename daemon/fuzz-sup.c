@@ -0,0 +1,267 @@
+/* MDM - The MDM Display Manager
+ *
+ * Feeds arbitrary bytes to the supervisor socket code of the daemon.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Usage: fuzz-sup [FILE...]
+ *
+ * Every input is sent by a client over a real unix socket to a listening
+ * connection that has the daemon's own handler, so it goes through the
+ * line splitting in mdm-net.c and the command dispatch in mdm.c just
+ * like on MDM_SUP_SOCKET.  The socket lives in a scratch directory and
+ * the daemon is not running, there are three fake attached displays
+ * instead.  None of them has a cookie, so AUTH_LOCAL never succeeds and
+ * the commands that need it are only run up to the refusal; the others
+ * would start X servers.
+ *
+ * Without arguments one input is read from stdin, otherwise each FILE is
+ * one input.  That is the way AFL runs it:
+ *
+ *	afl-fuzz -i fuzz-sup-corpus -o findings -x fuzz-sup.dict -- ./fuzz-sup @@
+ *
+ * Configured with --enable-libfuzzer it is a libFuzzer target instead:
+ *
+ *	./fuzz-sup -dict=fuzz-sup.dict corpus fuzz-sup-corpus
+ *
+ * It is not built by default, "make fuzz" builds it and replays the seed
+ * inputs once.
+ *
+ * The configuration comes from the file in MDM_FUZZ_CONFIG, if set, and
+ * otherwise from the installed defaults.  Warnings are not printed
+ * unless MDM_FUZZ_VERBOSE is set, criticals abort.
+ */
+
+/* The handler and the display list are static in there */
+#define main mdm_daemon_main
+#include "mdm.c"
+#undef main
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib/gstdio.h>
+
+#define FAKE_DISPLAYS 3
+
+static char *fuzz_dir = NULL;
+static char *fuzz_socket = NULL;
+
+static void
+fuzz_log_handler (const gchar   *log_domain,
+		  GLogLevelFlags log_level,
+		  const gchar   *message,
+		  gpointer       data)
+{
+	if (log_level & (G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_ERROR)) {
+		g_printerr ("%s\n", message);
+		abort ();
+	}
+
+	if (g_getenv ("MDM_FUZZ_VERBOSE") != NULL)
+		g_printerr ("%s\n", message);
+}
+
+static void
+fuzz_cleanup (void)
+{
+	if (fuzz_socket != NULL)
+		g_unlink (fuzz_socket);
+	if (fuzz_dir != NULL)
+		g_rmdir (fuzz_dir);
+}
+
+static void
+fuzz_init (void)
+{
+	MdmConnection *conn;
+	int i;
+
+	g_log_set_default_handler (fuzz_log_handler, NULL);
+	signal (SIGPIPE, SIG_IGN);
+
+	mdm_daemon_config_load (g_getenv ("MDM_FUZZ_CONFIG"));
+
+	for (i = 0; i < FAKE_DISPLAYS; i++) {
+		MdmDisplay *disp;
+
+		disp = mdm_display_alloc (i, "/usr/bin/X -br", NULL);
+		disp->vt = 7 + i;
+		disp->greetpid = 1000 + i;
+		if (i == 0) {
+			disp->logged_in = TRUE;
+			disp->login = g_strdup ("fuzz");
+		}
+		mdm_daemon_config_display_list_append (disp);
+	}
+
+	fuzz_dir = g_build_filename (g_get_tmp_dir (), "mdm-fuzz-XXXXXX", NULL);
+	if (g_mkdtemp (fuzz_dir) == NULL) {
+		g_printerr ("fuzz-sup: cannot create a scratch directory\n");
+		exit (1);
+	}
+	fuzz_socket = g_build_filename (fuzz_dir, "socket", NULL);
+	atexit (fuzz_cleanup);
+
+	/* Set up like create_connections does for MDM_SUP_SOCKET */
+	conn = mdm_connection_open_unix (fuzz_socket, 0600);
+	if (conn == NULL) {
+		g_printerr ("fuzz-sup: cannot listen on %s\n", fuzz_socket);
+		exit (1);
+	}
+	mdm_connection_set_handler (conn,
+				    mdm_handle_user_message,
+				    NULL /* data */,
+				    NULL /* destroy_notify */);
+	mdm_connection_set_nonblock (conn, TRUE);
+}
+
+static int
+fuzz_connect (void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, fuzz_socket);
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		close (fd);
+		return -1;
+	}
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+
+	return fd;
+}
+
+/*
+ * Writes the input as fast as the daemon side reads it, throws the
+ * answers away and runs the main loop until the daemon side closed the
+ * connection, which it does at the latest when it sees the end of the
+ * input.
+ */
+static void
+fuzz_one (const guint8 *data, size_t size)
+{
+	char buf[PIPE_SIZE];
+	size_t written = 0;
+	gboolean shut = FALSE;
+	ssize_t n;
+	int fd;
+
+	fd = fuzz_connect ();
+	if (fd < 0) {
+		g_printerr ("fuzz-sup: cannot connect to %s\n", fuzz_socket);
+		exit (1);
+	}
+
+	for (;;) {
+		if (written < size) {
+			VE_IGNORE_EINTR (n = send (fd, data + written, size - written,
+						   MSG_NOSIGNAL));
+			if (n > 0)
+				written += n;
+			else if (n < 0 && errno != EAGAIN)
+				written = size; /* the daemon side is gone */
+		}
+		if (written == size && ! shut) {
+			shutdown (fd, SHUT_WR);
+			shut = TRUE;
+		}
+
+		VE_IGNORE_EINTR (n = recv (fd, buf, sizeof (buf), 0));
+		if (n == 0 || (n < 0 && errno != EAGAIN))
+			break;
+		if (n > 0)
+			continue;
+
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	close (fd);
+
+	/* Let the daemon side see the close and anything left in the idle
+	 * sources finish */
+	while (g_main_context_iteration (NULL, FALSE))
+		;
+}
+
+#ifdef MDM_LIBFUZZER
+
+int LLVMFuzzerTestOneInput (const guint8 *data, size_t size);
+
+int
+LLVMFuzzerTestOneInput (const guint8 *data, size_t size)
+{
+	static gboolean initialized = FALSE;
+
+	if ( ! initialized) {
+		fuzz_init ();
+		initialized = TRUE;
+	}
+
+	fuzz_one (data, size);
+
+	return 0;
+}
+
+#else /* ! MDM_LIBFUZZER */
+
+int
+main (int argc, char **argv)
+{
+	GError *error = NULL;
+	gchar *contents;
+	gsize len;
+	int i;
+
+	fuzz_init ();
+
+	if (argc < 2) {
+		GIOChannel *in = g_io_channel_unix_new (STDIN_FILENO);
+
+		g_io_channel_set_encoding (in, NULL, NULL);
+		if (g_io_channel_read_to_end (in, &contents, &len, &error) != G_IO_STATUS_NORMAL) {
+			g_printerr ("fuzz-sup: %s\n", error->message);
+			return 1;
+		}
+		g_io_channel_unref (in);
+
+		fuzz_one ((guint8 *) contents, len);
+		g_free (contents);
+
+		return 0;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if ( ! g_file_get_contents (argv[i], &contents, &len, &error)) {
+			g_printerr ("fuzz-sup: %s\n", error->message);
+			return 1;
+		}
+
+		fuzz_one ((guint8 *) contents, len);
+		g_free (contents);
+	}
+
+	return 0;
+}
+
+#endif /* MDM_LIBFUZZER */
@@ -26,6 +26,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -144,108 +145,107 @@ mdm_get_vt_device (int vtno)
 
 #define MDMCONSOLEDEVICE "/dev/tty0"
 
+/* Where Linux publishes the active VT; it can be poll()ed for changes */
+#define MDMACTIVEVTFILE "/sys/class/tty/tty0/active"
+
+/* How long an activation is tracked before it is given up on */
+#define VT_ACTIVATE_TIMEOUT 5 /* seconds */
+/* How often the active VT is polled when there is nothing to watch */
+#define VT_POLL_INTERVAL 50 /* msec */
+
+typedef struct {
+	int        vt;
+	MdmVtFunc  func;
+	gpointer   data;
+	gint64     deadline;
+} VtActivation;
+
+static GSList *vt_activations = NULL;
+static int     vt_active_fd = -1;
+static guint   vt_active_watch = 0;
+static guint   vt_poll_id = 0;
+
+/*
+ * The console is opened once per process.  Slaves close every inherited
+ * descriptor, so the cached one is only trusted in the process that
+ * opened it.
+ */
+static int   console_fd = -1;
+static pid_t console_pid = -1;
+
 static int
-open_vt (int vtno)
+get_console_fd (void)
 {
-	char *vtname = NULL;
-	int fd = -1;
+	int fd;
 
-	vtname = mdm_get_vt_device (vtno);
+	if (console_fd >= 0 && console_pid == getpid ())
+		return console_fd;
 
 	do {
 		errno = 0;
-		fd = open (vtname, O_RDWR
+		fd = open (MDMCONSOLEDEVICE,
+			   O_WRONLY
 #ifdef O_NOCTTY
 			   |O_NOCTTY
 #endif
 			   , 0);
 	} while G_UNLIKELY (errno == EINTR);
+	if (fd < 0)
+		return -1;
 
-	g_free (vtname);
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+	console_fd = fd;
+	console_pid = getpid ();
 
 	return fd;
 }
 
-#if defined (MDM_USE_SYS_VT)
-
-static int 
-get_free_vt_sys (int *vtfd)
+static int
+open_vt (int vtno)
 {
-	int fd, fdv;
-	int vtno;
-	unsigned short vtmask;
-	struct vt_stat vtstat;
+	char *vtname = NULL;
+	int fd = -1;
 
-	*vtfd = -1;
+	vtname = mdm_get_vt_device (vtno);
 
 	do {
 		errno = 0;
-		fd = open (MDMCONSOLEDEVICE,
-			   O_WRONLY
+		fd = open (vtname, O_RDWR
 #ifdef O_NOCTTY
 			   |O_NOCTTY
 #endif
 			   , 0);
 	} while G_UNLIKELY (errno == EINTR);
-	if (fd < 0)
-		return -1;
 
-	if (ioctl (fd, VT_GETSTATE, &vtstat) < 0) {
-		VE_IGNORE_EINTR (close (fd));
-		return -1;
-	}
-
-	for (vtno = mdm_daemon_config_get_value_int (MDM_KEY_FIRST_VT), vtmask = 1 << vtno;
-			vtstat.v_state & vtmask; vtno++, vtmask <<= 1);
-	if (!vtmask) {
-		VE_IGNORE_EINTR (close (fd));
-		return -1;
-	}
+	g_free (vtname);
 
-	fdv = open_vt (vtno);
-	if (fdv < 0) {
-		VE_IGNORE_EINTR (close (fd));
-		return -1;
-	}
-	*vtfd = fdv;
-	return vtno;
+	return fd;
 }
 
-#elif defined (MDM_USE_CONSIO_VT)
-
+/*
+ * VT_OPENQRY hands out the lowest VT nobody has open, so the ones below
+ * first_vt are held open until it gets past them.  Works across the whole
+ * VT range.
+ */
 static int
-get_free_vt_consio (int *vtfd)
+get_free_vt_openqry (int fd, int first_vt, int *vtfd)
 {
-	int fd, fdv;
+	int fdv;
 	int vtno;
 	GList *to_close_vts = NULL, *li;
 
 	*vtfd = -1;
 
-	do {
-		errno = 0;
-		fd = open (MDMCONSOLEDEVICE,
-			   O_WRONLY
-#ifdef O_NOCTTY
-			   |O_NOCTTY
-#endif
-			   , 0);
-	} while G_UNLIKELY (errno == EINTR);
-	if (fd < 0)
-		return -1;
-
 	if ((ioctl (fd, VT_OPENQRY, &vtno) < 0) || (vtno == -1)) {
-		VE_IGNORE_EINTR (close (fd));
 		return -1;
 	}
 
 	fdv = open_vt (vtno);
 	if (fdv < 0) {
-		VE_IGNORE_EINTR (close (fd));
 		return -1;
 	}
 
-	while (vtno < mdm_daemon_config_get_value_int (MDM_KEY_FIRST_VT)) {
+	while (vtno < first_vt) {
 		int oldvt = vtno;
 		to_close_vts = g_list_prepend (to_close_vts,
 					       GINT_TO_POINTER (fdv));
@@ -273,56 +273,270 @@ cleanup:
 	for (li = to_close_vts; li != NULL; li = li->next) {
 		VE_IGNORE_EINTR (close (GPOINTER_TO_INT (li->data)));
 	}
+	g_list_free (to_close_vts);
 	return vtno;
 }
 
+#if defined (MDM_USE_SYS_VT)
+
+static int 
+get_free_vt_sys (int *vtfd)
+{
+	int fd, fdv;
+	int vtno;
+	int first_vt;
+	struct vt_stat vtstat;
+
+	*vtfd = -1;
+
+	fd = get_console_fd ();
+	if (fd < 0)
+		return -1;
+
+	first_vt = mdm_daemon_config_get_value_int (MDM_KEY_FIRST_VT);
+
+	/* v_state only covers the first 16 VTs, look there first since
+	 * it needs no VTs held open */
+	if (ioctl (fd, VT_GETSTATE, &vtstat) == 0) {
+		for (vtno = MAX (first_vt, 1); vtno < 16; vtno++) {
+			if (vtstat.v_state & (1 << vtno))
+				continue;
+
+			fdv = open_vt (vtno);
+			if (fdv < 0)
+				return -1;
+			*vtfd = fdv;
+			return vtno;
+		}
+	}
+
+	return get_free_vt_openqry (fd, MAX (first_vt, 16), vtfd);
+}
+
+#elif defined (MDM_USE_CONSIO_VT)
+
+static int
+get_free_vt_consio (int *vtfd)
+{
+	int fd;
+
+	*vtfd = -1;
+
+	fd = get_console_fd ();
+	if (fd < 0)
+		return -1;
+
+	return get_free_vt_openqry (fd,
+				    mdm_daemon_config_get_value_int (MDM_KEY_FIRST_VT),
+				    vtfd);
+}
+
 #endif
 
+/*
+ * With ParallelStaticDisplays several slaves may look for a VT at the same
+ * time, and two of them could be told the same free VT before either has
+ * opened it.  The VT handed out stays open until its X server has taken
+ * it, so locking the console from the query until the open is enough.
+ */
 char *
 mdm_get_empty_vt_argument (int *fd, int *vt)
 {
+	int console;
+
 	if ( ! mdm_daemon_config_get_value_bool (MDM_KEY_VT_ALLOCATION)) {
 		*fd = -1;
 		return NULL;
 	}
 
+	console = get_console_fd ();
+	if (console >= 0)
+		VE_IGNORE_EINTR (flock (console, LOCK_EX));
+
 #if defined (MDM_USE_SYS_VT)
 	*vt = get_free_vt_sys (fd);
 #elif defined (MDM_USE_CONSIO_VT)
 	*vt = get_free_vt_consio (fd);
 #endif
 
+	if (console >= 0)
+		flock (console, LOCK_UN);
+
 	if (*vt < 0)
 		return NULL;
 	else
 		return g_strdup_printf ("vt%d", *vt);
 }
 
-/* change to an existing vt */
+static int
+read_active_vt (void)
+{
+	char buf[32];
+	int vt;
+	ssize_t len;
+
+	if (vt_active_fd < 0)
+		return mdm_get_current_vt ();
+
+	lseek (vt_active_fd, 0, SEEK_SET);
+	VE_IGNORE_EINTR (len = read (vt_active_fd, buf, sizeof (buf) - 1));
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	if (sscanf (buf, "tty%d", &vt) != 1)
+		return -1;
+
+	return vt;
+}
+
+/* Runs the callbacks of activations that are done and drops expired ones */
+static void
+vt_activations_check (void)
+{
+	GSList *li, *next;
+	GSList *done = NULL;
+	gint64 now;
+	int vt;
+
+	vt = read_active_vt ();
+	now = g_get_monotonic_time ();
+
+	for (li = vt_activations; li != NULL; li = next) {
+		VtActivation *act = li->data;
+
+		next = li->next;
+
+		if (act->vt != vt && now < act->deadline)
+			continue;
+
+		vt_activations = g_slist_remove_link (vt_activations, li);
+		done = g_slist_concat (li, done);
+	}
+
+	/* Callbacks may start new activations, so only run them once the
+	 * list is consistent again */
+	for (li = done; li != NULL; li = li->next) {
+		VtActivation *act = li->data;
+
+		if (act->vt != vt)
+			mdm_debug ("mdm_change_vt: VT %d did not become active", act->vt);
+		(*act->func) (act->vt, act->vt == vt, act->data);
+		g_free (act);
+	}
+	g_slist_free (done);
+}
+
+static gboolean
+vt_active_changed (GIOChannel   *source,
+		   GIOCondition  cond,
+		   gpointer      data)
+{
+	/* Reading re-arms the notification */
+	vt_activations_check ();
+	return TRUE;
+}
+
+static gboolean
+vt_poll (gpointer data)
+{
+	vt_activations_check ();
+
+	if (vt_activations != NULL)
+		return TRUE;
+
+	vt_poll_id = 0;
+	return FALSE;
+}
+
+static void
+vt_watch_start (void)
+{
+	GIOChannel *channel;
+
+	if (vt_active_watch != 0 || vt_poll_id != 0)
+		return;
+
+#ifdef __linux__
+	if (vt_active_fd < 0) {
+		VE_IGNORE_EINTR (vt_active_fd = open (MDMACTIVEVTFILE, O_RDONLY));
+		if (vt_active_fd >= 0) {
+			fcntl (vt_active_fd, F_SETFD, FD_CLOEXEC);
+			/* Start from the current state */
+			read_active_vt ();
+
+			channel = g_io_channel_unix_new (vt_active_fd);
+			vt_active_watch = g_io_add_watch (channel,
+							  G_IO_PRI | G_IO_ERR,
+							  vt_active_changed,
+							  NULL);
+			g_io_channel_unref (channel);
+			return;
+		}
+	}
+#endif
+
+	vt_poll_id = g_timeout_add (VT_POLL_INTERVAL, vt_poll, NULL);
+}
+
+/* change to an existing vt, without waiting for the switch */
 void
-mdm_change_vt (int vt)
+mdm_change_vt_full (int vt, MdmVtFunc func, gpointer data)
 {
+	VtActivation *act;
 	int fd;
-	int rc;
-	if (vt < 0)
+
+	fd = vt < 0 ? -1 : get_console_fd ();
+	if (fd < 0) {
+		if (func != NULL)
+			(*func) (vt, FALSE, data);
 		return;
+	}
 
-	do {
-		errno = 0;
-		fd = open (MDMCONSOLEDEVICE,
-			   O_WRONLY
-#ifdef O_NOCTTY
-			   |O_NOCTTY
-#endif
-			   , 0);
-	} while G_UNLIKELY (errno == EINTR);
-	if (fd < 0)
+	if (ioctl (fd, VT_ACTIVATE, vt) < 0) {
+		mdm_debug ("mdm_change_vt: Cannot activate VT %d: %s", vt,
+			   strerror (errno));
+		if (func != NULL)
+			(*func) (vt, FALSE, data);
 		return;
+	}
 
-	rc = ioctl (fd, VT_ACTIVATE, vt);
-	rc = ioctl (fd, VT_WAITACTIVE, vt);
+	if (func == NULL)
+		return;
+
+	act = g_new0 (VtActivation, 1);
+	act->vt = vt;
+	act->func = func;
+	act->data = data;
+	act->deadline = g_get_monotonic_time () +
+		VT_ACTIVATE_TIMEOUT * G_USEC_PER_SEC;
+	vt_activations = g_slist_prepend (vt_activations, act);
+
+	vt_watch_start ();
+	vt_activations_check ();
+}
 
-	VE_IGNORE_EINTR (close (fd));
+void
+mdm_change_vt (int vt)
+{
+	mdm_change_vt_full (vt, NULL, NULL);
+}
+
+/* For when there is no main loop to wait in any more */
+void
+mdm_change_vt_and_wait (int vt)
+{
+	int i;
+
+	mdm_change_vt_full (vt, NULL, NULL);
+
+	for (i = 0; i < VT_ACTIVATE_TIMEOUT * 1000 / VT_POLL_INTERVAL; i++) {
+		if (mdm_get_current_vt () == vt)
+			return;
+		g_usleep (VT_POLL_INTERVAL * 1000);
+	}
+
+	mdm_debug ("mdm_change_vt: VT %d did not become active", vt);
 }
 
 int
@@ -335,21 +549,12 @@ mdm_get_current_vt (void)
 #endif
 	int fd;
 
-	do {
-		errno = 0;
-		fd = open (MDMCONSOLEDEVICE,
-			   O_WRONLY
-#ifdef O_NOCTTY
-			   |O_NOCTTY
-#endif
-			   , 0);
-	} while G_UNLIKELY (errno == EINTR);
+	fd = get_console_fd ();
 	if (fd < 0)
 		return -1;
 #if defined (MDM_USE_SYS_VT)
-	ioctl (fd, VT_GETSTATE, &s);
-
-	VE_IGNORE_EINTR (close (fd));
+	if (ioctl (fd, VT_GETSTATE, &s) < 0)
+		return -1;
 
 	/* debug */
 	/*
@@ -359,12 +564,9 @@ mdm_get_current_vt (void)
 	return s.v_active;
 #elif defined (MDM_USE_CONSIO_VT)
 	if (ioctl (fd, VT_GETACTIVE, &vtno) == -1) {
-		VE_IGNORE_EINTR (close (fd));
 		return -1;
 	}
 
-VE_IGNORE_EINTR (close (fd));
-
 	/* debug */
 	/*
 	printf ("current_Active %d\n", vtno);
@@ -387,12 +589,25 @@ mdm_get_empty_vt_argument (int *fd, int *vt)
 	return NULL;
 }
 
+void
+mdm_change_vt_full (int vt, MdmVtFunc func, gpointer data)
+{
+	if (func != NULL)
+		(*func) (vt, FALSE, data);
+}
+
 void
 mdm_change_vt (int vt)
 {
 	return;
 }
 
+void
+mdm_change_vt_and_wait (int vt)
+{
+	return;
+}
+
 int
 mdm_get_current_vt (void)
 {
@@ -44,8 +44,20 @@
 char *	mdm_get_empty_vt_argument	(int *fd,
 					 int *vt);
 
-/* Change to the specified virtual terminal */
+typedef void (*MdmVtFunc) (int vt, gboolean active, gpointer data);
+
+/* Change to the specified virtual terminal.  This only asks for the
+ * switch, it does not wait for it to happen. */
 void	mdm_change_vt			(int vt);
+/* Same, and calls func from the main loop once vt is active.  func gets
+ * active FALSE if the switch cannot be made or does not happen within a
+ * few seconds, and may run before mdm_change_vt_full returns. */
+void	mdm_change_vt_full		(int vt,
+					 MdmVtFunc func,
+					 gpointer data);
+/* Same as mdm_change_vt, but blocks until vt is active, for a few
+ * seconds at most */
+void	mdm_change_vt_and_wait		(int vt);
 
 /* Get the current virtual terminal number or -1 if we can't */
 int	mdm_get_current_vt		(void);
@@ -87,6 +87,8 @@ typedef enum {
 	MDM_ID_FLEXIBLE_XSERVERS,
 	MDM_ID_FIRST_VT,
 	MDM_ID_VT_ALLOCATION,
+	MDM_ID_PARALLEL_STATIC_DISPLAYS,
+	MDM_ID_WATCH_CONFIG,
 	MDM_ID_CONSOLE_CANNOT_HANDLE,
 	MDM_ID_XSERVER_TIMEOUT,
 	MDM_ID_SERVER_PREFIX,
@@ -104,6 +106,7 @@ typedef enum {
 	MDM_ID_RETRY_DELAY,
 	MDM_ID_DISALLOW_TCP,
 	MDM_ID_PAM_STACK,
+	MDM_ID_PAM_PREWARM,
 	MDM_ID_NEVER_PLACE_COOKIES_ON_NFS,
 	MDM_ID_PASSWORD_REQUIRED,
 	MDM_ID_UTMP_LINE_ATTACHED,	
@@ -302,6 +305,12 @@ static const MdmConfigEntry mdm_daemon_config_entries [] = {
 	{ MDM_CONFIG_GROUP_DAEMON, "FirstVT", MDM_CONFIG_VALUE_INT, "7", MDM_ID_FIRST_VT },
 	{ MDM_CONFIG_GROUP_DAEMON, "VTAllocation", MDM_CONFIG_VALUE_BOOL, "true", MDM_ID_VT_ALLOCATION },
 
+	/* How many static displays may be starting at the same time, 0 for no limit */
+	{ MDM_CONFIG_GROUP_DAEMON, "ParallelStaticDisplays", MDM_CONFIG_VALUE_INT, "1", MDM_ID_PARALLEL_STATIC_DISPLAYS },
+
+	/* Pick up changes to the configuration files without MDM_CONFIG_UPDATE */
+	{ MDM_CONFIG_GROUP_DAEMON, "WatchConfig", MDM_CONFIG_VALUE_BOOL, "true", MDM_ID_WATCH_CONFIG },
+
 	{ MDM_CONFIG_GROUP_DAEMON, "ConsoleCannotHandle", MDM_CONFIG_VALUE_STRING, "am,ar,az,bn,el,fa,gu,hi,ja,ko,ml,mr,pa,ta,zh", MDM_ID_CONSOLE_CANNOT_HANDLE },
 
 	/* How long to wait before assuming an Xserver has timed out */
@@ -319,6 +328,7 @@ static const MdmConfigEntry mdm_daemon_config_entries [] = {
 	{ MDM_CONFIG_GROUP_SECURITY, "RetryDelay", MDM_CONFIG_VALUE_INT, "1", MDM_ID_RETRY_DELAY },
 	{ MDM_CONFIG_GROUP_SECURITY, "DisallowTCP", MDM_CONFIG_VALUE_BOOL, "true", MDM_ID_DISALLOW_TCP },
 	{ MDM_CONFIG_GROUP_SECURITY, "PamStack", MDM_CONFIG_VALUE_STRING, "mdm", MDM_ID_PAM_STACK },
+	{ MDM_CONFIG_GROUP_SECURITY, "PamPrewarm", MDM_CONFIG_VALUE_BOOL, "false", MDM_ID_PAM_PREWARM },
 
 	{ MDM_CONFIG_GROUP_SECURITY, "NeverPlaceCookiesOnNFS", MDM_CONFIG_VALUE_BOOL, "true", MDM_ID_NEVER_PLACE_COOKIES_ON_NFS },
 	{ MDM_CONFIG_GROUP_SECURITY, "PasswordRequired", MDM_CONFIG_VALUE_BOOL, "false", MDM_ID_PASSWORD_REQUIRED },
@@ -84,6 +84,8 @@ G_BEGIN_DECLS
 #define MDM_KEY_FLEXIBLE_XSERVERS "daemon/FlexibleXServers=5"
 #define MDM_KEY_FIRST_VT "daemon/FirstVT=7"
 #define MDM_KEY_VT_ALLOCATION "daemon/VTAllocation=true"
+#define MDM_KEY_PARALLEL_STATIC_DISPLAYS "daemon/ParallelStaticDisplays=1"
+#define MDM_KEY_WATCH_CONFIG "daemon/WatchConfig=true"
 #define MDM_KEY_CONSOLE_CANNOT_HANDLE "daemon/ConsoleCannotHandle=am,ar,az,bn,el,fa,gu,hi,ja,ko,ml,mr,pa,ta,zh"
 #define MDM_KEY_XSERVER_TIMEOUT "daemon/MdmXserverTimeout=10"
 #define MDM_KEY_SYSTEM_COMMANDS_IN_MENU "daemon/SystemCommandsInMenu=HALT;REBOOT;SUSPEND"
@@ -106,6 +108,7 @@ G_BEGIN_DECLS
 #define MDM_KEY_RETRY_DELAY "security/RetryDelay=1"
 #define MDM_KEY_DISALLOW_TCP "security/DisallowTCP=true"
 #define MDM_KEY_PAM_STACK "security/PamStack=mdm"
+#define MDM_KEY_PAM_PREWARM "security/PamPrewarm=false"
 #define MDM_KEY_NEVER_PLACE_COOKIES_ON_NFS "security/NeverPlaceCookiesOnNFS=true"
 #define MDM_KEY_PASSWORD_REQUIRED "security/PasswordRequired=false"
 #define MDM_KEY_UTMP_LINE_ATTACHED "security/UtmpLineAttached="
@@ -44,8 +44,13 @@
 #include <sys/stat.h>
 #include <sys/resource.h>
 #include <signal.h>
+#include <errno.h>
+#include <limits.h>
 #include <pwd.h>
 #include <grp.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 #include <glib.h>
 #include <glib/gi18n.h>
@@ -60,6 +65,7 @@
 
 #include "mdm-common.h"
 #include "mdm-config.h"
+#include "mdm-config-snapshot.h"
 #include "mdm-log.h"
 #include "mdm-daemon-config.h"
 
@@ -70,10 +76,23 @@ static MdmConfig *daemon_config = NULL;
 static GSList *displays = NULL;
 static GSList *xservers = NULL;
 
+#define MDM_DISTRO_CONF "/usr/share/mdm/distro.conf"
+
 static gint high_display_num = 0;
 static const char *default_config_file = NULL;
 static char *custom_config_file = NULL;
 
+/* Slave notifications collected while a reload is diffing the keys */
+static GString *pending_notifies = NULL;
+
+/* The snapshot of the configuration handed to the greeters, written
+ * again on demand once the configuration has changed */
+static int snapshot_fd = -1;
+static int snapshot_generation_fd = -1;
+static volatile guint64 *snapshot_generation = NULL;
+static pid_t snapshot_owner = 0;
+static gboolean snapshot_dirty = TRUE;
+
 static uid_t MdmUserId;   /* Userid  under which mdm should run */
 static gid_t MdmGroupId;  /* Gruopid under which mdm should run */
 
@@ -886,22 +905,30 @@ notify_displays_value (MdmConfig      *config,
 		valstr = g_strdup (" ");
 	}
 
-	for (li = displays; li != NULL; li = li->next) {
-		MdmDisplay *disp = li->data;
+	if (pending_notifies != NULL) {
+		g_string_append_printf (pending_notifies,
+					"%c%s %s\n",
+					MDM_SLAVE_NOTIFY_KEY,
+					keystr,
+					valstr);
+	} else {
+		for (li = displays; li != NULL; li = li->next) {
+			MdmDisplay *disp = li->data;
 
-		if (disp->master_notify_fd < 0) {
-			/* no point */
-			continue;
-		}
+			if (disp->master_notify_fd < 0) {
+				/* no point */
+				continue;
+			}
 
-		mdm_fdprintf (disp->master_notify_fd,
-			      "%c%s %s\n",
-			      MDM_SLAVE_NOTIFY_KEY,
-			      keystr,
-			      valstr);
+			mdm_fdprintf (disp->master_notify_fd,
+				      "%c%s %s\n",
+				      MDM_SLAVE_NOTIFY_KEY,
+				      keystr,
+				      valstr);
 
-		if (disp != NULL && disp->slavepid > 1) {
-			kill (disp->slavepid, SIGUSR2);
+			if (disp != NULL && disp->slavepid > 1) {
+				kill (disp->slavepid, SIGUSR2);
+			}
 		}
 	}
 
@@ -909,6 +936,72 @@ notify_displays_value (MdmConfig      *config,
 	g_free (valstr);
 }
 
+/* Writes whole lines, at most PIPE_BUF bytes at a time so that every
+ * write is atomic and the slave never reads half a line */
+static void
+write_notify_lines (int fd, const char *lines)
+{
+	const char *p = lines;
+
+	while (*p != '\0') {
+		const char *end = p;
+		const char *nl;
+
+		while ((nl = strchr (end, '\n')) != NULL &&
+		       (end == p || nl + 1 - p <= PIPE_BUF))
+			end = nl + 1;
+		if (end == p)
+			end = p + strlen (p);
+
+		VE_IGNORE_EINTR (write (fd, p, end - p));
+		p = end;
+	}
+}
+
+/* Sends everything collected in pending_notifies, with one signal per
+ * slave however many keys changed */
+static void
+flush_pending_notifies (void)
+{
+	GSList *li;
+
+	if (pending_notifies == NULL)
+		return;
+
+	if (pending_notifies->len > 0) {
+		for (li = displays; li != NULL; li = li->next) {
+			MdmDisplay *disp = li->data;
+
+			if (disp->master_notify_fd < 0) {
+				/* no point */
+				continue;
+			}
+
+			write_notify_lines (disp->master_notify_fd,
+					    pending_notifies->str);
+
+			if (disp->slavepid > 1) {
+				kill (disp->slavepid, SIGUSR2);
+			}
+		}
+	}
+
+	g_string_free (pending_notifies, TRUE);
+	pending_notifies = NULL;
+}
+
+/* Called for every key that changes.  Greeters see at once that their
+ * snapshot is out of date, the next one is written when needed.  Only
+ * the master may do this, the slaves share the generation page. */
+static void
+snapshot_invalidate (void)
+{
+	snapshot_dirty = TRUE;
+
+	if (snapshot_generation != NULL && getpid () == snapshot_owner)
+		(*snapshot_generation)++;
+}
+
 /* The following were used to internally set the
  * stored configuration values.  Now we'll just
  * ask the MdmConfig to store the entry. */
@@ -1724,6 +1817,8 @@ notify_cb (MdmConfig          *config,
 {
 	char *valstr;
 
+	snapshot_invalidate ();
+
         switch (id) {
         case MDM_ID_GREETER:
         case MDM_ID_SOUND_ON_LOGIN_FILE:
@@ -2010,7 +2105,7 @@ mdm_daemon_load_config_file (MdmConfig **load_config)
 	mdm_config_set_validate_func (*load_config, validate_cb, NULL);
 	mdm_config_add_static_entries (*load_config, mdm_daemon_config_entries);
 	mdm_config_set_default_file (*load_config, default_config_file);
-	mdm_config_set_distro_file (*load_config, "/usr/share/mdm/distro.conf");
+	mdm_config_set_distro_file (*load_config, MDM_DISTRO_CONF);
 	mdm_config_set_custom_file (*load_config, custom_config_file);
 
 	/* load the data files */
@@ -2025,6 +2120,25 @@ mdm_daemon_load_config_file (MdmConfig **load_config)
 	mdm_config_process_all (*load_config, &error);
 }
 
+/*
+ * Do not allow these keys to be updated, since MDM would need
+ * additional work, or at least heavy testing, to make these keys
+ * flexible enough to be changed at runtime.
+ */
+static gboolean
+is_fixed_key (const char *keystring)
+{
+	return (is_key (keystring, MDM_KEY_PID_FILE) ||
+		is_key (keystring, MDM_KEY_CONSOLE_NOTIFY) ||
+		is_key (keystring, MDM_KEY_USER) ||
+		is_key (keystring, MDM_KEY_GROUP) ||
+		is_key (keystring, MDM_KEY_LOG_DIR) ||
+		is_key (keystring, MDM_KEY_SERV_AUTHDIR) ||
+		is_key (keystring, MDM_KEY_USER_AUTHDIR) ||
+		is_key (keystring, MDM_KEY_USER_AUTHFILE) ||
+		is_key (keystring, MDM_KEY_USER_AUTHDIR_FALLBACK));
+}
+
 /**
  * mdm_daemon_config_update_key
  *
@@ -2056,20 +2170,7 @@ mdm_daemon_config_update_key (const char *keystring)
 	group = key = locale = NULL;
 	temp_config = NULL;
 
-	/*
-	 * Do not allow these keys to be updated, since MDM would need
-	 * additional work, or at least heavy testing, to make these keys
-	 * flexible enough to be changed at runtime.
-	 */
-	if (is_key (keystring, MDM_KEY_PID_FILE) ||
-	    is_key (keystring, MDM_KEY_CONSOLE_NOTIFY) ||
-	    is_key (keystring, MDM_KEY_USER) ||
-	    is_key (keystring, MDM_KEY_GROUP) ||
-	    is_key (keystring, MDM_KEY_LOG_DIR) ||
-	    is_key (keystring, MDM_KEY_SERV_AUTHDIR) ||
-	    is_key (keystring, MDM_KEY_USER_AUTHDIR) ||
-	    is_key (keystring, MDM_KEY_USER_AUTHFILE) ||
-	    is_key (keystring, MDM_KEY_USER_AUTHDIR_FALLBACK)) {
+	if (is_fixed_key (keystring)) {
 		return FALSE;
 	}
 
@@ -2113,21 +2214,380 @@ mdm_daemon_config_update_key (const char *keystring)
 	return rc;
 }
 
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* Editors and configuration management tools tend to write a file in
+ * several steps, so wait for things to settle before reading it */
+#define CONFIG_RELOAD_DELAY_MSEC 500
+
+typedef struct {
+	int   wd;
+	char *name;	/* the file, in the directory watched by wd */
+} ConfigWatch;
+
+static ConfigWatch config_watches[3];
+static int         n_config_watches = 0;
+static int         config_watch_fd  = -1;
+static guint       config_watch_id  = 0;
+static guint       config_reload_id = 0;
+
+/*
+ * Reads the configuration files again and sets every key whose value
+ * differs from the running one.  The slaves are told about all the
+ * changed keys they care about at once.
+ */
+static void
+reload_config_files (void)
+{
+	MdmConfig *temp_config;
+	gboolean   emergency;
+	GSList    *li;
+	int        changed;
+	int        i;
+
+	emergency = FALSE;
+	for (li = displays; li != NULL; li = li->next) {
+		MdmDisplay *disp = li->data;
+
+		if (disp->is_emergency_server)
+			emergency = TRUE;
+	}
+
+	temp_config = NULL;
+	mdm_daemon_load_config_file (&temp_config);
+
+	pending_notifies = g_string_new (NULL);
+	changed = 0;
+
+	for (i = 0; mdm_daemon_config_entries[i].group != NULL; i++) {
+		const MdmConfigEntry *entry = &mdm_daemon_config_entries[i];
+		MdmConfigValue       *old_value;
+		MdmConfigValue       *new_value;
+		char                 *keystring;
+
+		/* the emergency server never logs anyone in */
+		if (emergency &&
+		    (entry->id == MDM_ID_AUTOMATIC_LOGIN ||
+		     entry->id == MDM_ID_TIMED_LOGIN))
+			continue;
+
+		keystring = g_strdup_printf ("%s/%s", entry->group, entry->key);
+		if (is_fixed_key (keystring)) {
+			g_free (keystring);
+			continue;
+		}
+
+		old_value = new_value = NULL;
+		mdm_config_get_value_for_id (temp_config, entry->id, &new_value);
+		mdm_config_get_value_for_id (daemon_config, entry->id, &old_value);
+
+		if (new_value != NULL &&
+		    (old_value == NULL ||
+		     mdm_config_value_compare (old_value, new_value) != 0)) {
+			mdm_debug ("reload_config_files: %s changed", keystring);
+			mdm_config_set_value_for_id (daemon_config, entry->id, new_value);
+			changed++;
+		}
+
+		if (old_value != NULL)
+			mdm_config_value_free (old_value);
+		if (new_value != NULL)
+			mdm_config_value_free (new_value);
+		g_free (keystring);
+	}
+
+	mdm_config_free (temp_config);
+
+	flush_pending_notifies ();
+
+	if (changed > 0)
+		mdm_info ("Configuration reloaded, %d keys changed", changed);
+
+	if ( ! mdm_daemon_config_get_value_bool (MDM_KEY_WATCH_CONFIG))
+		mdm_daemon_config_unwatch ();
+}
+
+static gboolean
+config_reload_timeout (gpointer data)
+{
+	config_reload_id = 0;
+	reload_config_files ();
+
+	return FALSE;
+}
+
+static gboolean
+config_watch_cb (GIOChannel   *source,
+		 GIOCondition  cond,
+		 gpointer      data)
+{
+	union {
+		struct inotify_event event;
+		char                 buf[4096];
+	} u;
+	gboolean relevant = FALSE;
+	ssize_t  len;
+	char    *p;
+	int      i;
+
+	if (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		config_watch_id = 0;
+		mdm_daemon_config_unwatch ();
+		return FALSE;
+	}
+
+	for (;;) {
+		VE_IGNORE_EINTR (len = read (config_watch_fd, u.buf, sizeof (u.buf)));
+		if (len <= 0)
+			break;
+
+		for (p = u.buf; p < u.buf + len;) {
+			struct inotify_event *event = (struct inotify_event *) p;
+
+			if (event->mask & IN_Q_OVERFLOW)
+				relevant = TRUE;
+
+			for (i = 0; i < n_config_watches && event->len > 0; i++) {
+				if (event->wd == config_watches[i].wd &&
+				    strcmp (event->name, config_watches[i].name) == 0)
+					relevant = TRUE;
+			}
+
+			p += sizeof (struct inotify_event) + event->len;
+		}
+	}
+
+	if (relevant) {
+		if (config_reload_id > 0)
+			g_source_remove (config_reload_id);
+		config_reload_id = g_timeout_add (CONFIG_RELOAD_DELAY_MSEC,
+						  config_reload_timeout, NULL);
+	}
+
+	return TRUE;
+}
+
+static void
+config_watch_add (const char *file)
+{
+	char *dir;
+	int   wd;
+
+	if (file == NULL || n_config_watches >= (int) G_N_ELEMENTS (config_watches))
+		return;
+
+	/* Watch the directory, files are often replaced by renaming a
+	 * new one over them */
+	dir = g_path_get_dirname (file);
+	wd = inotify_add_watch (config_watch_fd, dir,
+				IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+				IN_CREATE | IN_DELETE);
+	if (wd < 0) {
+		mdm_debug ("config_watch_add: Cannot watch %s", dir);
+		g_free (dir);
+		return;
+	}
+	g_free (dir);
+
+	config_watches[n_config_watches].wd = wd;
+	config_watches[n_config_watches].name = g_path_get_basename (file);
+	n_config_watches++;
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
 /**
- * mdm_daemon_config_parse
+ * mdm_daemon_config_watch
+ * mdm_daemon_config_unwatch
  *
- * Loads initial configuration settings.
+ * Start or stop watching the configuration files.  Once they change,
+ * all keys that can change at runtime are read again, as if
+ * MDM_CONFIG_UPDATE had been sent for each of them.  Does nothing
+ * where inotify is not available.
  */
 void
-mdm_daemon_config_parse (const char *config_file,
-			 gboolean    no_console)
+mdm_daemon_config_watch (void)
 {
-	uid_t         uid;
-	gid_t         gid;
+#ifdef HAVE_SYS_INOTIFY_H
+	GIOChannel *channel;
 
-	displays            = NULL;
-	high_display_num    = 0;
+	if (config_watch_fd >= 0)
+		return;
+
+	config_watch_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+	if (config_watch_fd < 0) {
+		mdm_error ("Cannot watch the configuration files: %s",
+			   strerror (errno));
+		return;
+	}
+
+	config_watch_add (default_config_file);
+	config_watch_add (MDM_DISTRO_CONF);
+	config_watch_add (custom_config_file);
+
+	channel = g_io_channel_unix_new (config_watch_fd);
+	config_watch_id = g_io_add_watch (channel,
+					  G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+					  config_watch_cb, NULL);
+	g_io_channel_unref (channel);
+#endif
+}
+
+void
+mdm_daemon_config_unwatch (void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	int i;
+
+	if (config_reload_id > 0) {
+		g_source_remove (config_reload_id);
+		config_reload_id = 0;
+	}
+
+	if (config_watch_id > 0) {
+		g_source_remove (config_watch_id);
+		config_watch_id = 0;
+	}
+
+	if (config_watch_fd >= 0) {
+		VE_IGNORE_EINTR (close (config_watch_fd));
+		config_watch_fd = -1;
+	}
+
+	for (i = 0; i < n_config_watches; i++)
+		g_free (config_watches[i].name);
+	n_config_watches = 0;
+#endif
+}
+
+static gboolean
+snapshot_rebuild (void)
+{
+	GHashTable *values;
+	int fd;
+	int i;
+
+	if (snapshot_generation == NULL) {
+		snapshot_generation = mdm_config_snapshot_generation_new (&snapshot_generation_fd);
+		if (snapshot_generation == NULL)
+			return FALSE;
+		snapshot_owner = getpid ();
+	}
+
+	values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	for (i = 0; mdm_daemon_config_entries[i].group != NULL; i++) {
+		const MdmConfigEntry *entry = &mdm_daemon_config_entries[i];
+		char *keystring;
+		char *value;
+
+		keystring = g_strdup_printf ("%s/%s", entry->group, entry->key);
+
+		/* Has to go through GET_CONFIG, see sup_handle_get_config */
+		if (is_key (keystring, MDM_KEY_PRE_FETCH_PROGRAM)) {
+			g_free (keystring);
+			continue;
+		}
+
+		/* Same answer as GET_CONFIG, "OK " for a key without a value */
+		if ( ! mdm_daemon_config_to_string (keystring, NULL, &value))
+			value = g_strdup ("");
 
+		g_hash_table_insert (values, keystring, value);
+	}
+
+	fd = mdm_config_snapshot_write (values, *snapshot_generation);
+	g_hash_table_destroy (values);
+
+	if (fd < 0) {
+		mdm_error ("Cannot write the configuration snapshot: %s",
+			   strerror (errno));
+		return FALSE;
+	}
+
+	if (snapshot_fd >= 0)
+		VE_IGNORE_EINTR (close (snapshot_fd));
+	snapshot_fd = fd;
+	snapshot_dirty = FALSE;
+
+	return TRUE;
+}
+
+/**
+ * mdm_daemon_config_prepare_snapshot
+ *
+ * Writes a new configuration snapshot if the configuration changed since
+ * the last one.  Called by the master before forking a slave, which then
+ * inherits the descriptors.
+ */
+void
+mdm_daemon_config_prepare_snapshot (void)
+{
+	if (snapshot_owner != 0 && getpid () != snapshot_owner)
+		return;
+
+	if (snapshot_dirty || snapshot_fd < 0)
+		snapshot_rebuild ();
+}
+
+/**
+ * mdm_daemon_config_has_per_display_config
+ *
+ * Returns TRUE if display has its own configuration file, whose greeter
+ * and gui keys override the ones the daemon has loaded.
+ */
+gboolean
+mdm_daemon_config_has_per_display_config (const char *display)
+{
+	char *file;
+	gboolean ret;
+
+	if (display == NULL)
+		return FALSE;
+
+	file = mdm_daemon_config_get_per_display_custom_config_file (display);
+	ret = g_file_test (file, G_FILE_TEST_EXISTS);
+	g_free (file);
+
+	return ret;
+}
+
+/**
+ * mdm_daemon_config_get_snapshot
+ *
+ * Returns the descriptors of the configuration snapshot for the
+ * greeter on display.  Returns FALSE when there is none, or when the
+ * display has its own configuration file, which the snapshot does not
+ * know about.
+ */
+gboolean
+mdm_daemon_config_get_snapshot (const char *display,
+				int        *fd,
+				int        *generation_fd)
+{
+	*fd = *generation_fd = -1;
+
+	if (snapshot_fd < 0 || snapshot_generation_fd < 0)
+		return FALSE;
+
+	if (mdm_daemon_config_has_per_display_config (display))
+		return FALSE;
+
+	*fd = snapshot_fd;
+	*generation_fd = snapshot_generation_fd;
+	return TRUE;
+}
+
+/**
+ * mdm_daemon_config_load
+ *
+ * Reads the configuration files and the server definitions only.  The
+ * displays, the MDM user and the permissions are left alone, so this
+ * also works outside of a real daemon.
+ */
+void
+mdm_daemon_config_load (const char *config_file)
+{
 	/* Not NULL if config_file was set by command-line option. */
 	if (config_file == NULL) {
 		config_file = MDM_DEFAULTS_CONF;
@@ -2139,6 +2599,24 @@ mdm_daemon_config_parse (const char *config_file,
 	mdm_daemon_load_config_file (&daemon_config);
 	mdm_config_set_notify_func (daemon_config, notify_cb, NULL);
 	mdm_daemon_config_load_xservers (daemon_config);
+}
+
+/**
+ * mdm_daemon_config_parse
+ *
+ * Loads initial configuration settings.
+ */
+void
+mdm_daemon_config_parse (const char *config_file,
+			 gboolean    no_console)
+{
+	uid_t         uid;
+	gid_t         gid;
+
+	displays            = NULL;
+	high_display_num    = 0;
+
+	mdm_daemon_config_load (config_file);
 
 	/* Only read the list if no_console is FALSE at this stage */
 	if (! no_console) {
@@ -31,6 +31,7 @@ const char *   mdm_daemon_config_get_string_for_id    (int id);
 gboolean       mdm_daemon_config_get_bool_for_id      (int id);
 int            mdm_daemon_config_get_int_for_id       (int id);
 
+void           mdm_daemon_config_load                 (const char *config_file);
 void           mdm_daemon_config_parse                (const char *config_file,
                                                        gboolean    no_console);
 MdmXserver *   mdm_daemon_config_find_xserver         (const char *id);
@@ -79,6 +80,13 @@ gboolean       mdm_daemon_config_to_string            (const char *key,
                                                        const char *display,
                                                        char **retval);
 gboolean       mdm_daemon_config_update_key           (const char *key);
+void           mdm_daemon_config_watch                (void);
+void           mdm_daemon_config_unwatch              (void);
+void           mdm_daemon_config_prepare_snapshot     (void);
+gboolean       mdm_daemon_config_get_snapshot         (const char *display,
+                                                       int *fd,
+                                                       int *generation_fd);
+gboolean       mdm_daemon_config_has_per_display_config (const char *display);
 
 
 int            mdm_daemon_config_compare_displays     (gconstpointer a,
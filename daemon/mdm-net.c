@@ -37,6 +37,7 @@
 #include "mdm.h"
 #include "misc.h"
 #include "mdm-net.h"
+#include "mdm-stats.h"
 
 #include "mdm-common.h"
 #include "mdm-log.h"
@@ -82,6 +83,9 @@ struct _MdmConnection {
 
 	GString *buffer;
 
+	GString *output; /* not sent yet, see mdm_connection_write */
+	guint output_source;
+
 	int message_count;
 
 	gboolean nonblock;
@@ -101,6 +105,8 @@ struct _MdmConnection {
 	gpointer close_data;
 	GDestroyNotify close_notify;
 
+	GSList *weak_pointers; /* set to NULL on close */
+
 	MdmConnection *parent;
 
 	GList *subconnections;
@@ -154,7 +160,7 @@ mdm_connection_handler (GIOChannel *source,
 	MdmConnection *conn = data;
 	char buf[PIPE_SIZE];
 	char *p;
-	size_t len;
+	ssize_t len;
 
 	if ( ! (cond & G_IO_IN))
 		return close_if_needed (conn, cond, FALSE);
@@ -205,33 +211,35 @@ mdm_connection_is_writable (MdmConnection *conn)
 	return conn->writable;
 }
 
-gboolean
-mdm_connection_write (MdmConnection *conn, const char *str)
+/*
+ * A client that does not read its answers must not hold up the master,
+ * which serves every display.  What the socket does not take right away
+ * is kept and sent from the main loop when the client reads again.  A
+ * client that lets more than this pile up gets disconnected.
+ */
+#define MAX_PENDING_OUTPUT (1024 * 1024)
+
+static ssize_t
+connection_send (MdmConnection *conn, const char *str, size_t len)
 {
-	int ret;
+	ssize_t ret;
 	int save_errno;
 	int flags = 0;
 #ifndef MSG_NOSIGNAL
 	void (*old_handler)(int);
 #endif
 
-	g_return_val_if_fail (conn != NULL, FALSE);
-	g_return_val_if_fail (str != NULL, FALSE);
-
-	if G_UNLIKELY ( ! conn->writable)
-		return FALSE;
-
 #ifdef MSG_DONTWAIT
 	if (conn->nonblock)
 		flags |= MSG_DONTWAIT;
 #endif
 
 #ifdef MSG_NOSIGNAL
-	VE_IGNORE_EINTR (ret = send (conn->fd, str, strlen (str), MSG_NOSIGNAL | flags));
+	VE_IGNORE_EINTR (ret = send (conn->fd, str, len, MSG_NOSIGNAL | flags));
 	save_errno = errno;
 #else
 	old_handler = signal (SIGPIPE, SIG_IGN);
-	VE_IGNORE_EINTR (ret = send (conn->fd, str, strlen (str), flags));
+	VE_IGNORE_EINTR (ret = send (conn->fd, str, len, flags));
 	save_errno = errno;
 	signal (SIGPIPE, old_handler);
 #endif
@@ -239,10 +247,129 @@ mdm_connection_write (MdmConnection *conn, const char *str)
 	/* just so that 'signal' doesn't whack it */
 	errno = save_errno;
 
-	if G_UNLIKELY (ret < 0)
+	return ret;
+}
+
+static gboolean
+mdm_connection_flush (GIOChannel *source,
+		      GIOCondition cond,
+		      gpointer data)
+{
+	MdmConnection *conn = data;
+	ssize_t ret = -1;
+
+	if ( ! (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL))) {
+		ret = connection_send (conn, conn->output->str, conn->output->len);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return TRUE;
+	}
+
+	if (ret >= 0) {
+		g_string_erase (conn->output, 0, ret);
+		if (conn->output->len > 0)
+			return TRUE;
+		conn->output_source = 0;
 		return FALSE;
-	else
-		return TRUE;
+	}
+
+	mdm_debug ("mdm_connection_flush: Client on %d went away", conn->fd);
+	g_string_truncate (conn->output, 0);
+	conn->output_source = 0;
+	/* like close_if_needed, the listening sockets stay */
+	if (conn->parent != NULL)
+		mdm_connection_close (conn);
+	return FALSE;
+}
+
+/* Keeps the rest of a reply for mdm_connection_flush */
+static gboolean
+connection_queue (MdmConnection *conn, const char *str, size_t len)
+{
+	GIOChannel *chan;
+
+	if (conn->output == NULL)
+		conn->output = g_string_new (NULL);
+
+	/* The caller may still use conn, so leave the close to the read
+	 * handler, which sees the hangup */
+	if (conn->output->len + len > MAX_PENDING_OUTPUT) {
+		mdm_debug ("mdm_connection_write: Client on %d is not reading, dropping it",
+			   conn->fd);
+		g_string_truncate (conn->output, 0);
+		conn->writable = FALSE;
+		shutdown (conn->fd, SHUT_RDWR);
+		return FALSE;
+	}
+
+	g_string_append_len (conn->output, str, len);
+
+	if (conn->output_source == 0) {
+		chan = g_io_channel_unix_new (conn->fd);
+		g_io_channel_set_encoding (chan, NULL, NULL);
+		g_io_channel_set_buffered (chan, FALSE);
+		conn->output_source = g_io_add_watch_full
+			(chan, G_PRIORITY_DEFAULT,
+			 G_IO_OUT|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
+			 mdm_connection_flush, conn, NULL);
+		g_io_channel_unref (chan);
+	}
+
+	return TRUE;
+}
+
+gboolean
+mdm_connection_write (MdmConnection *conn, const char *str)
+{
+	ssize_t ret;
+	size_t len;
+
+	g_return_val_if_fail (conn != NULL, FALSE);
+	g_return_val_if_fail (str != NULL, FALSE);
+
+	if G_UNLIKELY ( ! conn->writable)
+		return FALSE;
+
+	len = strlen (str);
+
+	/* Keep the order, behind what is already waiting */
+	if (conn->output != NULL && conn->output->len > 0)
+		return connection_queue (conn, str, len);
+
+	ret = connection_send (conn, str, len);
+	if G_UNLIKELY (ret < 0) {
+		if ( ! conn->nonblock ||
+		    (errno != EAGAIN && errno != EWOULDBLOCK))
+			return FALSE;
+		ret = 0;
+	}
+
+	if ((size_t) ret < len) {
+		/* a blocking send only comes back short on errors */
+		if ( ! conn->nonblock)
+			return FALSE;
+		return connection_queue (conn, str + ret, len - ret);
+	}
+
+	return TRUE;
+}
+
+/* Only sends what fits into the socket right away, for events that go to
+ * many clients.  Returns FALSE if not all of str went out. */
+gboolean
+mdm_connection_write_now (MdmConnection *conn, const char *str)
+{
+	size_t len;
+
+	g_return_val_if_fail (conn != NULL, FALSE);
+	g_return_val_if_fail (str != NULL, FALSE);
+
+	if G_UNLIKELY ( ! conn->writable ||
+		       (conn->output != NULL && conn->output->len > 0))
+		return FALSE;
+
+	len = strlen (str);
+
+	return (connection_send (conn, str, len) == (ssize_t) len);
 }
 
 static gboolean
@@ -266,9 +393,12 @@ mdm_socket_handler (GIOChannel *source,
 				   &addr_size));
 	if G_UNLIKELY (fd < 0) {
 		mdm_debug ("mdm_socket_handler: Rejecting connection");
+		mdm_stats_add (MDM_STAT_CONNECTIONS_REJECTED, 1);
 		return TRUE;
 	}
 
+	mdm_stats_add (MDM_STAT_CONNECTIONS, 1);
+
 	mdm_debug ("mdm_socket_handler: Accepting new connection fd %d", fd);
 
 	newconn = g_new0 (MdmConnection, 1);
@@ -302,6 +432,7 @@ mdm_socket_handler (GIOChannel *source,
 		conn->subconnections =
 			g_list_remove (conn->subconnections, old);
 		mdm_connection_close (old);
+		mdm_stats_add (MDM_STAT_CONNECTIONS_DROPPED, 1);
 	}
 
 	unixchan = g_io_channel_unix_new (newconn->fd);
@@ -535,11 +666,31 @@ mdm_connection_close (MdmConnection *conn)
 	}
 	conn->close_data = NULL;
 
+	while (conn->weak_pointers != NULL) {
+		MdmConnection **location = conn->weak_pointers->data;
+		*location = NULL;
+		conn->weak_pointers = g_slist_delete_link (conn->weak_pointers,
+							   conn->weak_pointers);
+	}
+
 	if (conn->buffer != NULL) {
 		g_string_free (conn->buffer, TRUE);
 		conn->buffer = NULL;
 	}
 
+	/* One last try for what the client did not read yet, such as
+	 * the error we close the connection with */
+	if (conn->output != NULL) {
+		if (conn->output->len > 0 && conn->fd >= 0)
+			connection_send (conn, conn->output->str, conn->output->len);
+		g_string_free (conn->output, TRUE);
+		conn->output = NULL;
+	}
+	if (conn->output_source > 0) {
+		g_source_remove (conn->output_source);
+		conn->output_source = 0;
+	}
+
 	if (conn->parent != NULL) {
 		conn->parent->subconnections =
 			g_list_remove (conn->parent->subconnections, conn);
@@ -590,6 +741,31 @@ mdm_connection_set_close_notify (MdmConnection *conn,
 	conn->close_notify = close_notify;
 }
 
+gboolean
+mdm_connection_has_close_notify (MdmConnection *conn)
+{
+	g_return_val_if_fail (conn != NULL, FALSE);
+	return conn->close_notify != NULL;
+}
+
+/* *location, which must point to conn, is set to NULL when conn is
+ * closed, for answers that are sent later from the main loop */
+void
+mdm_connection_add_weak_pointer (MdmConnection *conn,
+				 MdmConnection **location)
+{
+	g_return_if_fail (conn != NULL);
+	conn->weak_pointers = g_slist_prepend (conn->weak_pointers, location);
+}
+
+void
+mdm_connection_remove_weak_pointer (MdmConnection *conn,
+				    MdmConnection **location)
+{
+	g_return_if_fail (conn != NULL);
+	conn->weak_pointers = g_slist_remove (conn->weak_pointers, location);
+}
+
 gboolean 
 mdm_connection_printf (MdmConnection *conn, const gchar *format, ...)
 {
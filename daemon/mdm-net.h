@@ -42,6 +42,8 @@ typedef void (* MdmConnectionHandler) (MdmConnection *conn,
 gboolean	mdm_connection_is_writable (MdmConnection *conn);
 gboolean	mdm_connection_write (MdmConnection *conn,
 		                      const char *str);
+gboolean	mdm_connection_write_now (MdmConnection *conn,
+					  const char *str);
 gboolean	mdm_connection_printf (MdmConnection *conn,
 				       const gchar *format, ...)
 				       G_GNUC_PRINTF (2, 3);
@@ -55,6 +57,11 @@ MdmConnection *	mdm_connection_open_fifo (const char *fifo,
 void		mdm_connection_set_close_notify (MdmConnection *conn,
 						 gpointer close_data,
 						 GDestroyNotify close_notify);
+gboolean	mdm_connection_has_close_notify (MdmConnection *conn);
+void		mdm_connection_add_weak_pointer (MdmConnection *conn,
+						 MdmConnection **location);
+void		mdm_connection_remove_weak_pointer (MdmConnection *conn,
+						    MdmConnection **location);
 
 void		mdm_connection_set_handler (MdmConnection *conn,
 					    MdmConnectionHandler handler,
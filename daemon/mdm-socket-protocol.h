@@ -74,6 +74,7 @@
 #define MDM_INTERRUPT_THEME       'H'
 #define MDM_INTERRUPT_CANCEL      'X'
 #define MDM_INTERRUPT_SELECT_LANG 'O'
+#define MDM_INTERRUPT_LANG_CHANGED 'G' /* greeter relocalized itself, no restart */
 
 /* List delimiter for config file lists */
 #define MDM_DELIMITER_MODULES ":"
@@ -109,7 +110,8 @@
 	/* 4 = X too busy */
 	/* 5 = Nest display can't connect */
 #define MDM_SOP_FLEXI_OK     "FLEXI_OK" /* <slave pid> */
-#define MDM_SOP_START_NEXT_LOCAL "START_NEXT_LOCAL" /* no arguments */
+#define MDM_SOP_START_NEXT_LOCAL "START_NEXT_LOCAL" /* <slave pid> */
+#define MDM_SOP_STAT         "STAT" /* <slave pid> <name> <value> */
 
 /* write out a sessreg (xdm) compatible Xservers file
  * in the ServAuthDir as <name>.Xservers */
@@ -185,6 +187,24 @@
 #define MDM_SUP_LOGOUT_ACTION_SUSPEND	          "SUSPEND"
 #define MDM_SUP_QUERY_VT "QUERY_VT"
 #define MDM_SUP_SET_VT "SET_VT"
+/* GET_USERS [<offset> [<count> [<display>]]]
+ * OK <total>\t<login>\t<uid>\t<homedir>\t<gecos>\t<login>...
+ * every field is escaped with g_strescape */
+#define MDM_SUP_GET_USERS "GET_USERS"
+/* WATCH_DISPLAYS [<pattern>]
+ * OK <server>;<server>;...		(as ATTACHED_SERVERS)
+ * EVENT <event> <server>		(one line per change, until closed) */
+#define MDM_SUP_WATCH_DISPLAYS "WATCH_DISPLAYS"
+#define MDM_SUP_EVENT "EVENT"
+#define MDM_SUP_EVENT_ADDED	"ADDED"
+#define MDM_SUP_EVENT_REMOVED	"REMOVED"
+#define MDM_SUP_EVENT_LOGIN	"LOGIN"
+#define MDM_SUP_EVENT_LOGOUT	"LOGOUT"
+#define MDM_SUP_EVENT_VT	"VT"
+/* STATS
+ * OK displays.<state>=<n>;<counter>=<n>;latency.<name>=<count>,<sum>,<max>,<bucket>,...
+ * times in usec, see mdm-stats.h for the buckets */
+#define MDM_SUP_STATS "STATS"
 #define MDM_SUP_CLOSE        "CLOSE"
 
 /* User flags for the SUP protocol */
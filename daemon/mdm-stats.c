@@ -0,0 +1,196 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Counters and latency histograms for the STATS supervisor command.
+ * Everything is a fixed size array in the master, so recording a value
+ * never allocates.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "mdm-socket-protocol.h"
+
+#include "mdm-stats.h"
+
+typedef struct {
+	guint64 count;
+	guint64 sum;
+	guint64 max;
+	guint64 buckets[MDM_STATS_BUCKETS];
+} Histogram;
+
+static const char *counter_names[MDM_STAT_COUNTER_LAST] = {
+	"slaves.started",
+	"slaves.exits",
+	"slaves.crashes",
+	"connections.accepted",
+	"connections.rejected",
+	"connections.dropped",
+	"sup.messages",
+	"sup.rejected",
+	"session_output.bytes"
+};
+
+static const char *histogram_names[MDM_STAT_HISTOGRAM_LAST] = {
+	"x_start",
+	"greeter_start",
+	"pam_start",
+	"pam_session"
+};
+
+/* Commands not in here are all counted as OTHER */
+static const char *sup_commands[] = {
+	MDM_SUP_VERSION,
+	MDM_SUP_AUTH_LOCAL,
+	MDM_SUP_FLEXI_XSERVER,
+	MDM_SUP_ATTACHED_SERVERS,
+	MDM_SUP_GET_CONFIG,
+	MDM_SUP_GET_CONFIG_FILE,
+	MDM_SUP_GET_CUSTOM_CONFIG_FILE,
+	MDM_SUP_UPDATE_CONFIG,
+	MDM_SUP_GREETERPIDS,
+	MDM_SUP_QUERY_LOGOUT_ACTION,
+	MDM_SUP_SET_LOGOUT_ACTION,
+	MDM_SUP_SET_SAFE_LOGOUT_ACTION,
+	MDM_SUP_QUERY_VT,
+	MDM_SUP_SET_VT,
+	MDM_SUP_GET_USERS,
+	MDM_SUP_WATCH_DISPLAYS,
+	MDM_SUP_STATS,
+	MDM_SUP_CLOSE,
+	"OTHER"
+};
+#define N_SUP_COMMANDS G_N_ELEMENTS (sup_commands)
+
+static guint64   counters[MDM_STAT_COUNTER_LAST];
+static Histogram histograms[MDM_STAT_HISTOGRAM_LAST];
+static Histogram sup_histograms[N_SUP_COMMANDS];
+
+static void
+histogram_add (Histogram *h, gint64 usec)
+{
+	guint64 v = MAX (usec, 0);
+	guint i;
+
+	/* 64us << (i - 1) <= v < 64us << i */
+	i = (v >> 6) == 0 ? 0 : g_bit_storage (v >> 6);
+	if (i >= MDM_STATS_BUCKETS)
+		i = MDM_STATS_BUCKETS - 1;
+
+	h->count++;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+	h->buckets[i]++;
+}
+
+static void
+histogram_format (GString *str, const char *name, const Histogram *h)
+{
+	int i;
+
+	if (h->count == 0)
+		return;
+
+	g_string_append_printf (str, ";%s=%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+				",%" G_GUINT64_FORMAT,
+				name, h->count, h->sum, h->max);
+	for (i = 0; i < MDM_STATS_BUCKETS; i++)
+		g_string_append_printf (str, ",%" G_GUINT64_FORMAT, h->buckets[i]);
+}
+
+void
+mdm_stats_add (MdmStatCounter counter, guint64 n)
+{
+	g_return_if_fail (counter < MDM_STAT_COUNTER_LAST);
+
+	counters[counter] += n;
+}
+
+void
+mdm_stats_sample (MdmStatHistogram hist, gint64 usec)
+{
+	g_return_if_fail (hist < MDM_STAT_HISTOGRAM_LAST);
+
+	histogram_add (&histograms[hist], usec);
+}
+
+void
+mdm_stats_sup_sample (const char *msg, gint64 usec)
+{
+	size_t len = strcspn (msg, " ");
+	guint i;
+
+	for (i = 0; i < N_SUP_COMMANDS - 1; i++) {
+		if (strlen (sup_commands[i]) == len &&
+		    strncmp (msg, sup_commands[i], len) == 0)
+			break;
+	}
+
+	histogram_add (&sup_histograms[i], usec);
+}
+
+gboolean
+mdm_stats_report (const char *name, gint64 value)
+{
+	int i;
+
+	for (i = 0; i < MDM_STAT_HISTOGRAM_LAST; i++) {
+		if (strcmp (name, histogram_names[i]) == 0) {
+			histogram_add (&histograms[i], value);
+			return TRUE;
+		}
+	}
+
+	if (strcmp (name, counter_names[MDM_STAT_SESSION_OUTPUT_BYTES]) == 0) {
+		counters[MDM_STAT_SESSION_OUTPUT_BYTES] += MAX (value, 0);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+void
+mdm_stats_format (GString *str)
+{
+	guint i;
+
+	for (i = 0; i < MDM_STAT_COUNTER_LAST; i++)
+		g_string_append_printf (str, ";%s=%" G_GUINT64_FORMAT,
+					counter_names[i], counters[i]);
+
+	for (i = 0; i < MDM_STAT_HISTOGRAM_LAST; i++) {
+		char *name = g_strconcat ("latency.", histogram_names[i], NULL);
+
+		histogram_format (str, name, &histograms[i]);
+		g_free (name);
+	}
+
+	for (i = 0; i < N_SUP_COMMANDS; i++) {
+		char *name = g_strconcat ("latency.sup.", sup_commands[i], NULL);
+
+		histogram_format (str, name, &sup_histograms[i]);
+		g_free (name);
+	}
+}
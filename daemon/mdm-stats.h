@@ -0,0 +1,68 @@
+/* MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MDM_STATS_H
+#define MDM_STATS_H
+
+#include <glib.h>
+
+/* Latency histograms have this many buckets.  Bucket 0 counts samples
+ * below 64us, bucket i those below 64us << i and the last one all the
+ * rest (about 17s and up). */
+#define MDM_STATS_BUCKETS 20
+
+typedef enum {
+	MDM_STAT_SLAVES_STARTED,
+	MDM_STAT_SLAVE_EXITS,
+	MDM_STAT_SLAVE_CRASHES,
+	MDM_STAT_CONNECTIONS,		/* accepted on the supervisor socket */
+	MDM_STAT_CONNECTIONS_REJECTED,	/* accept failed */
+	MDM_STAT_CONNECTIONS_DROPPED,	/* closed to stay under the limit */
+	MDM_STAT_SUP_MESSAGES,
+	MDM_STAT_SUP_REJECTED,		/* too many messages, not authenticated */
+	MDM_STAT_SESSION_OUTPUT_BYTES,	/* reported by the slaves */
+	MDM_STAT_COUNTER_LAST
+} MdmStatCounter;
+
+/* All of these are reported by the slaves */
+typedef enum {
+	MDM_STAT_X_START,
+	MDM_STAT_GREETER_START,
+	MDM_STAT_PAM_START,
+	MDM_STAT_PAM_SESSION,
+	MDM_STAT_HISTOGRAM_LAST
+} MdmStatHistogram;
+
+/* Only the master keeps statistics, and only from its main loop, so
+ * updates are plain increments */
+void     mdm_stats_add        (MdmStatCounter    counter,
+			       guint64           n);
+void     mdm_stats_sample     (MdmStatHistogram  hist,
+			       gint64            usec);
+/* msg is the supervisor command line, only its first word is used */
+void     mdm_stats_sup_sample (const char       *msg,
+			       gint64            usec);
+/* A value sent by a slave, by name.  FALSE if the name is unknown. */
+gboolean mdm_stats_report     (const char       *name,
+			       gint64            value);
+
+/* Appends ";<name>=<value>" for every counter and
+ * ";<name>=<count>,<sum>,<max>,<bucket>,..." for every histogram that
+ * has samples, times in usec */
+void     mdm_stats_format     (GString          *str);
+
+#endif /* MDM_STATS_H */
@@ -0,0 +1,475 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The user index is the list of users the greeters show in their face
+ * browser.  Enumerating the passwd database can be very slow with LDAP
+ * or SSSD, so the daemon does it once, in small chunks from an idle
+ * handler so that it never blocks the main loop, and keeps the result
+ * in memory and in ServAuthDir.  Greeters fetch the whole list with a
+ * single GET_USERS command instead of walking getpwent themselves.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "mdm.h"
+#include "mdm-common.h"
+#include "mdm-daemon-config.h"
+#include "mdm-log.h"
+
+#include "mdm-user-index.h"
+
+#define USER_INDEX_HEADER	"MDM-USER-INDEX 1"
+/* How many passwd entries to look at per main loop iteration */
+#define USER_INDEX_CHUNK	64
+/* Way more than any passwd file */
+#define MAX_INDEX_SIZE		(16 * 1024 * 1024)
+/* Rescan in the background when the index is older than this */
+#define USER_INDEX_MAX_AGE	300
+
+extern pid_t mdm_main_pid;
+
+typedef struct {
+	char  *login;
+	uid_t  uid;
+	char  *homedir;
+	char  *gecos;
+} MdmUserIndexEntry;
+
+static GPtrArray  *users           = NULL;
+static char       *users_signature = NULL;
+static time_t      last_refresh    = 0;
+static time_t      passwd_mtime    = 0;
+
+/* state of the pass in progress */
+static guint       refresh_source  = 0;
+static GPtrArray  *pending         = NULL;
+static GHashTable *pending_seen    = NULL;
+static GHashTable *shells          = NULL;
+static char      **excludes        = NULL;
+static char      **includes        = NULL;
+static int         include_pos     = 0;
+static gboolean    include_all     = FALSE;
+
+static void
+entry_free (MdmUserIndexEntry *entry)
+{
+	g_free (entry->login);
+	g_free (entry->homedir);
+	g_free (entry->gecos);
+	g_free (entry);
+}
+
+static void
+entries_free (GPtrArray *array)
+{
+	if (array == NULL)
+		return;
+
+	g_ptr_array_foreach (array, (GFunc) entry_free, NULL);
+	g_ptr_array_free (array, TRUE);
+}
+
+static gint
+entry_compare (gconstpointer a, gconstpointer b)
+{
+	const MdmUserIndexEntry *ea = *(MdmUserIndexEntry * const *) a;
+	const MdmUserIndexEntry *eb = *(MdmUserIndexEntry * const *) b;
+
+	return strcmp (ea->login, eb->login);
+}
+
+static gboolean
+entries_equal (GPtrArray *a, GPtrArray *b)
+{
+	guint i;
+
+	if (a == NULL || b == NULL || a->len != b->len)
+		return FALSE;
+
+	for (i = 0; i < a->len; i++) {
+		MdmUserIndexEntry *ea = g_ptr_array_index (a, i);
+		MdmUserIndexEntry *eb = g_ptr_array_index (b, i);
+
+		if (ea->uid != eb->uid ||
+		    strcmp (ea->login, eb->login) != 0 ||
+		    strcmp (ea->homedir, eb->homedir) != 0 ||
+		    strcmp (ea->gecos, eb->gecos) != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static char *
+get_signature (void)
+{
+	return g_strdup_printf ("%d;%d;%d;%s;%s",
+				(int) mdm_daemon_config_get_value_bool (MDM_KEY_INCLUDE_ALL),
+				(int) mdm_daemon_config_get_value_bool (MDM_KEY_ALLOW_ROOT),
+				mdm_daemon_config_get_value_int (MDM_KEY_MINIMAL_UID),
+				ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_INCLUDE)),
+				ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_EXCLUDE)));
+}
+
+static char *
+get_index_file (void)
+{
+	return g_build_filename (mdm_daemon_config_get_value_string (MDM_KEY_SERV_AUTHDIR),
+				 MDM_USER_INDEX_FILE, NULL);
+}
+
+static time_t
+get_passwd_mtime (void)
+{
+	struct stat s;
+
+	if (g_stat ("/etc/passwd", &s) != 0)
+		return 0;
+
+	return s.st_mtime;
+}
+
+static void
+format_entry (GString *str, MdmUserIndexEntry *entry)
+{
+	char *login   = g_strescape (entry->login, NULL);
+	char *homedir = g_strescape (entry->homedir, NULL);
+	char *gecos   = g_strescape (entry->gecos, NULL);
+
+	g_string_append_printf (str, "\t%s\t%ld\t%s\t%s",
+				login, (long) entry->uid, homedir, gecos);
+
+	g_free (login);
+	g_free (homedir);
+	g_free (gecos);
+}
+
+static void
+save_index (void)
+{
+	GString *str;
+	char    *file;
+	char    *signature;
+	guint    i;
+
+	str = g_string_new (USER_INDEX_HEADER);
+	signature = g_strescape (users_signature, NULL);
+	g_string_append_printf (str, "\t%s\n", signature);
+	g_free (signature);
+
+	for (i = 0; i < users->len; i++) {
+		/* skip the leading tab */
+		gsize pos = str->len;
+		format_entry (str, g_ptr_array_index (users, i));
+		g_string_erase (str, pos, 1);
+		g_string_append_c (str, '\n');
+	}
+
+	file = get_index_file ();
+	if (g_file_set_contents (file, str->str, str->len, NULL))
+		g_chmod (file, 0640);
+	else
+		mdm_debug ("mdm_user_index: Cannot write %s", file);
+
+	g_free (file);
+	g_string_free (str, TRUE);
+}
+
+static void
+load_index (void)
+{
+	char   *file;
+	char   *contents;
+	char  **lines;
+	int     i;
+
+	/* It is served to the greeters as the user list, and ServAuthDir is
+	 * writable by the mdm group, so only take what we wrote */
+	file = get_index_file ();
+	contents = NULL;
+	if ( ! mdm_common_read_root_file (file, MAX_INDEX_SIZE, &contents, NULL)) {
+		g_free (file);
+		return;
+	}
+	g_free (file);
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	if (lines[0] == NULL ||
+	    strncmp (lines[0], USER_INDEX_HEADER "\t", strlen (USER_INDEX_HEADER "\t")) != 0) {
+		g_strfreev (lines);
+		return;
+	}
+
+	users_signature = g_strcompress (lines[0] + strlen (USER_INDEX_HEADER "\t"));
+	users = g_ptr_array_new ();
+
+	for (i = 1; lines[i] != NULL; i++) {
+		MdmUserIndexEntry *entry;
+		char **fields;
+
+		fields = g_strsplit (lines[i], "\t", 4);
+		if (mdm_vector_len (fields) == 4) {
+			entry = g_new0 (MdmUserIndexEntry, 1);
+			entry->login   = g_strcompress (fields[0]);
+			entry->uid     = (uid_t) strtol (fields[1], NULL, 10);
+			entry->homedir = g_strcompress (fields[2]);
+			entry->gecos   = g_strcompress (fields[3]);
+			g_ptr_array_add (users, entry);
+		}
+		g_strfreev (fields);
+	}
+
+	g_strfreev (lines);
+
+	mdm_debug ("mdm_user_index: Loaded %u users from disk", users->len);
+}
+
+static gboolean
+user_is_listed (struct passwd *pwent)
+{
+	const char * const lockout_passes[] = { "!!", NULL };
+	int i;
+
+	if (pwent->pw_shell == NULL ||
+	    g_hash_table_lookup (shells, pwent->pw_shell) == NULL)
+		return FALSE;
+
+	if ( ! mdm_daemon_config_get_value_bool (MDM_KEY_ALLOW_ROOT) && pwent->pw_uid == 0)
+		return FALSE;
+
+	if (pwent->pw_uid < mdm_daemon_config_get_value_int (MDM_KEY_MINIMAL_UID))
+		return FALSE;
+
+	for (i = 0; lockout_passes[i] != NULL; i++) {
+		if (pwent->pw_passwd != NULL &&
+		    strcmp (lockout_passes[i], pwent->pw_passwd) == 0)
+			return FALSE;
+	}
+
+	for (i = 0; excludes != NULL && excludes[i] != NULL; i++) {
+		if (g_ascii_strcasecmp (excludes[i], pwent->pw_name) == 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+add_user (struct passwd *pwent)
+{
+	MdmUserIndexEntry *entry;
+	char *p;
+
+	if ( ! user_is_listed (pwent) ||
+	    g_hash_table_lookup (pending_seen, pwent->pw_name) != NULL)
+		return;
+
+	entry = g_new0 (MdmUserIndexEntry, 1);
+	entry->login   = g_strdup (pwent->pw_name);
+	entry->uid     = pwent->pw_uid;
+	entry->homedir = g_strdup (ve_sure_string (pwent->pw_dir));
+	if (g_utf8_validate (ve_sure_string (pwent->pw_gecos), -1, NULL))
+		entry->gecos = g_strdup (ve_sure_string (pwent->pw_gecos));
+	else
+		entry->gecos = ve_locale_to_utf8 (pwent->pw_gecos);
+
+	/* Cut up to first comma, but only if there is more then one,
+	 * same heuristic as the greeters use */
+	p = strchr (entry->gecos, ',');
+	if (p != NULL && strchr (p + 1, ',') != NULL)
+		*p = '\0';
+
+	g_ptr_array_add (pending, entry);
+	g_hash_table_insert (pending_seen, entry->login, entry);
+}
+
+static void
+setup_pass (void)
+{
+	char *shell;
+	int   i;
+
+	pending = g_ptr_array_new ();
+	pending_seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* Read the shells once per pass and not once per user */
+	shells = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	setusershell ();
+	while ((shell = getusershell ()) != NULL) {
+		if (strcmp (shell, NOLOGIN) == 0 ||
+		    strcmp (shell, "/bin/true") == 0 ||
+		    strcmp (shell, "/bin/false") == 0)
+			continue;
+		g_hash_table_insert (shells, g_strdup (shell), GINT_TO_POINTER (1));
+	}
+	endusershell ();
+
+	excludes = g_strsplit (ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_EXCLUDE)), ",", 0);
+	for (i = 0; excludes[i] != NULL; i++)
+		g_strstrip (excludes[i]);
+
+	includes = g_strsplit (ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_INCLUDE)), ",", 0);
+	for (i = 0; includes[i] != NULL; i++)
+		g_strstrip (includes[i]);
+	include_pos = 0;
+
+	include_all = mdm_daemon_config_get_value_bool (MDM_KEY_INCLUDE_ALL);
+	if (include_all)
+		setpwent ();
+
+	g_free (users_signature);
+	users_signature = get_signature ();
+	passwd_mtime = get_passwd_mtime ();
+}
+
+static void
+finish_pass (void)
+{
+	if (include_all)
+		endpwent ();
+
+	g_ptr_array_sort (pending, entry_compare);
+
+	if (entries_equal (users, pending)) {
+		entries_free (pending);
+	} else {
+		mdm_debug ("mdm_user_index: User list changed, %u users", pending->len);
+		entries_free (users);
+		users = pending;
+		save_index ();
+	}
+	pending = NULL;
+
+	g_hash_table_destroy (pending_seen);
+	pending_seen = NULL;
+	g_hash_table_destroy (shells);
+	shells = NULL;
+	g_strfreev (excludes);
+	excludes = NULL;
+	g_strfreev (includes);
+	includes = NULL;
+
+	last_refresh = time (NULL);
+}
+
+static gboolean
+refresh_step (gpointer data)
+{
+	struct passwd *pwent;
+	int i;
+
+	/* Only the main daemon maintains the index, never a forked slave */
+	if (getpid () != mdm_main_pid) {
+		refresh_source = 0;
+		return FALSE;
+	}
+
+	for (i = 0; i < USER_INDEX_CHUNK; i++) {
+		if (include_all) {
+			pwent = getpwent ();
+			if (pwent == NULL)
+				break;
+		} else {
+			if (includes[include_pos] == NULL)
+				break;
+			pwent = ve_string_empty (includes[include_pos]) ?
+				NULL : getpwnam (includes[include_pos]);
+			include_pos++;
+			if (pwent == NULL)
+				continue;
+		}
+
+		add_user (pwent);
+	}
+
+	if (i < USER_INDEX_CHUNK) {
+		finish_pass ();
+		refresh_source = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * mdm_user_index_refresh
+ *
+ * Starts a background pass over the passwd database unless one is
+ * already running.  The current index keeps being served until the pass
+ * is complete.
+ */
+void
+mdm_user_index_refresh (void)
+{
+	if (refresh_source != 0)
+		return;
+
+	mdm_debug ("mdm_user_index: Starting refresh");
+
+	setup_pass ();
+	refresh_source = g_idle_add_full (G_PRIORITY_LOW, refresh_step, NULL, NULL);
+}
+
+void
+mdm_user_index_init (void)
+{
+	load_index ();
+	mdm_user_index_refresh ();
+}
+
+gboolean
+mdm_user_index_format (GString *str,
+		       guint    offset,
+		       guint    count)
+{
+	char  *signature;
+	guint  i;
+
+	/* Serve what we have, but get a fresh copy for the next greeter */
+	signature = get_signature ();
+	if (time (NULL) - last_refresh > USER_INDEX_MAX_AGE ||
+	    get_passwd_mtime () != passwd_mtime ||
+	    strcmp (signature, ve_sure_string (users_signature)) != 0)
+		mdm_user_index_refresh ();
+	g_free (signature);
+
+	if (users == NULL)
+		return FALSE;
+
+	g_string_append_printf (str, "%u", users->len);
+
+	for (i = offset; i < users->len && i - offset < count; i++)
+		format_entry (str, g_ptr_array_index (users, i));
+
+	return TRUE;
+}
@@ -0,0 +1,36 @@
+/* MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MDM_USER_INDEX_H
+#define MDM_USER_INDEX_H
+
+#include <glib.h>
+
+/* Name of the on-disk copy of the index inside ServAuthDir */
+#define MDM_USER_INDEX_FILE ".user-index"
+
+void     mdm_user_index_init       (void);
+void     mdm_user_index_refresh    (void);
+
+/* Appends "<total>" and then at most count records of
+ * "\t<login>\t<uid>\t<homedir>\t<gecos>" (g_strescape'd) starting at
+ * offset.  Returns FALSE if no index is available yet. */
+gboolean mdm_user_index_format     (GString *str,
+				    guint    offset,
+				    guint    count);
+
+#endif /* MDM_USER_INDEX_H */
@@ -66,6 +66,8 @@
 #include "cookie.h"
 #include "filecheck.h"
 #include "errorgui.h"
+#include "mdm-user-index.h"
+#include "mdm-stats.h"
 
 #include "mdm-socket-protocol.h"
 #include "mdm-daemon-config.h"
@@ -78,6 +80,8 @@ static void mdm_daemonify (void);
 static void mdm_safe_restart (void);
 static void mdm_try_logout_action (MdmDisplay *disp);
 static void mdm_restart_now (void);
+static void display_autopsy (MdmDisplay *d, int status);
+static gboolean display_recover (gpointer data);
 static void handle_flexi_server (MdmConnection *conn, int type, const gchar *server, gboolean handled, const gchar *username);
 
 /* Global vars */
@@ -178,26 +182,75 @@ mdm_daemonify (void)
 	mdm_open_dev_null (O_RDWR); /* open stderr - fd 2 */
 }
 
+/* When the static displays started coming up, for the boot timeline */
+static gint64 static_start_time = 0;
+static gboolean static_all_reported = FALSE;
+
+/* Another static display on the same device is still starting */
+static gboolean
+static_device_busy (MdmDisplay *d)
+{
+	GSList *li;
+
+	if (ve_string_empty (d->device_name))
+		return FALSE;
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+		MdmDisplay *other = li->data;
+
+		if (other != d &&
+		    other->starting &&
+		    ve_string_empty (other->device_name) == FALSE &&
+		    strcmp (other->device_name, d->device_name) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Starts unborn static displays, as many as ParallelStaticDisplays allows
+ * to be starting at once.  The default of 1 starts them one after another,
+ * each once the previous one sent START_NEXT_LOCAL.
+ */
 static void
 mdm_start_first_unborn_local (int delay)
 {
 	GSList *li;
 	GSList *displays;
+	int limit;
+	int starting = 0;
 
 	displays = mdm_daemon_config_get_display_list ();
+	limit = mdm_daemon_config_get_value_int (MDM_KEY_PARALLEL_STATIC_DISPLAYS);
 
 	/* tickle the random stuff */
 	mdm_random_tick ();
 
+	if (static_start_time == 0)
+		static_start_time = g_get_monotonic_time ();
+
+	for (li = displays; li != NULL; li = li->next) {
+		MdmDisplay *d = li->data;
+
+		if (d != NULL && d->starting)
+			starting++;
+	}
+
 	for (li = displays; li != NULL; li = li->next) {
 		MdmDisplay *d = li->data;
 
+		if (limit > 0 && starting >= limit)
+			break;
+
 		if (d != NULL &&
 		    d->type == TYPE_STATIC &&
-		    d->dispstat == DISPLAY_UNBORN) {
+		    d->dispstat == DISPLAY_UNBORN &&
+		    ! static_device_busy (d)) {
 			MdmXserver *svr;
 			mdm_debug ("mdm_start_first_unborn_local: "
-				   "Starting %s", d->name);
+				   "Starting %s at +%.2fs", d->name,
+				   (g_get_monotonic_time () - static_start_time) / (double) G_USEC_PER_SEC);
 
 			/* well sleep at least 'delay' seconds
 			 * before starting */
@@ -220,16 +273,49 @@ mdm_start_first_unborn_local (int delay)
 			} else {
 				/* only the first static display where
 				   we actually log in gets
-				   autologged in */
+				   autologged in.  The slaves forked
+				   after this one see FALSE */
 				if (svr != NULL &&
 				    svr->handled)
 					mdm_first_login = FALSE;
-				break;
+				d->starting = TRUE;
+				starting++;
 			}
 		}
 	}
 }
 
+/* The X server of a static display is up, or it never will be */
+static void
+static_display_ready (MdmDisplay *d, gboolean up)
+{
+	GSList *li;
+
+	if ( ! d->starting)
+		return;
+
+	d->starting = FALSE;
+
+	if (up)
+		mdm_debug ("static_display_ready: %s up at +%.2fs", d->name,
+			   (g_get_monotonic_time () - static_start_time) / (double) G_USEC_PER_SEC);
+
+	if (static_all_reported)
+		return;
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+		MdmDisplay *other = li->data;
+
+		if (other->type == TYPE_STATIC &&
+		    (other->starting || other->dispstat == DISPLAY_UNBORN))
+			return;
+	}
+
+	static_all_reported = TRUE;
+	mdm_info ("All static displays started in %.2fs",
+		  (g_get_monotonic_time () - static_start_time) / (double) G_USEC_PER_SEC);
+}
+
 void
 mdm_final_cleanup (void)
 {
@@ -288,6 +374,7 @@ mdm_final_cleanup (void)
 			}
 			first = FALSE;
 			mdm_display_unmanage (d);
+			mdm_display_wait_for_slaves ();
 		}
 		g_slist_free (list);
 	}	
@@ -325,11 +412,9 @@ mdm_final_cleanup (void)
 }
 
 static gboolean
-deal_with_x_crashes (MdmDisplay *d)
+try_failsafe_xserver (MdmDisplay *d)
 {
-	gboolean just_abort = FALSE;
 	const char *failsafe = mdm_daemon_config_get_value_string (MDM_KEY_FAILSAFE_XSERVER);
-	const char *keepscrashing = mdm_daemon_config_get_value_string (MDM_KEY_X_KEEPS_CRASHING);
 
 	if ( ! d->failsafe_xserver &&
 	     ! ve_string_empty (failsafe)) {
@@ -347,114 +432,93 @@ deal_with_x_crashes (MdmDisplay *d)
 		g_free (bin);
 	}
 
+	return FALSE;
+}
+
+/*
+ * Starts the XKeepsCrashing script for d, if there is one.  The display
+ * is picked up again in x_keeps_crashing_done once the script exits.
+ */
+static gboolean
+run_x_keeps_crashing (MdmDisplay *d)
+{
+	const char *keepscrashing = mdm_daemon_config_get_value_string (MDM_KEY_X_KEEPS_CRASHING);
+	pid_t pid;
+
 	/* Eeek X keeps crashing, let's try the XKeepsCrashing script */
-	if ( ! ve_string_empty (keepscrashing) &&
-	     g_access (keepscrashing, X_OK|R_OK) == 0) {
-		pid_t pid;
-
-		mdm_info ("deal_with_x_crashes: Running the XKeepsCrashing script");
-
-		extra_process = pid = fork ();
-		if (pid < 0)
-			extra_process = 0;
-
-		if (pid == 0) {
-			char *argv[2];
-			char *xlog = mdm_make_filename (mdm_daemon_config_get_value_string (MDM_KEY_LOG_DIR), d->name, ".log");
-
-			mdm_unset_signals ();
-
-			/* Also make a new process group so that we may use
-			 * kill -(extra_process) to kill extra process and all its
-			 * possible children */
-			setsid ();		
-
-			mdm_close_all_descriptors (0 /* from */, -1 /* except */, -1 /* except2 */);
-
-			/* No error checking here - if it's messed the best response
-			 * is to ignore & try to continue */
-			mdm_open_dev_null (O_RDONLY); /* open stdin - fd 0 */
-			mdm_open_dev_null (O_RDWR); /* open stdout - fd 1 */
-			mdm_open_dev_null (O_RDWR); /* open stderr - fd 2 */
-
-			argv[0] = (char *)mdm_daemon_config_get_value_string (MDM_KEY_X_KEEPS_CRASHING);
-			argv[1] = NULL;
-
-			mdm_restoreenv ();
-
-			/* unset DISPLAY and XAUTHORITY if they exist
-			 * so that gdialog (if used) doesn't get confused */
-			g_unsetenv ("DISPLAY");
-			g_unsetenv ("XAUTHORITY");
-
-			/* some promised variables */
-			g_setenv ("XLOG", xlog, TRUE);
-			g_setenv ("BINDIR", BINDIR, TRUE);
-			g_setenv ("SBINDIR", SBINDIR, TRUE);
-			g_setenv ("LIBEXECDIR", LIBEXECDIR, TRUE);
-			g_setenv ("SYSCONFDIR", MDMCONFDIR, TRUE);
-
-			/* To enable gettext stuff in the script */
-			g_setenv ("TEXTDOMAIN", GETTEXT_PACKAGE, TRUE);
-			g_setenv ("TEXTDOMAINDIR", GNOMELOCALEDIR, TRUE);
-
-			if ( ! mdm_ok_console_language ()) {
-				g_unsetenv ("LANG");
-				g_unsetenv ("LC_ALL");
-				g_unsetenv ("LC_MESSAGES");
-				g_setenv ("LANG", "C", TRUE);
-				g_setenv ("UNSAFE_TO_TRANSLATE", "yes", TRUE);
-			}
+	if (ve_string_empty (keepscrashing) ||
+	    g_access (keepscrashing, X_OK|R_OK) != 0)
+		return FALSE;
 
-			VE_IGNORE_EINTR (execv (argv[0], argv));
-
-			/* yaikes! */
-			_exit (32);
-		} else if (pid > 0) {
-			int status;
-
-			if (extra_process > 1) {
-				int ret;
-				int killsignal = SIGTERM;
-				int storeerrno;
-				errno = 0;
-				ret = waitpid (extra_process, &status, WNOHANG);
-				do {
-					/* wait for some signal, yes this is a race */
-					if (ret <= 0) {
-						mdm_debug("mdm deal_with_x_crashes: sleeping for 10 seconds");
-						sleep (10);
-					}
-					errno = 0;
-					ret = waitpid (extra_process, &status, WNOHANG);
-					storeerrno = errno;
-					if ((ret <= 0) && mdm_daemon_config_signal_terminthup_was_notified ()) {
-						kill (-(extra_process), killsignal);
-						killsignal = SIGKILL;
-					}
-				} while (ret == 0 || (ret < 0 && storeerrno == EINTR));
-			}
-			extra_process = 0;
-
-			if (WIFEXITED (status) &&
-			    WEXITSTATUS (status) == 0) {
-				/* Yay, the user wants to try again, so
-				 * here we go */
-				return TRUE;
-			} else if (WIFEXITED (status) &&
-				   WEXITSTATUS (status) == 32) {
-				/* We couldn't run the script, just drop through */
-				;
-			} else {
-				/* Things went wrong. */
-				just_abort = TRUE;
-			}
+	mdm_info ("deal_with_x_crashes: Running the XKeepsCrashing script");
+
+	pid = fork ();
+
+	if (pid == 0) {
+		char *argv[2];
+		char *xlog = mdm_make_filename (mdm_daemon_config_get_value_string (MDM_KEY_LOG_DIR), d->name, ".log");
+
+		mdm_unset_signals ();
+
+		/* Also make a new process group so that we may use
+		 * kill -(crash_script_pid) to kill the script and all its
+		 * possible children */
+		setsid ();		
+
+		mdm_close_all_descriptors (0 /* from */, -1 /* except */, -1 /* except2 */);
+
+		/* No error checking here - if it's messed the best response
+		 * is to ignore & try to continue */
+		mdm_open_dev_null (O_RDONLY); /* open stdin - fd 0 */
+		mdm_open_dev_null (O_RDWR); /* open stdout - fd 1 */
+		mdm_open_dev_null (O_RDWR); /* open stderr - fd 2 */
+
+		argv[0] = (char *)mdm_daemon_config_get_value_string (MDM_KEY_X_KEEPS_CRASHING);
+		argv[1] = NULL;
+
+		mdm_restoreenv ();
+
+		/* unset DISPLAY and XAUTHORITY if they exist
+		 * so that gdialog (if used) doesn't get confused */
+		g_unsetenv ("DISPLAY");
+		g_unsetenv ("XAUTHORITY");
+
+		/* some promised variables */
+		g_setenv ("XLOG", xlog, TRUE);
+		g_setenv ("BINDIR", BINDIR, TRUE);
+		g_setenv ("SBINDIR", SBINDIR, TRUE);
+		g_setenv ("LIBEXECDIR", LIBEXECDIR, TRUE);
+		g_setenv ("SYSCONFDIR", MDMCONFDIR, TRUE);
+
+		/* To enable gettext stuff in the script */
+		g_setenv ("TEXTDOMAIN", GETTEXT_PACKAGE, TRUE);
+		g_setenv ("TEXTDOMAINDIR", GNOMELOCALEDIR, TRUE);
+
+		if ( ! mdm_ok_console_language ()) {
+			g_unsetenv ("LANG");
+			g_unsetenv ("LC_ALL");
+			g_unsetenv ("LC_MESSAGES");
+			g_setenv ("LANG", "C", TRUE);
+			g_setenv ("UNSAFE_TO_TRANSLATE", "yes", TRUE);
 		}
 
-		/* if we failed to fork, or something else has happened,
-		 * we fall through to the other options below */
+		VE_IGNORE_EINTR (execv (argv[0], argv));
+
+		/* yaikes! */
+		_exit (32);
 	}
 
+	if (pid < 0)
+		return FALSE;
+
+	d->crash_script_pid = pid;
+	return TRUE;
+}
+
+/* Tells the user that X can not be started, and buries d */
+static void
+give_up_on_x (MdmDisplay *d, gboolean just_abort)
+{
 	/* if we have "open" we can talk to the user, not as user
 	 * friendly as the above script, but getting there */
 	if ( ! just_abort &&
@@ -477,9 +541,79 @@ deal_with_x_crashes (MdmDisplay *d)
 
 	mdm_error ("Failed to start X server several times in a short time period; disabling display %s", d->name);
 
-	return FALSE;
+	/*
+	 * An original way to deal with these things:
+	 * "Screw you guys, I'm going home!"
+	 */
+	mdm_display_unmanage (d);
+
+	/* If there are some pending statics, start them now */
+	mdm_start_first_unborn_local (3 /* delay */);
 }
 
+static MdmDisplay *
+x_keeps_crashing_lookup (pid_t pid)
+{
+	GSList *li;
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+		MdmDisplay *d = li->data;
+
+		if (d->crash_script_pid == pid)
+			return d;
+	}
+
+	return NULL;
+}
+
+static void
+x_keeps_crashing_done (MdmDisplay *d, int status)
+{
+	d->crash_script_pid = 0;
+
+	if (WIFEXITED (status) &&
+	    WEXITSTATUS (status) == 0) {
+		/* Yay, the user wants to try again, so
+		 * here we go */
+		mdm_debug ("mdm_child_action: Trying again");
+
+		/* reset */
+		d->x_faileds     = 0;
+		d->last_x_failed = 0;
+		d->last_loop_start_time = 0;
+
+		/* From here on as the remanage case of display_autopsy */
+		if (d->socket_conn != NULL) {
+			MdmConnection *conn = d->socket_conn;
+			d->socket_conn = NULL;
+			mdm_connection_set_close_notify (conn, NULL, NULL);
+			mdm_connection_write (conn, "ERROR 2 Startup errors\n");
+		}
+
+		mdm_try_logout_action (d);
+		mdm_safe_restart ();
+
+		if ( ! mdm_display_manage (d)) {
+			mdm_display_unmanage (d);
+			mdm_start_first_unborn_local (3 /* delay */);
+		}
+	} else if (WIFEXITED (status) &&
+		   WEXITSTATUS (status) == 32) {
+		/* We couldn't run the script, just drop through */
+		give_up_on_x (d, FALSE);
+	} else {
+		/* Things went wrong. */
+		give_up_on_x (d, TRUE);
+	}
+
+	/* What display_autopsy does last, a static display is still
+	 * around after mdm_display_unmanage */
+	mdm_try_logout_action (d);
+	mdm_safe_restart ();
+}
+
+
+
 static gboolean
 try_command (const char *command)
 {
@@ -545,7 +679,9 @@ suspend_machine (void)
 static void
 change_to_first_and_clear (gboolean restart)
 {
-	mdm_change_vt (1);
+	/* What is printed below has to end up on the console the user
+	   is looking at */
+	mdm_change_vt_and_wait (1);
 	VE_IGNORE_EINTR (close (0));
 	VE_IGNORE_EINTR (close (1));
 	VE_IGNORE_EINTR (close (2));
@@ -748,7 +884,6 @@ mdm_cleanup_children (void)
 	gint exitstatus = 0, status;
 	MdmDisplay *d = NULL;
 	gboolean crashed;
-	gboolean sysmenu;
 	pid_t pid;
 
 	/* Pid and exit status of slave that died */
@@ -789,12 +924,25 @@ mdm_cleanup_children (void)
 		return TRUE;
 	}
 
+	/* A slave we already let go of */
+	if (mdm_display_reap_slave (pid, exitstatus))
+		return TRUE;
+
+	/* An XKeepsCrashing script is done */
+	d = x_keeps_crashing_lookup (pid);
+	if (d != NULL) {
+		x_keeps_crashing_done (d, exitstatus);
+		return TRUE;
+	}
+
 	/* Find out who this slave belongs to */
 	d = mdm_display_lookup (pid);
 
 	if (d == NULL)
 		return TRUE;
 
+	mdm_stats_add (crashed ? MDM_STAT_SLAVE_CRASHES : MDM_STAT_SLAVE_EXITS, 1);
+
 	/* Whack connections about this display */
 	if (unixconn != NULL)
 		mdm_kill_subconnections_with_display (unixconn, d);
@@ -812,9 +960,6 @@ mdm_cleanup_children (void)
 		if (d->servpid > 1)
 			kill (d->servpid, SIGTERM);
 		d->servpid = 0;	
-
-		/* Race avoider */
-		mdm_sleep_no_signal (1);
 	}
 
 	/* null all these, they are not valid most definately */
@@ -824,12 +969,51 @@ mdm_cleanup_children (void)
 
 	/* definately not logged in now */
 	d->logged_in = FALSE;
-	g_free (d->login);
-	d->login = NULL;
+	if (d->login != NULL) {
+		g_free (d->login);
+		d->login = NULL;
+		mdm_display_watchers_notify (d, MDM_SUP_EVENT_LOGOUT);
+	}
 
 	/* Declare the display dead */
 	d->slavepid = 0;
 	d->dispstat = DISPLAY_DEAD;
+	static_display_ready (d, FALSE);
+
+	/* if we crashed clear the theme */
+	if (crashed) {
+		g_free (d->theme_name);
+		d->theme_name = NULL;
+
+		/* Race avoider: give the children we just killed a moment
+		 * to go away before anything is restarted on this display,
+		 * without holding up the other displays */
+		d->recovery_status = status;
+		d->recovery_id = g_timeout_add_seconds (1, display_recover, d);
+		return TRUE;
+	}
+
+	display_autopsy (d, status);
+
+	return TRUE;
+}
+
+static gboolean
+display_recover (gpointer data)
+{
+	MdmDisplay *d = data;
+
+	d->recovery_id = 0;
+	display_autopsy (d, d->recovery_status);
+
+	return FALSE;
+}
+
+/* Decides what happens to a display whose slave is gone */
+static void
+display_autopsy (MdmDisplay *d, int status)
+{
+	gboolean sysmenu;
 
 	/* Run SuperPost script */
 	mdm_exec_script ("/etc/mdm/SuperPost", "root", getpwnam("root"), FALSE /* pass_stdout */);
@@ -887,12 +1071,6 @@ mdm_cleanup_children (void)
 		d->try_different_greeter = FALSE;
 	}
 
-	/* if we crashed clear the theme */
-	if (crashed) {
-		g_free (d->theme_name);
-		d->theme_name = NULL;
-	}
-
  start_autopsy:
 
 	/* Autopsy */
@@ -964,18 +1142,13 @@ mdm_cleanup_children (void)
 				d->sleep_before_run = 3;
 			} else if (d->x_faileds >= 3) {
 				mdm_debug ("mdm_child_action: dealing with X crashes");
-				if ( ! deal_with_x_crashes (d)) {
-					mdm_debug ("mdm_child_action: Aborting display");
-					/*
-					 * An original way to deal with these
-					 * things:
-					 * "Screw you guys, I'm going home!"
-					 */
-					mdm_display_unmanage (d);
-
-					/* If there are some pending statics,
-					 * start them now */
-					mdm_start_first_unborn_local (3 /* delay */);
+				if ( ! try_failsafe_xserver (d)) {
+					/* The script decides later,
+					 * see x_keeps_crashing_done */
+					if ( ! run_x_keeps_crashing (d)) {
+						mdm_debug ("mdm_child_action: Aborting display");
+						give_up_on_x (d, FALSE);
+					}
 					break;
 				}
 				mdm_debug ("mdm_child_action: Trying again");
@@ -1065,8 +1238,6 @@ mdm_cleanup_children (void)
 
 	mdm_try_logout_action (d);
 	mdm_safe_restart ();
-
-	return TRUE;
 }
 
 static void
@@ -1629,6 +1800,12 @@ main (int argc, char *argv[])
 
 	create_connections ();
 
+	if (mdm_daemon_config_get_value_bool (MDM_KEY_WATCH_CONFIG))
+		mdm_daemon_config_watch ();
+
+	/* Start listing users for the greeters in the background */
+	mdm_user_index_init ();
+
 	/* make sure things (currently /tmp/.ICE-unix and /tmp/.X11-unix)
 	 * are sane */
 	mdm_ensure_sanity () ;
@@ -1983,8 +2160,12 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 		d = mdm_display_lookup (slave_pid);
 
 		if (d != NULL) {
+			gboolean changed = (d->vt != vt_num);
+
 			d->vt = vt_num;
 			mdm_debug ("Got VT_NUM == %d", vt_num);
+			if (changed)
+				mdm_display_watchers_notify (d, MDM_SUP_EVENT_VT);
 			/* send ack */
 			send_slave_ack (d, NULL);
 		}
@@ -2012,6 +2193,10 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 			g_free (d->login);
 			d->login = g_strdup (p);
 			mdm_debug ("Got LOGIN == %s", p);
+			/* The slave reports a logout as an empty login */
+			mdm_display_watchers_notify (d, ve_string_empty (p) ?
+						     MDM_SUP_EVENT_LOGOUT :
+						     MDM_SUP_EVENT_LOGIN);
 			/* send ack */
 			send_slave_ack (d, NULL);
 		}
@@ -2224,8 +2409,33 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 			/* send ack */
 			send_slave_ack (d, NULL);
 		}
-	} else if (strcmp (msg, MDM_SOP_START_NEXT_LOCAL) == 0) {
+	} else if (strncmp (msg, MDM_SOP_START_NEXT_LOCAL,
+			    strlen (MDM_SOP_START_NEXT_LOCAL)) == 0) {
+		MdmDisplay *d;
+		long slave_pid;
+
+		if (sscanf (msg, MDM_SOP_START_NEXT_LOCAL " %ld",
+			    &slave_pid) == 1) {
+			d = mdm_display_lookup (slave_pid);
+			if (d != NULL)
+				static_display_ready (d, TRUE);
+		}
+
 		mdm_start_first_unborn_local (3 /* delay */);
+	} else if (strncmp (msg, MDM_SOP_STAT " ",
+		            strlen (MDM_SOP_STAT " ")) == 0) {
+		long slave_pid;
+		char name[64];
+		gint64 value;
+
+		if (sscanf (msg, MDM_SOP_STAT " %ld %63s %" G_GINT64_FORMAT,
+			    &slave_pid, name, &value) != 3)
+			return;
+
+		/* No ack, the slave does not wait for one */
+		if (mdm_display_lookup (slave_pid) != NULL &&
+		    ! mdm_stats_report (name, value))
+			mdm_debug ("Unknown statistic %s", name);
 	} else if (strncmp (msg, MDM_SOP_WRITE_X_SERVERS " ",
 		            strlen (MDM_SOP_WRITE_X_SERVERS " ")) == 0) {
 		MdmDisplay *d;
@@ -2578,6 +2788,7 @@ handle_flexi_server (MdmConnection *conn, int type, const char *server, gboolean
 	if (conn != NULL)
 		mdm_connection_set_close_notify (conn, display, close_conn);
 	mdm_daemon_config_display_list_append (display);
+	mdm_display_watchers_notify (display, MDM_SUP_EVENT_ADDED);
 
 	if ( ! mdm_display_manage (display)) {
 		mdm_display_unmanage (display);
@@ -2645,48 +2856,171 @@ sup_handle_auth_local (MdmConnection *conn,
 	g_free (cookie);
 }
 
+/* Appends <display>,<logged in user>,<vt> */
 static void
-sup_handle_attached_servers (MdmConnection *conn,
-			     const char    *msg,
-			     gpointer       data)
+append_display_entry (GString *str, MdmDisplay *disp)
 {
-	GString *retMsg;
-	GSList  *li;
-	const gchar *sep = " ";
-	char    *key;
-	int     msgLen=0;
-	GSList *displays;
-
-	displays = mdm_daemon_config_get_display_list ();
+	g_string_append_printf (str, "%s,%s,%d",
+				ve_sure_string (disp->name),
+				ve_sure_string (disp->login),
+				disp->vt);
+}
 
-	if (strncmp (msg, MDM_SUP_ATTACHED_SERVERS,
-		     strlen (MDM_SUP_ATTACHED_SERVERS)) == 0)
-		msgLen = strlen (MDM_SUP_ATTACHED_SERVERS);	
+/* Returns NULL, matching everything, for an empty pattern */
+static GPatternSpec *
+display_pattern_new (const char *msg, const char *command)
+{
+	char *key;
+	GPatternSpec *spec = NULL;
 
-	key = g_strdup (&msg[msgLen]);
+	key = g_strdup (&msg[strlen (command)]);
 	g_strstrip (key);
+	if ( ! ve_string_empty (key))
+		spec = g_pattern_spec_new (key);
+	g_free (key);
 
-	retMsg = g_string_new ("OK");
-	for (li = displays; li != NULL; li = li->next) {
+	return spec;
+}
+
+static void
+append_attached_servers (GString *str, GPatternSpec *spec)
+{
+	GSList *li;
+	const gchar *sep = " ";
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
 		MdmDisplay *disp = li->data;
 
 		if ( ! disp->attached)
 			continue;
-		if (!(strlen (key)) || (g_pattern_match_simple (key, disp->command))) {
-			g_string_append_printf (retMsg, "%s%s,%s,", sep,
-						ve_sure_string (disp->name),
-						ve_sure_string (disp->login));
+		if (spec == NULL ||
+		    g_pattern_match_string (spec, ve_sure_string (disp->command))) {
+			g_string_append (str, sep);
+			append_display_entry (str, disp);
 			sep = ";";
-			g_string_append_printf (retMsg, "%d", disp->vt);			
 		}
 	}
+}
+
+static void
+sup_handle_attached_servers (MdmConnection *conn,
+			     const char    *msg,
+			     gpointer       data)
+{
+	GString *retMsg;
+	GPatternSpec *spec;
 
+	spec = display_pattern_new (msg, MDM_SUP_ATTACHED_SERVERS);
+
+	retMsg = g_string_new ("OK");
+	append_attached_servers (retMsg, spec);
 	g_string_append (retMsg, "\n");
 	mdm_connection_write (conn, retMsg->str);
-	g_free (key);
+
+	if (spec != NULL)
+		g_pattern_spec_free (spec);
 	g_string_free (retMsg, TRUE);
 }
 
+/*
+ * Connections that sent WATCH_DISPLAYS.  They stay open and get an
+ * EVENT line whenever an attached display they match changes.
+ */
+typedef struct {
+	MdmConnection *conn;
+	GPatternSpec  *spec;
+} DisplayWatcher;
+
+static GSList *display_watchers = NULL;
+
+static void
+display_watcher_closed (gpointer data)
+{
+	DisplayWatcher *watcher = data;
+
+	display_watchers = g_slist_remove (display_watchers, watcher);
+	if (watcher->spec != NULL)
+		g_pattern_spec_free (watcher->spec);
+	g_free (watcher);
+}
+
+void
+mdm_display_watchers_notify (MdmDisplay *disp, const char *event)
+{
+	GSList *li, *next;
+	GString *line = NULL;
+
+	if (display_watchers == NULL || ! disp->attached)
+		return;
+
+	for (li = display_watchers; li != NULL; li = next) {
+		DisplayWatcher *watcher = li->data;
+
+		next = li->next;
+
+		if (watcher->spec != NULL &&
+		    ! g_pattern_match_string (watcher->spec,
+					      ve_sure_string (disp->command)))
+			continue;
+
+		if (line == NULL) {
+			line = g_string_new (NULL);
+			g_string_printf (line, MDM_SUP_EVENT " %s ", event);
+			append_display_entry (line, disp);
+			g_string_append_c (line, '\n');
+		}
+
+		/* A watcher that does not keep up is dropped right
+		   away rather than queued for, it can always
+		   subscribe again */
+		if ( ! mdm_connection_write_now (watcher->conn, line->str)) {
+			mdm_debug ("Dropping display watcher, write failed");
+			mdm_connection_close (watcher->conn);
+		}
+	}
+
+	if (line != NULL)
+		g_string_free (line, TRUE);
+}
+
+static void
+sup_handle_watch_displays (MdmConnection *conn,
+			   const char    *msg,
+			   gpointer       data)
+{
+	DisplayWatcher *watcher;
+	GString *retMsg;
+
+	/* Setting our close notify would run the one the connection
+	   has now, e.g. tear down the flexi server it asked for */
+	if (mdm_connection_has_close_notify (conn)) {
+		mdm_connection_write (conn, "ERROR 1 Connection already in use\n");
+		return;
+	}
+
+	watcher = g_new0 (DisplayWatcher, 1);
+	watcher->conn = conn;
+	watcher->spec = display_pattern_new (msg, MDM_SUP_WATCH_DISPLAYS);
+
+	/* The snapshot, then events from here on */
+	retMsg = g_string_new ("OK");
+	append_attached_servers (retMsg, watcher->spec);
+	g_string_append (retMsg, "\n");
+
+	if ( ! mdm_connection_write (conn, retMsg->str)) {
+		g_string_free (retMsg, TRUE);
+		if (watcher->spec != NULL)
+			g_pattern_spec_free (watcher->spec);
+		g_free (watcher);
+		mdm_connection_close (conn);
+		return;
+	}
+	g_string_free (retMsg, TRUE);
+
+	display_watchers = g_slist_prepend (display_watchers, watcher);
+	mdm_connection_set_close_notify (conn, watcher, display_watcher_closed);
+}
+
 static void
 sup_handle_get_config (MdmConnection *conn,
 		       const char    *msg,
@@ -2880,6 +3214,46 @@ sup_handle_greeterpids (MdmConnection *conn,
 	g_string_free (reply, TRUE);
 }
 
+static void
+sup_handle_stats (MdmConnection *conn,
+		  const char    *msg,
+		  gpointer       data)
+{
+	GString *reply;
+	GSList *li;
+	int unborn = 0, alive = 0, dead = 0, configuring = 0, logged_in = 0;
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+		MdmDisplay *disp = li->data;
+
+		switch (disp->dispstat) {
+		case DISPLAY_UNBORN:
+			unborn++;
+			break;
+		case DISPLAY_ALIVE:
+			alive++;
+			break;
+		case DISPLAY_DEAD:
+			dead++;
+			break;
+		case DISPLAY_CONFIG:
+			configuring++;
+			break;
+		}
+		if (disp->logged_in)
+			logged_in++;
+	}
+
+	reply = g_string_new (NULL);
+	g_string_printf (reply, "OK displays.unborn=%d;displays.alive=%d;"
+			 "displays.dead=%d;displays.config=%d;displays.logged_in=%d",
+			 unborn, alive, dead, configuring, logged_in);
+	mdm_stats_format (reply);
+	g_string_append (reply, "\n");
+	mdm_connection_write (conn, reply->str);
+	g_string_free (reply, TRUE);
+}
+
 static void
 sup_handle_set_logout_action (MdmConnection *conn,
 			      const char    *msg,
@@ -3008,16 +3382,45 @@ sup_handle_query_vt (MdmConnection *conn,
 #endif
 }
 
+#if defined (MDM_USE_SYS_VT) || defined (MDM_USE_CONSIO_VT)
+/* Wakes up the display that just got switched to, then answers the
+ * SET_VT that asked for it, unless that connection is gone */
+static void
+vt_activated (int      vt,
+	      gboolean active,
+	      gpointer data)
+{
+	MdmConnection **conn = data;
+	GSList *li;
+
+	if (active) {
+		for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+			MdmDisplay *disp = li->data;
+			if (disp->vt == vt) {
+				send_slave_command (disp, MDM_NOTIFY_TWIDDLE_POINTER);
+				break;
+			}
+		}
+	}
+
+	if (*conn != NULL) {
+		mdm_connection_remove_weak_pointer (*conn, conn);
+		mdm_connection_write (*conn, active ? "OK\n" :
+				      "ERROR 10 Virtual terminal switch failed\n");
+	}
+	g_free (conn);
+}
+#endif
+
 static void
 sup_handle_set_vt (MdmConnection *conn,
 		   const char    *msg,
 		   gpointer       data)
 {
 	int vt;
-	GSList *li;
-	GSList *displays;
-
-	displays = mdm_daemon_config_get_display_list ();
+#if defined (MDM_USE_SYS_VT) || defined (MDM_USE_CONSIO_VT)
+	MdmConnection **request;
+#endif
 
 	if (sscanf (msg, MDM_SUP_SET_VT " %d", &vt) != 1 ||
 	    vt < 0) {
@@ -3034,32 +3437,56 @@ sup_handle_set_vt (MdmConnection *conn,
 	}
 
 #if defined (MDM_USE_SYS_VT) || defined (MDM_USE_CONSIO_VT)
-	mdm_change_vt (vt);
-	for (li = displays; li != NULL; li = li->next) {
-		MdmDisplay *disp = li->data;
-		if (disp->vt == vt) {
-			send_slave_command (disp, MDM_NOTIFY_TWIDDLE_POINTER);
-			break;
-		}
-	}
-	mdm_connection_write (conn, "OK\n");
+	/* Answered once the switch is done */
+	request = g_new (MdmConnection *, 1);
+	*request = conn;
+	mdm_connection_add_weak_pointer (conn, request);
+	mdm_change_vt_full (vt, vt_activated, request);
 #else
 	mdm_connection_write (conn, "ERROR 8 Virtual terminals not supported\n");
 #endif
 }
 
 static void
-mdm_handle_user_message (MdmConnection *conn,
-			 const char    *msg,
-			 gpointer       data)
+sup_handle_get_users (MdmConnection *conn,
+		      const char    *msg,
+		      gpointer       data)
 {
+	GString *reply;
+	guint offset = 0;
+	guint count = G_MAXUINT;
+	char display[256] = "";
 
-	mdm_debug ("Handling user message: '%s'", msg);
+	/* GET_USERS [<offset> [<count> [<display>]]] */
+	sscanf (msg, MDM_SUP_GET_USERS " %u %u %255s", &offset, &count, display);
+
+	/* The index only knows the global Include and Exclude lists,
+	   a display with its own has to make its list itself */
+	if (mdm_daemon_config_has_per_display_config (display[0] != '\0' ? display : NULL)) {
+		mdm_connection_write (conn, "ERROR 3 Display has its own configuration\n");
+		return;
+	}
+
+	reply = g_string_new ("OK ");
+	if (mdm_user_index_format (reply, offset, count)) {
+		g_string_append (reply, "\n");
+		mdm_connection_write (conn, reply->str);
+	} else {
+		mdm_connection_write (conn, "ERROR 2 User list not ready\n");
+	}
+	g_string_free (reply, TRUE);
+}
 
+static void
+dispatch_user_message (MdmConnection *conn,
+		       const char    *msg,
+		       gpointer       data)
+{
 	if (mdm_connection_get_message_count (conn) > MDM_SUP_MAX_MESSAGES) {
 		mdm_debug ("Closing connection, %d messages reached", MDM_SUP_MAX_MESSAGES);
 		mdm_connection_write (conn, "ERROR 200 Too many messages\n");
 		mdm_connection_close (conn);
+		mdm_stats_add (MDM_STAT_SUP_REJECTED, 1);
 		return;
 	}
 
@@ -3073,6 +3500,7 @@ mdm_handle_user_message (MdmConnection *conn,
 		if ( ! MDM_CONN_AUTHENTICATED (conn)) {
 			mdm_info ("%s request denied: Not authenticated", "FLEXI_XSERVER");
 			mdm_connection_write (conn, "ERROR 100 Not authenticated\n");
+			mdm_stats_add (MDM_STAT_SUP_REJECTED, 1);
 			return;
 		}
 
@@ -3083,6 +3511,12 @@ mdm_handle_user_message (MdmConnection *conn,
 
 		sup_handle_attached_servers (conn, msg, data);
 
+	} else if (strcmp (msg, MDM_SUP_WATCH_DISPLAYS) == 0 ||
+		   strncmp (msg, MDM_SUP_WATCH_DISPLAYS " ",
+			    strlen (MDM_SUP_WATCH_DISPLAYS " ")) == 0) {
+
+		sup_handle_watch_displays (conn, msg, data);
+
 	} else if (strcmp (msg, MDM_SUP_GREETERPIDS) == 0) {
 
 		sup_handle_greeterpids (conn, msg, data);
@@ -3139,6 +3573,16 @@ mdm_handle_user_message (MdmConnection *conn,
 			    strlen (MDM_SUP_SET_VT " ")) == 0) {
 
 		sup_handle_set_vt (conn, msg, data);	
+	} else if (strcmp (msg, MDM_SUP_GET_USERS) == 0 ||
+		   strncmp (msg, MDM_SUP_GET_USERS " ",
+			    strlen (MDM_SUP_GET_USERS " ")) == 0) {
+
+		sup_handle_get_users (conn, msg, data);
+
+	} else if (strcmp (msg, MDM_SUP_STATS) == 0) {
+
+		sup_handle_stats (conn, msg, data);
+
 	} else if (strcmp (msg, MDM_SUP_VERSION) == 0) {
 		mdm_connection_write (conn, "MDM " VERSION "\n");
 	} else if (strcmp (msg, MDM_SUP_CLOSE) == 0) {
@@ -3148,3 +3592,20 @@ mdm_handle_user_message (MdmConnection *conn,
 		mdm_connection_close (conn);
 	}
 }
+
+static void
+mdm_handle_user_message (MdmConnection *conn,
+			 const char    *msg,
+			 gpointer       data)
+{
+	gint64 start;
+
+	mdm_debug ("Handling user message: '%s'", msg);
+
+	/* msg stays valid even if the connection gets closed, the close
+	 * is deferred until we return */
+	start = g_get_monotonic_time ();
+	dispatch_user_message (conn, msg, data);
+	mdm_stats_add (MDM_STAT_SUP_MESSAGES, 1);
+	mdm_stats_sup_sample (msg, g_get_monotonic_time () - start);
+}
@@ -30,6 +30,7 @@
 #include <dbus/dbus.h>
 #include <dbus/dbus-glib-lowlevel.h>
 
+#include "mdm-common.h"
 #include "mdm-log.h" /* for mdm_debug */
 #include "mdmconsolekit.h"
 
@@ -41,7 +42,33 @@
 #define CK_MANAGER_INTERFACE "org.freedesktop.ConsoleKit.Manager"
 #define CK_SESSION_INTERFACE "org.freedesktop.ConsoleKit.Session"
 
+#define LOGIN1_NAME              "org.freedesktop.login1"
+#define LOGIN1_MANAGER_PATH      "/org/freedesktop/login1"
+#define LOGIN1_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define LOGIN1_SESSION_INTERFACE "org.freedesktop.login1.Session"
+
+#define PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+
+/*
+ * How long to wait for an answer.  A hung session service must not
+ * keep the session from starting.
+ */
+#define CALL_TIMEOUT_MSEC 10000
+
+/*
+ * One private system bus connection for the life of the slave.
+ * ConsoleKit closes a session when the connection that opened it goes
+ * away, so it is only closed along with the session.
+ */
 static DBusConnection *private_connection = NULL;
+static int             call_timeout = CALL_TIMEOUT_MSEC;
+
+/*
+ * The slave has no main loop of its own.  The connection is attached to
+ * this context, which only ever has its watches and timeouts, and the
+ * answers are handled by notify functions while calls_wait runs it.
+ */
+static GMainContext   *call_context = NULL;
 
 static void
 add_param_int (DBusMessageIter *iter_struct,
@@ -139,263 +166,570 @@ add_param_string (DBusMessageIter *iter_struct,
 	dbus_message_iter_close_container (iter_struct, &iter_struct_entry);
 }
 
-static gboolean
-session_get_x11_display (DBusConnection *connection,
-			 const char     *ssid,
-			 char          **str)
+static DBusConnection *
+get_connection (void)
 {
-	DBusError       error;
-	DBusMessage    *message;
-	DBusMessage    *reply;
-	DBusMessageIter iter;
-	const char     *value;
+	DBusError error;
 
-	if (str != NULL) {
-		*str = NULL;
-	}
+	if (private_connection != NULL) {
+		if (dbus_connection_get_is_connected (private_connection))
+			return private_connection;
 
-	message = dbus_message_new_method_call (CK_NAME,
-						ssid,
-						CK_SESSION_INTERFACE,
-						"GetX11Display");
-	if (message == NULL) {
-		mdm_debug ("ConsoleKit: Couldn't allocate the D-Bus message");
-		return FALSE;
+		dbus_connection_close (private_connection);
+		dbus_connection_unref (private_connection);
+		private_connection = NULL;
 	}
 
 	dbus_error_init (&error);
-	reply = dbus_connection_send_with_reply_and_block (connection,
-							   message,
-							   -1, &error);
-	if (dbus_error_is_set (&error)) {
-		mdm_debug ("ConsoleKit: %s raised:\n %s\n\n", error.name, error.message);
-		reply = NULL;
+	private_connection = dbus_bus_get_private (DBUS_BUS_SYSTEM, &error);
+	if (private_connection == NULL) {
+		mdm_debug ("ConsoleKit: Failed to connect to the D-Bus daemon: %s", error.message);
+		dbus_error_free (&error);
+		return NULL;
 	}
 
-	dbus_connection_flush (connection);
-	dbus_message_unref (message);
+	if (call_context == NULL)
+		call_context = g_main_context_new ();
 
-	if (reply == NULL) {
-		return FALSE;
-	}
-
-	dbus_message_iter_init (reply, &iter);
-	dbus_message_iter_get_basic (&iter, &value);
-	if (str != NULL) {
-		*str = g_strdup (value);
-	}
-	dbus_message_unref (reply);
+	dbus_connection_set_exit_on_disconnect (private_connection, FALSE);
+	dbus_connection_setup_with_g_main (private_connection, call_context);
 
-	return TRUE;
+	return private_connection;
 }
 
+/*
+ * Sends message and has func called with the answer, or with an error
+ * once call_timeout has passed.  *outstanding counts the calls func has
+ * not run for yet, func must decrement it.  free_data is called on data
+ * once func ran or the call could not be sent.
+ */
 static gboolean
-session_unlock (DBusConnection *connection,
-		const char     *ssid)
+call_start (DBusConnection               *connection,
+	    DBusMessage                  *message,
+	    int                          *outstanding,
+	    DBusPendingCallNotifyFunction func,
+	    gpointer                      data,
+	    DBusFreeFunction              free_data)
 {
-	DBusError       error;
-	DBusMessage    *message;
-	DBusMessage    *reply;
+	DBusPendingCall *pending = NULL;
 
-	mdm_debug ("ConsoleKit: Unlocking session %s", ssid);
-	message = dbus_message_new_method_call (CK_NAME,
-						ssid,
-						CK_SESSION_INTERFACE,
-						"Unlock");
 	if (message == NULL) {
 		mdm_debug ("ConsoleKit: Couldn't allocate the D-Bus message");
+		if (free_data != NULL)
+			(* free_data) (data);
 		return FALSE;
 	}
 
-	dbus_error_init (&error);
-	reply = dbus_connection_send_with_reply_and_block (connection,
-							   message,
-							   -1, &error);
-	dbus_message_unref (message);
-	dbus_message_unref (reply);
-	dbus_connection_flush (connection);
-
-	if (dbus_error_is_set (&error)) {
-		mdm_debug ("ConsoleKit: %s raised:\n %s\n\n", error.name, error.message);
+	if ( ! dbus_connection_send_with_reply (connection, message,
+						&pending, call_timeout) ||
+	    pending == NULL ||
+	    ! dbus_pending_call_set_notify (pending, func, data, free_data)) {
+		mdm_debug ("ConsoleKit: Couldn't send %s",
+			   dbus_message_get_member (message));
+		if (pending != NULL) {
+			dbus_pending_call_cancel (pending);
+			dbus_pending_call_unref (pending);
+		}
+		dbus_message_unref (message);
+		if (free_data != NULL)
+			(* free_data) (data);
 		return FALSE;
 	}
+	dbus_message_unref (message);
+
+	(*outstanding)++;
+
+	/* set_notify does not run func for a call that is already over */
+	if (dbus_pending_call_get_completed (pending))
+		(* func) (pending, data);
+
+	/* the connection keeps it until it completes */
+	dbus_pending_call_unref (pending);
 
 	return TRUE;
 }
 
-/* from libhal */
-static char **
-get_path_array_from_iter (DBusMessageIter *iter,
-			  int             *num_elements)
+/* Handles the answers until no call is outstanding any more.  Every call
+ * completes, at the latest with a timeout error. */
+static void
+calls_wait (DBusConnection *connection,
+	    int            *outstanding)
 {
-	int count;
-	char **buffer;
+	dbus_connection_flush (connection);
 
-	count = 0;
-	buffer = (char **)malloc (sizeof (char *) * 8);
+	while (*outstanding > 0)
+		g_main_context_iteration (call_context, TRUE);
+}
 
-	if (buffer == NULL)
-		goto oom;
+static gboolean
+wait_timed_out (gpointer data)
+{
+	gboolean *timed_out = data;
 
-	buffer[0] = NULL;
-	while (dbus_message_iter_get_arg_type (iter) == DBUS_TYPE_OBJECT_PATH) {
-		const char *value;
-		char *str;
+	*timed_out = TRUE;
 
-		if ((count % 8) == 0 && count != 0) {
-			buffer = realloc (buffer, sizeof (char *) * (count + 8));
-			if (buffer == NULL)
-				goto oom;
-		}
+	return FALSE;
+}
 
-		dbus_message_iter_get_basic (iter, &value);
-		str = strdup (value);
-		if (str == NULL)
-			goto oom;
+/* Like calls_wait, but gives up after msec even when calls that started
+ * from the answers are still outstanding.  Returns FALSE then. */
+static gboolean
+calls_wait_bounded (DBusConnection *connection,
+		    int            *outstanding,
+		    int             msec)
+{
+	GSource *source;
+	gboolean timed_out = FALSE;
 
-		buffer[count] = str;
+	dbus_connection_flush (connection);
 
-		dbus_message_iter_next (iter);
-		count++;
-	}
+	source = g_timeout_source_new (msec);
+	g_source_set_callback (source, wait_timed_out, &timed_out, NULL);
+	g_source_attach (source, call_context);
+
+	while (*outstanding > 0 && ! timed_out)
+		g_main_context_iteration (call_context, TRUE);
+
+	g_source_destroy (source);
+	g_source_unref (source);
 
-	if ((count % 8) == 0) {
-		buffer = realloc (buffer, sizeof (char *) * (count + 1));
-		if (buffer == NULL)
-			goto oom;
+	return *outstanding == 0;
+}
+
+/* In a notify function, the answer, or NULL on errors and timeouts */
+static DBusMessage *
+call_reply (DBusPendingCall *pending)
+{
+	DBusError    error;
+	DBusMessage *reply;
+
+	reply = dbus_pending_call_steal_reply (pending);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_error_init (&error);
+	if (dbus_set_error_from_message (&error, reply)) {
+		mdm_debug ("ConsoleKit: %s raised:\n %s\n\n", error.name, error.message);
+		dbus_error_free (&error);
+		dbus_message_unref (reply);
+		return NULL;
 	}
 
-	buffer[count] = NULL;
-	if (num_elements != NULL)
-		*num_elements = count;
-	return buffer;
+	return reply;
+}
+
+/* For calls that only one answer is waited for */
+typedef struct {
+	int          outstanding;
+	DBusMessage *reply;
+} SingleCall;
 
-oom:
-	mdm_debug ("%s %d : error allocating memory\n", __FILE__, __LINE__);
-	return NULL;
+static void
+single_call_done (DBusPendingCall *pending,
+		  void            *data)
+{
+	SingleCall *call = data;
 
+	call->reply = call_reply (pending);
+	call->outstanding--;
 }
 
-static char **
-get_sessions_for_user (DBusConnection *connection,
-		       const char     *user,
-		       const char     *x11_display)
+static DBusMessage *
+call_and_wait (DBusConnection *connection,
+	       DBusMessage    *message)
+{
+	SingleCall call = { 0, NULL };
+
+	if (call_start (connection, message, &call.outstanding,
+			single_call_done, &call, NULL))
+		calls_wait (connection, &call.outstanding);
+
+	return call.reply;
+}
+
+/* Returns the first argument of reply if it is a string, or NULL */
+static char *
+reply_get_string (DBusMessage *reply)
 {
-	DBusError       error;
-	DBusMessage    *message;
-	DBusMessage    *reply;
 	DBusMessageIter iter;
-	DBusMessageIter iter_reply;
-	DBusMessageIter iter_array;
-	struct passwd	*pwent;
-	char           **sessions;
+	const char     *value;
 
-	sessions = NULL;
-	message = NULL;
-	reply = NULL;
+	if (reply == NULL)
+		return NULL;
 
-	pwent = getpwnam (user);
+	if ( ! dbus_message_iter_init (reply, &iter))
+		return NULL;
 
-	dbus_error_init (&error);
-	message = dbus_message_new_method_call (CK_NAME,
-						CK_MANAGER_PATH,
-						CK_MANAGER_INTERFACE,
-						"GetSessionsForUser");
-	if (message == NULL) {
-		mdm_debug ("ConsoleKit: Couldn't allocate the D-Bus message");
-		goto out;
+	if (dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_VARIANT) {
+		DBusMessageIter iter_var;
+
+		dbus_message_iter_recurse (&iter, &iter_var);
+		iter = iter_var;
 	}
 
-	dbus_message_iter_init_append (message, &iter);
-	dbus_message_iter_append_basic (&iter,
-					DBUS_TYPE_UINT32,
-					&pwent->pw_uid);
+	if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_STRING)
+		return NULL;
 
-	dbus_error_init (&error);
-	reply = dbus_connection_send_with_reply_and_block (connection,
-							   message,
-							   -1, &error);
-	dbus_connection_flush (connection);
+	dbus_message_iter_get_basic (&iter, &value);
+	return g_strdup (value);
+}
 
-	if (dbus_error_is_set (&error)) {
-		mdm_debug ("ConsoleKit: %s raised:\n %s\n\n", error.name, error.message);
-		goto out;
+/*
+ * The unlock is a chain of calls: which sessions does the user have, on
+ * which displays are they, unlock those on x11_display.  Each answer
+ * starts the next calls right away, so every step of the chain costs one
+ * round trip however many sessions the user has.  The slave only waits
+ * call_timeout for the whole chain; a request it gave up on is freed
+ * once its last answer came in.
+ */
+typedef struct {
+	DBusConnection *connection;
+	char           *user;
+	uid_t           uid;
+	char           *x11_display;
+	int             outstanding;
+	gboolean        abandoned;
+} UnlockRequest;
+
+static void
+unlock_request_free (UnlockRequest *request)
+{
+	g_free (request->user);
+	g_free (request->x11_display);
+	g_free (request);
+}
+
+/* Every notify function of the chain ends with this */
+static void
+unlock_request_call_done (UnlockRequest *request)
+{
+	request->outstanding--;
+
+	if (request->outstanding == 0 && request->abandoned)
+		unlock_request_free (request);
+}
+
+typedef struct {
+	UnlockRequest *request;
+	char          *id;	/* the logind session id */
+	char          *path;
+} UnlockSession;
+
+static UnlockSession *
+unlock_session_new (UnlockRequest *request,
+		    const char    *id,
+		    const char    *path)
+{
+	UnlockSession *session = g_new0 (UnlockSession, 1);
+
+	session->request = request;
+	session->id = g_strdup (id);
+	session->path = g_strdup (path);
+
+	return session;
+}
+
+static void
+unlock_session_free (void *data)
+{
+	UnlockSession *session = data;
+
+	g_free (session->id);
+	g_free (session->path);
+	g_free (session);
+}
+
+static void
+unlock_done (DBusPendingCall *pending,
+	     void            *data)
+{
+	UnlockRequest *request = data;
+	DBusMessage   *reply;
+
+	reply = call_reply (pending);
+	if (reply != NULL)
+		dbus_message_unref (reply);
+	else
+		mdm_error ("ConsoleKit: Unable to unlock a session of %s", request->user);
+
+	unlock_request_call_done (request);
+}
+
+static void
+ck_display_done (DBusPendingCall *pending,
+		 void            *data)
+{
+	UnlockSession *session = data;
+	UnlockRequest *request = session->request;
+	DBusMessage   *reply;
+	char          *xdisplay;
+
+	reply = call_reply (pending);
+	xdisplay = reply_get_string (reply);
+	if (reply != NULL)
+		dbus_message_unref (reply);
+
+	mdm_debug ("ConsoleKit: session %s has DISPLAY %s",
+		   session->path, ve_sure_string (xdisplay));
+
+	if (xdisplay != NULL && strcmp (xdisplay, request->x11_display) == 0) {
+		mdm_debug ("ConsoleKit: Unlocking session %s", session->path);
+		call_start (request->connection,
+			    dbus_message_new_method_call (CK_NAME,
+							  session->path,
+							  CK_SESSION_INTERFACE,
+							  "Unlock"),
+			    &request->outstanding,
+			    unlock_done, request, NULL);
+		dbus_connection_flush (request->connection);
 	}
+	g_free (xdisplay);
+
+	unlock_request_call_done (request);
+}
 
-	if (reply == NULL) {
-		mdm_debug ("ConsoleKit: No reply for GetSessionsForUser");
+static void
+ck_sessions_done (DBusPendingCall *pending,
+		  void            *data)
+{
+	UnlockRequest  *request = data;
+	DBusMessage    *reply;
+	DBusMessageIter iter_reply;
+	DBusMessageIter iter_array;
+
+	reply = call_reply (pending);
+	if (reply == NULL)
 		goto out;
-	}
 
 	dbus_message_iter_init (reply, &iter_reply);
 	if (dbus_message_iter_get_arg_type (&iter_reply) != DBUS_TYPE_ARRAY) {
 		mdm_debug ("ConsoleKit: Wrong reply for GetSessionsForUser - expecting an array.");
+		dbus_message_unref (reply);
 		goto out;
 	}
 
 	dbus_message_iter_recurse (&iter_reply, &iter_array);
-	sessions = get_path_array_from_iter (&iter_array, NULL);
+	while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_OBJECT_PATH) {
+		const char *path;
+
+		dbus_message_iter_get_basic (&iter_array, &path);
+		call_start (request->connection,
+			    dbus_message_new_method_call (CK_NAME,
+							  path,
+							  CK_SESSION_INTERFACE,
+							  "GetX11Display"),
+			    &request->outstanding,
+			    ck_display_done,
+			    unlock_session_new (request, NULL, path),
+			    unlock_session_free);
+
+		dbus_message_iter_next (&iter_array);
+	}
+	dbus_message_unref (reply);
+	dbus_connection_flush (request->connection);
 
  out:
+	unlock_request_call_done (request);
+}
+
+static void
+login1_display_done (DBusPendingCall *pending,
+		     void            *data)
+{
+	UnlockSession *session = data;
+	UnlockRequest *request = session->request;
+	DBusMessage   *reply;
+	char          *xdisplay;
+
+	reply = call_reply (pending);
+	xdisplay = reply_get_string (reply);
+	if (reply != NULL)
+		dbus_message_unref (reply);
+
+	mdm_debug ("logind: session %s has DISPLAY %s",
+		   session->id, ve_sure_string (xdisplay));
+
+	if (xdisplay != NULL && strcmp (xdisplay, request->x11_display) == 0) {
+		DBusMessage *message;
+
+		mdm_debug ("logind: Unlocking session %s", session->id);
+		message = dbus_message_new_method_call (LOGIN1_NAME,
+							LOGIN1_MANAGER_PATH,
+							LOGIN1_MANAGER_INTERFACE,
+							"UnlockSession");
+		if (message != NULL)
+			dbus_message_append_args (message,
+						  DBUS_TYPE_STRING, &session->id,
+						  DBUS_TYPE_INVALID);
+		call_start (request->connection, message,
+			    &request->outstanding,
+			    unlock_done, request, NULL);
+		dbus_connection_flush (request->connection);
+	}
+	g_free (xdisplay);
+
+	unlock_request_call_done (request);
+}
+
+static void
+login1_get_display_start (UnlockRequest *request,
+			  const char    *id,
+			  const char    *path)
+{
+	DBusMessage    *message;
+	DBusMessageIter iter;
+	const char     *interface = LOGIN1_SESSION_INTERFACE;
+	const char     *property = "Display";
+
+	message = dbus_message_new_method_call (LOGIN1_NAME,
+						path,
+						PROPERTIES_INTERFACE,
+						"Get");
 	if (message != NULL) {
-		dbus_message_unref (message);
+		dbus_message_iter_init_append (message, &iter);
+		dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &interface);
+		dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &property);
 	}
-	if (reply != NULL) {
+
+	call_start (request->connection, message,
+		    &request->outstanding,
+		    login1_display_done,
+		    unlock_session_new (request, id, path),
+		    unlock_session_free);
+}
+
+/* Moves iter on to the next field of a struct if it has the given type,
+ * and stores its value in *value */
+static gboolean
+iter_get_field (DBusMessageIter *iter,
+		int              type,
+		void            *value)
+{
+	if (dbus_message_iter_get_arg_type (iter) != type)
+		return FALSE;
+
+	dbus_message_iter_get_basic (iter, value);
+	dbus_message_iter_next (iter);
+	return TRUE;
+}
+
+static void
+login1_sessions_done (DBusPendingCall *pending,
+		      void            *data)
+{
+	UnlockRequest  *request = data;
+	DBusMessage    *reply;
+	DBusMessageIter iter;
+	DBusMessageIter iter_array;
+
+	reply = call_reply (pending);
+	if (reply == NULL)
+		goto out;
+
+	dbus_message_iter_init (reply, &iter);
+	if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY) {
+		mdm_debug ("logind: Wrong reply for ListSessions - expecting an array.");
 		dbus_message_unref (reply);
+		goto out;
+	}
+
+	/* a(susso): id, uid, user, seat, object path */
+	dbus_message_iter_recurse (&iter, &iter_array);
+	while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRUCT) {
+		DBusMessageIter iter_struct;
+		const char     *id;
+		const char     *user;
+		const char     *seat;
+		const char     *path;
+		dbus_uint32_t   session_uid;
+
+		dbus_message_iter_recurse (&iter_array, &iter_struct);
+		if ( ! iter_get_field (&iter_struct, DBUS_TYPE_STRING, &id) ||
+		     ! iter_get_field (&iter_struct, DBUS_TYPE_UINT32, &session_uid) ||
+		     ! iter_get_field (&iter_struct, DBUS_TYPE_STRING, &user) ||
+		     ! iter_get_field (&iter_struct, DBUS_TYPE_STRING, &seat) ||
+		     ! iter_get_field (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path)) {
+			mdm_debug ("logind: Wrong reply for ListSessions - expecting (susso).");
+			break;
+		}
+
+		if (session_uid == request->uid)
+			login1_get_display_start (request, id, path);
+
+		dbus_message_iter_next (&iter_array);
 	}
+	dbus_message_unref (reply);
+	dbus_connection_flush (request->connection);
 
-	return sessions;
+ out:
+	unlock_request_call_done (request);
 }
 
+/*
+ * Unlocks the sessions of user on x11_display, in both ConsoleKit and
+ * logind, whichever is running.
+ */
 void
-unlock_ck_session (const char *user,
-		   const char *x11_display)
+unlock_login_sessions (const char *user,
+		       const char *x11_display)
 {
-	DBusError       error;
+	UnlockRequest  *request;
 	DBusConnection *connection;
-	char           **sessions;
-	int              i;
+	struct passwd  *pwent;
 
 	mdm_debug ("ConsoleKit: Unlocking session for %s on %s", user, x11_display);
 
-	dbus_error_init (&error);
-	connection = dbus_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
-		mdm_debug ("ConsoleKit: Failed to connect to the D-Bus daemon: %s", error.message);
-		dbus_error_free (&error);
+	if (x11_display == NULL)
 		return;
-	}
 
-	sessions = get_sessions_for_user (connection, user, x11_display);
-	if (sessions == NULL || sessions[0] == NULL) {
-		mdm_debug ("ConsoleKit: no sessions found");
-		g_strfreev (sessions);
+	pwent = getpwnam (user);
+	if (pwent == NULL)
 		return;
-	}
-
-	for (i = 0; sessions[i] != NULL; i++) {
-		char *ssid;
-		char *xdisplay;
-
-		ssid = sessions[i];
-		session_get_x11_display (connection, ssid, &xdisplay);
-		mdm_debug ("ConsoleKit: session %s has DISPLAY %s", ssid, xdisplay);
 
-		if (xdisplay != NULL
-		    && x11_display != NULL
-		    && strcmp (xdisplay, x11_display) == 0) {
-			gboolean res;
-
-			res = session_unlock (connection, ssid);
-			if (! res) {
-				mdm_error ("ConsoleKit: Unable to unlock %s", ssid);
-			}
-		}
+	connection = get_connection ();
+	if (connection == NULL)
+		return;
 
-		g_free (xdisplay);
+	request = g_new0 (UnlockRequest, 1);
+	request->connection = connection;
+	request->user = g_strdup (user);
+	request->uid = pwent->pw_uid;
+	request->x11_display = g_strdup (x11_display);
+
+	/* Which sessions does the user have */
+	{
+		DBusMessage  *message;
+		dbus_uint32_t value = pwent->pw_uid;
+
+		message = dbus_message_new_method_call (CK_NAME,
+							CK_MANAGER_PATH,
+							CK_MANAGER_INTERFACE,
+							"GetSessionsForUser");
+		if (message != NULL)
+			dbus_message_append_args (message,
+						  DBUS_TYPE_UINT32, &value,
+						  DBUS_TYPE_INVALID);
+		call_start (connection, message, &request->outstanding,
+			    ck_sessions_done, request, NULL);
+	}
+	call_start (connection,
+		    dbus_message_new_method_call (LOGIN1_NAME,
+						  LOGIN1_MANAGER_PATH,
+						  LOGIN1_MANAGER_INTERFACE,
+						  "ListSessions"),
+		    &request->outstanding,
+		    login1_sessions_done, request, NULL);
+
+	/* The old mdm-unlock-logind did not hold up the slave at all, so
+	 * do not wait for every step of a slow service.  What is left is
+	 * handled whenever the connection is used again. */
+	if (calls_wait_bounded (connection, &request->outstanding, call_timeout)) {
+		unlock_request_free (request);
+	} else {
+		mdm_debug ("ConsoleKit: Not waiting any longer to unlock the sessions of %s",
+			   user);
+		request->abandoned = TRUE;
 	}
-
-	g_strfreev (sessions);
 }
 
 char *
@@ -404,31 +738,18 @@ open_ck_session (struct passwd *pwent,
 		 const char    *session)
 {
 	DBusConnection *connection;
-	DBusError       error;
 	DBusMessage    *message;
 	DBusMessage    *reply;
 	DBusMessageIter iter;
 	DBusMessageIter iter_struct;
 	char	       *cookie;
 
-	cookie = NULL;
-
 	mdm_debug ("ConsoleKit: Opening session for %s", pwent->pw_name);
 
-	dbus_error_init (&error);
-	connection = dbus_bus_get_private (DBUS_BUS_SYSTEM, &error);
-	private_connection = connection;
-
-	if (connection == NULL) {
-		mdm_debug ("ConsoleKit: Failed to connect to the D-Bus daemon: %s", error.message);
-		dbus_error_free (&error);
+	connection = get_connection ();
+	if (connection == NULL)
 		return NULL;
-	}
 
-	dbus_connection_set_exit_on_disconnect (connection, FALSE);
-	dbus_connection_setup_with_g_main (connection, NULL);
-
-	dbus_error_init (&error);
 	message = dbus_message_new_method_call (CK_NAME,
 						CK_MANAGER_PATH,
 						CK_MANAGER_INTERFACE,
@@ -465,27 +786,10 @@ open_ck_session (struct passwd *pwent,
 
 	dbus_message_iter_close_container (&iter, &iter_struct);
 
-	reply = dbus_connection_send_with_reply_and_block (connection,
-							   message,
-							   -1, &error);
-	if (dbus_error_is_set (&error)) {
-		mdm_debug ("ConsoleKit: %s raised:\n %s\n\n", error.name, error.message);
-		reply = NULL;
-	}
-
-	dbus_connection_flush (connection);
-
-	dbus_message_unref (message);
-	dbus_error_free (&error);
-
-	if (reply != NULL) {
-		const char *value;
-
-		dbus_message_iter_init (reply, &iter);
-		dbus_message_iter_get_basic (&iter, &value);
-		cookie = g_strdup (value);
+	reply = call_and_wait (connection, message);
+	cookie = reply_get_string (reply);
+	if (reply != NULL)
 		dbus_message_unref (reply);
-	}
 
 	return cookie;
 }
@@ -493,10 +797,8 @@ open_ck_session (struct passwd *pwent,
 void
 close_ck_session (const char *cookie)
 {
-	DBusError       error;
 	DBusMessage    *message;
 	DBusMessage    *reply;
-	DBusMessageIter iter;
 
 	if (cookie == NULL) {
 		return;
@@ -508,34 +810,28 @@ close_ck_session (const char *cookie)
 
 	mdm_debug ("ConsoleKit: Closing session for cookie %s", cookie);
 
-	dbus_error_init (&error);
 	message = dbus_message_new_method_call (CK_NAME,
 						CK_MANAGER_PATH,
 						CK_MANAGER_INTERFACE,
 						"CloseSession");
-	if (message == NULL) {
-		mdm_debug ("ConsoleKit: Couldn't allocate the D-Bus message");
-		return;
-	}
-
-	dbus_message_iter_init_append (message, &iter);
-	dbus_message_iter_append_basic (&iter,
-					DBUS_TYPE_STRING,
-					&cookie);
-
-	reply = dbus_connection_send_with_reply_and_block (private_connection,
-							   message,
-							   -1, &error);
-	if (dbus_error_is_set (&error)) {
-		mdm_debug ("ConsoleKit: %s raised:\n %s\n\n", error.name, error.message);
-		reply = NULL;
-	}
+	if (message != NULL)
+		dbus_message_append_args (message,
+					  DBUS_TYPE_STRING, &cookie,
+					  DBUS_TYPE_INVALID);
 
-	dbus_connection_flush (private_connection);
-
-	dbus_message_unref (message);
-	dbus_error_free (&error);
+	reply = call_and_wait (private_connection, message);
+	if (reply != NULL)
+		dbus_message_unref (reply);
 
-        dbus_connection_close (private_connection);
+	dbus_connection_close (private_connection);
+	dbus_connection_unref (private_connection);
 	private_connection = NULL;
 }
+
+#ifdef MDM_CONSOLE_KIT_TEST
+void
+set_ck_call_timeout (int msec)
+{
+	call_timeout = msec;
+}
+#endif
@@ -32,8 +32,13 @@ char *      open_ck_session       (struct passwd *pwent,
                                    MdmDisplay    *display,
                                    const char    *session);
 void        close_ck_session      (const char    *cookie);
-void        unlock_ck_session     (const char    *user,
+/* Unlocks the user's ConsoleKit and logind sessions on x11_display */
+void        unlock_login_sessions (const char    *user,
                                    const char    *x11_display);
+#ifdef MDM_CONSOLE_KIT_TEST
+/* Bounds every call to the session managers, in milliseconds */
+void        set_ck_call_timeout   (int            msec);
+#endif
 
 G_END_DECLS
 
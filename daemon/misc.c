@@ -1051,8 +1051,30 @@ mdm_fdgets (int fd)
 	}
 }
 
+static gboolean
+is_in_fd_list (int fd, const int *fds, int n_fds)
+{
+	int i;
+
+	for (i = 0; i < n_fds; i++) {
+		if (fds[i] == fd)
+			return TRUE;
+	}
+	return FALSE;
+}
+
 void
 mdm_close_all_descriptors (int from, int except, int except2)
+{
+	int keep[2] = { except, except2 };
+
+	mdm_close_all_descriptors_except (from, keep, G_N_ELEMENTS (keep));
+}
+
+/* Like mdm_close_all_descriptors, with any number of descriptors to
+ * keep.  Negative entries in keep are ignored. */
+void
+mdm_close_all_descriptors_except (int from, const int *keep, int n_keep)
 {
 	DIR *dir;
 	struct dirent *ent;
@@ -1072,7 +1094,7 @@ mdm_close_all_descriptors (int from, int except, int except2)
 			if (ent->d_name[0] == '.')
 				continue;
 			fd = atoi (ent->d_name);
-			if (fd >= from && fd != except && fd != except2)
+			if (fd >= from && ! is_in_fd_list (fd, keep, n_keep))
 				openfds = g_slist_prepend (openfds, GINT_TO_POINTER (fd));
 		}
 		closedir (dir);
@@ -1100,7 +1122,7 @@ mdm_close_all_descriptors (int from, int except, int except2)
 			max = MAX (i+1, 4096);
 		}
 		for (i = from; i < max; i++) {
-			if G_LIKELY (i != except && i != except2)
+			if G_LIKELY ( ! is_in_fd_list (i, keep, n_keep))
 				VE_IGNORE_EINTR (close (i));
 		}
 	}
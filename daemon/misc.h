@@ -68,6 +68,7 @@ void mdm_desetuid (void);
 gboolean mdm_test_opt (const char *cmd, const char *help, const char *option);
 
 void mdm_close_all_descriptors (int from, int except, int except2);
+void mdm_close_all_descriptors_except (int from, const int *keep, int n_keep);
 
 int mdm_open_dev_null (mode_t mode);
 
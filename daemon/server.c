@@ -506,6 +506,7 @@ mdm_server_start (MdmDisplay *disp,
     int flexi_disp = 20;
     char *vtarg = NULL;
     int vtfd = -1, vt = -1;
+    gint64 start;
     
     if (disp == NULL)
 	    return FALSE;
@@ -555,6 +556,7 @@ mdm_server_start (MdmDisplay *disp,
     }
 
     /* fork X server process */
+    start = g_get_monotonic_time ();
     mdm_server_spawn (d, vtarg);
 
     g_free (vtarg);
@@ -580,6 +582,7 @@ mdm_server_start (MdmDisplay *disp,
 
     case SERVER_RUNNING:
 	    mdm_debug ("mdm_server_start: Completed %s!", d->name);
+	    mdm_slave_send_stat ("x_start", g_get_monotonic_time () - start);
 
 	    if (SERVER_IS_FLEXI (d))
 		    mdm_slave_send_num (MDM_SOP_FLEXI_OK, 0 /* bogus */);
@@ -104,6 +104,8 @@
 
 #include "mdm-common.h"
 #include "mdm-log.h"
+#include "mdm-session-index.h"
+#include "mdm-config-snapshot.h"
 #include "mdm-daemon-config.h"
 
 #include "mdm-socket-protocol.h"
@@ -151,6 +153,8 @@ static int exit_code_to_use            = DISPLAY_REMANAGE;
 static gboolean session_started        = FALSE;
 static gboolean greeter_disabled       = FALSE;
 static gboolean greeter_no_focus       = FALSE;
+static gint64 greeter_spawn_time       = 0;  /* Until the greeter first
+						   answers */
 
 static uid_t logged_in_uid             = -1;
 static gid_t logged_in_gid             = -1;
@@ -207,6 +211,7 @@ static void   mdm_slave_handle_usr2_message (void);
 static void   mdm_slave_handle_notify (const char *msg);
 static void   check_notifies_now (void);
 static void   restart_the_greeter (void);
+static MdmSessionIndex *get_session_index (void);
 
 gboolean mdm_is_user_valid (const char *username);
 
@@ -284,6 +289,9 @@ slave_waitpid_setpid (pid_t pid)
 	return wp;
 }
 
+/* Session output read since it was last reported to the master */
+static gint64 session_output_bytes = 0;
+
 static void
 run_session_output (gboolean read_until_eof)
 {
@@ -347,6 +355,8 @@ run_session_output (gboolean read_until_eof)
 			break;
 		}
 
+		session_output_bytes += r;
+
 		if G_UNLIKELY (limit_output && d->xsession_errors_bytes >= MAX_XSESSION_ERRORS_BYTES || got_xfsz_signal) {
 			continue;
 		}
@@ -1243,14 +1253,14 @@ mdm_slave_check_user_wants_to_log_in (const char *user)
 	/* Must be that r == 1, that is return to previous login */
 
 #ifdef WITH_CONSOLE_KIT
-	// Unlock the session with consolekit
-	unlock_ck_session (user, migrate_to);
-#endif
-
+	// Unlock the session with consolekit and logind
+	unlock_login_sessions (user, migrate_to);
+#else
 	// Unlock the session with logind
 	char * unlock_logind_command = g_strdup_printf ("/usr/bin/mdm-unlock-logind %s %s &", user, migrate_to);
 	system(unlock_logind_command);
 	g_free(unlock_logind_command);
+#endif
 
 	if (d->type == TYPE_FLEXI) {
 		mdm_slave_whack_greeter ();
@@ -1446,7 +1456,10 @@ mdm_slave_run (MdmDisplay *display)
 		mdm_sleep_no_signal (1);
 
 	if (SERVER_IS_LOCAL (d)) {
-		mdm_slave_send (MDM_SOP_START_NEXT_LOCAL, FALSE);
+		char *msg = g_strdup_printf ("%s %ld", MDM_SOP_START_NEXT_LOCAL,
+					     (long)getpid ());
+		mdm_slave_send (msg, FALSE);
+		g_free (msg);
 	}
 
 	check_notifies_now ();
@@ -2236,9 +2249,13 @@ mdm_slave_greeter (void)
 	const char *mdmuser;
 	const char *moduleslist;
 	const char *mdmlang;
+	int snapshot_fd, snapshot_generation_fd;
 
 	mdm_debug ("mdm_slave_greeter: Running greeter on %s", d->name);
 
+	/* Make sure the greeter finds an up to date session index */
+	get_session_index ();
+
 	/* Run the init script. mdmslave suspends until script has terminated */
 	mdm_slave_exec_script (d, "/etc/mdm/SuperInit", "root", getpwnam("root"), FALSE /* pass_stdout */);
 	mdm_slave_exec_script (d, mdm_daemon_config_get_value_string (MDM_KEY_DISPLAY_INIT_DIR), NULL, NULL, FALSE /* pass_stdout */);
@@ -2262,6 +2279,7 @@ mdm_slave_greeter (void)
 	mdm_sigchld_block_push ();
 	mdm_sigterm_block_push ();
 	greet = TRUE;
+	greeter_spawn_time = g_get_monotonic_time ();
 	pid = d->greetpid = fork ();
 	if (pid == 0)
 		mdm_unset_signals ();
@@ -2284,7 +2302,17 @@ mdm_slave_greeter (void)
 
 		mdm_log_shutdown ();
 
-		mdm_close_all_descriptors (2 /* from */, slave_fifo_pipe_fd/* except */, d->slave_notify_fd/* except2 */);
+		/* The configuration snapshot stays open across the exec */
+		if (mdm_daemon_config_get_snapshot (d->name, &snapshot_fd, &snapshot_generation_fd)) {
+			fcntl (snapshot_fd, F_SETFD, 0);
+			fcntl (snapshot_generation_fd, F_SETFD, 0);
+		}
+
+		{
+			int keep[] = { slave_fifo_pipe_fd, d->slave_notify_fd,
+				       snapshot_fd, snapshot_generation_fd };
+			mdm_close_all_descriptors_except (2 /* from */, keep, G_N_ELEMENTS (keep));
+		}
 
 		mdm_open_dev_null (O_RDWR); /* open stderr - fd 2 */
 
@@ -2324,6 +2352,15 @@ mdm_slave_greeter (void)
 			  MDM_GREETER_PROTOCOL_VERSION, TRUE);
 		g_setenv ("MDM_VERSION", VERSION, TRUE);
 
+		if (snapshot_fd >= 0) {
+			char *fds = g_strdup_printf ("%d,%d", snapshot_fd,
+						     snapshot_generation_fd);
+			g_setenv (MDM_CONFIG_SNAPSHOT_ENV, fds, TRUE);
+			g_free (fds);
+		} else {
+			g_unsetenv (MDM_CONFIG_SNAPSHOT_ENV);
+		}
+
 		pwent = getpwnam (mdmuser);
 		if G_LIKELY (pwent != NULL) {
 			/* Note that usually this doesn't exist */
@@ -2499,6 +2536,9 @@ mdm_slave_greeter (void)
 
 		mdm_slave_send_num (MDM_SOP_GREETPID, d->greetpid);
 
+		/* Load the PAM stack while the greeter starts up */
+		mdm_verify_prewarm (d);
+
 		// Append pictures to greeter (except for mdmwebkit)
 		run_pictures ();
 		
@@ -2629,6 +2669,20 @@ mdm_slave_send_num (const char *opcode, long num)
 	g_free (msg);
 }
 
+/* Values for the STATS command, the master does not ack these */
+void
+mdm_slave_send_stat (const char *name, gint64 value)
+{
+	char *msg;
+
+	msg = g_strdup_printf ("%s %ld %s %" G_GINT64_FORMAT, MDM_SOP_STAT,
+			       (long)getpid (), name, value);
+
+	mdm_slave_send (msg, FALSE);
+
+	g_free (msg);
+}
+
 void
 mdm_slave_send_string (const char *opcode, const char *str)
 {
@@ -2656,6 +2710,27 @@ mdm_slave_send_string (const char *opcode, const char *str)
 	g_free (msg);
 }
 
+static MdmSessionIndex *
+get_session_index (void)
+{
+	static MdmSessionIndex *session_index = NULL;
+
+	if (session_index == NULL) {
+		char *cache_file;
+
+		cache_file = g_build_filename (mdm_daemon_config_get_value_string (MDM_KEY_SERV_AUTHDIR),
+					       MDM_SESSION_INDEX_FILE, NULL);
+		session_index = mdm_session_index_new (mdm_daemon_config_get_value_string (MDM_KEY_SESSION_DESKTOP_DIR),
+						       cache_file);
+		g_free (cache_file);
+	}
+
+	/* Only stats the session dirs unless one of them changed */
+	mdm_session_index_refresh (session_index, TRUE /* save */);
+
+	return session_index;
+}
+
 static gboolean
 is_session_valid (const char *session_name)
 {
@@ -2671,20 +2746,30 @@ is_session_valid (const char *session_name)
 		return FALSE;
 	}
 
-	// For other sessions we check the session file to see if Exec and Try_Exec are in the path
+	// For other sessions we check the session index to see if Exec and TryExec are in the path
 	gboolean valid = FALSE;
-	char * exec = mdm_daemon_config_get_session_exec (session_name, TRUE /* check_try_exec */);
-	if (exec != NULL) {
+	MdmSessionIndex *index = get_session_index ();
+	switch (mdm_session_index_get_status (index, session_name)) {
+	case MDM_SESSION_INDEX_OK:
 		valid = TRUE;
+		break;
+	case MDM_SESSION_INDEX_INCOMPLETE: {
+		// Name is only needed by the greeter, Exec is what matters here
+		char * exec = mdm_session_index_get_exec (index, session_name);
+		valid = ! ve_string_empty (exec);
+		g_free (exec);
+		break;
+	}
+	default:
+		break;
 	}
-	g_free (exec);
 	return valid;
 }
 
 static char *
 find_a_session (void)
 {
-	char *session;
+	char *session = NULL;
 	const char *default_session = mdm_daemon_config_get_value_string (MDM_KEY_DEFAULT_SESSION);
 	if (is_session_valid (default_session)) {
 		mdm_debug ("find_a_session: Applied default session '%s'", default_session);
@@ -3229,6 +3314,11 @@ finish_session_output (gboolean do_read)
 			d->xsession_errors_fd = -1;
 		}
 	}
+
+	if (session_output_bytes > 0) {
+		mdm_slave_send_stat ("session_output.bytes", session_output_bytes);
+		session_output_bytes = 0;
+	}
 }
 
 static GString *
@@ -4393,18 +4483,29 @@ static void
 mdm_slave_handle_usr2_message (void)
 {
 	char buf[256];
+	GString *msgs;
 	ssize_t count;
 	char **vec;
 	int i;
 
-	VE_IGNORE_EINTR (count = read (d->slave_notify_fd, buf, sizeof (buf) -1));
-	if (count <= 0) {
-		return;
+	/* The daemon may send several keys with one signal (after it
+	 * reloaded its configuration), so read everything there is.  The
+	 * daemon writes whole lines, the fd is non-blocking. */
+	msgs = g_string_new (NULL);
+	for (;;) {
+		VE_IGNORE_EINTR (count = read (d->slave_notify_fd, buf, sizeof (buf)));
+		if (count <= 0)
+			break;
+		g_string_append_len (msgs, buf, count);
 	}
 
-	buf[count] = '\0';
+	if (msgs->len == 0) {
+		g_string_free (msgs, TRUE);
+		return;
+	}
 
-	vec = g_strsplit (buf, "\n", -1);
+	vec = g_strsplit (msgs->str, "\n", -1);
+	g_string_free (msgs, TRUE);
 	if (vec == NULL) {
 		return;
 	}
@@ -4544,6 +4645,30 @@ mdm_slave_xioerror_handler (Display *disp)
 	return 0;
 }
 
+/* The language the greeter picked, for PAM messages and for any greeter
+ * started from now on */
+static void
+slave_set_language (const char *locale)
+{
+	ve_clearenv ();
+	if (!strcmp (locale, DEFAULT_LANGUAGE)) {
+		locale = mdm_system_locale;
+	}
+	/*
+	 * Do not lose DISPLAY.  It should always be
+	 * available for use, PAM modules use it for
+	 * example.
+	 */
+	g_setenv ("DISPLAY", d->name, TRUE);
+	g_setenv ("MDM_LANG", locale, TRUE);
+	g_setenv ("LANG", locale, TRUE);
+	g_unsetenv ("LC_ALL");
+	g_unsetenv ("LC_MESSAGES");
+	setlocale (LC_ALL, "");
+	setlocale (LC_MESSAGES, "");
+	mdm_saveenv ();
+}
+
 /* return true for "there was an interruption received",
    and interrupted will be TRUE if we are actually interrupted from doing what
    we want.  If FALSE is returned, just continue on as we would normally */
@@ -4617,32 +4742,18 @@ check_for_interruption (const char *msg)
 			return TRUE;
 		case MDM_INTERRUPT_SELECT_LANG:
 			if (msg + 2) {
-				const char *locale;
-
-				locale = (gchar*)(msg + 3);
-
 				always_restart_greeter = (gboolean)(*(msg + 2));
-				ve_clearenv ();
-				if (!strcmp (locale, DEFAULT_LANGUAGE)) {
-					locale = mdm_system_locale;
-				}
-				/*
-				 * Do not lose DISPLAY.  It should always be
-				 * available for use, PAM modules use it for
-				 * example.
-				 */
-				g_setenv ("DISPLAY", d->name, TRUE);
-				g_setenv ("MDM_LANG", locale, TRUE);
-				g_setenv ("LANG", locale, TRUE);
-				g_unsetenv ("LC_ALL");
-				g_unsetenv ("LC_MESSAGES");
-				setlocale (LC_ALL, "");
-				setlocale (LC_MESSAGES, "");
-				mdm_saveenv ();
+				slave_set_language ((gchar*)(msg + 3));
 
 				do_restart_greeter = TRUE;
 			}
 			break;
+		case MDM_INTERRUPT_LANG_CHANGED:
+			/* The greeter already speaks the new language,
+			 * only PAM and the next greeter have to follow.
+			 * Not interrupted, keep reading the answer. */
+			slave_set_language (&msg[2]);
+			return TRUE;
 		default:
 			break;
 		}
@@ -4697,6 +4808,12 @@ mdm_slave_greeter_ctl (char cmd, const char *str)
 		}
 	} while (check_for_interruption (buf) && ! interrupted);
 
+	if (greeter_spawn_time != 0) {
+		mdm_slave_send_stat ("greeter_start",
+				     g_get_monotonic_time () - greeter_spawn_time);
+		greeter_spawn_time = 0;
+	}
+
 	/* user responses take kind of random amount of time */
 	mdm_random_tick ();
 
@@ -0,0 +1,308 @@
+/* MDM - The MDM Display Manager
+ *
+ * Exercises mdmconsolekit.c against stub ConsoleKit and logind services.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The "system bus" is whatever DBUS_SYSTEM_BUS_ADDRESS points at, so run
+ * this on a private bus:
+ *
+ *	dbus-run-session -- sh -c \
+ *		'DBUS_SYSTEM_BUS_ADDRESS=$DBUS_SESSION_BUS_ADDRESS ./test-consolekit'
+ *
+ * A forked stub owns both service names.  The user has two ConsoleKit
+ * sessions, on :0 and :1, and one logind session on :0.  Sessions opened
+ * on display ":hang" never get an answer.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+#include "mdmconsolekit.h"
+
+#define CK_NAME			"org.freedesktop.ConsoleKit"
+#define CK_MANAGER_INTERFACE	"org.freedesktop.ConsoleKit.Manager"
+#define CK_SESSION_INTERFACE	"org.freedesktop.ConsoleKit.Session"
+#define CK_SESSION_1		"/org/freedesktop/ConsoleKit/Session1"
+#define CK_SESSION_2		"/org/freedesktop/ConsoleKit/Session2"
+
+#define LOGIN1_NAME		"org.freedesktop.login1"
+#define LOGIN1_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define LOGIN1_SESSION		"/org/freedesktop/login1/session/c1"
+
+/* The stub reports every unlock on this pipe */
+static int report_fd = -1;
+
+static void
+report (const char *what)
+{
+	char *line = g_strconcat (what, "\n", NULL);
+
+	write (report_fd, line, strlen (line));
+	g_free (line);
+}
+
+static const char *
+opened_display (DBusMessage *message)
+{
+	DBusMessageIter iter, iter_array, iter_struct, iter_var;
+	const char *key, *value;
+
+	dbus_message_iter_init (message, &iter);
+	dbus_message_iter_recurse (&iter, &iter_array);
+	while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRUCT) {
+		dbus_message_iter_recurse (&iter_array, &iter_struct);
+		dbus_message_iter_get_basic (&iter_struct, &key);
+		dbus_message_iter_next (&iter_struct);
+		dbus_message_iter_recurse (&iter_struct, &iter_var);
+		if (strcmp (key, "x11-display") == 0 &&
+		    dbus_message_iter_get_arg_type (&iter_var) == DBUS_TYPE_STRING) {
+			dbus_message_iter_get_basic (&iter_var, &value);
+			return value;
+		}
+		dbus_message_iter_next (&iter_array);
+	}
+
+	return "";
+}
+
+static DBusHandlerResult
+stub_filter (DBusConnection *connection,
+	     DBusMessage    *message,
+	     void           *data)
+{
+	const char  *path = dbus_message_get_path (message);
+	DBusMessage *reply;
+
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	reply = dbus_message_new_method_return (message);
+
+	if (dbus_message_is_method_call (message, CK_MANAGER_INTERFACE,
+					 "GetSessionsForUser")) {
+		const char *sessions[] = { CK_SESSION_1, CK_SESSION_2 };
+		const char **p = sessions;
+
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH, &p, 2,
+					  DBUS_TYPE_INVALID);
+	} else if (dbus_message_is_method_call (message, CK_SESSION_INTERFACE,
+						"GetX11Display")) {
+		const char *display = strcmp (path, CK_SESSION_1) == 0 ? ":0" : ":1";
+
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &display,
+					  DBUS_TYPE_INVALID);
+	} else if (dbus_message_is_method_call (message, CK_SESSION_INTERFACE,
+						"Unlock")) {
+		report (path);
+	} else if (dbus_message_is_method_call (message, CK_MANAGER_INTERFACE,
+						"OpenSessionWithParameters")) {
+		const char *cookie = "stub-cookie";
+
+		if (strcmp (opened_display (message), ":hang") == 0) {
+			dbus_message_unref (reply);
+			return DBUS_HANDLER_RESULT_HANDLED;
+		}
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &cookie,
+					  DBUS_TYPE_INVALID);
+	} else if (dbus_message_is_method_call (message, CK_MANAGER_INTERFACE,
+						"CloseSession")) {
+		report ("closed");
+	} else if (dbus_message_is_method_call (message, LOGIN1_MANAGER_INTERFACE,
+						"ListSessions")) {
+		DBusMessageIter iter, iter_array, iter_struct;
+		const char *id = "c1", *name = "stub", *seat = "seat0";
+		const char *object = LOGIN1_SESSION;
+		dbus_uint32_t uid = getuid ();
+
+		dbus_message_iter_init_append (reply, &iter);
+		dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+						  "(susso)", &iter_array);
+		dbus_message_iter_open_container (&iter_array, DBUS_TYPE_STRUCT,
+						  NULL, &iter_struct);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &id);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &uid);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &seat);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &object);
+		dbus_message_iter_close_container (&iter_array, &iter_struct);
+		dbus_message_iter_close_container (&iter, &iter_array);
+	} else if (dbus_message_is_method_call (message, "org.freedesktop.DBus.Properties",
+						"Get")) {
+		DBusMessageIter iter, iter_var;
+		const char *display = ":0";
+
+		dbus_message_iter_init_append (reply, &iter);
+		dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT,
+						  DBUS_TYPE_STRING_AS_STRING, &iter_var);
+		dbus_message_iter_append_basic (&iter_var, DBUS_TYPE_STRING, &display);
+		dbus_message_iter_close_container (&iter, &iter_var);
+	} else if (dbus_message_is_method_call (message, LOGIN1_MANAGER_INTERFACE,
+						"UnlockSession")) {
+		const char *id = "";
+
+		dbus_message_get_args (message, NULL,
+				       DBUS_TYPE_STRING, &id,
+				       DBUS_TYPE_INVALID);
+		report (id);
+	} else {
+		dbus_message_unref (reply);
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	dbus_connection_send (connection, reply, NULL);
+	dbus_message_unref (reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void
+run_stub (void)
+{
+	DBusConnection *connection;
+
+	connection = dbus_bus_get_private (DBUS_BUS_SYSTEM, NULL);
+	if (connection == NULL ||
+	    dbus_bus_request_name (connection, CK_NAME,
+				   DBUS_NAME_FLAG_DO_NOT_QUEUE, NULL) !=
+	    DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER ||
+	    dbus_bus_request_name (connection, LOGIN1_NAME,
+				   DBUS_NAME_FLAG_DO_NOT_QUEUE, NULL) !=
+	    DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER)
+		_exit (1);
+
+	dbus_connection_add_filter (connection, stub_filter, NULL, NULL);
+	report ("ready");
+
+	while (dbus_connection_read_write_dispatch (connection, -1))
+		;
+	_exit (0);
+}
+
+static int
+compare_lines (const void *a, const void *b)
+{
+	return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+/* Everything the stub reported so far, sorted */
+static char *
+read_reports (int fd)
+{
+	GString *buf = g_string_new (NULL);
+	char   **lines;
+	char    *ret;
+	char     c;
+
+	while (read (fd, &c, 1) == 1)
+		g_string_append_c (buf, c);
+
+	lines = g_strsplit (g_strstrip (buf->str), "\n", -1);
+	qsort (lines, g_strv_length (lines), sizeof (char *), compare_lines);
+	g_string_free (buf, TRUE);
+
+	ret = g_strjoinv (" ", lines);
+	g_strfreev (lines);
+
+	return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+	struct passwd *pwent;
+	MdmDisplay    *d;
+	char          *cookie;
+	char          *reports;
+	char           line[16];
+	gint64         start;
+	int            fds[2];
+	pid_t          stub;
+
+	if (g_getenv ("DBUS_SYSTEM_BUS_ADDRESS") == NULL) {
+		g_printerr ("%s: DBUS_SYSTEM_BUS_ADDRESS is not set\n", argv[0]);
+		return 77;
+	}
+
+	pwent = getpwuid (getuid ());
+	g_assert (pwent != NULL);
+
+	g_assert (pipe (fds) == 0);
+	stub = fork ();
+	if (stub == 0) {
+		close (fds[0]);
+		report_fd = fds[1];
+		run_stub ();
+	}
+	close (fds[1]);
+
+	g_assert (read (fds[0], line, 6) == 6 && strncmp (line, "ready\n", 6) == 0);
+	fcntl (fds[0], F_SETFL, O_NONBLOCK);
+
+	/* Only the sessions on :0 get unlocked, in both services */
+	unlock_login_sessions (pwent->pw_name, ":0");
+	reports = read_reports (fds[0]);
+	g_assert_cmpstr (reports, ==, CK_SESSION_1 " c1");
+	g_free (reports);
+
+	d = g_new0 (MdmDisplay, 1);
+	d->name = g_strdup (":0");
+	d->attached = TRUE;
+	d->vt = 7;
+
+	cookie = open_ck_session (pwent, d, NULL);
+	g_assert_cmpstr (cookie, ==, "stub-cookie");
+	close_ck_session (cookie);
+	g_free (cookie);
+	reports = read_reports (fds[0]);
+	g_assert_cmpstr (reports, ==, "closed");
+	g_free (reports);
+
+	/* A service that never answers costs the timeout, not forever */
+	set_ck_call_timeout (200);
+	g_free (d->name);
+	d->name = g_strdup (":hang");
+	start = g_get_monotonic_time ();
+	cookie = open_ck_session (pwent, d, NULL);
+	g_assert (cookie == NULL);
+	g_assert (g_get_monotonic_time () - start < 5 * G_USEC_PER_SEC);
+
+	close_ck_session ("stub-cookie");
+
+	kill (stub, SIGTERM);
+	waitpid (stub, NULL, 0);
+
+	g_free (d->name);
+	g_free (d);
+
+	return 0;
+}
@@ -0,0 +1,221 @@
+/* MDM - The MDM Display Manager
+ *
+ * Measures how quickly a running daemon answers on the supervisor
+ * socket while its slaves keep getting killed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Usage: test-sup-latency [SECONDS [KILL-INTERVAL [MAX-MSEC]]]
+ *
+ * Sends VERSION requests back to back for SECONDS (default 30).  Every
+ * KILL-INTERVAL seconds (default 5) one slave of the daemon is killed
+ * with SIGKILL, which the daemon treats as a crash.  Fails if any answer
+ * took longer than MAX-MSEC (default 250).
+ *
+ * Needs root and a running daemon, it kills real displays.  Exits with
+ * 77 when there is none.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include "mdm-socket-protocol.h"
+
+static int
+sup_connect (void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, MDM_SUP_SOCKET);
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* One request, returns how long the answer took in usec or -1 */
+static gint64
+sup_round_trip (int fd)
+{
+	const char *req = MDM_SUP_VERSION "\n";
+	gint64 start;
+	char c;
+
+	start = g_get_monotonic_time ();
+	if (write (fd, req, strlen (req)) != (ssize_t) strlen (req))
+		return -1;
+
+	do {
+		if (read (fd, &c, 1) != 1)
+			return -1;
+	} while (c != '\n');
+
+	return g_get_monotonic_time () - start;
+}
+
+static pid_t
+read_pid_file (void)
+{
+	char *contents;
+	pid_t pid = -1;
+
+	if (g_file_get_contents (MDM_PID_FILE, &contents, NULL, NULL)) {
+		pid = atoi (contents);
+		g_free (contents);
+	}
+
+	return pid;
+}
+
+/* Kills one child of master, returns FALSE if there was none */
+static gboolean
+kill_a_slave (pid_t master)
+{
+	DIR *dir;
+	struct dirent *ent;
+	gboolean killed = FALSE;
+
+	dir = opendir ("/proc");
+	if (dir == NULL)
+		return FALSE;
+
+	while ( ! killed && (ent = readdir (dir)) != NULL) {
+		char *file, *contents, *p;
+		int ppid;
+
+		if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+			continue;
+
+		file = g_build_filename ("/proc", ent->d_name, "stat", NULL);
+		if (g_file_get_contents (file, &contents, NULL, NULL)) {
+			/* pid (comm) state ppid ... */
+			p = strrchr (contents, ')');
+			if (p != NULL &&
+			    sscanf (p + 1, " %*c %d", &ppid) == 1 &&
+			    ppid == master) {
+				g_print ("killing slave %s\n", ent->d_name);
+				killed = (kill (atoi (ent->d_name), SIGKILL) == 0);
+			}
+			g_free (contents);
+		}
+		g_free (file);
+	}
+	closedir (dir);
+
+	return killed;
+}
+
+static int
+compare_times (const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+int
+main (int argc, char **argv)
+{
+	GArray *times;
+	gint64 end, next_kill, t;
+	pid_t master;
+	int seconds = 30;
+	int interval = 5;
+	int max_msec = 250;
+	int kills = 0;
+	int fd;
+
+	if (argc > 1)
+		seconds = atoi (argv[1]);
+	if (argc > 2)
+		interval = MAX (1, atoi (argv[2]));
+	if (argc > 3)
+		max_msec = atoi (argv[3]);
+
+	master = read_pid_file ();
+	fd = sup_connect ();
+	if (master <= 0 || fd < 0 || geteuid () != 0) {
+		g_printerr ("%s: needs root and a running daemon\n", argv[0]);
+		return 77;
+	}
+
+	times = g_array_new (FALSE, FALSE, sizeof (gint64));
+	end = g_get_monotonic_time () + seconds * G_USEC_PER_SEC;
+	next_kill = g_get_monotonic_time ();
+
+	while (g_get_monotonic_time () < end) {
+		if (g_get_monotonic_time () >= next_kill) {
+			if (kill_a_slave (master))
+				kills++;
+			next_kill += interval * G_USEC_PER_SEC;
+		}
+
+		t = sup_round_trip (fd);
+		if (t < 0) {
+			/* The daemon may have dropped us, try again */
+			close (fd);
+			fd = sup_connect ();
+			if (fd < 0) {
+				g_printerr ("%s: lost the daemon\n", argv[0]);
+				return 1;
+			}
+			continue;
+		}
+		g_array_append_val (times, t);
+	}
+	close (fd);
+
+	if (times->len == 0) {
+		g_printerr ("%s: no answers\n", argv[0]);
+		return 1;
+	}
+
+	qsort (times->data, times->len, sizeof (gint64), compare_times);
+
+	g_print ("slaves killed: %d\n", kills);
+	g_print ("requests: %u\n", times->len);
+	g_print ("p50: %.2f ms\n", g_array_index (times, gint64, times->len / 2) / 1000.0);
+	g_print ("p99: %.2f ms\n", g_array_index (times, gint64, times->len * 99 / 100) / 1000.0);
+	g_print ("max: %.2f ms\n", g_array_index (times, gint64, times->len - 1) / 1000.0);
+
+	t = g_array_index (times, gint64, times->len - 1);
+	g_array_free (times, TRUE);
+
+	return (t > max_msec * 1000) ? 1 : 0;
+}
@@ -439,6 +439,12 @@ mdm_verify_cleanup (MdmDisplay *d)
 	setgroups (1, groups);
 }
 
+void
+mdm_verify_prewarm (MdmDisplay *d)
+{
+	/* nothing to prepare without PAM */
+}
+
 /* used in pam */
 gboolean
 mdm_verify_setup_env (MdmDisplay *d)
@@ -74,6 +74,14 @@ static char *selected_user = NULL;
 static gboolean opened_session = FALSE;
 static gboolean did_setcred    = FALSE;
 
+/* With PamPrewarm the handle is started before it is needed and kept
+ * across failed attempts, these say what it was started for */
+static gboolean pamh_reusable = FALSE;
+static gboolean pamh_used = FALSE;
+static struct pam_conv *pamh_conv = NULL;
+static char *pamh_service = NULL;
+static char *pamh_display = NULL;
+
 extern char *mdm_ack_question_response;
 
 gboolean mdm_verify_check_selectable_user (const char * user) {		
@@ -526,37 +534,71 @@ static struct pam_conv standalone_pamc = {
 	NULL
 };
 
-/* Creates a pam handle for the auto login */
+/* Starts pamh, or picks up the one kept from before */
 static gboolean
-create_pamh (MdmDisplay *d,
-	     const char *service,
-	     const char *login,
-	     struct pam_conv *conv,
-	     const char *display,
-	     int *pamerr)
+start_pamh (MdmDisplay *d,
+	    const char *service,
+	    const char *login,
+	    struct pam_conv *conv,
+	    const char *display,
+	    int *pamerr)
 {
+	gint64 start;
 
-	if (display == NULL) {
-		mdm_error ("Cannot setup pam handle with null display");
-		return FALSE;
+	if (pamh != NULL && pamh_reusable &&
+	    pamh_conv == conv &&
+	    strcmp (pamh_service, service) == 0 &&
+	    strcmp (pamh_display, display) == 0) {
+		pamh_reusable = FALSE;
+		opened_session = FALSE;
+		did_setcred = FALSE;
+
+		/* A fresh handle already has no user */
+		if (login != NULL || pamh_used)
+			*pamerr = pam_set_item (pamh, PAM_USER, login);
+		else
+			*pamerr = PAM_SUCCESS;
+
+		if (*pamerr == PAM_SUCCESS) {
+			mdm_debug ("create_pamh: Reusing the %s handle for %s, no pam_start needed",
+				   pamh_used ? "previous" : "pre-warmed", service);
+			pamh_used = TRUE;
+			return TRUE;
+		}
 	}
 
 	if (pamh != NULL) {
-		mdm_error ("create_pamh: Stale pamh around, cleaning up");
+		if (pamh_reusable)
+			mdm_debug ("create_pamh: Dropping the pre-warmed handle");
+		else
+			mdm_error ("create_pamh: Stale pamh around, cleaning up");
 		pam_end (pamh, PAM_SUCCESS);
 	}
 	/* init things */
 	pamh = NULL;
+	pamh_reusable = FALSE;
 	opened_session = FALSE;
 	did_setcred = FALSE;
 
 	/* Initialize a PAM session for the user */
+	start = g_get_monotonic_time ();
 	if ((*pamerr = pam_start (service, login, conv, &pamh)) != PAM_SUCCESS) {
 		pamh = NULL; /* be anal */
 		if (mdm_slave_action_pending ())
 			mdm_error ("Unable to establish service %s: %s\n", service, pam_strerror (NULL, *pamerr));
 		return FALSE;
 	}
+	start = g_get_monotonic_time () - start;
+	mdm_debug ("create_pamh: pam_start for %s took %.1f ms", service,
+		   start / 1000.0);
+	mdm_slave_send_stat ("pam_start", start);
+
+	pamh_used = TRUE;
+	pamh_conv = conv;
+	g_free (pamh_service);
+	pamh_service = g_strdup (service);
+	g_free (pamh_display);
+	pamh_display = g_strdup (display);
 
 	/* Inform PAM of the user's tty */
 		if ((*pamerr = pam_set_item (pamh, PAM_TTY, display)) != PAM_SUCCESS) {
@@ -576,6 +618,27 @@ create_pamh (MdmDisplay *d,
 		}
 	}
 
+	return TRUE;
+}
+
+/* Creates a pam handle for the auto login */
+static gboolean
+create_pamh (MdmDisplay *d,
+	     const char *service,
+	     const char *login,
+	     struct pam_conv *conv,
+	     const char *display,
+	     int *pamerr)
+{
+
+	if (display == NULL) {
+		mdm_error ("Cannot setup pam handle with null display");
+		return FALSE;
+	}
+
+	if ( ! start_pamh (d, service, login, conv, display, pamerr))
+		return FALSE;
+
 	// Preselect the previous user
 	if (do_we_need_to_preset_the_username) {		
 		do_we_need_to_preset_the_username = FALSE;
@@ -585,6 +648,58 @@ create_pamh (MdmDisplay *d,
 	return TRUE;
 }
 
+/*
+ * Whether pamh may be used again after a failed pam_authenticate.
+ * Linux-PAM drops the authentication tokens at the end of every
+ * pam_authenticate, so a new attempt with another PAM_USER starts clean.
+ */
+static gboolean
+pamh_can_retry (int pamerr, gboolean credentials_set)
+{
+#ifdef __LINUX_PAM__
+	if ( ! mdm_daemon_config_get_value_bool (MDM_KEY_PAM_PREWARM) ||
+	    credentials_set)
+		return FALSE;
+
+	return (pamerr == PAM_AUTH_ERR ||
+		pamerr == PAM_USER_UNKNOWN ||
+		pamerr == PAM_AUTHINFO_UNAVAIL);
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * mdm_verify_prewarm:
+ * @d: Display the greeter is starting on
+ *
+ * With PamPrewarm set, starts the PAM stack for d now, so that it is
+ * loaded by the time the greeter asks for a user.
+ */
+void
+mdm_verify_prewarm (MdmDisplay *d)
+{
+	char *pam_stack;
+	int pamerr;
+
+	if ( ! mdm_daemon_config_get_value_bool (MDM_KEY_PAM_PREWARM) ||
+	    pamh != NULL || d->name == NULL)
+		return;
+
+	pam_stack = mdm_daemon_config_get_value_string_per_display (MDM_KEY_PAM_STACK,
+		(char *)d->name);
+
+	if (start_pamh (d, pam_stack, NULL, &pamc, d->name, &pamerr)) {
+		pamh_used = FALSE;
+		pamh_reusable = TRUE;
+	} else if (pamh != NULL) {
+		pam_end (pamh, pamerr);
+		pamh = NULL;
+	}
+
+	g_free (pam_stack);
+}
+
 /**
  * log_to_audit_system:
  * @login: Name of user
@@ -660,6 +775,7 @@ mdm_verify_user (MdmDisplay *d,
 	gboolean credentials_set = FALSE;
 	gboolean error_msg_given = FALSE;
 	gboolean started_timer   = FALSE;
+	gint64 session_start;
 
     verify_user_again:
 
@@ -879,6 +995,7 @@ mdm_verify_user (MdmDisplay *d,
 	}
 
 	/* Check if the user's account is healthy. */
+	session_start = g_get_monotonic_time ();
 	pamerr = pam_acct_mgmt (pamh, null_tok);
 	switch (pamerr) {
 	case PAM_SUCCESS :
@@ -946,6 +1063,7 @@ mdm_verify_user (MdmDisplay *d,
 			mdm_error ("Couldn't open session for %s", login);
 		goto pamerr;
 	}
+	mdm_slave_send_stat ("pam_session", g_get_monotonic_time () - session_start);
 
 	/* Workaround to avoid mdm messages being logged as PAM_pwdb */
 	mdm_log_shutdown ();
@@ -1037,7 +1155,11 @@ mdm_verify_user (MdmDisplay *d,
 	did_setcred = FALSE;
 	opened_session = FALSE;
 
-	if (pamh != NULL) {
+	if (pamh != NULL && pamh_can_retry (pamerr, credentials_set)) {
+		/* Keep it for the next attempt */
+		mdm_debug ("mdm_verify_user: Keeping the PAM handle for the next attempt");
+		pamh_reusable = TRUE;
+	} else if (pamh != NULL) {
 		pam_handle_t *tmp_pamh;
 		mdm_sigterm_block_push ();
 		mdm_sigchld_block_push ();
@@ -1051,7 +1173,6 @@ mdm_verify_user (MdmDisplay *d,
 			pam_setcred (tmp_pamh, PAM_DELETE_CRED);
 		pam_end (tmp_pamh, pamerr);
 	}
-	pamh = NULL;
 
 	/* Workaround to avoid mdm messages being logged as PAM_pwdb */
 	mdm_log_shutdown ();
@@ -1084,6 +1205,7 @@ mdm_verify_setup_user (MdmDisplay *d, const gchar *login, char **new_login)
 	int null_tok = 0;
 	gboolean credentials_set;
 	const char *after_login;
+	gint64 session_start;
 
 	credentials_set = FALSE;
 
@@ -1154,6 +1276,7 @@ mdm_verify_setup_user (MdmDisplay *d, const gchar *login, char **new_login)
 	}
 
 	/* Check if the user's account is healthy. */
+	session_start = g_get_monotonic_time ();
 	pamerr = pam_acct_mgmt (pamh, null_tok);
 	switch (pamerr) {
 	case PAM_SUCCESS :
@@ -1233,6 +1356,7 @@ mdm_verify_setup_user (MdmDisplay *d, const gchar *login, char **new_login)
 			mdm_error ("Couldn't open session for %s", login);
 		goto setup_pamerr;
 	}
+	mdm_slave_send_stat ("pam_session", g_get_monotonic_time () - session_start);
 
 	/* Workaround to avoid mdm messages being logged as PAM_pwdb */
 	mdm_log_shutdown ();
@@ -1317,6 +1441,8 @@ mdm_verify_cleanup (MdmDisplay *d)
 
 		mdm_debug ("Running mdm_verify_cleanup and pamh != NULL");
 
+		pamh_reusable = FALSE;
+
 		mdm_sigterm_block_push ();
 		mdm_sigchld_block_push ();
 		tmp_pamh = pamh;
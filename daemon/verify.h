@@ -28,6 +28,8 @@ gchar *mdm_verify_user			 (MdmDisplay *d,
 					  const char *username,
 					  gboolean allow_retry);
 void   mdm_verify_cleanup		 (MdmDisplay *d);
+/* Gets authentication ready ahead of mdm_verify_user, if configured */
+void   mdm_verify_prewarm		 (MdmDisplay *d);
 void   mdm_verify_select_user		 (const char *user);
 
 /* used in pam */
@@ -44,6 +44,7 @@
 #include "mdm.h"
 #include "mdmwm.h"
 #include "mdmcomm.h"
+#include "mdmctrl.h"
 #include "mdmcommon.h"
 #include "mdmconfig.h"
 #include "mdmsession.h"
@@ -90,8 +91,6 @@ static gboolean first_prompt = TRUE;
 
 extern char       *current_session;
 
-static void process_operation (guchar opcode, const gchar *args);
-
 void
 greeter_ignore_buttons (gboolean val)
 {
@@ -100,44 +99,6 @@ greeter_ignore_buttons (gboolean val)
 
 static char *get_theme_file (const char *in, char **theme_dir);
 
-static gboolean
-greeter_ctrl_handler (GIOChannel *source,
-		      GIOCondition cond,
-		      gint fd)
-{
-    gchar buf[PIPE_SIZE];
-    gchar *p;
-    gsize len;
-
-    /* If this is not incoming i/o then return */
-    if (cond != G_IO_IN) 
-      return TRUE;
-
-    /* Read random garbage from i/o channel until first STX is found */
-    do {
-      g_io_channel_read_chars (source, buf, 1, &len, NULL);
-      
-      if (len != 1)
-	return TRUE;
-    } while (buf[0] && buf[0] != STX);
-
-    memset (buf, '\0', sizeof (buf));
-    if (g_io_channel_read_chars (source, buf, sizeof (buf) - 1, &len, NULL) !=
-	G_IO_STATUS_NORMAL)
-      return TRUE;
-
-    p = memchr (buf, STX, len);
-    if (p != NULL) {
-      len = p - buf;
-      g_io_channel_seek_position (source, -((sizeof (buf) - 1) - len), G_SEEK_CUR, NULL);
-      memset (buf + len, '\0', (sizeof (buf) - 1) - len);
-    }
-    buf[len - 1] = '\0';  
-
-    process_operation ((guchar) buf[0], buf + 1);
-    return TRUE;
-}
-
 static GtkWidget *
 hig_dialog_new (GtkWindow      *parent,
 		GtkDialogFlags flags,
@@ -165,315 +126,340 @@ hig_dialog_new (GtkWindow      *parent,
 }
 
 static void
-process_operation (guchar       op_code,
-		   const gchar *args)
+op_setlogin (const gchar *args)
+{
+    /* somebody is trying to fool us this is the user that
+     * wants to log in, and well, we are the gullible kind */
+	
+    greeter_item_pam_set_user (args);
+    mdm_ctrl_ack ();
+}
+
+static void
+op_prompt (const gchar *args)
 {
-    GtkWidget *dlg;
     char *tmp;
-    char *session;
-    GreeterItemInfo *conversation_info;
-    static GnomeCanvasItem *disabled_cover = NULL;
 
-    /* Parse opcode */
-    switch (op_code) {
-    case MDM_SETLOGIN:
-	/* somebody is trying to fool us this is the user that
-	 * wants to log in, and well, we are the gullible kind */
-	
-	greeter_item_pam_set_user (args);
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    tmp = ve_locale_to_utf8 (args);
+    if (tmp != NULL && strcmp (tmp, _("Username:")) == 0) {
+	    mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM),
+				    mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE),
+				    mdm_config_get_bool (MDM_KEY_SOUND_ON_LOGIN));
+	    greeter_probably_login_prompt = TRUE;
+    }
+    if (gtk_ok_button != NULL)
+            gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
 
-    case MDM_PROMPT:
-	tmp = ve_locale_to_utf8 (args);
-	if (tmp != NULL && strcmp (tmp, _("Username:")) == 0) {
-		mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM),
-					mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE),
-					mdm_config_get_bool (MDM_KEY_SOUND_ON_LOGIN));
-		greeter_probably_login_prompt = TRUE;
-	}
-	if (gtk_ok_button != NULL)
-                gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
+    if (gtk_start_again_button != NULL)
+            gtk_widget_set_sensitive (GTK_WIDGET (gtk_start_again_button), !first_prompt);
 
-	if (gtk_start_again_button != NULL)
-                gtk_widget_set_sensitive (GTK_WIDGET (gtk_start_again_button), !first_prompt);
+    first_prompt = FALSE;
 
-	first_prompt = FALSE;
+    greeter_ignore_buttons (FALSE);
 
-	greeter_ignore_buttons (FALSE);
+    greeter_item_pam_prompt (tmp, PW_ENTRY_SIZE, TRUE);
+    g_free (tmp);
+}
 
-	greeter_item_pam_prompt (tmp, PW_ENTRY_SIZE, TRUE);
-	g_free (tmp);
-	break;
+static void
+op_noecho (const gchar *args)
+{
+    char *tmp;
 
-    case MDM_NOECHO:
-	tmp = ve_locale_to_utf8 (args);
+    tmp = ve_locale_to_utf8 (args);
 
-	greeter_probably_login_prompt = FALSE;
+    greeter_probably_login_prompt = FALSE;
 
-	if (gtk_ok_button != NULL)
-                gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
+    if (gtk_ok_button != NULL)
+            gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
 
-	if (gtk_start_again_button != NULL)
-                gtk_widget_set_sensitive (GTK_WIDGET (gtk_start_again_button), !first_prompt);
+    if (gtk_start_again_button != NULL)
+            gtk_widget_set_sensitive (GTK_WIDGET (gtk_start_again_button), !first_prompt);
 
-	first_prompt = FALSE;
+    first_prompt = FALSE;
 
-	greeter_ignore_buttons (FALSE);
-	greeter_item_pam_prompt (tmp, PW_ENTRY_SIZE, FALSE);
-	g_free (tmp);
+    greeter_ignore_buttons (FALSE);
+    greeter_item_pam_prompt (tmp, PW_ENTRY_SIZE, FALSE);
+    g_free (tmp);
+}
 
-	break;
+static void
+op_msg (const gchar *args)
+{
+    char *tmp;
 
-    case MDM_MSG:
-	tmp = ve_locale_to_utf8 (args);
-	greeter_item_pam_message (tmp);
-	g_free (tmp);
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    tmp = ve_locale_to_utf8 (args);
+    greeter_item_pam_message (tmp);
+    g_free (tmp);
+    mdm_ctrl_ack ();
+}
 
-    case MDM_ERRBOX:
-	tmp = ve_locale_to_utf8 (args);
-	greeter_item_pam_error (tmp);
-	g_free (tmp);
+static void
+op_errbox (const gchar *args)
+{
+    char *tmp;
+
+    tmp = ve_locale_to_utf8 (args);
+    greeter_item_pam_error (tmp);
+    g_free (tmp);
 	
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    mdm_ctrl_ack ();
+}
 
-    case MDM_ERRDLG:
-	/* we should be now fine for focusing new windows */
-	mdm_wm_focus_new_windows (TRUE);
+static void
+op_errdlg (const gchar *args)
+{
+    GtkWidget *dlg;
+    char *tmp;
 
-	tmp = ve_locale_to_utf8 (args);
-	dlg = hig_dialog_new (NULL /* parent */,
-                              GTK_DIALOG_MODAL /* flags */,
-                              GTK_MESSAGE_ERROR,
-                              GTK_BUTTONS_OK,
-                              tmp,
-                              "");
-	g_free (tmp);
+    /* we should be now fine for focusing new windows */
+    mdm_wm_focus_new_windows (TRUE);
 
-	mdm_wm_center_window (GTK_WINDOW (dlg));
+    tmp = ve_locale_to_utf8 (args);
+    dlg = hig_dialog_new (NULL /* parent */,
+                          GTK_DIALOG_MODAL /* flags */,
+                          GTK_MESSAGE_ERROR,
+                          GTK_BUTTONS_OK,
+                          tmp,
+                          "");
+    g_free (tmp);
 
-	mdm_wm_no_login_focus_push ();
-	gtk_dialog_run (GTK_DIALOG (dlg));
-	gtk_widget_destroy (dlg);
-	mdm_wm_no_login_focus_pop ();
-	
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
-
-    case MDM_SESS:
-	printf ("%c%s\n", STX, current_session);
-	fflush (stdout);
-	break;
-
-    case MDM_LANG:
-	mdm_lang_op_lang (args);
-	break;
-
-    case MDM_SLANG:
-	mdm_lang_op_slang (args);
-	break;
-
-	case MDM_SETSESS:
-		current_session = args;
-		printf ("%c\n", STX);
-        fflush (stdout);
-		break;
+    mdm_wm_center_window (GTK_WINDOW (dlg));
 
-    case MDM_SETLANG:
-	mdm_lang_op_setlang (args);
-	break;
+    mdm_wm_no_login_focus_push ();
+    gtk_dialog_run (GTK_DIALOG (dlg));
+    gtk_widget_destroy (dlg);
+    mdm_wm_no_login_focus_pop ();
+	
+    mdm_ctrl_ack ();
+}
 
-    case MDM_ALWAYS_RESTART:
-	mdm_lang_op_always_restart (args);
-	break;
+static void
+op_sess (const gchar *args)
+{
+    mdm_ctrl_reply (current_session);
+}
 
-    case MDM_RESET:
-	/* fall thru to reset */
+static void
+op_setsess (const gchar *args)
+{
+    /* args goes away once we return */
+    current_session = g_strdup (args);
+    mdm_ctrl_ack ();
+}
 
-    case MDM_RESETOK:
+static void
+op_reset (const gchar *args)
+{
+    GreeterItemInfo *conversation_info;
+    char *tmp;
 
-	if (gtk_ok_button != NULL)
-                gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
-	if (gtk_start_again_button != NULL)
-                gtk_widget_set_sensitive (GTK_WIDGET (gtk_start_again_button), FALSE);
+    if (gtk_ok_button != NULL)
+            gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
+    if (gtk_start_again_button != NULL)
+            gtk_widget_set_sensitive (GTK_WIDGET (gtk_start_again_button), FALSE);
 
-	first_prompt = TRUE;
+    first_prompt = TRUE;
 
-	conversation_info = greeter_lookup_id ("pam-conversation");
+    conversation_info = greeter_lookup_id ("pam-conversation");
 	
-	if (conversation_info)
-	  {
-	    tmp = ve_locale_to_utf8 (args);
-	    g_object_set (G_OBJECT (conversation_info->item),
-			  "text", tmp,
-			  NULL);
-	    g_free (tmp);
-	  }
+    if (conversation_info)
+      {
+	tmp = ve_locale_to_utf8 (args);
+	g_object_set (G_OBJECT (conversation_info->item),
+		      "text", tmp,
+		      NULL);
+	g_free (tmp);
+      }
 
-	printf ("%c\n", STX);
-	fflush (stdout);
-	greeter_ignore_buttons (FALSE);
-        greeter_item_ulist_enable ();
-
-	break;
-
-    case MDM_QUIT:
-	greeter_item_timed_stop ();
-
-	if (require_quarter) {
-		/* we should be now fine for focusing new windows */
-		mdm_wm_focus_new_windows (TRUE);
-
-		dlg = hig_dialog_new (NULL /* parent */,
-                                      GTK_DIALOG_MODAL /* flags */,
-                                      GTK_MESSAGE_INFO,
-                                      GTK_BUTTONS_OK,
-                                      /* translators:  This is a nice and evil eggie text, translate
-                                       * to your favourite currency */
-                                      _("Please insert 25 cents "
-                                        "to log in."),
-                                      "");
-		mdm_wm_center_window (GTK_WINDOW (dlg));
-
-		mdm_wm_no_login_focus_push ();
-		gtk_dialog_run (GTK_DIALOG (dlg));
-		gtk_widget_destroy (dlg);
-		mdm_wm_no_login_focus_pop ();
-	}
+    mdm_ctrl_ack ();
+    greeter_ignore_buttons (FALSE);
+    greeter_item_ulist_enable ();
+}
 
-	greeter_item_pam_leftover_messages ();
+static void
+op_quit (const gchar *args)
+{
+    GtkWidget *dlg;
 
-	gdk_flush ();
+    greeter_item_timed_stop ();
+
+    if (require_quarter) {
+	    /* we should be now fine for focusing new windows */
+	    mdm_wm_focus_new_windows (TRUE);
+
+	    dlg = hig_dialog_new (NULL /* parent */,
+                                  GTK_DIALOG_MODAL /* flags */,
+                                  GTK_MESSAGE_INFO,
+                                  GTK_BUTTONS_OK,
+                                  /* translators:  This is a nice and evil eggie text, translate
+                                   * to your favourite currency */
+                                  _("Please insert 25 cents "
+                                    "to log in."),
+                                  "");
+	    mdm_wm_center_window (GTK_WINDOW (dlg));
+
+	    mdm_wm_no_login_focus_push ();
+	    gtk_dialog_run (GTK_DIALOG (dlg));
+	    gtk_widget_destroy (dlg);
+	    mdm_wm_no_login_focus_pop ();
+    }
 
-	if (greeter_show_only_background (root)) {
-		GdkPixbuf *background;
-		int width, height;
+    greeter_item_pam_leftover_messages ();
 
-		gtk_window_get_size (GTK_WINDOW (window), &width, &height);
-		background = gdk_pixbuf_get_from_drawable (NULL, gtk_widget_get_root_window(window), NULL, 0, 0, 0, 0 ,width, height);
-		if (background) {
-			mdm_common_set_root_background (background);
-			g_object_unref (background);
-		}
-	}
+    gdk_flush ();
+
+    if (greeter_show_only_background (root)) {
+	    GdkPixbuf *background;
+	    int width, height;
+
+	    gtk_window_get_size (GTK_WINDOW (window), &width, &height);
+	    background = gdk_pixbuf_get_from_drawable (NULL, gtk_widget_get_root_window(window), NULL, 0, 0, 0, 0 ,width, height);
+	    if (background) {
+		    mdm_common_set_root_background (background);
+		    g_object_unref (background);
+	    }
+    }
 
-	printf ("%c\n", STX);
-	fflush (stdout);
+    mdm_ctrl_ack ();
 
-	/* screw gtk_main_quit, we want to make sure we definately die */
-	_exit (EXIT_SUCCESS);
-	break;
+    /* screw gtk_main_quit, we want to make sure we definately die */
+    _exit (EXIT_SUCCESS);
+}
 
-    case MDM_STARTTIMER:
-	greeter_item_timed_start ();
+static void
+op_starttimer (const gchar *args)
+{
+    greeter_item_timed_start ();
 	
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    mdm_ctrl_ack ();
+}
 
-    case MDM_STOPTIMER:
-	greeter_item_timed_stop ();
+static void
+op_stoptimer (const gchar *args)
+{
+    greeter_item_timed_stop ();
 
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    mdm_ctrl_ack ();
+}
 
-    case MDM_DISABLE:
-	gtk_widget_set_sensitive (window, FALSE);
+static GnomeCanvasItem *disabled_cover = NULL;
 
-	if (disabled_cover == NULL)
-	  {
-	    disabled_cover = gnome_canvas_item_new
-		    (gnome_canvas_root (GNOME_CANVAS (canvas)),
-		     GNOME_TYPE_CANVAS_RECT,
-		     "x1", 0.0,
-		     "y1", 0.0,
-		     "x2", (double)canvas->allocation.width,
-		     "y2", (double)canvas->allocation.height,
-		     "fill_color_rgba", (guint)0x00000088,
-		     NULL);
-	  }
+static void
+op_disable (const gchar *args)
+{
+    gtk_widget_set_sensitive (window, FALSE);
 
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    if (disabled_cover == NULL)
+      {
+	disabled_cover = gnome_canvas_item_new
+		(gnome_canvas_root (GNOME_CANVAS (canvas)),
+		 GNOME_TYPE_CANVAS_RECT,
+		 "x1", 0.0,
+		 "y1", 0.0,
+		 "x2", (double)canvas->allocation.width,
+		 "y2", (double)canvas->allocation.height,
+		 "fill_color_rgba", (guint)0x00000088,
+		 NULL);
+      }
 
-    case MDM_ENABLE:
-	gtk_widget_set_sensitive (window, TRUE);
+    mdm_ctrl_ack ();
+}
 
-	if (disabled_cover != NULL)
-	  {
-	    gtk_object_destroy (GTK_OBJECT (disabled_cover));
-	    disabled_cover = NULL;
-	  }
+static void
+op_enable (const gchar *args)
+{
+    gtk_widget_set_sensitive (window, TRUE);
 
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    if (disabled_cover != NULL)
+      {
+	gtk_object_destroy (GTK_OBJECT (disabled_cover));
+	disabled_cover = NULL;
+      }
 
-    /* These are handled separately so ignore them here and send
-     * back a NULL response so that the daemon quits sending them */
-    case MDM_NEEDPIC:
-    case MDM_READPIC:
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
-
-    case MDM_NOFOCUS:
-	mdm_wm_no_login_focus_push ();
+    mdm_ctrl_ack ();
+}
+
+static void
+op_nofocus (const gchar *args)
+{
+    mdm_wm_no_login_focus_push ();
 	
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    mdm_ctrl_ack ();
+}
 
-    case MDM_FOCUS:
-	mdm_wm_no_login_focus_pop ();
+static void
+op_focus (const gchar *args)
+{
+    mdm_wm_no_login_focus_pop ();
 	
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    mdm_ctrl_ack ();
+}
 
-    case MDM_SAVEDIE:
-	/* Set busy cursor */
-	mdm_common_setup_cursor (GDK_WATCH);
+static void
+op_savedie (const gchar *args)
+{
+    /* Set busy cursor */
+    mdm_common_setup_cursor (GDK_WATCH);
 
-	mdm_wm_save_wm_order ();
+    mdm_wm_save_wm_order ();
 
-	gdk_flush ();
-	printf ("%c\n", STX);
-	fflush (stdout);
+    gdk_flush ();
+    mdm_ctrl_ack ();
 
-	_exit (EXIT_SUCCESS);
+    _exit (EXIT_SUCCESS);
+}
 
-    case MDM_QUERY_CAPSLOCK:
-	if (greeter_is_capslock_on ())
-	    printf ("%cY\n", STX);
-	else
-	    printf ("%c\n", STX);
-	fflush (stdout);
+static void
+op_query_capslock (const gchar *args)
+{
+    mdm_ctrl_reply (greeter_is_capslock_on () ? "Y" : "");
+}
 
-	break;
-	
-    default:
-	mdm_common_fail_greeter ("Unexpected greeter command received: '%c'", op_code);
-	break;
-    }
+static void
+op_unknown (guchar op_code, const gchar *args)
+{
+    mdm_common_fail_greeter ("Unexpected greeter command received: '%c'", op_code);
 }
 
+static const MdmCtrlOp ctrl_ops[] = {
+    { MDM_SETLOGIN,       op_setlogin },
+    { MDM_PROMPT,         op_prompt },
+    { MDM_NOECHO,         op_noecho },
+    { MDM_MSG,            op_msg },
+    { MDM_ERRBOX,         op_errbox },
+    { MDM_ERRDLG,         op_errdlg },
+    { MDM_SESS,           op_sess },
+    { MDM_LANG,           mdm_lang_op_lang },
+    { MDM_SLANG,          mdm_lang_op_slang },
+    { MDM_SETSESS,        op_setsess },
+    { MDM_SETLANG,        mdm_lang_op_setlang },
+    { MDM_ALWAYS_RESTART, mdm_lang_op_always_restart },
+    { MDM_RESET,          op_reset },
+    { MDM_RESETOK,        op_reset },
+    { MDM_QUIT,           op_quit },
+    { MDM_STARTTIMER,     op_starttimer },
+    { MDM_STOPTIMER,      op_stoptimer },
+    { MDM_DISABLE,        op_disable },
+    { MDM_ENABLE,         op_enable },
+    /* These are handled separately so ignore them here and send
+     * back a NULL response so that the daemon quits sending them */
+    { MDM_NEEDPIC,        mdm_ctrl_op_ack },
+    { MDM_READPIC,        mdm_ctrl_op_ack },
+    { MDM_NOFOCUS,        op_nofocus },
+    { MDM_FOCUS,          op_focus },
+    { MDM_SAVEDIE,        op_savedie },
+    { MDM_QUERY_CAPSLOCK, op_query_capslock },
+    { 0, NULL }
+};
+
 static gboolean
 key_press_event (GtkWidget *widget, GdkEventKey *key, gpointer data)
 {
   if (key->keyval == GDK_Escape)
     {
       if (DOING_MDM_DEVELOPMENT)
-        process_operation (MDM_QUIT, NULL);
+        op_quit (NULL);
       else
       {
         printf ("%c%c%c\n", STX, BEL, MDM_INTERRUPT_CANCEL);
@@ -864,6 +850,20 @@ mdm_event (GSignalInvocationHint *ihint,
         return TRUE;
 }
 
+/*
+ * The menus are relabelled by mdm_common_retranslate_widgets, this puts
+ * the texts of the theme up again in the new language.
+ */
+void
+lang_relocalize_callback (void)
+{
+  if (root != NULL)
+    greeter_parser_relocalize (root);
+
+  greeter_item_pam_relocalize ();
+  greeter_item_clock_update ();
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -871,7 +871,6 @@ main (int argc, char *argv[])
   struct sigaction hup;
   struct sigaction term;
   sigset_t mask;
-  GIOChannel *ctrlch;
   GError *error;
   char *theme_file;
   char *theme_dir;
@@ -1176,17 +1175,7 @@ main (int argc, char *argv[])
   greeter_setup_items ();
 
   if G_LIKELY (! DOING_MDM_DEVELOPMENT) {
-    ctrlch = g_io_channel_unix_new (STDIN_FILENO);
-    g_io_channel_set_encoding (ctrlch, NULL, NULL);
-    g_io_channel_set_buffered (ctrlch, TRUE);
-    g_io_channel_set_flags (ctrlch, 
-			    g_io_channel_get_flags (ctrlch) | G_IO_FLAG_NONBLOCK,
-			    NULL);
-    g_io_add_watch (ctrlch, 
-		    G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
-		    (GIOFunc) greeter_ctrl_handler,
-		    NULL);
-    g_io_channel_unref (ctrlch);
+    mdm_ctrl_watch (ctrl_ops, op_unknown);
   }
 
   mdm_common_setup_blinking ();
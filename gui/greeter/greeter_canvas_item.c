@@ -24,6 +24,10 @@
 #include <glib/gi18n.h>
 #include <librsvg/rsvg.h>
 
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "mdm.h"
 #include "mdmcommon.h"
 #include "mdmconfig.h"
@@ -44,23 +48,65 @@
 GtkButton *gtk_ok_button = NULL;
 GtkButton *gtk_start_again_button = NULL;
 
+/*
+ * Multiplies every channel by factor / 0xff, exactly as the old scalar
+ * "x * factor / 0xff" did.  With t = x * factor <= 0xfe01 the division
+ * is (t + 1 + (t >> 8)) >> 8, which fits in 16 bit lanes.
+ */
 static void
-apply_tint (GdkPixbuf *pixbuf, guint32 tint_color)
+scale_channels_c (guchar *line, guint n, guint pixel_stride,
+		  guint r, guint g, guint b, guint a)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+    {
+      line[0] = line[0] * r / 0xff;
+      line[1] = line[1] * g / 0xff;
+      line[2] = line[2] * b / 0xff;
+      if (pixel_stride == 4)
+	line[3] = line[3] * a / 0xff;
+      line += pixel_stride;
+    }
+}
+
+#if defined (__SSE2__)
+static guint
+scale_channels_sse2 (guchar *line, guint n, __m128i factors)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i one = _mm_set1_epi16 (1);
+  guint i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (line + i * 4));
+      __m128i lo = _mm_mullo_epi16 (_mm_unpacklo_epi8 (v, zero), factors);
+      __m128i hi = _mm_mullo_epi16 (_mm_unpackhi_epi8 (v, zero), factors);
+
+      lo = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (lo, one), _mm_srli_epi16 (lo, 8)), 8);
+      hi = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (hi, one), _mm_srli_epi16 (hi, 8)), 8);
+
+      _mm_storeu_si128 ((__m128i *) (line + i * 4), _mm_packus_epi16 (lo, hi));
+    }
+
+  return i;
+}
+#endif
+
+static void
+scale_channels (GdkPixbuf *pixbuf, guint r, guint g, guint b, guint a)
 {
   guchar *pixels;
-  guint r, g, b;
   gboolean has_alpha;
   guint w, h, stride;
   guint pixel_stride;
-  guchar *line;
-  int i;
-  
+#if defined (__SSE2__)
+  __m128i factors = _mm_setr_epi16 (r, g, b, a, r, g, b, a);
+#endif
+
   pixels = gdk_pixbuf_get_pixels (pixbuf);
   has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
-  
-  r = (tint_color & 0xff0000) >> 16;
-  g = (tint_color & 0x00ff00) >> 8;
-  b = (tint_color & 0x0000ff);
 
   w = gdk_pixbuf_get_width (pixbuf);
   h = gdk_pixbuf_get_height (pixbuf);
@@ -70,64 +116,155 @@ apply_tint (GdkPixbuf *pixbuf, guint32 tint_color)
 
   while (h-->0)
     {
-      line = pixels;
-
-      for (i = 0; i < w; i++)
-	{
-	  line[0] = line[0] * r / 0xff;
-	  line[1] = line[1] * g / 0xff;
-	  line[2] = line[2] * b / 0xff;
-	  line += pixel_stride;
-	}
+      guint done = 0;
+
+#if defined (__SSE2__)
+      if (pixel_stride == 4)
+	done = scale_channels_sse2 (pixels, w, factors);
+#endif
+      scale_channels_c (pixels + done * pixel_stride, w - done, pixel_stride,
+			r, g, b, a);
 
       pixels += stride;
     }
 }
 
+static void
+apply_tint (GdkPixbuf *pixbuf, guint32 tint_color)
+{
+  scale_channels (pixbuf,
+		  (tint_color & 0xff0000) >> 16,
+		  (tint_color & 0x00ff00) >> 8,
+		  (tint_color & 0x0000ff),
+		  0xff);
+}
+
 static GdkPixbuf *
 transform_pixbuf (GdkPixbuf *orig,
 		  gboolean has_tint, guint32 tint_color,
-		  double alpha, gint width, gint height)
+		  int alpha_i, gint width, gint height)
 {
   GdkPixbuf *scaled;
   gint p_width, p_height;
 
   p_width = gdk_pixbuf_get_width (orig);
   p_height = gdk_pixbuf_get_height (orig);
-  
-  if (p_width != width ||
-      p_height != height ||
-      alpha < 1.0 ||
-      has_tint)
+
+  if (p_width == width && p_height == height)
     {
-      int alpha_i;
-      
-      if (alpha >= 1.0)
-	alpha_i = 0xff;
-      else if (alpha <= 0.0)
-	alpha_i = 0;
-      else
-	alpha_i = (guint) floor (0xff*alpha);
-      if (alpha != 0xff)
-	{
-	  scaled = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, width, height);
-	  gdk_pixbuf_fill (scaled, 0);
-	  gdk_pixbuf_composite (orig, scaled, 0, 0, width, height,
-				0, 0, (double)width/p_width, (double)height/p_height,
-				GDK_INTERP_BILINEAR, alpha_i);
-	}
-      else
-	scaled = gdk_pixbuf_scale_simple (orig, width, height, GDK_INTERP_BILINEAR);
+      if (alpha_i == 0xff && ! has_tint)
+	return g_object_ref (orig);
+
+      /* No scaling needed, so just scale the alpha channel of a copy
+       * instead of compositing onto an empty pixbuf */
+      scaled = gdk_pixbuf_add_alpha (orig, FALSE, 0, 0, 0);
+      if (alpha_i != 0xff)
+	scale_channels (scaled, 0xff, 0xff, 0xff, alpha_i);
+    }
+  else if (alpha_i != 0xff)
+    {
+      scaled = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+      gdk_pixbuf_fill (scaled, 0);
+      gdk_pixbuf_composite (orig, scaled, 0, 0, width, height,
+			    0, 0, (double)width/p_width, (double)height/p_height,
+			    GDK_INTERP_BILINEAR, alpha_i);
     }
   else
-    scaled = g_object_ref (orig);
-  
+    scaled = gdk_pixbuf_scale_simple (orig, width, height, GDK_INTERP_BILINEAR);
+
   if (has_tint)
     apply_tint (scaled, tint_color);
 
   return scaled;
 }
 
+/*
+ * Transformed pixbufs are shared between the state images of an item and
+ * between items, keyed by everything that goes into the transform.  The
+ * parser already shares source pixbufs by file name, so the source
+ * pointer identifies the image.
+ */
+typedef struct {
+  GdkPixbuf *source;
+  gboolean has_tint;
+  guint32 tint_color;
+  int alpha;
+  gint width;
+  gint height;
+} TransformKey;
+
+static GHashTable *transform_cache = NULL;
+
+static guint
+transform_key_hash (gconstpointer data)
+{
+  const TransformKey *key = data;
+
+  return g_direct_hash (key->source) ^
+	 (key->has_tint ? key->tint_color : 0x5a5a5a5a) ^
+	 ((guint) key->alpha << 24) ^
+	 ((guint) key->width << 12) ^
+	 (guint) key->height;
+}
+
+static gboolean
+transform_key_equal (gconstpointer a, gconstpointer b)
+{
+  const TransformKey *ka = a;
+  const TransformKey *kb = b;
+
+  return ka->source == kb->source &&
+	 ka->has_tint == kb->has_tint &&
+	 (! ka->has_tint || ka->tint_color == kb->tint_color) &&
+	 ka->alpha == kb->alpha &&
+	 ka->width == kb->width &&
+	 ka->height == kb->height;
+}
+
+static void
+transform_key_free (gpointer data)
+{
+  TransformKey *key = data;
+
+  g_object_unref (key->source);
+  g_free (key);
+}
+
+static GdkPixbuf *
+transform_pixbuf_cached (GdkPixbuf *orig,
+			 gboolean has_tint, guint32 tint_color,
+			 int alpha_i, gint width, gint height)
+{
+  TransformKey lookup;
+  TransformKey *key;
+  GdkPixbuf *pb;
+
+  if (transform_cache == NULL)
+    transform_cache = g_hash_table_new_full (transform_key_hash,
+					     transform_key_equal,
+					     transform_key_free,
+					     (GDestroyNotify) g_object_unref);
+
+  lookup.source = orig;
+  lookup.has_tint = has_tint ? TRUE : FALSE;
+  lookup.tint_color = tint_color;
+  lookup.alpha = alpha_i;
+  lookup.width = width;
+  lookup.height = height;
+
+  pb = g_hash_table_lookup (transform_cache, &lookup);
+  if (pb != NULL)
+    return g_object_ref (pb);
+
+  pb = transform_pixbuf (orig, lookup.has_tint, tint_color, alpha_i, width, height);
+
+  key = g_memdup (&lookup, sizeof (lookup));
+  g_object_ref (key->source);
+  g_hash_table_insert (transform_cache, key, g_object_ref (pb));
+
+  return pb;
+}
+
 static void
 activate_button (GtkWidget *widget, gpointer data)
 {
@@ -159,7 +296,8 @@ make_menubar (void)
 	menu = gtk_menu_new ();
 	gtk_menu_item_set_submenu (GTK_MENU_ITEM (w), menu);
 
-	w = gtk_image_menu_item_new_with_mnemonic (_("Select _Language..."));
+	w = gtk_image_menu_item_new_with_mnemonic ("");
+	mdm_common_translate_widget (w, N_("Select _Language..."));
 	gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w), 
 		gtk_image_new_from_icon_name ("preferences-desktop-locale", GTK_ICON_SIZE_MENU));
 
@@ -169,7 +307,8 @@ make_menubar (void)
 			  G_CALLBACK (activate_button),
 			  "language_button");
 
-	w = gtk_image_menu_item_new_with_mnemonic (_("Select _Session..."));
+	w = gtk_image_menu_item_new_with_mnemonic ("");
+	mdm_common_translate_widget (w, N_("Select _Session..."));
 	gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w), 
 		gtk_image_new_from_icon_name ("user-desktop", GTK_ICON_SIZE_MENU));
 
@@ -186,11 +325,13 @@ make_menubar (void)
 	 * flexi, even if not local.  and Disconnect
 	 * only for xdmcp */
 	if ( ! ve_string_empty (g_getenv ("MDM_FLEXI_SERVER"))) {
-		w = gtk_image_menu_item_new_with_mnemonic (_("_Quit"));
+		w = gtk_image_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (w, N_("_Quit"));
 		gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w), 
 			gtk_image_new_from_icon_name ("system-log-out", GTK_ICON_SIZE_MENU));
 	} else if (ve_string_empty (g_getenv ("MDM_IS_LOCAL"))) {
-		w = gtk_image_menu_item_new_with_mnemonic (_("D_isconnect"));
+		w = gtk_image_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (w, N_("D_isconnect"));
 		gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w), 
 			gtk_image_new_from_icon_name ("system-log-out", GTK_ICON_SIZE_MENU));
 	} else {
@@ -357,9 +498,9 @@ greeter_item_create_canvas_item (GreeterItemInfo *item)
 	if (pb != NULL)
 	  {
 	    item->data.pixmap.pixbufs[i] =
-	      transform_pixbuf (pb,
-				(item->data.pixmap.have_tint & (1<<i)), item->data.pixmap.tints[i],
-				(double)item->data.pixmap.alphas[i] / 256.0, rect.width, rect.height);
+	      transform_pixbuf_cached (pb,
+				       (item->data.pixmap.have_tint & (1<<i)), item->data.pixmap.tints[i],
+				       item->data.pixmap.alphas[i], rect.width, rect.height);
 	    g_object_unref (pb);
 	  }
       }
@@ -126,8 +126,13 @@ greeter_item_info_free (GreeterItemInfo *info)
   g_list_foreach (list, (GFunc) greeter_item_info_free, NULL);
   g_list_free (list);
 
-  if (GREETER_ITEM_TYPE_IS_TEXT (info))
-    g_free (info->data.text.orig_text);
+  if (GREETER_ITEM_TYPE_IS_TEXT (info) ||
+      info->item_type == GREETER_ITEM_TYPE_BUTTON)
+    {
+      g_free (info->data.text.orig_text);
+      g_free (info->data.text.stock_type);
+      g_strfreev (info->data.text.translations);
+    }
 
   /* FIXME: what about custom list items! */
 
@@ -162,6 +162,12 @@ struct _GreeterItemInfo {
 
 		  PangoFontDescription *fonts[GREETER_ITEM_STATE_MAX];
 		  char *orig_text;
+		  /* where orig_text came from, to pick it again in
+		     another language: a stock label type, or the
+		     xml:lang and text pairs of the theme with "" for
+		     no xml:lang */
+		  char *stock_type;
+		  char **translations;
 		  guint16 max_width;
 		  guint8 max_screen_percent_width;
 		  guint16 real_max_width;
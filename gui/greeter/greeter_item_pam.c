@@ -41,6 +41,8 @@
 static gboolean messages_to_give = FALSE;
 static gboolean replace_msg = TRUE;
 static guint err_box_clear_handler = 0;
+/* The untranslated prompt when it is one of ours, see relocalize */
+static const char *prompt_msgid = NULL;
 
 gchar *greeter_current_user = NULL;
 
@@ -259,6 +261,13 @@ greeter_item_pam_prompt (const char *message,
   conversation_info = greeter_lookup_id ("pam-prompt");
   entry_info = greeter_lookup_id ("user-pw-entry");
 
+  if (message != NULL && strcmp (message, _("Username:")) == 0)
+    prompt_msgid = N_("Username:");
+  else if (message != NULL && strcmp (message, _("Password:")) == 0)
+    prompt_msgid = N_("Password:");
+  else
+    prompt_msgid = NULL;
+
   if (conversation_info)
     {
       set_text (conversation_info, message);
@@ -305,6 +314,21 @@ greeter_item_pam_prompt (const char *message,
   replace_msg = TRUE;
 }
 
+/*
+ * After a language change puts the prompt up again in the new language,
+ * if it is one we know.  Anything PAM said stays as it is until the next
+ * prompt.
+ */
+void
+greeter_item_pam_relocalize (void)
+{
+  GreeterItemInfo *conversation_info;
+
+  conversation_info = greeter_lookup_id ("pam-prompt");
+  if (conversation_info != NULL && prompt_msgid != NULL)
+    set_text (conversation_info, _(prompt_msgid));
+}
+
 void
 greeter_item_pam_message (const char *message)
 {
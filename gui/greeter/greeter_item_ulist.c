@@ -53,6 +53,7 @@ static GList      *users = NULL;
 static GList      *users_string = NULL;
 static GdkPixbuf  *defface;
 static GHashTable *displays_hash = NULL;
+static gboolean    watching_displays = FALSE;
 
 static GtkWidget  *pam_entry = NULL;
 static GtkWidget  *user_list = NULL;
@@ -112,6 +113,110 @@ greeter_item_ulist_unset_selected_user (void)
 	selected_user = NULL;
 }
 
+static gboolean
+display_entry_matches (gpointer key, gpointer value, gpointer name)
+{
+	return strcmp (value, name) == 0;
+}
+
+static char *
+user_label (MdmUser *usr, gboolean active)
+{
+	char *name;
+	char *label;
+
+	if (usr->gecos && strcmp (usr->gecos, "") != 0) {
+		name = mdm_common_text_to_escaped_utf8 (usr->gecos);
+	} else {
+		name = mdm_common_text_to_escaped_utf8 (usr->login);
+	}
+
+	if (active) {
+		label = g_strdup_printf ("<b>%s</b>\n    <i><small>%s</small></i>",
+					 name,
+					 _("Already logged in"));
+	} else {
+		label = g_strdup_printf ("<b>%s</b>\n",
+					 name);
+	}
+
+	g_free (name);
+
+	return label;
+}
+
+/* Relabels the users whose logged in state changed */
+static void
+update_active_users (void)
+{
+	GtkTreeModel *tm;
+	GtkTreeIter iter = {0};
+	gboolean valid;
+
+	if (user_list == NULL ||
+	    (tm = gtk_tree_view_get_model (GTK_TREE_VIEW (user_list))) == NULL)
+		return;
+
+	for (valid = gtk_tree_model_get_iter_first (tm, &iter);
+	     valid;
+	     valid = gtk_tree_model_iter_next (tm, &iter)) {
+		char     *login;
+		gboolean  active;
+		gboolean  now_active;
+		GList    *li;
+
+		gtk_tree_model_get (tm, &iter,
+				    GREETER_ULIST_LOGIN_COLUMN, &login,
+				    GREETER_ULIST_ACTIVE_COLUMN, &active,
+				    -1);
+
+		now_active = (g_hash_table_lookup (displays_hash, login) != NULL);
+		if (now_active != active) {
+			for (li = users; li != NULL; li = li->next) {
+				MdmUser *usr = li->data;
+
+				if (strcmp (usr->login, login) == 0) {
+					char *label = user_label (usr, now_active);
+
+					gtk_list_store_set (GTK_LIST_STORE (tm), &iter,
+							    GREETER_ULIST_LABEL_COLUMN, label,
+							    GREETER_ULIST_ACTIVE_COLUMN, now_active,
+							    -1);
+					g_free (label);
+					break;
+				}
+			}
+		}
+		g_free (login);
+	}
+}
+
+/* WATCH_DISPLAYS callback, keeps displays_hash current */
+static void
+display_changed (const char *event,
+		 const char *name,
+		 const char *login,
+		 int         vt,
+		 gpointer    data)
+{
+	if (event == NULL) {
+		g_hash_table_remove_all (displays_hash);
+	} else {
+		g_hash_table_foreach_remove (displays_hash,
+					     display_entry_matches,
+					     (gpointer) name);
+
+		if (strcmp (event, MDM_SUP_EVENT_REMOVED) != 0 &&
+		    strcmp (event, MDM_SUP_EVENT_LOGOUT) != 0 &&
+		    ! ve_string_empty (login))
+			g_hash_table_insert (displays_hash,
+					     g_strdup (login),
+					     g_strdup (name));
+	}
+
+	update_active_users ();
+}
+
 static void
 check_for_displays (void)
 {
@@ -119,6 +224,21 @@ check_for_displays (void)
 	char **vec;
 	int    i;
 
+	if (displays_hash == NULL)
+		displays_hash = g_hash_table_new_full (g_str_hash,
+						       g_str_equal,
+						       g_free,
+						       g_free);
+
+	if (watching_displays)
+		return;
+
+	/* Follow logins from here on if the daemon can tell us */
+	if (mdmcomm_watch_displays (display_changed, NULL)) {
+		watching_displays = TRUE;
+		return;
+	}
+
 	/*
 	 * Might be nice to move this call into read_config() so that it happens
 	 * on the same socket call as reading the configuration.
@@ -134,12 +254,6 @@ check_for_displays (void)
 	if (vec == NULL)
 		return;
 
-	if (displays_hash == NULL)
-		displays_hash = g_hash_table_new_full (g_str_hash,
-						       g_str_equal,
-						       g_free,
-						       g_free);
-
 	for (i = 0; vec[i] != NULL; i++) {
 		char **rvec;
 
@@ -184,30 +298,14 @@ greeter_populate_user_list (GtkTreeModel *tm)
 		MdmUser    *usr = li->data;
 		GtkTreeIter iter = {0};
 		char       *label;
-		char       *name;
 		gboolean    active;
 
-		if (usr->gecos && strcmp (usr->gecos, "") != 0) {
-			name = mdm_common_text_to_escaped_utf8 (usr->gecos);
-		} else {
-			name = mdm_common_text_to_escaped_utf8 (usr->login);
-		}
-
 		if (g_hash_table_lookup (displays_hash, usr->login))
 			active = TRUE;
 		else
 			active = FALSE;
 
-		if (active) {
-			label = g_strdup_printf ("<b>%s</b>\n    <i><small>%s</small></i>",
-						 name,
-						 _("Already logged in"));
-		} else {
-			label = g_strdup_printf ("<b>%s</b>\n",
-						 name);
-		}
-
-		g_free (name);
+		label = user_label (usr, active);
 
 		gtk_list_store_append (GTK_LIST_STORE (tm), &iter);
 		gtk_list_store_set (GTK_LIST_STORE (tm), &iter,
@@ -332,9 +430,11 @@ greeter_generate_userlist (GtkWidget *tv, GreeterItemInfo *info)
 		}
 	}
 
-	/* we are done with the hash */
-	g_hash_table_destroy (displays_hash);
-	displays_hash = NULL;
+	/* we are done with the hash, unless it is being kept current */
+	if ( ! watching_displays) {
+		g_hash_table_destroy (displays_hash);
+		displays_hash = NULL;
+	}
 }
 
 static inline void
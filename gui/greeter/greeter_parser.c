@@ -28,17 +28,22 @@
 #include <glib/gi18n.h>
 #include <gdk/gdkx.h>
 #include <syslog.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
 
 #include "mdmwm.h"
 #include "mdmcommon.h"
 #include "mdmconfig.h"
 
 #include "mdm-common.h"
+#include "mdm-log.h"
 #include "mdm-daemon-config-keys.h"
 
 #include "greeter_configuration.h"
 #include "greeter_parser.h"
 #include "greeter_events.h"
+#include "greeter_canvas_item.h"
+#include "greeter_theme_cache.h"
 #include "mdm.h"
 
 /* FIXME: hack */
@@ -307,6 +312,52 @@ parse_pos (xmlNodePtr       node,
   return TRUE;
 }
 
+static const struct {
+  const char *type;
+  const char *msgid;
+} stock_labels[] = {
+  { "language",          N_("_Language") },
+  { "session",           N_("_Session") },
+  { "system",            N_("_Actions") },
+  { "disconnect",        N_("D_isconnect") },
+  { "quit",              N_("_Quit") },
+  { "halt",              N_("Shut _Down") },
+  { "suspend",           N_("Sus_pend") },
+  { "reboot",            N_("_Restart") },
+  { "chooser",           N_("Remote Login via _XDMCP") },
+  { "config",            N_("Confi_gure") },
+  { "options",           N_("Op_tions") },
+  { "caps-lock-warning", N_("Caps Lock is on.") },
+  { "timed-label",       N_("User %u will login in %t") },
+  /* the welcome message from the configuration */
+  { "welcome-label",     NULL },
+  /* FIXME: is this actually needed? */
+  { "username-label",    N_("Username:") },
+  { "ok",                N_("_OK") },
+  { "cancel",            N_("_Cancel") },
+  { "startagain",        N_("_Start Again") },
+};
+
+/* The text of a stock label in the current language, NULL for an
+ * unknown type */
+static char *
+stock_label_text (const char *type)
+{
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (stock_labels); i++)
+    {
+      if (g_ascii_strcasecmp (type, stock_labels[i].type) != 0)
+	continue;
+
+      if (stock_labels[i].msgid == NULL)
+	return mdm_common_get_welcomemsg ();
+      return g_strdup (_(stock_labels[i].msgid));
+    }
+
+  return NULL;
+}
+
 /* We pass the same arguments as to translated text, since we'll override it
  * with translation score */
 static gboolean
@@ -317,107 +368,13 @@ parse_stock (xmlNodePtr node,
 	     GError   **error)
 {
   xmlChar *prop;
-  int i = -1;
-  gchar * key_string = NULL;
+  char *text;
 
   prop = xmlGetProp (node,(const xmlChar *) "type");
   if (prop)
     {
-      if (g_ascii_strcasecmp ((char *) prop, "language") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Language"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "session") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Session"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "system") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Actions"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "disconnect") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("D_isconnect"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "quit") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Quit"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "halt") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Shut _Down"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "suspend") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Sus_pend"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "reboot") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Restart"));
-	}  
-      else if (g_ascii_strcasecmp ((char *) prop, "chooser") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Remote Login via _XDMCP"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "config") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Confi_gure"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "options") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Op_tions"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "caps-lock-warning") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Caps Lock is on."));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "timed-label") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("User %u will login in %t"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "welcome-label") == 0)
-        {
-	  /* FIXME: hack */
-	  welcome_string_info = info;
-
-	  g_free (*translated_text);
-	  *translated_text = mdm_common_get_welcomemsg ();
-	}
-      /* FIXME: is this actually needed? */
-      else if (g_ascii_strcasecmp ((char *) prop, "username-label") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Username:"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "ok") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_OK"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "cancel") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Cancel"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "startagain") == 0)
-        {
-          g_free (*translated_text);
-          *translated_text = g_strdup (_("_Start Again"));
-        }     
-      else
+      text = stock_label_text ((char *) prop);
+      if (text == NULL)
       {
 	      g_set_error (error,
 			   GREETER_PARSER_ERROR,
@@ -427,6 +384,18 @@ parse_stock (xmlNodePtr node,
 	      return FALSE;	      
 	}
 
+      if (g_ascii_strcasecmp ((char *) prop, "welcome-label") == 0)
+        {
+	  /* FIXME: hack */
+	  welcome_string_info = info;
+	}
+
+      g_free (*translated_text);
+      *translated_text = text;
+
+      g_free (info->data.text.stock_type);
+      info->data.text.stock_type = g_strdup ((char *) prop);
+
       /* This is the very very very best "translation" */
       *translation_score = -1;
 
@@ -1292,6 +1261,73 @@ parse_translated_text (xmlNodePtr node,
   return TRUE;
 }
 
+/* The text children of node as language and text pairs, for
+ * pick_translation */
+static char **
+collect_translations (xmlNodePtr node)
+{
+  GPtrArray *translations;
+  xmlNodePtr child;
+  xmlChar *prop;
+
+  translations = g_ptr_array_new ();
+
+  for (child = node->children; child != NULL; child = child->next)
+    {
+      if (child->type != XML_ELEMENT_NODE ||
+	  strcmp ((char *) child->name, "text") != 0)
+	continue;
+
+      prop = xmlNodeGetLang (child);
+      g_ptr_array_add (translations, g_strdup (prop ? (char *) prop : ""));
+      if (prop)
+	xmlFree (prop);
+
+      prop = xmlNodeGetContent (child);
+      g_ptr_array_add (translations, g_strdup (prop ? (char *) prop : ""));
+      if (prop)
+	xmlFree (prop);
+    }
+
+  g_ptr_array_add (translations, NULL);
+  return (char **) g_ptr_array_free (translations, FALSE);
+}
+
+/* Does what parse_translated_text and the evil hack below do, for the
+ * current language.  NULL if no text is in a language we speak. */
+static char *
+pick_translation (char **translations)
+{
+  const char *text = NULL;
+  gint translation_score = 1000;
+  int i;
+
+  for (i = 0; translations[i] != NULL && translations[i + 1] != NULL; i += 2)
+    {
+      gint score;
+
+      if (translations[i][0] != '\0')
+	score = is_current_locale (translations[i]);
+      else
+	score = 999;
+
+      if (score < translation_score)
+	{
+	  translation_score = score;
+	  text = translations[i + 1];
+	}
+    }
+
+  if (text == NULL)
+    return NULL;
+
+  if (translation_score == 999 &&
+      ! ve_string_empty (text))
+    return g_strdup (_(text));
+
+  return g_strdup (text);
+}
+
 static gboolean
 parse_label_pos_extras (xmlNodePtr       node,
 			GreeterItemInfo *info,
@@ -1437,6 +1473,11 @@ parse_label (xmlNodePtr        node,
   do_font_size_reduction (info);
 
   info->data.text.orig_text = translated_text;
+
+  /* To pick the text again when the language changes.  A stock label
+   * wins over any text. */
+  if (info->data.text.stock_type == NULL)
+    info->data.text.translations = collect_translations (node);
   
   return TRUE;
 }
@@ -1785,6 +1826,177 @@ greeter_info_id_hash (GreeterItemInfo *key)
   return g_str_hash (key->id);
 }
 
+/* Everything besides the XML itself that the parse result depends on */
+static char *
+theme_cache_key (const char *file)
+{
+  const char * const *langs;
+  struct stat s, ds;
+  GString *key;
+  char *dir;
+  int i;
+
+  dir = g_path_get_dirname (file);
+  if (g_stat (file, &s) < 0 || g_stat (dir, &ds) < 0)
+    {
+      g_free (dir);
+      return NULL;
+    }
+  g_free (dir);
+
+  key = g_string_new (VERSION);
+  g_string_append_printf (key, "\n%s %ld %ld %ld\n%s\n",
+			  file, (long) s.st_mtime, (long) s.st_size,
+			  (long) ds.st_mtime, ve_sure_string (file_search_path));
+
+  /* the translated strings */
+  langs = g_get_language_names ();
+  for (i = 0; langs[i] != NULL; i++)
+    g_string_append_printf (key, "%s:", langs[i]);
+
+  /* the font size reduction in do_font_size_reduction */
+  g_string_append_printf (key, "\n%d",
+			  mdm_wm_screen.width <= 640 ? 2 :
+			  mdm_wm_screen.width <= 800 ? 1 : 0);
+
+  return g_string_free (key, FALSE);
+}
+
+static char *
+default_font_string (void)
+{
+  if (gtk_widget_get_default_style ()->font_desc)
+    return pango_font_description_to_string (gtk_widget_get_default_style ()->font_desc);
+  return g_strdup ("");
+}
+
+static void
+setup_theme_gtk (const char *file, const char *gtk_theme)
+{
+  char *dirtheme, *gtkrc;
+
+  dirtheme = g_path_get_dirname (file);
+  gtkrc = g_build_filename (dirtheme, "gtk-2.0", "gtkrc", NULL);
+  if (g_file_test (gtkrc, G_FILE_TEST_IS_REGULAR))
+    gtk_rc_parse (gtkrc);
+  g_free (dirtheme);
+  g_free (gtkrc);
+
+  /*
+   * The gtk-theme property specifies a theme specific gtk-theme to use
+   */
+  if (gtk_theme != NULL)
+    {
+      gchar *theme_dir;
+
+      /*
+       * It might be nice if we allowed this property to also supply a gtkrc file
+       * that could be included in the theme.  Perhaps we should check first in
+       * the theme directory for a gtkrc file by the provided name and use that
+       * if found.
+       */
+      theme_dir = g_strdup_printf ("%s/%s", gtk_rc_get_theme_dir (), gtk_theme);
+      if (g_file_test (theme_dir, G_FILE_TEST_IS_DIR))
+         mdm_set_theme (gtk_theme);
+      g_free (theme_dir);
+    }
+}
+
+static void
+setup_root (GreeterItemInfo *root, GList *items,
+	    GnomeCanvas *canvas, int width, int height)
+{
+  root->fixed_children = items;
+  
+  root->x = 0;
+  root->y = 0;
+  root->x_type = GREETER_ITEM_POS_ABSOLUTE;
+  root->y_type = GREETER_ITEM_POS_ABSOLUTE;
+
+  root->width = width;
+  root->height = height;
+  root->width_type = GREETER_ITEM_SIZE_ABSOLUTE;
+  root->width_type = GREETER_ITEM_SIZE_ABSOLUTE;
+
+  root->group_item = gnome_canvas_root (canvas);
+}
+
+/* Redoes what parse_id, parse_stock and parse_list do outside the item */
+static void
+register_cached_item (GreeterItemInfo *info, guint flags, gpointer data)
+{
+  if (info->id != NULL)
+    g_hash_table_insert (item_hash, info, info);
+
+  if (flags & GREETER_THEME_CACHE_WELCOME)
+    {
+      /* FIXME: hack */
+      welcome_string_info = info;
+
+      g_free (info->data.text.orig_text);
+      info->data.text.orig_text = mdm_common_get_welcomemsg ();
+    }
+
+  if (flags & GREETER_THEME_CACHE_CUSTOM)
+    custom_items = g_list_append (custom_items, info);
+}
+
+static char *
+theme_cache_file (const char *authdir, const char *file)
+{
+  char *sum, *name, *path;
+
+  sum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, file, -1);
+  name = g_strconcat (GREETER_THEME_CACHE_PREFIX, sum, NULL);
+  path = g_build_filename (authdir, name, NULL);
+  g_free (name);
+  g_free (sum);
+
+  return path;
+}
+
+/* The gtk setup is only done once the cache turned out to be usable, the
+ * XML parse does it otherwise */
+static GreeterItemInfo *
+greeter_parse_cached (const char *file, const char *cache_file, const char *key,
+		      const char *font, GnomeCanvas *canvas, int width, int height)
+{
+  GreeterThemeCache *cache;
+  GreeterItemInfo *root;
+  GList *items;
+  gboolean res;
+
+  cache = greeter_theme_cache_open (cache_file, key);
+  if (cache == NULL)
+    return NULL;
+
+  item_hash = g_hash_table_new ((GHashFunc)greeter_info_id_hash,
+				(GEqualFunc)greeter_info_id_equal);
+
+  root = greeter_item_info_new (NULL, GREETER_ITEM_TYPE_RECT);
+
+  res = greeter_theme_cache_load_items (cache, font, root, &items,
+					register_cached_item, NULL);
+
+  if G_UNLIKELY (!res)
+    {
+      greeter_theme_cache_free (cache);
+      g_hash_table_destroy (item_hash);
+      item_hash = NULL;
+      greeter_item_info_free (root);
+      return NULL;
+    }
+
+  setup_theme_gtk (file, greeter_theme_cache_get_gtk_theme (cache));
+  greeter_theme_cache_free (cache);
+
+  mdm_debug ("Loaded compiled theme for %s", file);
+
+  setup_root (root, items, canvas, width, height);
+
+  return root;
+}
+
 GreeterItemInfo *
 greeter_parse (const char *file, const char *datadir,
 	       GnomeCanvas *canvas,
@@ -1796,7 +2008,11 @@ greeter_parse (const char *file, const char *datadir,
   xmlChar *prop;
   gboolean res;
   GList *items;
-  char *dirtheme, *gtkrc;
+  char *gtk_theme = NULL;
+  char *cache_file = NULL;
+  char *cache_key = NULL;
+  char *font = NULL;
+  const char *authdir;
   
   /* FIXME: EVIL! GLOBAL! */
   g_free (file_search_path);
@@ -1810,11 +2026,36 @@ greeter_parse (const char *file, const char *datadir,
 		   "Can't open file %s", file);
       return NULL;
     }
-  
+
+  authdir = mdm_config_get_string (MDM_KEY_SERV_AUTHDIR);
+  if ( ! ve_string_empty (authdir))
+    {
+      cache_file = theme_cache_file (authdir, file);
+      cache_key = theme_cache_key (file);
+      /* Taken before the theme's gtk setup, both when loading and
+       * when saving, so that the two compare */
+      font = default_font_string ();
+    }
+
+  if (cache_key != NULL)
+    {
+      root = greeter_parse_cached (file, cache_file, cache_key, font,
+				   canvas, width, height);
+      if (root != NULL)
+	{
+	  g_free (cache_file);
+	  g_free (cache_key);
+	  g_free (font);
+	  return root;
+	}
+    }
 
   doc = xmlParseFile (file);
   if G_UNLIKELY (doc == NULL)
     {
+      g_free (cache_file);
+      g_free (cache_key);
+      g_free (font);
       g_set_error (error,
 		   GREETER_PARSER_ERROR,
 		   GREETER_PARSER_ERROR_BAD_XML,
@@ -1826,6 +2067,9 @@ greeter_parse (const char *file, const char *datadir,
   if G_UNLIKELY (node == NULL)
     {
       xmlFreeDoc (doc);
+      g_free (cache_file);
+      g_free (cache_key);
+      g_free (font);
       g_set_error (error,
 		   GREETER_PARSER_ERROR,
 		   GREETER_PARSER_ERROR_BAD_XML,
@@ -1836,6 +2080,9 @@ greeter_parse (const char *file, const char *datadir,
   if G_UNLIKELY (strcmp ((char *) node->name, "greeter") != 0)
     {
       xmlFreeDoc (doc);
+      g_free (cache_file);
+      g_free (cache_key);
+      g_free (font);
       g_set_error (error,
 		   GREETER_PARSER_ERROR,
 		   GREETER_PARSER_ERROR_WRONG_TYPE,
@@ -1843,34 +2090,15 @@ greeter_parse (const char *file, const char *datadir,
       return NULL;
     }
 
-  dirtheme = g_path_get_dirname (file);
-  gtkrc = g_build_filename (dirtheme, "gtk-2.0", "gtkrc", NULL);
-  if (g_file_test (gtkrc, G_FILE_TEST_IS_REGULAR))
-    gtk_rc_parse (gtkrc);
-  g_free (dirtheme);
-  g_free (gtkrc);
-
-  /*
-   * The gtk-theme property specifies a theme specific gtk-theme to use
-   */
   prop = xmlGetProp (node, (const xmlChar *) "gtk-theme");
   if (prop)
     {
-      gchar *theme_dir;
-
-      /*
-       * It might be nice if we allowed this property to also supply a gtkrc file
-       * that could be included in the theme.  Perhaps we should check first in
-       * the theme directory for a gtkrc file by the provided name and use that
-       * if found.
-       */
-      theme_dir = g_strdup_printf ("%s/%s", gtk_rc_get_theme_dir (), (char *) prop);
-      if (g_file_test (theme_dir, G_FILE_TEST_IS_DIR))
-         mdm_set_theme ((char *) prop);
-
+      gtk_theme = g_strdup ((char *) prop);
       xmlFree (prop);
     }
 
+  setup_theme_gtk (file, gtk_theme);
+
   item_hash = g_hash_table_new ((GHashFunc)greeter_info_id_hash,
 				(GEqualFunc)greeter_info_id_equal);
   
@@ -1878,6 +2106,14 @@ greeter_parse (const char *file, const char *datadir,
   root = greeter_item_info_new (NULL, GREETER_ITEM_TYPE_RECT);
   res = parse_items (node, &items, root, error);
 
+  if (res && cache_key != NULL)
+    greeter_theme_cache_save (cache_file, cache_key, gtk_theme, font,
+			      items, welcome_string_info, custom_items);
+  g_free (cache_file);
+  g_free (cache_key);
+  g_free (font);
+  g_free (gtk_theme);
+
   /* Now we can whack the hash, we don't want to keep cached
      pixbufs around anymore */
   if (pixbuf_hash != NULL) {
@@ -1910,19 +2146,7 @@ greeter_parse (const char *file, const char *datadir,
 
   xmlFreeDoc (doc);
 
-  root->fixed_children = items;
-  
-  root->x = 0;
-  root->y = 0;
-  root->x_type = GREETER_ITEM_POS_ABSOLUTE;
-  root->y_type = GREETER_ITEM_POS_ABSOLUTE;
-
-  root->width = width;
-  root->height = height;
-  root->width_type = GREETER_ITEM_SIZE_ABSOLUTE;
-  root->width_type = GREETER_ITEM_SIZE_ABSOLUTE;
-
-  root->group_item = gnome_canvas_root (canvas);
+  setup_root (root, items, canvas, width, height);
   
   return root;
 }
@@ -1980,3 +2204,67 @@ greeter_show_only_background (GreeterItemInfo *root_item)
 
 	return found_background;
 }
+
+static void
+relocalize_item (GreeterItemInfo *info, gpointer user_data)
+{
+  char *text = NULL;
+
+  if (GREETER_ITEM_TYPE_IS_TEXT (info) ||
+      info->item_type == GREETER_ITEM_TYPE_BUTTON)
+    {
+      if (info->data.text.stock_type != NULL)
+	text = stock_label_text (info->data.text.stock_type);
+      else if (info->data.text.translations != NULL)
+	text = pick_translation (info->data.text.translations);
+    }
+
+  if (text != NULL &&
+      strcmp (text, ve_sure_string (info->data.text.orig_text)) != 0)
+    {
+      g_free (info->data.text.orig_text);
+      info->data.text.orig_text = text;
+      text = NULL;
+
+      /* The pam items show what the slave sent, not their own text */
+      if (info->id != NULL && strncmp (info->id, "pam-", 4) == 0)
+	;
+      else if (info->item_type == GREETER_ITEM_TYPE_LABEL &&
+	       info->item != NULL)
+	{
+	  char *expanded = mdm_common_expand_text (info->data.text.orig_text);
+
+	  greeter_canvas_item_break_set_string (info,
+						expanded,
+						TRUE /* markup */,
+						info->data.text.real_max_width,
+						NULL /* width */,
+						NULL /* height */,
+						NULL /* canvas */,
+						info->item);
+	  g_free (expanded);
+	}
+      else if (info->item_type == GREETER_ITEM_TYPE_BUTTON &&
+	       info->item != NULL &&
+	       GNOME_IS_CANVAS_WIDGET (info->item))
+	{
+	  gtk_button_set_label (GTK_BUTTON (GNOME_CANVAS_WIDGET (info->item)->widget),
+				info->data.text.orig_text);
+	}
+    }
+  g_free (text);
+
+  g_list_foreach (info->fixed_children, (GFunc) relocalize_item, user_data);
+  g_list_foreach (info->box_children, (GFunc) relocalize_item, user_data);
+}
+
+/*
+ * Picks the texts of the theme again for the current language and puts
+ * them on the canvas.  The items keep their place, the layout is not
+ * redone.
+ */
+void
+greeter_parser_relocalize (GreeterItemInfo *root_item)
+{
+  relocalize_item (root_item, NULL);
+}
@@ -154,7 +154,8 @@ greeter_system_append_system_menu (GtkWidget *menu)
 	if (mdm_config_get_bool (MDM_KEY_CONFIG_AVAILABLE) &&
 	    !mdm_config_get_bool (MDM_KEY_ADD_GTK_MODULES) &&
 	    bin_exists (mdm_config_get_string (MDM_KEY_CONFIGURATOR))) {
-		w = gtk_image_menu_item_new_with_mnemonic (_("Confi_gure Login Manager..."));
+		w = gtk_image_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (w, N_("Confi_gure Login Manager..."));
 		gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w),
 			gtk_image_new_from_icon_name ("mdmsetup", GTK_ICON_SIZE_MENU));
 
@@ -172,7 +173,8 @@ greeter_system_append_system_menu (GtkWidget *menu)
 	}
 
 	if (MdmRebootFound && mdm_common_is_action_available ("REBOOT")) {
- 		w = gtk_image_menu_item_new_with_mnemonic (_("_Restart"));
+ 		w = gtk_image_menu_item_new_with_mnemonic ("");
+ 		mdm_common_translate_widget (w, N_("_Restart"));
  		gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w),
  					       gtk_image_new_from_icon_name ("system-restart", GTK_ICON_SIZE_MENU));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menu), w);
@@ -183,7 +185,8 @@ greeter_system_append_system_menu (GtkWidget *menu)
 	}
 
 	if (MdmHaltFound && mdm_common_is_action_available ("HALT")) {
- 		w = gtk_image_menu_item_new_with_mnemonic (_("Shut _Down"));
+ 		w = gtk_image_menu_item_new_with_mnemonic ("");
+ 		mdm_common_translate_widget (w, N_("Shut _Down"));
  		gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w), 
  					       gtk_image_new_from_icon_name ("system-shut-down", GTK_ICON_SIZE_MENU));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menu), w);
@@ -194,7 +197,8 @@ greeter_system_append_system_menu (GtkWidget *menu)
 	}
 
 	if (MdmSuspendFound && mdm_common_is_action_available ("SUSPEND")) {
- 		w = gtk_image_menu_item_new_with_mnemonic (_("Sus_pend"));
+ 		w = gtk_image_menu_item_new_with_mnemonic ("");
+ 		mdm_common_translate_widget (w, N_("Sus_pend"));
  		gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (w),
  					       gtk_image_new_from_icon_name ("system-suspend", GTK_ICON_SIZE_MENU));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menu), w);
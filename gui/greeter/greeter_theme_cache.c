@@ -0,0 +1,800 @@
+/* MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Compiled themes.
+ *
+ * The file is a header, a metadata section and a pixel section:
+ *
+ *   "MDMTHM03" meta_len:u32 pixel_offset:u32
+ *   key gtk_theme default_font
+ *   n_pixbufs { file mtime width height rowstride has_alpha offset }
+ *   n_items { item ... }                           (pre-order)
+ *   ...                                            (padding)
+ *   pixels, rows packed, each pixbuf 16 byte aligned
+ *
+ * Integers are native endian, strings are a u32 length plus one (0 for
+ * NULL) followed by the bytes, string vectors a u32 count plus one (0
+ * for NULL) followed by the strings.  The file only ever lives on the machine
+ * that wrote it.  Pixmaps are handed out as pixbufs pointing straight
+ * into the mapping, so a warm start decodes neither XML nor PNG.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+#include "mdm-common.h"
+#include "mdm-log.h"
+
+#include "greeter_item.h"
+#include "greeter_theme_cache.h"
+
+#define CACHE_MAGIC "MDMTHM03"
+#define HEADER_SIZE 16
+/* No theme image is anywhere near this, and it keeps the pixel sizes
+ * well within what GdkPixbuf takes */
+#define MAX_DIMENSION 32768
+
+struct _GreeterThemeCache {
+  GMappedFile *file;
+  const guchar *data;
+  gsize len;
+  gsize pixel_offset;
+
+  /* reader position in the metadata section */
+  const guchar *p;
+  const guchar *end;
+  gboolean bad;
+
+  char *gtk_theme;
+  char *default_font;
+
+  guint n_pixbufs;
+  GdkPixbuf **pixbufs;
+};
+
+/* writing */
+
+static void
+put_u32 (GString *str, guint32 v)
+{
+  g_string_append_len (str, (const char *) &v, sizeof (v));
+}
+
+static void
+put_float (GString *str, float v)
+{
+  g_string_append_len (str, (const char *) &v, sizeof (v));
+}
+
+static void
+put_string (GString *str, const char *s)
+{
+  if (s == NULL)
+    {
+      put_u32 (str, 0);
+      return;
+    }
+  put_u32 (str, strlen (s) + 1);
+  g_string_append_len (str, s, strlen (s));
+}
+
+static void
+put_strv (GString *str, char **v)
+{
+  int i;
+
+  if (v == NULL)
+    {
+      put_u32 (str, 0);
+      return;
+    }
+  put_u32 (str, g_strv_length (v) + 1);
+  for (i = 0; v[i] != NULL; i++)
+    put_string (str, v[i]);
+}
+
+static void
+put_font (GString *str, PangoFontDescription *font)
+{
+  char *s;
+
+  if (font == NULL)
+    {
+      put_string (str, NULL);
+      return;
+    }
+  s = pango_font_description_to_string (font);
+  put_string (str, s);
+  g_free (s);
+}
+
+typedef struct {
+  GString *meta;
+  GHashTable *pixbuf_index;	/* GdkPixbuf * -> index + 1 */
+  GPtrArray *pixbufs;
+  GPtrArray *pixbuf_files;
+  GreeterItemInfo *welcome_info;
+  GList *custom_items;
+} Writer;
+
+static void put_items (Writer *w, GList *items);
+
+static guint32
+pixbuf_index (Writer *w, GdkPixbuf *pb, const char *file)
+{
+  gpointer idx;
+
+  if (pb == NULL)
+    return 0;
+
+  idx = g_hash_table_lookup (w->pixbuf_index, pb);
+  if (idx == NULL)
+    {
+      g_ptr_array_add (w->pixbufs, pb);
+      g_ptr_array_add (w->pixbuf_files, (gpointer) file);
+      idx = GUINT_TO_POINTER (w->pixbufs->len);
+      g_hash_table_insert (w->pixbuf_index, pb, idx);
+    }
+  return GPOINTER_TO_UINT (idx);
+}
+
+static void
+put_item (Writer *w, GreeterItemInfo *info)
+{
+  GString *m = w->meta;
+  guint flags = 0;
+  GList *li;
+  int i;
+
+  if (info == w->welcome_info)
+    flags |= GREETER_THEME_CACHE_WELCOME;
+  if (g_list_find (w->custom_items, info) != NULL)
+    flags |= GREETER_THEME_CACHE_CUSTOM;
+
+  put_u32 (m, info->item_type);
+  put_u32 (m, flags);
+
+  put_u32 (m, info->anchor);
+  put_float (m, info->x);
+  put_float (m, info->y);
+  put_float (m, info->width);
+  put_float (m, info->height);
+  put_u32 (m, info->minimum_required_screen_width);
+  put_u32 (m, info->minimum_required_screen_height);
+
+  put_u32 (m, info->x_type);
+  put_u32 (m, info->y_type);
+  put_u32 (m, info->width_type);
+  put_u32 (m, info->height_type);
+  put_u32 (m, info->x_negative);
+  put_u32 (m, info->y_negative);
+  put_u32 (m, info->expand);
+  put_u32 (m, info->show_modes);
+  put_u32 (m, info->box_homogeneous);
+  put_u32 (m, info->canvasbutton);
+  put_u32 (m, info->gtkbutton);
+  put_u32 (m, info->background);
+  put_u32 (m, info->have_state);
+
+  put_string (m, info->show_type);
+  put_string (m, info->id);
+
+  put_u32 (m, info->box_orientation);
+  put_u32 (m, info->box_x_padding);
+  put_u32 (m, info->box_y_padding);
+  put_u32 (m, info->box_min_width);
+  put_u32 (m, info->box_min_height);
+  put_u32 (m, info->box_spacing);
+
+  switch (info->item_type)
+    {
+    case GREETER_ITEM_TYPE_LABEL:
+    case GREETER_ITEM_TYPE_ENTRY:
+    case GREETER_ITEM_TYPE_BUTTON:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  put_u32 (m, info->data.text.alphas[i]);
+	  put_u32 (m, info->data.text.colors[i]);
+	  put_font (m, info->data.text.fonts[i]);
+	}
+      put_u32 (m, info->data.text.have_color);
+      put_string (m, info->data.text.orig_text);
+      put_string (m, info->data.text.stock_type);
+      put_strv (m, info->data.text.translations);
+      put_u32 (m, info->data.text.max_width);
+      put_u32 (m, info->data.text.max_screen_percent_width);
+      put_u32 (m, info->data.text.real_max_width);
+      break;
+
+    case GREETER_ITEM_TYPE_PIXMAP:
+    case GREETER_ITEM_TYPE_SVG:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  put_u32 (m, info->data.pixmap.alphas[i]);
+	  put_u32 (m, info->data.pixmap.tints[i]);
+	  put_string (m, info->data.pixmap.files[i]);
+	  put_u32 (m, pixbuf_index (w, info->data.pixmap.pixbufs[i],
+				    info->data.pixmap.files[i]));
+	}
+      put_u32 (m, info->data.pixmap.have_tint);
+      break;
+
+    case GREETER_ITEM_TYPE_LIST:
+      put_string (m, info->data.list.icon_color);
+      put_string (m, info->data.list.label_color);
+      put_u32 (m, info->data.list.combo_type);
+      put_u32 (m, g_list_length (info->data.list.items));
+      for (li = info->data.list.items; li != NULL; li = li->next)
+	{
+	  GreeterItemListItem *item = li->data;
+	  put_string (m, item->id);
+	  put_string (m, item->text);
+	}
+      break;
+
+    case GREETER_ITEM_TYPE_RECT:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  put_u32 (m, info->data.rect.alphas[i]);
+	  put_u32 (m, info->data.rect.colors[i]);
+	}
+      put_u32 (m, info->data.rect.have_color);
+      break;
+    }
+
+  put_items (w, info->fixed_children);
+  put_items (w, info->box_children);
+}
+
+static void
+put_items (Writer *w, GList *items)
+{
+  GList *li;
+
+  put_u32 (w->meta, g_list_length (items));
+  for (li = items; li != NULL; li = li->next)
+    put_item (w, li->data);
+}
+
+gboolean
+greeter_theme_cache_save (const char      *cache_file,
+			  const char      *key,
+			  const char      *gtk_theme,
+			  const char      *default_font,
+			  GList           *items,
+			  GreeterItemInfo *welcome_info,
+			  GList           *custom_items)
+{
+  Writer w;
+  GString *tree;
+  GString *out;
+  gsize offset;
+  guint i;
+  gboolean ret;
+  GError *error = NULL;
+
+  w.meta = g_string_new (NULL);
+  w.pixbuf_index = g_hash_table_new (NULL, NULL);
+  w.pixbufs = g_ptr_array_new ();
+  w.pixbuf_files = g_ptr_array_new ();
+  w.welcome_info = welcome_info;
+  w.custom_items = custom_items;
+
+  /* The pixbuf table goes before the tree but is only known after
+   * walking it, so write the tree into its own string first */
+  put_items (&w, items);
+  tree = w.meta;
+  w.meta = g_string_new (NULL);
+
+  put_string (w.meta, key);
+  put_string (w.meta, gtk_theme);
+  put_string (w.meta, default_font);
+
+  put_u32 (w.meta, w.pixbufs->len);
+  offset = 0;
+  for (i = 0; i < w.pixbufs->len; i++)
+    {
+      GdkPixbuf *pb = g_ptr_array_index (w.pixbufs, i);
+      const char *file = g_ptr_array_index (w.pixbuf_files, i);
+      struct stat s;
+
+      if (file == NULL || g_stat (file, &s) < 0)
+	s.st_mtime = 0;
+
+      put_string (w.meta, file);
+      put_u32 (w.meta, (guint32) s.st_mtime);
+      put_u32 (w.meta, gdk_pixbuf_get_width (pb));
+      put_u32 (w.meta, gdk_pixbuf_get_height (pb));
+      put_u32 (w.meta, gdk_pixbuf_get_width (pb) * gdk_pixbuf_get_n_channels (pb));
+      put_u32 (w.meta, gdk_pixbuf_get_has_alpha (pb));
+      put_u32 (w.meta, offset);
+
+      offset += gdk_pixbuf_get_width (pb) * gdk_pixbuf_get_n_channels (pb) *
+		gdk_pixbuf_get_height (pb);
+      offset = (offset + 15) & ~15;
+    }
+
+  g_string_append_len (w.meta, tree->str, tree->len);
+  g_string_free (tree, TRUE);
+
+  out = g_string_sized_new (HEADER_SIZE + w.meta->len + offset + 16);
+  g_string_append_len (out, CACHE_MAGIC, 8);
+  put_u32 (out, w.meta->len);
+  put_u32 (out, (HEADER_SIZE + w.meta->len + 15) & ~15);
+  g_string_append_len (out, w.meta->str, w.meta->len);
+
+  for (i = 0; i < w.pixbufs->len; i++)
+    {
+      GdkPixbuf *pb = g_ptr_array_index (w.pixbufs, i);
+      const guchar *pixels = gdk_pixbuf_get_pixels (pb);
+      int rowstride = gdk_pixbuf_get_rowstride (pb);
+      int row_len = gdk_pixbuf_get_width (pb) * gdk_pixbuf_get_n_channels (pb);
+      int y;
+
+      while (out->len % 16 != 0)
+	g_string_append_c (out, '\0');
+      for (y = 0; y < gdk_pixbuf_get_height (pb); y++)
+	g_string_append_len (out, (const char *) pixels + y * rowstride, row_len);
+    }
+
+  ret = g_file_set_contents (cache_file, out->str, out->len, &error);
+  if ( ! ret)
+    {
+      mdm_debug ("Could not write compiled theme: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_string_free (out, TRUE);
+  g_string_free (w.meta, TRUE);
+  g_hash_table_destroy (w.pixbuf_index);
+  g_ptr_array_free (w.pixbufs, TRUE);
+  g_ptr_array_free (w.pixbuf_files, TRUE);
+
+  return ret;
+}
+
+/* reading */
+
+static guint32
+get_u32 (GreeterThemeCache *cache)
+{
+  guint32 v;
+
+  if (cache->bad || cache->end - cache->p < (gssize) sizeof (v))
+    {
+      cache->bad = TRUE;
+      return 0;
+    }
+  memcpy (&v, cache->p, sizeof (v));
+  cache->p += sizeof (v);
+  return v;
+}
+
+static float
+get_float (GreeterThemeCache *cache)
+{
+  float v;
+
+  if (cache->bad || cache->end - cache->p < (gssize) sizeof (v))
+    {
+      cache->bad = TRUE;
+      return 0;
+    }
+  memcpy (&v, cache->p, sizeof (v));
+  cache->p += sizeof (v);
+  return v;
+}
+
+static char *
+get_string (GreeterThemeCache *cache)
+{
+  guint32 len = get_u32 (cache);
+  char *s;
+
+  if (len == 0)
+    return NULL;
+  len--;
+  if (cache->bad || (gsize) (cache->end - cache->p) < len)
+    {
+      cache->bad = TRUE;
+      return NULL;
+    }
+  s = g_strndup ((const char *) cache->p, len);
+  cache->p += len;
+  return s;
+}
+
+static char **
+get_strv (GreeterThemeCache *cache)
+{
+  guint32 n = get_u32 (cache);
+  GPtrArray *v;
+
+  if (n == 0)
+    return NULL;
+  n--;
+  /* every string takes at least its length */
+  if (cache->bad || (gsize) (cache->end - cache->p) / sizeof (guint32) < n)
+    {
+      cache->bad = TRUE;
+      return NULL;
+    }
+  v = g_ptr_array_sized_new (n + 1);
+  while (n-- > 0)
+    {
+      char *str = get_string (cache);
+      g_ptr_array_add (v, str != NULL ? str : g_strdup (""));
+    }
+  g_ptr_array_add (v, NULL);
+  return (char **) g_ptr_array_free (v, FALSE);
+}
+
+static PangoFontDescription *
+get_font (GreeterThemeCache *cache)
+{
+  PangoFontDescription *font;
+  char *s = get_string (cache);
+
+  if (s == NULL)
+    return NULL;
+  font = pango_font_description_from_string (s);
+  g_free (s);
+  return font;
+}
+
+static GdkPixbuf *
+get_pixbuf (GreeterThemeCache *cache)
+{
+  guint32 idx = get_u32 (cache);
+
+  if (idx == 0)
+    return NULL;
+  if (idx > cache->n_pixbufs)
+    {
+      cache->bad = TRUE;
+      return NULL;
+    }
+  return g_object_ref (cache->pixbufs[idx - 1]);
+}
+
+static void
+unref_mapping (guchar *pixels, gpointer data)
+{
+  g_mapped_file_unref (data);
+}
+
+GreeterThemeCache *
+greeter_theme_cache_open (const char *cache_file, const char *key)
+{
+  GreeterThemeCache *cache;
+  guint32 meta_len;
+  guint32 pixel_offset;
+  char *cached_key;
+  guint i;
+
+  cache = g_new0 (GreeterThemeCache, 1);
+  cache->file = g_mapped_file_new (cache_file, FALSE, NULL);
+  if (cache->file == NULL)
+    {
+      g_free (cache);
+      return NULL;
+    }
+
+  cache->data = (const guchar *) g_mapped_file_get_contents (cache->file);
+  cache->len = g_mapped_file_get_length (cache->file);
+
+  if (cache->len < HEADER_SIZE ||
+      memcmp (cache->data, CACHE_MAGIC, 8) != 0)
+    goto fail;
+
+  memcpy (&meta_len, cache->data + 8, sizeof (meta_len));
+  memcpy (&pixel_offset, cache->data + 12, sizeof (pixel_offset));
+  cache->pixel_offset = pixel_offset;
+  if (meta_len > cache->len - HEADER_SIZE ||
+      cache->pixel_offset < HEADER_SIZE + meta_len ||
+      cache->pixel_offset > cache->len)
+    goto fail;
+
+  cache->p = cache->data + HEADER_SIZE;
+  cache->end = cache->p + meta_len;
+
+  cached_key = get_string (cache);
+  if (cached_key == NULL || strcmp (cached_key, key) != 0)
+    {
+      g_free (cached_key);
+      goto fail;
+    }
+  g_free (cached_key);
+
+  cache->gtk_theme = get_string (cache);
+  cache->default_font = get_string (cache);
+
+  cache->n_pixbufs = get_u32 (cache);
+  if (cache->bad || cache->n_pixbufs > meta_len)
+    goto fail;
+  cache->pixbufs = g_new0 (GdkPixbuf *, cache->n_pixbufs);
+
+  for (i = 0; i < cache->n_pixbufs; i++)
+    {
+      char *file = get_string (cache);
+      guint32 mtime = get_u32 (cache);
+      guint32 width = get_u32 (cache);
+      guint32 height = get_u32 (cache);
+      guint32 rowstride = get_u32 (cache);
+      guint32 has_alpha = get_u32 (cache);
+      guint32 offset = get_u32 (cache);
+      struct stat s;
+
+      /* A changed image invalidates the whole cache */
+      if (cache->bad || file == NULL ||
+	  g_stat (file, &s) < 0 || (guint32) s.st_mtime != mtime)
+	{
+	  g_free (file);
+	  goto fail;
+	}
+      g_free (file);
+
+      if (width == 0 || height == 0 ||
+	  width > MAX_DIMENSION || height > MAX_DIMENSION ||
+	  (guint64) rowstride != (guint64) width * (has_alpha ? 4 : 3) ||
+	  (guint64) offset + (guint64) rowstride * height >
+	  (guint64) (cache->len - cache->pixel_offset))
+	goto fail;
+
+      cache->pixbufs[i] =
+	gdk_pixbuf_new_from_data (cache->data + cache->pixel_offset + offset,
+				  GDK_COLORSPACE_RGB,
+				  has_alpha ? TRUE : FALSE,
+				  8,
+				  width,
+				  height,
+				  rowstride,
+				  unref_mapping,
+				  g_mapped_file_ref (cache->file));
+    }
+
+  return cache;
+
+ fail:
+  greeter_theme_cache_free (cache);
+  return NULL;
+}
+
+const char *
+greeter_theme_cache_get_gtk_theme (GreeterThemeCache *cache)
+{
+  return cache->gtk_theme;
+}
+
+typedef struct {
+  GreeterItemInfo *info;
+  guint flags;
+} LoadedItem;
+
+static gboolean get_items (GreeterThemeCache *cache, GreeterItemInfo *parent,
+			   GList **items_out, GList **button_stack, GArray *loaded);
+
+static GreeterItemInfo *
+get_item (GreeterThemeCache *cache, GreeterItemInfo *parent,
+	  GList **button_stack, GArray *loaded)
+{
+  GreeterItemInfo *info;
+  GreeterItemType type;
+  LoadedItem li;
+  guint32 n;
+  int i;
+
+  type = get_u32 (cache);
+  if (cache->bad || type > GREETER_ITEM_TYPE_BUTTON)
+    {
+      cache->bad = TRUE;
+      return NULL;
+    }
+
+  info = greeter_item_info_new (parent, type);
+
+  li.info = info;
+  li.flags = get_u32 (cache);
+  g_array_append_val (loaded, li);
+
+  info->anchor = get_u32 (cache);
+  info->x = get_float (cache);
+  info->y = get_float (cache);
+  info->width = get_float (cache);
+  info->height = get_float (cache);
+  info->minimum_required_screen_width = get_u32 (cache);
+  info->minimum_required_screen_height = get_u32 (cache);
+
+  info->x_type = get_u32 (cache);
+  info->y_type = get_u32 (cache);
+  info->width_type = get_u32 (cache);
+  info->height_type = get_u32 (cache);
+  info->x_negative = get_u32 (cache);
+  info->y_negative = get_u32 (cache);
+  info->expand = get_u32 (cache);
+  info->show_modes = get_u32 (cache);
+  info->box_homogeneous = get_u32 (cache);
+  info->canvasbutton = get_u32 (cache);
+  info->gtkbutton = get_u32 (cache);
+  info->background = get_u32 (cache);
+  info->have_state = get_u32 (cache);
+
+  info->show_type = get_string (cache);
+  info->id = get_string (cache);
+
+  info->box_orientation = get_u32 (cache);
+  info->box_x_padding = get_u32 (cache);
+  info->box_y_padding = get_u32 (cache);
+  info->box_min_width = get_u32 (cache);
+  info->box_min_height = get_u32 (cache);
+  info->box_spacing = get_u32 (cache);
+
+  /* Same button bookkeeping as parse_items */
+  if (*button_stack != NULL)
+    info->my_button = (*button_stack)->data;
+  if (info->canvasbutton)
+    *button_stack = g_list_prepend (*button_stack, info);
+
+  switch (type)
+    {
+    case GREETER_ITEM_TYPE_LABEL:
+    case GREETER_ITEM_TYPE_ENTRY:
+    case GREETER_ITEM_TYPE_BUTTON:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  info->data.text.alphas[i] = get_u32 (cache);
+	  info->data.text.colors[i] = get_u32 (cache);
+	  info->data.text.fonts[i] = get_font (cache);
+	}
+      info->data.text.have_color = get_u32 (cache);
+      info->data.text.orig_text = get_string (cache);
+      info->data.text.stock_type = get_string (cache);
+      info->data.text.translations = get_strv (cache);
+      info->data.text.max_width = get_u32 (cache);
+      info->data.text.max_screen_percent_width = get_u32 (cache);
+      info->data.text.real_max_width = get_u32 (cache);
+      break;
+
+    case GREETER_ITEM_TYPE_PIXMAP:
+    case GREETER_ITEM_TYPE_SVG:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  info->data.pixmap.alphas[i] = get_u32 (cache);
+	  info->data.pixmap.tints[i] = get_u32 (cache);
+	  info->data.pixmap.files[i] = get_string (cache);
+	  info->data.pixmap.pixbufs[i] = get_pixbuf (cache);
+	}
+      info->data.pixmap.have_tint = get_u32 (cache);
+      break;
+
+    case GREETER_ITEM_TYPE_LIST:
+      info->data.list.icon_color = get_string (cache);
+      info->data.list.label_color = get_string (cache);
+      info->data.list.combo_type = get_u32 (cache);
+      n = get_u32 (cache);
+      while (n-- > 0 && ! cache->bad)
+	{
+	  GreeterItemListItem *item = g_new0 (GreeterItemListItem, 1);
+	  item->id = get_string (cache);
+	  item->text = get_string (cache);
+	  info->data.list.items = g_list_append (info->data.list.items, item);
+	}
+      break;
+
+    case GREETER_ITEM_TYPE_RECT:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  info->data.rect.alphas[i] = get_u32 (cache);
+	  info->data.rect.colors[i] = get_u32 (cache);
+	}
+      info->data.rect.have_color = get_u32 (cache);
+      break;
+    }
+
+  get_items (cache, info, &info->fixed_children, button_stack, loaded);
+  get_items (cache, info, &info->box_children, button_stack, loaded);
+
+  if (info->canvasbutton)
+    *button_stack = g_list_remove (*button_stack, info);
+
+  return info;
+}
+
+static gboolean
+get_items (GreeterThemeCache *cache, GreeterItemInfo *parent,
+	   GList **items_out, GList **button_stack, GArray *loaded)
+{
+  GList *items = NULL;
+  guint32 n;
+
+  n = get_u32 (cache);
+  while (n-- > 0 && ! cache->bad)
+    {
+      GreeterItemInfo *info = get_item (cache, parent, button_stack, loaded);
+      if (info != NULL)
+	items = g_list_prepend (items, info);
+    }
+
+  *items_out = g_list_reverse (items);
+  return ! cache->bad;
+}
+
+gboolean
+greeter_theme_cache_load_items (GreeterThemeCache *cache,
+				const char        *default_font,
+				GreeterItemInfo   *root,
+				GList            **items_out,
+				GreeterThemeCacheItemFunc func,
+				gpointer           data)
+{
+  GList *button_stack = NULL;
+  GArray *loaded;
+  GList *items;
+  guint i;
+
+  *items_out = NULL;
+
+  /* Label fonts were merged with the default style font at compile time */
+  if (strcmp (ve_sure_string (cache->default_font), ve_sure_string (default_font)) != 0)
+    return FALSE;
+
+  loaded = g_array_new (FALSE, FALSE, sizeof (LoadedItem));
+
+  if ( ! get_items (cache, root, &items, &button_stack, loaded) ||
+      cache->p != cache->end)
+    {
+      mdm_debug ("Compiled theme is corrupt, parsing the theme instead");
+      g_list_foreach (items, (GFunc) greeter_item_info_free, NULL);
+      g_list_free (items);
+      g_list_free (button_stack);
+      g_array_free (loaded, TRUE);
+      return FALSE;
+    }
+
+  for (i = 0; i < loaded->len; i++)
+    {
+      LoadedItem *li = &g_array_index (loaded, LoadedItem, i);
+      (* func) (li->info, li->flags, data);
+    }
+
+  g_array_free (loaded, TRUE);
+  *items_out = items;
+  return TRUE;
+}
+
+void
+greeter_theme_cache_free (GreeterThemeCache *cache)
+{
+  guint i;
+
+  if (cache == NULL)
+    return;
+
+  for (i = 0; i < cache->n_pixbufs; i++)
+    if (cache->pixbufs[i] != NULL)
+      g_object_unref (cache->pixbufs[i]);
+  g_free (cache->pixbufs);
+  g_free (cache->gtk_theme);
+  g_free (cache->default_font);
+  g_mapped_file_unref (cache->file);
+  g_free (cache);
+}
@@ -0,0 +1,68 @@
+/* MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __GREETER_THEME_CACHE_H__
+#define __GREETER_THEME_CACHE_H__
+
+#include "greeter_item.h"
+
+/* Name of a compiled theme inside ServAuthDir, followed by a hash of the
+ * theme file so that greeters with different themes keep their own */
+#define GREETER_THEME_CACHE_PREFIX ".theme-cache-"
+
+/* Per item flags recorded along with the tree, for the bits of parser
+ * state that live outside the items themselves */
+enum {
+  GREETER_THEME_CACHE_WELCOME = 1<<0,	/* the welcome-label stock item */
+  GREETER_THEME_CACHE_CUSTOM  = 1<<1	/* on the custom_items list */
+};
+
+typedef struct _GreeterThemeCache GreeterThemeCache;
+
+typedef void (*GreeterThemeCacheItemFunc) (GreeterItemInfo *info,
+					   guint            flags,
+					   gpointer         data);
+
+/*
+ * The key is an opaque string describing everything the parse depends
+ * on.  On top of it the cache checks the mtime of every pixmap it holds.
+ */
+gboolean           greeter_theme_cache_save          (const char       *cache_file,
+						      const char       *key,
+						      const char       *gtk_theme,
+						      const char       *default_font,
+						      GList            *items,
+						      GreeterItemInfo  *welcome_info,
+						      GList            *custom_items);
+
+GreeterThemeCache *greeter_theme_cache_open          (const char       *cache_file,
+						      const char       *key);
+/* The theme's gtk-theme attribute, or NULL */
+const char *       greeter_theme_cache_get_gtk_theme (GreeterThemeCache *cache);
+
+/* Rebuilds the item tree under root.  Fails if default_font differs from
+ * the one the cache was compiled with.  func is called for every item,
+ * in parse order, only once the whole tree has been read. */
+gboolean           greeter_theme_cache_load_items    (GreeterThemeCache *cache,
+						      const char        *default_font,
+						      GreeterItemInfo   *root,
+						      GList            **items_out,
+						      GreeterThemeCacheItemFunc func,
+						      gpointer           data);
+void               greeter_theme_cache_free          (GreeterThemeCache *cache);
+
+#endif /* __GREETER_THEME_CACHE_H__ */
@@ -0,0 +1,473 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * MDM - The MDM Display Manager
+ *
+ * Background image compositing for the greeters.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* AVX2 is only compiled in where the compiler can target it per
+ * function, and only used when the CPU reports it at runtime */
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__)) && \
+    (__GNUC__ >= 5 || defined (__clang__))
+#define MDM_BACKGROUND_AVX2 1
+#include <immintrin.h>
+#endif
+
+#include "mdmbackground.h"
+
+#include "mdm-common.h"
+#include "mdm-log.h"
+
+#define CACHE_MAGIC "MDMBG01\n"
+/* Far beyond any screen, and keeps the pixel sizes well within what
+ * GdkPixbuf takes */
+#define CACHE_MAX_DIMENSION 32768
+
+typedef struct {
+	char    magic[8];
+	guint32 width;
+	guint32 height;
+	guint32 rowstride;
+	guint32 has_alpha;
+	guint32 key_len;
+	guint32 data_offset;
+} CacheHeader;
+
+typedef struct {
+	gpointer addr;
+	gsize    len;
+} CacheMapping;
+
+/*
+ * The blend is p = (p * a + c * (255 - a)) >> 8 with the alpha forced
+ * to 255 afterwards.  The vector kernels compute exactly the same thing
+ * in 16 bit lanes (the sum is at most 255 * 255) so all paths give
+ * identical pixels.  They return how many pixels they handled and the
+ * scalar loop finishes the row.
+ */
+static void
+blend_row_c (guchar *p, int n, int cr, int cg, int cb)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		int a = p[3];
+
+		p[0] = (p[0] * a + cr * (255 - a)) >> 8;
+		p[1] = (p[1] * a + cg * (255 - a)) >> 8;
+		p[2] = (p[2] * a + cb * (255 - a)) >> 8;
+		p[3] = 255;
+
+		p += 4;
+	}
+}
+
+#if defined (__SSE2__)
+static inline __m128i
+blend_pair_sse2 (__m128i x, __m128i col, __m128i c255)
+{
+	__m128i a;
+
+	a = _mm_shufflelo_epi16 (x, _MM_SHUFFLE (3, 3, 3, 3));
+	a = _mm_shufflehi_epi16 (a, _MM_SHUFFLE (3, 3, 3, 3));
+
+	x = _mm_add_epi16 (_mm_mullo_epi16 (x, a),
+			   _mm_mullo_epi16 (col, _mm_sub_epi16 (c255, a)));
+	return _mm_srli_epi16 (x, 8);
+}
+
+static int
+blend_row_sse2 (guchar *p, int n, int cr, int cg, int cb)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i c255 = _mm_set1_epi16 (255);
+	const __m128i col = _mm_setr_epi16 (cr, cg, cb, 0, cr, cg, cb, 0);
+	const __m128i opaque = _mm_set1_epi32 ((int) 0xff000000);
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *) (p + i * 4));
+		__m128i lo = blend_pair_sse2 (_mm_unpacklo_epi8 (v, zero), col, c255);
+		__m128i hi = blend_pair_sse2 (_mm_unpackhi_epi8 (v, zero), col, c255);
+
+		v = _mm_or_si128 (_mm_packus_epi16 (lo, hi), opaque);
+		_mm_storeu_si128 ((__m128i *) (p + i * 4), v);
+	}
+
+	return i;
+}
+#endif
+
+#ifdef MDM_BACKGROUND_AVX2
+__attribute__ ((target ("avx2"))) static int
+blend_row_avx2 (guchar *p, int n, int cr, int cg, int cb)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i c255 = _mm256_set1_epi16 (255);
+	const __m256i col = _mm256_setr_epi16 (cr, cg, cb, 0, cr, cg, cb, 0,
+					       cr, cg, cb, 0, cr, cg, cb, 0);
+	const __m256i opaque = _mm256_set1_epi32 ((int) 0xff000000);
+	int i;
+
+	/* unpack, shuffle and pack all work within 128 bit lanes, so the
+	 * pixels come back out in the order they went in */
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256 ((const __m256i *) (p + i * 4));
+		__m256i lo = _mm256_unpacklo_epi8 (v, zero);
+		__m256i hi = _mm256_unpackhi_epi8 (v, zero);
+		__m256i alo, ahi;
+
+		alo = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (lo, _MM_SHUFFLE (3, 3, 3, 3)),
+					      _MM_SHUFFLE (3, 3, 3, 3));
+		ahi = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (hi, _MM_SHUFFLE (3, 3, 3, 3)),
+					      _MM_SHUFFLE (3, 3, 3, 3));
+
+		lo = _mm256_srli_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16 (lo, alo),
+							  _mm256_mullo_epi16 (col, _mm256_sub_epi16 (c255, alo))), 8);
+		hi = _mm256_srli_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16 (hi, ahi),
+							  _mm256_mullo_epi16 (col, _mm256_sub_epi16 (c255, ahi))), 8);
+
+		v = _mm256_or_si256 (_mm256_packus_epi16 (lo, hi), opaque);
+		_mm256_storeu_si256 ((__m256i *) (p + i * 4), v);
+	}
+
+	return i;
+}
+
+static gboolean
+cpu_has_avx2 (void)
+{
+	static int has_avx2 = -1;
+
+	if (has_avx2 < 0) {
+		__builtin_cpu_init ();
+		has_avx2 = __builtin_cpu_supports ("avx2") ? 1 : 0;
+	}
+	return has_avx2;
+}
+#endif
+
+void
+mdm_background_blend_color (GdkPixbuf *pb, const GdkColor *color)
+{
+	int width, height, rowstride;
+	guchar *pixels;
+	int cr, cg, cb;
+	int i;
+
+	g_return_if_fail (pb != NULL);
+	g_return_if_fail (color != NULL);
+
+	if ( ! gdk_pixbuf_get_has_alpha (pb) ||
+	    gdk_pixbuf_get_n_channels (pb) != 4)
+		return;
+
+	width = gdk_pixbuf_get_width (pb);
+	height = gdk_pixbuf_get_height (pb);
+	rowstride = gdk_pixbuf_get_rowstride (pb);
+	pixels = gdk_pixbuf_get_pixels (pb);
+	cr = color->red >> 8;
+	cg = color->green >> 8;
+	cb = color->blue >> 8;
+
+	for (i = 0; i < height; i++) {
+		guchar *p = pixels + (rowstride * i);
+		int done = 0;
+
+#ifdef MDM_BACKGROUND_AVX2
+		if (cpu_has_avx2 ())
+			done = blend_row_avx2 (p, width, cr, cg, cb);
+#endif
+#if defined (__SSE2__)
+		done += blend_row_sse2 (p + done * 4, width - done, cr, cg, cb);
+#endif
+		blend_row_c (p + done * 4, width - done, cr, cg, cb);
+	}
+}
+
+GdkPixbuf *
+mdm_background_scale (const GdkPixbuf    *pb,
+		      const GdkRectangle *monitors,
+		      int                 n_monitors)
+{
+	int i;
+	int width, height;
+
+	GdkPixbuf *back = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+					  gdk_pixbuf_get_has_alpha (pb),
+					  8,
+					  gdk_screen_width (),
+					  gdk_screen_height ());
+
+	width = gdk_pixbuf_get_width (pb);
+	height = gdk_pixbuf_get_height (pb);
+
+	for (i = 0; i < n_monitors; i++) {
+		gdk_pixbuf_scale (pb, back,
+				  monitors[i].x,
+				  monitors[i].y,
+				  monitors[i].width,
+				  monitors[i].height,
+				  monitors[i].x /* offset_x */,
+				  monitors[i].y /* offset_y */,
+				  (double) monitors[i].width / width,
+				  (double) monitors[i].height / height,
+				  GDK_INTERP_BILINEAR);
+	}
+
+	return back;
+}
+
+static char *
+cache_key (const char         *image,
+	   const struct stat  *s,
+	   const GdkColor     *color,
+	   const GdkRectangle *monitors,
+	   int                 n_monitors)
+{
+	GString *key;
+	int i;
+
+	key = g_string_new (image);
+	g_string_append_printf (key, "\n%ld %ld\n", (long) s->st_mtime, (long) s->st_size);
+	if (color != NULL)
+		g_string_append_printf (key, "#%02x%02x%02x\n",
+					color->red >> 8, color->green >> 8, color->blue >> 8);
+	else
+		g_string_append (key, "none\n");
+	g_string_append_printf (key, "%dx%d", gdk_screen_width (), gdk_screen_height ());
+	for (i = 0; i < n_monitors; i++)
+		g_string_append_printf (key, "\n%d,%d,%d,%d",
+					monitors[i].x, monitors[i].y,
+					monitors[i].width, monitors[i].height);
+
+	return g_string_free (key, FALSE);
+}
+
+static void
+cache_unmap (guchar *pixels, gpointer data)
+{
+	CacheMapping *mapping = data;
+
+	munmap (mapping->addr, mapping->len);
+	g_free (mapping);
+}
+
+static GdkPixbuf *
+cache_load (const char *path, const char *key)
+{
+	CacheHeader hdr;
+	CacheMapping *mapping;
+	struct stat s;
+	guchar *map;
+	gsize key_len = strlen (key);
+	guint64 needed;
+	int fd;
+
+	VE_IGNORE_EINTR (fd = open (path, O_RDONLY));
+	if (fd < 0)
+		return NULL;
+
+	if (fstat (fd, &s) < 0 || s.st_size < (off_t) sizeof (hdr)) {
+		VE_IGNORE_EINTR (close (fd));
+		return NULL;
+	}
+
+	map = mmap (NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	VE_IGNORE_EINTR (close (fd));
+	if (map == MAP_FAILED)
+		return NULL;
+
+	memcpy (&hdr, map, sizeof (hdr));
+	needed = (guint64) hdr.data_offset + (guint64) hdr.rowstride * hdr.height;
+
+	if (memcmp (hdr.magic, CACHE_MAGIC, sizeof (hdr.magic)) != 0 ||
+	    hdr.key_len != key_len ||
+	    hdr.data_offset < sizeof (hdr) + key_len ||
+	    hdr.width == 0 || hdr.height == 0 ||
+	    hdr.width > CACHE_MAX_DIMENSION || hdr.height > CACHE_MAX_DIMENSION ||
+	    (guint64) hdr.rowstride < (guint64) hdr.width * (hdr.has_alpha ? 4 : 3) ||
+	    hdr.rowstride > G_MAXINT ||
+	    needed > (guint64) s.st_size ||
+	    memcmp (map + sizeof (hdr), key, key_len) != 0) {
+		munmap (map, s.st_size);
+		return NULL;
+	}
+
+	mapping = g_new (CacheMapping, 1);
+	mapping->addr = map;
+	mapping->len = s.st_size;
+
+	mdm_debug ("Using cached background %s", path);
+
+	return gdk_pixbuf_new_from_data (map + hdr.data_offset,
+					 GDK_COLORSPACE_RGB,
+					 hdr.has_alpha ? TRUE : FALSE,
+					 8,
+					 hdr.width,
+					 hdr.height,
+					 hdr.rowstride,
+					 cache_unmap,
+					 mapping);
+}
+
+static gboolean
+write_all (int fd, const void *buf, gsize len)
+{
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t n;
+
+		VE_IGNORE_EINTR (n = write (fd, p, len));
+		if (n <= 0)
+			return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+static void
+cache_save (const char *path, const char *key, GdkPixbuf *pb)
+{
+	static const char zeros[16] = { 0 };
+	CacheHeader hdr;
+	const guchar *pixels;
+	char *tmp;
+	gsize key_len = strlen (key);
+	gsize row_len;
+	gboolean ok;
+	int rowstride;
+	int fd;
+	int i;
+
+	memset (&hdr, 0, sizeof (hdr));
+	memcpy (hdr.magic, CACHE_MAGIC, sizeof (hdr.magic));
+	hdr.width = gdk_pixbuf_get_width (pb);
+	hdr.height = gdk_pixbuf_get_height (pb);
+	hdr.has_alpha = gdk_pixbuf_get_has_alpha (pb);
+	hdr.key_len = key_len;
+	hdr.data_offset = (sizeof (hdr) + key_len + 15) & ~15;
+
+	/* rows are stored packed, without the pixbuf's padding */
+	row_len = hdr.width * gdk_pixbuf_get_n_channels (pb);
+	hdr.rowstride = row_len;
+
+	tmp = g_strconcat (path, ".XXXXXX", NULL);
+	fd = g_mkstemp (tmp);
+	if (fd < 0) {
+		mdm_debug ("Can't write background cache %s: %s", path, strerror (errno));
+		g_free (tmp);
+		return;
+	}
+
+	pixels = gdk_pixbuf_get_pixels (pb);
+	rowstride = gdk_pixbuf_get_rowstride (pb);
+
+	ok = write_all (fd, &hdr, sizeof (hdr)) &&
+	     write_all (fd, key, key_len) &&
+	     write_all (fd, zeros, hdr.data_offset - sizeof (hdr) - key_len);
+	for (i = 0; ok && i < (int) hdr.height; i++)
+		ok = write_all (fd, pixels + i * rowstride, row_len);
+
+	if (fchmod (fd, 0640) < 0)
+		ok = FALSE;
+	VE_IGNORE_EINTR (close (fd));
+
+	if ( ! ok || g_rename (tmp, path) < 0) {
+		mdm_debug ("Can't write background cache %s", path);
+		g_unlink (tmp);
+	}
+	g_free (tmp);
+}
+
+GdkPixbuf *
+mdm_background_load (const char         *image,
+		     const GdkColor     *color,
+		     const GdkRectangle *monitors,
+		     int                 n_monitors,
+		     const char         *cache_dir)
+{
+	GdkPixbuf *pb;
+	GdkPixbuf *back;
+	struct stat s;
+	char *key = NULL;
+	char *path = NULL;
+
+	g_return_val_if_fail (image != NULL, NULL);
+
+	if (g_stat (image, &s) < 0)
+		return NULL;
+
+	if ( ! ve_string_empty (cache_dir)) {
+		char *name;
+
+		key = cache_key (image, &s, color, monitors, n_monitors);
+		name = g_strdup_printf (".background-%dx%d",
+					gdk_screen_width (), gdk_screen_height ());
+		path = g_build_filename (cache_dir, name, NULL);
+		g_free (name);
+
+		back = cache_load (path, key);
+		if (back != NULL) {
+			g_free (key);
+			g_free (path);
+			return back;
+		}
+	}
+
+	pb = gdk_pixbuf_new_from_file (image, NULL);
+	if (pb == NULL) {
+		g_free (key);
+		g_free (path);
+		return NULL;
+	}
+
+	if (color != NULL)
+		mdm_background_blend_color (pb, color);
+
+	back = mdm_background_scale (pb, monitors, n_monitors);
+	g_object_unref (G_OBJECT (pb));
+
+	if (path != NULL && back != NULL)
+		cache_save (path, key, back);
+
+	g_free (key);
+	g_free (path);
+
+	return back;
+}
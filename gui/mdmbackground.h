@@ -0,0 +1,50 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * MDM - The MDM Display Manager
+ *
+ * Background image compositing for the greeters.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MDM_BACKGROUND_H
+#define MDM_BACKGROUND_H
+
+#include <gtk/gtk.h>
+
+/* Flattens an RGBA pixbuf onto a solid colour, in place.  Does nothing
+ * for pixbufs without alpha. */
+void       mdm_background_blend_color  (GdkPixbuf          *pb,
+					const GdkColor     *color);
+
+/* Returns a screen sized pixbuf with pb scaled onto every monitor */
+GdkPixbuf *mdm_background_scale        (const GdkPixbuf    *pb,
+					const GdkRectangle *monitors,
+					int                 n_monitors);
+
+/*
+ * Loads image, flattens it onto color (if not NULL) and scales it onto the
+ * monitors.  When cache_dir is set the result is kept there, keyed by the
+ * image's mtime and size, the colour and the monitor geometry, and later
+ * calls with the same key just map the cached pixels.  Returns NULL if
+ * the image can not be loaded.
+ */
+GdkPixbuf *mdm_background_load         (const char         *image,
+					const GdkColor     *color,
+					const GdkRectangle *monitors,
+					int                 n_monitors,
+					const char         *cache_dir);
+
+#endif /* MDM_BACKGROUND_H */
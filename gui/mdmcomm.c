@@ -27,6 +27,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -63,8 +64,10 @@ static char *
 do_command (int fd, const char *command, gboolean get_response)
 {
 	GString *str;
-	char buf[1];
+	char buf[4096];
 	char *cstr;
+	char *nl;
+	int want;
 	int ret;
 #ifndef MSG_NOSIGNAL
 	void (*old_handler)(int);
@@ -95,10 +98,32 @@ do_command (int fd, const char *command, gboolean get_response)
 	if ( ! get_response)
 		return NULL;
 
+	/*
+	 * Read the response a block at a time instead of a byte at a time,
+	 * since some responses (GET_USERS) are long.  Peek first so that
+	 * nothing past the end of the line is consumed.
+	 */
 	str = g_string_new (NULL);
-	while (read (fd, buf, 1) == 1 &&
-	       buf[0] != '\n') {
-		g_string_append_c (str, buf[0]);
+	for (;;) {
+		VE_IGNORE_EINTR (ret = recv (fd, buf, sizeof (buf), MSG_PEEK));
+		if (ret <= 0)
+			break;
+
+		nl = memchr (buf, '\n', ret);
+		if (nl != NULL)
+			want = nl - buf + 1;
+		else
+			want = ret;
+
+		VE_IGNORE_EINTR (ret = read (fd, buf, want));
+		if (ret <= 0)
+			break;
+
+		if (nl != NULL && ret == want) {
+			g_string_append_len (str, buf, ret - 1);
+			break;
+		}
+		g_string_append_len (str, buf, ret);
 	}
 
         mdm_common_debug ("  Got response: '%s'", str->str);
@@ -322,6 +347,167 @@ mdmcomm_close_connection_to_daemon (void)
 	bulk_acs = FALSE;
 }
 
+/*
+ * WATCH_DISPLAYS subscription.  The connection is kept open for the
+ * life of the program and reopened if the daemon goes away.
+ */
+typedef struct {
+	MdmcommDisplayFunc func;
+	gpointer data;
+	GIOChannel *channel;
+} DisplayWatch;
+
+/* entry is <display>,<logged in user>,<vt> */
+static void
+display_watch_dispatch (DisplayWatch *watch, const char *event, const char *entry)
+{
+	char **fields;
+
+	fields = g_strsplit (entry, ",", 3);
+	if (mdm_vector_len (fields) == 3)
+		watch->func (event, fields[0], fields[1], atoi (fields[2]),
+			     watch->data);
+	g_strfreev (fields);
+}
+
+static gboolean display_watch_connect (DisplayWatch *watch);
+
+static gboolean
+display_watch_retry (gpointer data)
+{
+	/* keep trying until the daemon is back */
+	return ! display_watch_connect (data);
+}
+
+static gboolean
+display_watch_read (GIOChannel *source, GIOCondition cond, gpointer data)
+{
+	DisplayWatch *watch = data;
+	GIOStatus status = G_IO_STATUS_AGAIN;
+	gchar *line;
+
+	if (cond & G_IO_IN) {
+		while ((status = g_io_channel_read_line (source, &line, NULL,
+							 NULL, NULL)) == G_IO_STATUS_NORMAL) {
+			char *event, *entry;
+
+			g_strchomp (line);
+			mdm_common_debug ("Display watch: '%s'", line);
+
+			if (strncmp (line, MDM_SUP_EVENT " ",
+				     strlen (MDM_SUP_EVENT " ")) == 0) {
+				event = &line[strlen (MDM_SUP_EVENT " ")];
+				entry = strchr (event, ' ');
+				if (entry != NULL) {
+					*entry++ = '\0';
+					display_watch_dispatch (watch, event, entry);
+				}
+			}
+			g_free (line);
+		}
+	}
+
+	if (status == G_IO_STATUS_AGAIN && ! (cond & (G_IO_HUP | G_IO_ERR)))
+		return TRUE;
+
+	mdm_common_debug ("Lost the display watch connection");
+	g_io_channel_unref (watch->channel);
+	watch->channel = NULL;
+
+	watch->func (NULL, NULL, NULL, -1, watch->data);
+	g_timeout_add_seconds (5, display_watch_retry, watch);
+
+	return FALSE;
+}
+
+static gboolean
+display_watch_connect (DisplayWatch *watch)
+{
+	struct sockaddr_un addr;
+	const char *cmd = MDM_SUP_WATCH_DISPLAYS "\n";
+	gchar *line = NULL;
+	char **vec;
+	int fd;
+	int ret;
+	int i;
+#ifndef MSG_NOSIGNAL
+	void (*old_handler)(int);
+#endif
+
+	strcpy (addr.sun_path, MDM_SUP_SOCKET);
+	addr.sun_family = AF_UNIX;
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return FALSE;
+
+	if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		VE_IGNORE_EINTR (close (fd));
+		return FALSE;
+	}
+
+#ifdef MSG_NOSIGNAL
+	ret = send (fd, cmd, strlen (cmd), MSG_NOSIGNAL);
+#else
+	old_handler = signal (SIGPIPE, SIG_IGN);
+	ret = send (fd, cmd, strlen (cmd), 0);
+	signal (SIGPIPE, old_handler);
+#endif
+	if (ret < 0) {
+		VE_IGNORE_EINTR (close (fd));
+		return FALSE;
+	}
+
+	watch->channel = g_io_channel_unix_new (fd);
+	g_io_channel_set_close_on_unref (watch->channel, TRUE);
+	g_io_channel_set_encoding (watch->channel, NULL, NULL);
+
+	/* The snapshot comes straight back, so just block for it */
+	if (g_io_channel_read_line (watch->channel, &line, NULL, NULL,
+				    NULL) != G_IO_STATUS_NORMAL ||
+	    strncmp (line, "OK", 2) != 0) {
+		/* older daemon */
+		mdm_common_debug ("Display watch refused: '%s'",
+				  ve_sure_string (line));
+		g_free (line);
+		g_io_channel_unref (watch->channel);
+		watch->channel = NULL;
+		return FALSE;
+	}
+
+	g_strchomp (line);
+	vec = g_strsplit (&line[2], ";", -1);
+	for (i = 0; vec[i] != NULL; i++) {
+		g_strstrip (vec[i]);
+		if ( ! ve_string_empty (vec[i]))
+			display_watch_dispatch (watch, MDM_SUP_EVENT_ADDED, vec[i]);
+	}
+	g_strfreev (vec);
+	g_free (line);
+
+	g_io_channel_set_flags (watch->channel, G_IO_FLAG_NONBLOCK, NULL);
+	g_io_add_watch (watch->channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+			display_watch_read, watch);
+
+	return TRUE;
+}
+
+gboolean
+mdmcomm_watch_displays (MdmcommDisplayFunc func, gpointer data)
+{
+	DisplayWatch *watch;
+
+	watch = g_new0 (DisplayWatch, 1);
+	watch->func = func;
+	watch->data = data;
+
+	if ( ! display_watch_connect (watch)) {
+		g_free (watch);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 const char *
 mdmcomm_get_display (void)
 {
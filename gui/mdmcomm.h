@@ -38,6 +38,21 @@ char *		mdmcomm_get_a_cookie (gboolean binary);
 /* get the mdm auth cookie */
 char *		mdmcomm_get_auth_cookie (void);
 
+/*
+ * Subscribes to WATCH_DISPLAYS.  func is called with event
+ * MDM_SUP_EVENT_ADDED for every attached display before this returns,
+ * then again from the main loop for every change.  If the daemon goes
+ * away func gets a NULL event, the list should be forgotten, and it is
+ * sent again once the daemon is back.  Returns FALSE if the daemon
+ * does not support subscriptions.
+ */
+typedef void	(*MdmcommDisplayFunc) (const char *event,
+				       const char *name,
+				       const char *login,
+				       int         vt,
+				       gpointer    data);
+gboolean	mdmcomm_watch_displays (MdmcommDisplayFunc func, gpointer data);
+
 gboolean	mdmcomm_is_daemon_running (gboolean show_dialog);
 const char *	mdmcomm_get_error_message (const char *ret);
 
@@ -834,18 +834,123 @@ mdm_common_get_clock (struct tm **the_tm)
         return str;
 }
 
-char *
-mdm_common_expand_text (const gchar *text)
+/*
+ * The %-escapes that can change while the greeter runs.  Everything
+ * else in a text is expanded once, when the text is first seen.
+ */
+typedef enum {
+	TEXT_TOKEN_LITERAL,
+	TEXT_TOKEN_CLOCK,		/* %c */
+	TEXT_TOKEN_TIMED_DELAY,		/* %t */
+	TEXT_TOKEN_TIMED_USER		/* %u */
+} TextTokenType;
+
+typedef struct {
+	TextTokenType  type;
+	gchar         *literal;
+} TextToken;
+
+typedef struct {
+	GArray *tokens;
+	gsize   literal_len;
+} TextTemplate;
+
+/* Texts come from the theme and the configuration, so there are only a
+ * handful of them.  Past this the cache is simply started over. */
+#define TEXT_TEMPLATES_MAX 64
+
+static GHashTable *text_templates = NULL;
+
+static gchar *host_display    = NULL;
+static gchar *host_name       = NULL;
+static gchar *host_domain     = NULL;
+static gchar *host_machine    = NULL;
+static gchar *host_nodename   = NULL;
+static gchar *host_release    = NULL;
+static gchar *host_sysname    = NULL;
+
+static void
+text_host_fields_init (void)
 {
+	gchar buf[256];
+	struct utsname name;
+
+	if (host_name != NULL)
+		return;
+
+	host_display = g_strdup (ve_sure_string (g_getenv ("DISPLAY")));
+
+	buf[sizeof (buf) - 1] = '\0';
+	if (gethostname (buf, sizeof (buf) - 1))
+		host_name = g_strdup ("localhost");
+	else
+		host_name = g_strdup (buf);
+
+	buf[sizeof (buf) - 1] = '\0';
+	if (getdomainname (buf, sizeof (buf) - 1))
+		host_domain = g_strdup ("localdomain");
+	else
+		host_domain = g_strdup (buf);
+
+	if (uname (&name) == 0) {
+		host_machine  = g_strdup (name.machine);
+		host_nodename = g_strdup (name.nodename);
+		host_release  = g_strdup (name.release);
+		host_sysname  = g_strdup (name.sysname);
+	} else {
+		host_machine  = g_strdup ("");
+		host_nodename = g_strdup ("");
+		host_release  = g_strdup ("");
+		host_sysname  = g_strdup ("");
+	}
+}
+
+static void
+text_template_add (TextTemplate *tmpl, TextTokenType type, GString *literal)
+{
+	TextToken token;
+
+	if (literal->len > 0) {
+		token.type = TEXT_TOKEN_LITERAL;
+		token.literal = g_strndup (literal->str, literal->len);
+		g_array_append_val (tmpl->tokens, token);
+		tmpl->literal_len += literal->len;
+		g_string_truncate (literal, 0);
+	}
+
+	if (type != TEXT_TOKEN_LITERAL) {
+		token.type = type;
+		token.literal = NULL;
+		g_array_append_val (tmpl->tokens, token);
+	}
+}
+
+static void
+text_template_free (TextTemplate *tmpl)
+{
+	guint i;
+
+	for (i = 0; i < tmpl->tokens->len; i++)
+		g_free (g_array_index (tmpl->tokens, TextToken, i).literal);
+	g_array_free (tmpl->tokens, TRUE);
+	g_free (tmpl);
+}
+
+/* Splits text into literal runs and the dynamic escapes.  The static
+ * escapes and the underline markup end up in the literals. */
+static TextTemplate *
+text_template_compile (const gchar *text)
+{
+	TextTemplate *tmpl;
 	GString *str;
 	const char *p;
-	gchar *clock, *display;
-	int r, i, n_chars;
+	int i, n_chars;
 	gboolean underline = FALSE;
-	gchar buf[256];
-	struct utsname name;
-	struct tm *the_tm;
 
+	text_host_fields_init ();
+
+	tmpl = g_new0 (TextTemplate, 1);
+	tmpl->tokens = g_array_new (FALSE, FALSE, sizeof (TextToken));
 	str = g_string_sized_new (strlen (text));
 
 	p = text;
@@ -887,52 +992,34 @@ mdm_common_expand_text (const gchar *text)
 				g_string_append (str, "%");
 				break;
 			case 'c':
-				clock = mdm_common_get_clock (&the_tm);
-				g_string_append (str, clock);
-				g_free (clock);
+				text_template_add (tmpl, TEXT_TOKEN_CLOCK, str);
 				break;
 			case 'd':
-				display = g_strdup (g_getenv ("DISPLAY"));
-				g_string_append (str, display);
+				g_string_append (str, host_display);
 				break;
 			case 'h':
-				buf[sizeof (buf) - 1] = '\0';
-				r = gethostname (buf, sizeof (buf) - 1);
-				if (r)
-					g_string_append (str, "localhost");
-				else
-					g_string_append (str, buf);
+				g_string_append (str, host_name);
 				break;
 			case 'm':
-				uname (&name);
-				g_string_append (str, name.machine);
+				g_string_append (str, host_machine);
 				break;
 			case 'n':
-				uname (&name);
-				g_string_append (str, name.nodename);
+				g_string_append (str, host_nodename);
 				break;
 			case 'o':
-				buf[sizeof (buf) - 1] = '\0';
-				r = getdomainname (buf, sizeof (buf) - 1);
-				if (r)
-					g_string_append (str, "localdomain");
-				else
-					g_string_append (str, buf);
+				g_string_append (str, host_domain);
 				break;
 			case 'r':
-				uname (&name);
-				g_string_append (str, name.release);
+				g_string_append (str, host_release);
 				break;
 			case 's':
-				uname (&name);
-				g_string_append (str, name.sysname);
+				g_string_append (str, host_sysname);
 				break;
 			case 't':
-				g_string_append_printf (str, ngettext("%d second", "%d seconds", mdm_timed_delay),
-							mdm_timed_delay);
+				text_template_add (tmpl, TEXT_TOKEN_TIMED_DELAY, str);
 				break;
 			case 'u':
-				g_string_append (str, ve_sure_string (g_getenv("MDM_TIMED_LOGIN_OK")));
+				text_template_add (tmpl, TEXT_TOKEN_TIMED_USER, str);
 				break;
 			default:
 				if (ch < 127)
@@ -965,9 +1052,135 @@ mdm_common_expand_text (const gchar *text)
 	if (underline)
 		g_string_append (str, "</u>");
 
+	text_template_add (tmpl, TEXT_TOKEN_LITERAL, str);
+	g_string_free (str, TRUE);
+
+	return tmpl;
+}
+
+static gchar *
+text_template_render (const TextTemplate *tmpl)
+{
+	GString *str;
+	gchar *clock;
+	struct tm *the_tm;
+	guint i;
+
+	/* the common case, nothing in the text changes */
+	if (tmpl->tokens->len == 1 &&
+	    g_array_index (tmpl->tokens, TextToken, 0).type == TEXT_TOKEN_LITERAL)
+		return g_strdup (g_array_index (tmpl->tokens, TextToken, 0).literal);
+
+	str = g_string_sized_new (tmpl->literal_len + 64);
+
+	for (i = 0; i < tmpl->tokens->len; i++) {
+		const TextToken *token = &g_array_index (tmpl->tokens, TextToken, i);
+
+		switch (token->type) {
+		case TEXT_TOKEN_LITERAL:
+			g_string_append (str, token->literal);
+			break;
+		case TEXT_TOKEN_CLOCK:
+			clock = mdm_common_get_clock (&the_tm);
+			g_string_append (str, clock);
+			g_free (clock);
+			break;
+		case TEXT_TOKEN_TIMED_DELAY:
+			g_string_append_printf (str, ngettext("%d second", "%d seconds", mdm_timed_delay),
+						mdm_timed_delay);
+			break;
+		case TEXT_TOKEN_TIMED_USER:
+			g_string_append (str, ve_sure_string (g_getenv("MDM_TIMED_LOGIN_OK")));
+			break;
+		}
+	}
+
 	return g_string_free (str, FALSE);
 }
 
+/*
+ * Expands the \ and % escapes and the _ underline markers in text.  Each
+ * text is only parsed the first time it is seen, after that only the
+ * clock, the timed login delay and the timed login user are filled in.
+ */
+char *
+mdm_common_expand_text (const gchar *text)
+{
+	TextTemplate *tmpl;
+
+	if (text_templates == NULL)
+		text_templates = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+							(GDestroyNotify) text_template_free);
+
+	tmpl = g_hash_table_lookup (text_templates, text);
+	if (tmpl == NULL) {
+		if (g_hash_table_size (text_templates) >= TEXT_TEMPLATES_MAX)
+			g_hash_table_remove_all (text_templates);
+
+		tmpl = text_template_compile (text);
+		g_hash_table_insert (text_templates, g_strdup (text), tmpl);
+	}
+
+	return text_template_render (tmpl);
+}
+
+/* Widgets labelled by mdm_common_translate_widget, in no order */
+static GSList *translated_widgets = NULL;
+
+static void
+translated_widget_gone (gpointer data, GObject *where_the_object_was)
+{
+	translated_widgets = g_slist_remove (translated_widgets, where_the_object_was);
+}
+
+static void
+translated_widget_update (GtkWidget *widget)
+{
+	const char *msgid = g_object_get_data (G_OBJECT (widget), "mdm-msgid");
+	const char *text;
+
+	if (msgid == NULL)
+		return;
+	text = _(msgid);
+
+	if (GTK_IS_WINDOW (widget))
+		gtk_window_set_title (GTK_WINDOW (widget), text);
+	else if (GTK_IS_BUTTON (widget))
+		gtk_button_set_label (GTK_BUTTON (widget), text);
+	else if (GTK_IS_LABEL (widget))
+		gtk_label_set_text_with_mnemonic (GTK_LABEL (widget), text);
+	else if (GTK_IS_BIN (widget) &&
+		 GTK_IS_LABEL (gtk_bin_get_child (GTK_BIN (widget))))
+		gtk_label_set_text_with_mnemonic (GTK_LABEL (gtk_bin_get_child (GTK_BIN (widget))),
+						  text);
+}
+
+/*
+ * Labels a window, button, label or menu item with the translation of
+ * msgid, which has to be a static string marked with N_().  The label
+ * follows mdm_common_retranslate_widgets when the greeter changes its
+ * language in place.  Buttons and menu items have to be created with a
+ * mnemonic for the underscores to work.  A NULL msgid only stops the
+ * relabelling, for a widget that was given some other text.
+ */
+void
+mdm_common_translate_widget (GtkWidget *widget, const gchar *msgid)
+{
+	if (g_slist_find (translated_widgets, widget) == NULL) {
+		translated_widgets = g_slist_prepend (translated_widgets, widget);
+		g_object_weak_ref (G_OBJECT (widget), translated_widget_gone, NULL);
+	}
+	g_object_set_data (G_OBJECT (widget), "mdm-msgid", (gpointer) msgid);
+
+	translated_widget_update (widget);
+}
+
+void
+mdm_common_retranslate_widgets (void)
+{
+	g_slist_foreach (translated_widgets, (GFunc) translated_widget_update, NULL);
+}
+
 typedef enum
 {
   LOCALE_UP_TO_LANGUAGE = 0,
@@ -74,4 +74,7 @@ gchar*    mdm_common_expand_text            (const gchar *text);
 gchar*    mdm_common_get_clock              (struct tm **the_tm);
 gboolean  mdm_common_locale_is_displayable  (const gchar *locale);
 gboolean  mdm_common_is_action_available    (gchar *action);
+void      mdm_common_translate_widget       (GtkWidget   *widget,
+                                             const gchar *msgid);
+void      mdm_common_retranslate_widgets    (void);
 #endif /* MDM_COMMON_H */
@@ -35,6 +35,7 @@
 #include "mdmconfig.h"
 
 #include "mdm-common.h"
+#include "mdm-config-snapshot.h"
 #include "mdm-log.h"
 #include "mdm-socket-protocol.h"
 
@@ -45,6 +46,8 @@ static GHashTable *bool_hash      = NULL;
 static GHashTable *string_hash    = NULL;
 static gboolean mdm_never_cache   = FALSE;
 static int comm_tries             = 5;
+static MdmConfigSnapshot *snapshot = NULL;
+static gboolean snapshot_opened   = FALSE;
 
 /**
  * mdm_config_never_cache
@@ -143,6 +146,28 @@ mdm_config_get_result (const gchar *key)
 	if (p != NULL)
 		*p = '\0';
 
+	/*
+	 * The greeters get a snapshot of the daemon configuration from the
+	 * slave, ask the daemon only for what is not in it.  Once the
+	 * configuration changed the snapshot is of no use anymore.
+	 */
+	if ( ! snapshot_opened) {
+		snapshot = mdm_config_snapshot_open_from_env ();
+		snapshot_opened = TRUE;
+	}
+	if (snapshot != NULL) {
+		const gchar *value = mdm_config_snapshot_lookup (snapshot, newkey);
+
+		if (value != NULL) {
+			g_free (newkey);
+			return g_strconcat ("OK ", value, NULL);
+		}
+		if ( ! mdm_config_snapshot_is_current (snapshot)) {
+			mdm_config_snapshot_close (snapshot);
+			snapshot = NULL;
+		}
+	}
+
 	display = g_strdup (g_getenv ("DISPLAY"));
 	if (display == NULL)
 		command = g_strdup_printf ("%s %s", MDM_SUP_GET_CONFIG, newkey);
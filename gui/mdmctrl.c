@@ -0,0 +1,171 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The greeter end of the slave/greeter pipe.  The slave writes commands
+ * as STX, an opcode, the arguments and a newline, all in one write.
+ * Whatever is in the pipe is read in one go and every complete command
+ * is run before going back to the main loop.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include "mdm.h"
+#include "mdm-common.h"
+#include "mdm-socket-protocol.h"
+
+#include "mdmctrl.h"
+
+static MdmCtrlFunc        ctrl_ops[256];
+static MdmCtrlUnknownFunc ctrl_unknown = NULL;
+static GString           *ctrl_buf     = NULL;
+
+static void
+ctrl_dispatch (guchar op_code, const gchar *args)
+{
+	if (ctrl_ops[op_code] != NULL)
+		ctrl_ops[op_code] (args);
+	else if (ctrl_unknown != NULL)
+		ctrl_unknown (op_code, args);
+}
+
+/* Runs every complete command in the buffer and drops it.  The buffer
+ * is not touched while a command runs: the watch does not recurse, even
+ * from the nested main loop of a dialog. */
+static void
+ctrl_dispatch_all (void)
+{
+	gchar *end = ctrl_buf->str + ctrl_buf->len;
+	gchar *p = ctrl_buf->str;
+
+	for (;;) {
+		gchar *cmd, *next;
+		gsize len;
+
+		/* skip random garbage up to the STX */
+		cmd = memchr (p, STX, end - p);
+		if (cmd == NULL) {
+			p = end;
+			break;
+		}
+
+		/* A command ends at the next STX.  The last one is
+		 * complete once its newline is in, as the slave sends
+		 * each in a single write. */
+		next = memchr (cmd + 1, STX, end - (cmd + 1));
+		if (next == NULL) {
+			if (end[-1] != '\n') {
+				p = cmd;
+				break;
+			}
+			next = end;
+		}
+		p = next;
+
+		/* opcode and the newline, which gets eaten */
+		len = next - (cmd + 1);
+		if (len < 2)
+			continue;
+		cmd[len] = '\0';
+
+		ctrl_dispatch ((guchar) cmd[1], cmd + 2);
+	}
+
+	g_string_erase (ctrl_buf, 0, p - ctrl_buf->str);
+}
+
+static gboolean
+ctrl_handler (GIOChannel   *source,
+	      GIOCondition  cond,
+	      gpointer      data)
+{
+	gchar buf[PIPE_SIZE];
+	gssize n;
+
+	/* The slave is gone, it will kill us soon enough */
+	if ( ! (cond & G_IO_IN))
+		return FALSE;
+
+	VE_IGNORE_EINTR (n = read (g_io_channel_unix_get_fd (source),
+				   buf, sizeof (buf)));
+	if (n < 0)
+		return (errno == EAGAIN);
+	if (n == 0)
+		return FALSE;
+
+	g_string_append_len (ctrl_buf, buf, n);
+	ctrl_dispatch_all ();
+
+	return TRUE;
+}
+
+void
+mdm_ctrl_watch (const MdmCtrlOp   *ops,
+		MdmCtrlUnknownFunc unknown)
+{
+	GIOChannel *ctrlch;
+	int i;
+
+	memset (ctrl_ops, 0, sizeof (ctrl_ops));
+	for (i = 0; ops[i].op_code != 0; i++)
+		ctrl_ops[ops[i].op_code] = ops[i].func;
+	ctrl_unknown = unknown;
+
+	if (ctrl_buf == NULL)
+		ctrl_buf = g_string_sized_new (PIPE_SIZE);
+
+	ctrlch = g_io_channel_unix_new (STDIN_FILENO);
+	g_io_channel_set_encoding (ctrlch, NULL, NULL);
+	g_io_channel_set_buffered (ctrlch, FALSE);
+	g_io_channel_set_flags (ctrlch,
+				g_io_channel_get_flags (ctrlch) | G_IO_FLAG_NONBLOCK,
+				NULL);
+	g_io_add_watch (ctrlch,
+			G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+			ctrl_handler,
+			NULL);
+	g_io_channel_unref (ctrlch);
+}
+
+void
+mdm_ctrl_ack (void)
+{
+	printf ("%c\n", STX);
+	fflush (stdout);
+}
+
+void
+mdm_ctrl_reply (const gchar *answer)
+{
+	printf ("%c%s\n", STX, answer != NULL ? answer : "");
+	fflush (stdout);
+}
+
+void
+mdm_ctrl_op_ack (const gchar *args)
+{
+	mdm_ctrl_ack ();
+}
@@ -0,0 +1,49 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * MDM - The MDM Display Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MDM_CTRL_H
+#define MDM_CTRL_H
+
+#include <glib.h>
+
+/* args is the rest of the command line without the newline, it is only
+ * valid until the function returns */
+typedef void (*MdmCtrlFunc)        (const gchar *args);
+typedef void (*MdmCtrlUnknownFunc) (guchar op_code, const gchar *args);
+
+typedef struct {
+	guchar      op_code;
+	MdmCtrlFunc func;
+} MdmCtrlOp;
+
+/* Starts reading the commands the slave sends on stdin.  ops ends with
+ * an entry with op_code 0, commands not in it go to unknown.  Anything
+ * that reads stdin by itself (the face pictures) has to be done before
+ * this is called. */
+void	mdm_ctrl_watch		(const MdmCtrlOp   *ops,
+				 MdmCtrlUnknownFunc unknown);
+
+/* Answers the command being handled, with an empty answer or a string */
+void	mdm_ctrl_ack		(void);
+void	mdm_ctrl_reply		(const gchar *answer);
+
+/* For commands that only need to be acknowledged */
+void	mdm_ctrl_op_ack		(const gchar *args);
+
+#endif /* MDM_CTRL_H */
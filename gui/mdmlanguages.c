@@ -46,6 +46,12 @@
  */
 void lang_set_custom_callback (gchar *language);
 
+/*
+ * Called once this process has switched to a new language, for the
+ * greeter to translate whatever it has on screen again.
+ */
+void lang_relocalize_callback (void);
+
 static GtkWidget    *tv                       = NULL;
 static GtkListStore *lang_model               = NULL;
 static GtkWidget    *dialog                   = NULL;
@@ -949,6 +955,99 @@ mdm_lang_set_restart_state (gboolean do_restart)
   always_restart = do_restart;
 }
 
+/* The language names in the model follow the language of the greeter */
+static void
+mdm_lang_retranslate_model (void)
+{
+  GtkTreeIter iter;
+  gboolean valid;
+
+  if (lang_model == NULL)
+    return;
+
+  valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (lang_model), &iter);
+  while (valid)
+    {
+      char *locale, *name;
+
+      gtk_tree_model_get (GTK_TREE_MODEL (lang_model), &iter,
+			  LOCALE_COLUMN, &locale, -1);
+
+      if (strcmp (locale, LAST_LANGUAGE) == 0)
+	name = g_strdup (_("Last language"));
+      else if (strcmp (locale, DEFAULT_LANGUAGE) == 0)
+	name = g_strdup (_("System Default"));
+      else
+	name = mdm_lang_name (locale,
+			      FALSE /* never_encoding */,
+			      TRUE /* no_group */,
+			      FALSE /* untranslated */,
+			      FALSE /* markup */);
+
+      gtk_list_store_set (lang_model, &iter,
+			  TRANSLATED_NAME_COLUMN, name,
+			  -1);
+      g_free (name);
+      g_free (locale);
+
+      valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (lang_model), &iter);
+    }
+}
+
+/*
+ * Switches this process over to language, with the environment the slave
+ * would start a new greeter in.  Returns FALSE if that is not possible
+ * and the greeter has to be restarted after all.
+ */
+static gboolean
+mdm_lang_relocalize (const char *language)
+{
+  locale_t loc;
+  char *localedir;
+
+  /* Only the slave knows what the system default is */
+  if (strcmp (language, DEFAULT_LANGUAGE) == 0)
+    return FALSE;
+
+  /* A locale that is not installed leaves everything as it was */
+  loc = newlocale (LC_ALL_MASK, language, (locale_t) 0);
+  if (loc == (locale_t) 0)
+    return FALSE;
+  freelocale (loc);
+
+  g_setenv ("MDM_LANG", language, TRUE);
+  g_setenv ("LANG", language, TRUE);
+  g_unsetenv ("LC_ALL");
+  g_unsetenv ("LC_MESSAGES");
+  setlocale (LC_ALL, "");
+
+  /* Have gettext open the catalogs for the new locale */
+  localedir = g_strdup (bindtextdomain (GETTEXT_PACKAGE, NULL));
+  bindtextdomain (GETTEXT_PACKAGE, localedir);
+  bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+  g_free (localedir);
+
+  /* The same check gtk does when it starts */
+  if (strcmp (dgettext ("gtk20", "default:LTR"), "default:RTL") == 0)
+    gtk_widget_set_default_direction (GTK_TEXT_DIR_RTL);
+  else
+    gtk_widget_set_default_direction (GTK_TEXT_DIR_LTR);
+
+  mdm_lang_retranslate_model ();
+
+  /* Built again with the new strings the next time it is needed */
+  if (dialog != NULL)
+    {
+      gtk_widget_destroy (dialog);
+      tv = NULL;
+    }
+
+  mdm_common_retranslate_widgets ();
+  lang_relocalize_callback ();
+
+  return TRUE;
+}
+
 void
 mdm_lang_set_restart_dialog (char *language)
 {
@@ -962,6 +1061,20 @@ mdm_lang_set_restart_dialog (char *language)
      {
        gint response = GTK_RESPONSE_YES;
 
+       /* No restart needed, the slave only has to know */
+       if (strcmp (language, LAST_LANGUAGE) &&
+           mdm_lang_relocalize (language))
+         {
+           mdm_lang_set (language);
+
+           printf ("%c%c%c%s\n", STX,
+                   BEL,
+                   MDM_INTERRUPT_LANG_CHANGED,
+                   language);
+           fflush (stdout);
+           return;
+         }
+
        if (strcmp (language, LAST_LANGUAGE))
          response = mdm_lang_ask_restart (language);
 
@@ -52,7 +52,9 @@
 
 #include "mdm.h"
 #include "mdmuser.h"
+#include "mdmbackground.h"
 #include "mdmcomm.h"
+#include "mdmctrl.h"
 #include "mdmcommon.h"
 #include "mdmsession.h"
 #include "mdmlanguages.h"
@@ -170,7 +172,7 @@ static void back_prog_launch_after_timeout (void);
 static void back_prog_run (void);
 static void back_prog_stop (void);
 
-static void process_operation (guchar op_code, const gchar *args);
+static void op_resetok (const gchar *args);
 
 /* 
  * This function is called when the background program exits.
@@ -831,7 +833,8 @@ mdm_login_language_menu_new (void)
 
     menu = gtk_menu_new ();
 
-    item = gtk_menu_item_new_with_mnemonic (_("Select _Language..."));
+    item = gtk_menu_item_new_with_mnemonic ("");
+    mdm_common_translate_widget (item, N_("Select _Language..."));
     gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
     g_signal_connect (G_OBJECT (item), "activate", 
 		      G_CALLBACK (mdm_login_language_handler), 
@@ -953,431 +956,431 @@ face_browser_select_user (gchar *login)
         fflush (stdout);
 }
 
-static gboolean
-mdm_login_ctrl_handler (GIOChannel *source, GIOCondition cond, gint fd)
+/* Set on a message, cleared when the user gets to see it */
+static gboolean replace_msg = TRUE;
+static gboolean messages_to_give = FALSE;
+
+static void
+op_setlogin (const gchar *args)
 {
-    gchar buf[PIPE_SIZE];
-    gchar *p;
-    gsize len;
+    /* somebody is trying to fool us this is the user that
+     * wants to log in, and well, we are the gullible kind */
+    g_free (curuser);
+    curuser = g_strdup (args);
+    if (mdm_config_get_bool (MDM_KEY_BROWSER)) {
+	browser_set_user (curuser);
+    }
+    mdm_ctrl_ack ();
+}
 
-    /* If this is not incoming i/o then return */
-    if (cond != G_IO_IN) 
-	return (TRUE);
+static void
+op_prompt (const gchar *args)
+{
+    char *tmp;
 
-    /* Read random garbage from i/o channel until STX is found */
-    do {
-	g_io_channel_read_chars (source, buf, 1, &len, NULL);
+    tmp = ve_locale_to_utf8 (args);
+    if (tmp != NULL && strcmp (tmp, _("Username:")) == 0) {
+	    mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM),
+				    mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE),
+				    mdm_config_get_bool   (MDM_KEY_SOUND_ON_LOGIN));
+	    mdm_common_translate_widget (label, N_("_Username:"));
+    } else {
+	    mdm_common_translate_widget (label, NULL);
+	    if (tmp != NULL)
+		    gtk_label_set_text (GTK_LABEL (label), tmp);
+    }
+    g_free (tmp);
 
-	if (len != 1)
-	    return (TRUE);
-    } while (buf[0] && buf[0] != STX);
+    gtk_widget_set_sensitive (GTK_WIDGET (start_again_button), !first_prompt);
+    first_prompt = FALSE;
 
-    memset (buf, '\0', sizeof (buf));
-    if (g_io_channel_read_chars (source, buf, sizeof (buf) - 1, &len, NULL) !=
-	G_IO_STATUS_NORMAL)
-      return TRUE;
+    gtk_widget_show (GTK_WIDGET (label));
+    gtk_entry_set_text (GTK_ENTRY (entry), "");
+    gtk_entry_set_max_length (GTK_ENTRY (entry), PW_ENTRY_SIZE);
+    gtk_entry_set_visibility (GTK_ENTRY (entry), TRUE);
+    gtk_widget_set_sensitive (entry, TRUE);
+    gtk_widget_set_sensitive (ok_button, FALSE);
+    gtk_widget_grab_focus (entry);	
+    gtk_window_set_focus (GTK_WINDOW (login), entry);	
+    gtk_widget_show (entry);
 
-    p = memchr (buf, STX, len);
-    if (p != NULL) {
-      len = p - buf;
-      g_io_channel_seek_position (source, -((sizeof (buf) - 1) - len), G_SEEK_CUR, NULL);
-      memset (buf + len, '\0', (sizeof (buf) - 1) - len);
-    }
-    buf[len - 1] = '\0';  
- 
-    process_operation ((guchar) buf[0], buf + 1);
+    /* replace rather then append next message string */
+    replace_msg = TRUE;
 
-    return TRUE;
+    /* the user has seen messages */
+    messages_to_give = FALSE;
+
+    login_window_resize (FALSE /* force */);
 }
 
 static void
-process_operation (guchar       op_code,
-		   const gchar *args)
+op_noecho (const gchar *args)
 {
     char *tmp;
-    gint i, x, y;
-    GtkWidget *dlg;
-    static gboolean replace_msg = TRUE;
-    static gboolean messages_to_give = FALSE;
-
-    /* Parse opcode */
-    switch (op_code) {
-    case MDM_SETLOGIN:
-	/* somebody is trying to fool us this is the user that
-	 * wants to log in, and well, we are the gullible kind */
-	g_free (curuser);
-	curuser = g_strdup (args);
-	if (mdm_config_get_bool (MDM_KEY_BROWSER)) {
-    	browser_set_user (curuser);
+
+    tmp = ve_locale_to_utf8 (args);
+    if (tmp != NULL && strcmp (tmp, _("Password:")) == 0) {
+	    mdm_common_translate_widget (label, N_("_Password:"));
+    } else {
+	    mdm_common_translate_widget (label, NULL);
+	    if (tmp != NULL)
+		    gtk_label_set_text (GTK_LABEL (label), tmp);
     }
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
-
-    case MDM_PROMPT:
-	tmp = ve_locale_to_utf8 (args);
-	if (tmp != NULL && strcmp (tmp, _("Username:")) == 0) {
-		mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM),
-					mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE),
-					mdm_config_get_bool   (MDM_KEY_SOUND_ON_LOGIN));
-		gtk_label_set_text_with_mnemonic (GTK_LABEL (label), _("_Username:"));
-	} else {
-		if (tmp != NULL)
-			gtk_label_set_text (GTK_LABEL (label), tmp);
-	}
-	g_free (tmp);
+    g_free (tmp);
 
-	gtk_widget_set_sensitive (GTK_WIDGET (start_again_button), !first_prompt);
-	first_prompt = FALSE;
+    gtk_widget_set_sensitive (GTK_WIDGET (start_again_button), !first_prompt);
+    first_prompt = FALSE;
 
-	gtk_widget_show (GTK_WIDGET (label));
-	gtk_entry_set_text (GTK_ENTRY (entry), "");
-	gtk_entry_set_max_length (GTK_ENTRY (entry), PW_ENTRY_SIZE);
-	gtk_entry_set_visibility (GTK_ENTRY (entry), TRUE);
-	gtk_widget_set_sensitive (entry, TRUE);
-	gtk_widget_set_sensitive (ok_button, FALSE);
-	gtk_widget_grab_focus (entry);	
-	gtk_window_set_focus (GTK_WINDOW (login), entry);	
-	gtk_widget_show (entry);
+    gtk_widget_show (GTK_WIDGET (label));
+    gtk_entry_set_text (GTK_ENTRY (entry), "");
+    gtk_entry_set_max_length (GTK_ENTRY (entry), PW_ENTRY_SIZE);
+    gtk_entry_set_visibility (GTK_ENTRY (entry), FALSE);
+    gtk_widget_set_sensitive (entry, TRUE);
+    gtk_widget_set_sensitive (ok_button, FALSE);
+    gtk_widget_grab_focus (entry);	
+    gtk_window_set_focus (GTK_WINDOW (login), entry);	
+    gtk_widget_show (entry);
 
-	/* replace rather then append next message string */
-	replace_msg = TRUE;
+    /* replace rather then append next message string */
+    replace_msg = TRUE;
 
-	/* the user has seen messages */
-	messages_to_give = FALSE;
+    /* the user has seen messages */
+    messages_to_give = FALSE;
 
-	login_window_resize (FALSE /* force */);
-	break;
+    login_window_resize (FALSE /* force */);
+}
 
-    case MDM_NOECHO:
-	tmp = ve_locale_to_utf8 (args);
-	if (tmp != NULL && strcmp (tmp, _("Password:")) == 0) {
-		gtk_label_set_text_with_mnemonic (GTK_LABEL (label), _("_Password:"));
-	} else {
-		if (tmp != NULL)
-			gtk_label_set_text (GTK_LABEL (label), tmp);
-	}
-	g_free (tmp);
+static void
+op_msg (const gchar *args)
+{
+    char *tmp;
 
-	gtk_widget_set_sensitive (GTK_WIDGET (start_again_button), !first_prompt);
-	first_prompt = FALSE;
+    /* the user has not yet seen messages */
+    messages_to_give = TRUE;
+
+    /* HAAAAAAACK.  Sometimes pam sends many many messages, SO
+     * we try to collect them until the next prompt or reset or
+     * whatnot */
+    if ( ! replace_msg &&
+	 /* empty message is for clearing */
+	 ! ve_string_empty (args)) {
+	    const char *oldtext;
+	    oldtext = gtk_label_get_text (GTK_LABEL (msg));
+	    if ( ! ve_string_empty (oldtext)) {
+		    char *newtext;
+		    tmp = ve_locale_to_utf8 (args);
+		    newtext = g_strdup_printf ("%s\n%s", oldtext, tmp);
+		    g_free (tmp);
+		    gtk_label_set_text (GTK_LABEL (msg), newtext);
+		    g_free (newtext);
+	    } else {
+		    tmp = ve_locale_to_utf8 (args);
+		    gtk_label_set_text (GTK_LABEL (msg), tmp);
+		    g_free (tmp);
+	    }
+    } else {
+	    tmp = ve_locale_to_utf8 (args);
+	    gtk_label_set_text (GTK_LABEL (msg), tmp);
+	    g_free (tmp);
+    }
+    replace_msg = FALSE;
 
-	gtk_widget_show (GTK_WIDGET (label));
-	gtk_entry_set_text (GTK_ENTRY (entry), "");
-	gtk_entry_set_max_length (GTK_ENTRY (entry), PW_ENTRY_SIZE);
-	gtk_entry_set_visibility (GTK_ENTRY (entry), FALSE);
-	gtk_widget_set_sensitive (entry, TRUE);
-	gtk_widget_set_sensitive (ok_button, FALSE);
-	gtk_widget_grab_focus (entry);	
-	gtk_window_set_focus (GTK_WINDOW (login), entry);	
-	gtk_widget_show (entry);
-
-	/* replace rather then append next message string */
-	replace_msg = TRUE;
-
-	/* the user has seen messages */
-	messages_to_give = FALSE;
-
-	login_window_resize (FALSE /* force */);
-	break;
-
-    case MDM_MSG:
-	/* the user has not yet seen messages */
-	messages_to_give = TRUE;
-
-	/* HAAAAAAACK.  Sometimes pam sends many many messages, SO
-	 * we try to collect them until the next prompt or reset or
-	 * whatnot */
-	if ( ! replace_msg &&
-	   /* empty message is for clearing */
-	   ! ve_string_empty (args)) {
-		const char *oldtext;
-		oldtext = gtk_label_get_text (GTK_LABEL (msg));
-		if ( ! ve_string_empty (oldtext)) {
-			char *newtext;
-			tmp = ve_locale_to_utf8 (args);
-			newtext = g_strdup_printf ("%s\n%s", oldtext, tmp);
-			g_free (tmp);
-			gtk_label_set_text (GTK_LABEL (msg), newtext);
-			g_free (newtext);
-		} else {
-			tmp = ve_locale_to_utf8 (args);
-			gtk_label_set_text (GTK_LABEL (msg), tmp);
-			g_free (tmp);
-		}
-	} else {
-		tmp = ve_locale_to_utf8 (args);
-		gtk_label_set_text (GTK_LABEL (msg), tmp);
-		g_free (tmp);
-	}
-	replace_msg = FALSE;
+    gtk_widget_show (GTK_WIDGET (msg));
+    mdm_ctrl_ack ();
 
-	gtk_widget_show (GTK_WIDGET (msg));
-	printf ("%c\n", STX);
-	fflush (stdout);
+    login_window_resize (FALSE /* force */);
+}
 
-	login_window_resize (FALSE /* force */);
+static void
+op_errbox (const gchar *args)
+{
+    char *tmp;
 
-	break;
+    tmp = ve_locale_to_utf8 (args);
+    gtk_label_set_text (GTK_LABEL (err_box), tmp);
+    g_free (tmp);
+    if (err_box_clear_handler > 0)
+	    g_source_remove (err_box_clear_handler);
+    if (ve_string_empty (args))
+	    err_box_clear_handler = 0;
+    else
+	    err_box_clear_handler = g_timeout_add (30000,
+						   err_box_clear,
+						   NULL);
+    mdm_ctrl_ack ();
 
-    case MDM_ERRBOX:
-	tmp = ve_locale_to_utf8 (args);
-	gtk_label_set_text (GTK_LABEL (err_box), tmp);
-	g_free (tmp);
-	if (err_box_clear_handler > 0)
-		g_source_remove (err_box_clear_handler);
-	if (ve_string_empty (args))
-		err_box_clear_handler = 0;
-	else
-		err_box_clear_handler = g_timeout_add (30000,
-						       err_box_clear,
-						       NULL);
-	printf ("%c\n", STX);
-	fflush (stdout);
+    login_window_resize (FALSE /* force */);
+}
 
-	login_window_resize (FALSE /* force */);
-	break;
+static void
+op_errdlg (const gchar *args)
+{
+    GtkWidget *dlg;
+    char *tmp;
 
-    case MDM_ERRDLG:
-	/* we should be now fine for focusing new windows */
-	mdm_wm_focus_new_windows (TRUE);
+    /* we should be now fine for focusing new windows */
+    mdm_wm_focus_new_windows (TRUE);
 
-	tmp = ve_locale_to_utf8 (args);
-	dlg = hig_dialog_new (NULL /* parent */,
-			      GTK_DIALOG_MODAL /* flags */,
-			      GTK_MESSAGE_ERROR,
-			      GTK_BUTTONS_OK,
-			      tmp,
-			      "");
-	g_free (tmp);
+    tmp = ve_locale_to_utf8 (args);
+    dlg = hig_dialog_new (NULL /* parent */,
+			  GTK_DIALOG_MODAL /* flags */,
+			  GTK_MESSAGE_ERROR,
+			  GTK_BUTTONS_OK,
+			  tmp,
+			  "");
+    g_free (tmp);
 
-	mdm_wm_center_window (GTK_WINDOW (dlg));
+    mdm_wm_center_window (GTK_WINDOW (dlg));
 
-	mdm_wm_no_login_focus_push ();
-	gtk_dialog_run (GTK_DIALOG (dlg));
-	gtk_widget_destroy (dlg);
-	mdm_wm_no_login_focus_pop ();
+    mdm_wm_no_login_focus_push ();
+    gtk_dialog_run (GTK_DIALOG (dlg));
+    gtk_widget_destroy (dlg);
+    mdm_wm_no_login_focus_pop ();
 
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    mdm_ctrl_ack ();
+}
 
-    case MDM_SESS:
-	printf ("%c%s\n", STX, current_session);
-	fflush (stdout);
-	break;
-
-    case MDM_LANG:
-	mdm_lang_op_lang (args);
-	break;
-
-    case MDM_SLANG:
-	mdm_lang_op_slang (args);
-	break;
-
-    case MDM_SETSESS:
-    	current_session = args;
-    	printf ("%c\n", STX);
-    	fflush (stdout);
-    	break;
-
-    case MDM_SETLANG:
-	mdm_lang_op_setlang (args);
-	break;
-
-    case MDM_ALWAYS_RESTART:
-	mdm_lang_op_always_restart (args);
-	break;
-
-    case MDM_RESET:
-	if (login->window != NULL &&
-	    icon_win == NULL &&
-	    GTK_WIDGET_VISIBLE (login)) {
-		Window lw = GDK_WINDOW_XWINDOW (login->window);
-
-		mdm_wm_get_window_pos (lw, &x, &y);
-
-		for (i = 32 ; i > 0 ; i = i/4) {
-			mdm_wm_move_window_now (lw, i+x, y);
-			usleep (200);
-			mdm_wm_move_window_now (lw, x, y);
-			usleep (200);
-			mdm_wm_move_window_now (lw, -i+x, y);
-			usleep (200);
-			mdm_wm_move_window_now (lw, x, y);
-			usleep (200);
-		}
-	}
-	/* fall thru to reset */
+static void
+op_sess (const gchar *args)
+{
+    mdm_ctrl_reply (current_session);
+}
 
-    case MDM_RESETOK:
-	if (curuser != NULL) {
-	    g_free (curuser);
-	    curuser = NULL;
-	}
+static void
+op_setsess (const gchar *args)
+{
+    /* args goes away once we return */
+    current_session = g_intern_string (args);
+    mdm_ctrl_ack ();
+}
 
-	first_prompt = TRUE;
+static void
+op_reset (const gchar *args)
+{
+    gint i, x, y;
 
-	gtk_widget_set_sensitive (entry, TRUE);
-	gtk_widget_set_sensitive (ok_button, FALSE);
-	gtk_widget_set_sensitive (start_again_button, FALSE);
-	if (mdm_config_get_bool (MDM_KEY_BROWSER)) {
-    	gtk_widget_set_sensitive (GTK_WIDGET (browser), TRUE);
+    if (login->window != NULL &&
+	icon_win == NULL &&
+	GTK_WIDGET_VISIBLE (login)) {
+	    Window lw = GDK_WINDOW_XWINDOW (login->window);
+
+	    mdm_wm_get_window_pos (lw, &x, &y);
+
+	    for (i = 32 ; i > 0 ; i = i/4) {
+		    mdm_wm_move_window_now (lw, i+x, y);
+		    usleep (200);
+		    mdm_wm_move_window_now (lw, x, y);
+		    usleep (200);
+		    mdm_wm_move_window_now (lw, -i+x, y);
+		    usleep (200);
+		    mdm_wm_move_window_now (lw, x, y);
+		    usleep (200);
+	    }
     }
 
-	tmp = ve_locale_to_utf8 (args);
-	gtk_label_set_text (GTK_LABEL (msg), tmp);
-	g_free (tmp);
-	gtk_widget_show (GTK_WIDGET (msg));
+    op_resetok (args);
+}
 
-	printf ("%c\n", STX);
-	fflush (stdout);
+static void
+op_resetok (const gchar *args)
+{
+    char *tmp;
 
-	login_window_resize (FALSE /* force */);
-	break;
+    if (curuser != NULL) {
+	g_free (curuser);
+	curuser = NULL;
+    }
 
-    case MDM_QUIT:
-	if (timed_handler_id != 0) {
-		g_source_remove (timed_handler_id);
-		timed_handler_id = 0;
-	}	
+    first_prompt = TRUE;
 
-	/* Hide the login window now */
-	gtk_widget_hide (login);
+    gtk_widget_set_sensitive (entry, TRUE);
+    gtk_widget_set_sensitive (ok_button, FALSE);
+    gtk_widget_set_sensitive (start_again_button, FALSE);
+    if (mdm_config_get_bool (MDM_KEY_BROWSER)) {
+	gtk_widget_set_sensitive (GTK_WIDGET (browser), TRUE);
+    }
 
-	if (messages_to_give) {
-		const char *oldtext;
-		oldtext = gtk_label_get_text (GTK_LABEL (msg));
+    tmp = ve_locale_to_utf8 (args);
+    gtk_label_set_text (GTK_LABEL (msg), tmp);
+    g_free (tmp);
+    gtk_widget_show (GTK_WIDGET (msg));
 
-		if ( ! ve_string_empty (oldtext)) {
-			/* we should be now fine for focusing new windows */
-			mdm_wm_focus_new_windows (TRUE);
+    mdm_ctrl_ack ();
 
-			dlg = hig_dialog_new (NULL /* parent */,
-					      GTK_DIALOG_MODAL /* flags */,
-					      GTK_MESSAGE_INFO,
-					      GTK_BUTTONS_OK,
-					      oldtext,
-					      "");
-			gtk_window_set_modal (GTK_WINDOW (dlg), TRUE);
-			mdm_wm_center_window (GTK_WINDOW (dlg));
+    login_window_resize (FALSE /* force */);
+}
 
-			mdm_wm_no_login_focus_push ();
-			gtk_dialog_run (GTK_DIALOG (dlg));
-			gtk_widget_destroy (dlg);
-			mdm_wm_no_login_focus_pop ();
-		}
-		messages_to_give = FALSE;
-	}
+static void
+op_quit (const gchar *args)
+{
+    GtkWidget *dlg;
 
-	mdm_kill_thingies ();
+    if (timed_handler_id != 0) {
+	    g_source_remove (timed_handler_id);
+	    timed_handler_id = 0;
+    }	
+
+    /* Hide the login window now */
+    gtk_widget_hide (login);
+
+    if (messages_to_give) {
+	    const char *oldtext;
+	    oldtext = gtk_label_get_text (GTK_LABEL (msg));
+
+	    if ( ! ve_string_empty (oldtext)) {
+		    /* we should be now fine for focusing new windows */
+		    mdm_wm_focus_new_windows (TRUE);
+
+		    dlg = hig_dialog_new (NULL /* parent */,
+					  GTK_DIALOG_MODAL /* flags */,
+					  GTK_MESSAGE_INFO,
+					  GTK_BUTTONS_OK,
+					  oldtext,
+					  "");
+		    gtk_window_set_modal (GTK_WINDOW (dlg), TRUE);
+		    mdm_wm_center_window (GTK_WINDOW (dlg));
+
+		    mdm_wm_no_login_focus_push ();
+		    gtk_dialog_run (GTK_DIALOG (dlg));
+		    gtk_widget_destroy (dlg);
+		    mdm_wm_no_login_focus_pop ();
+	    }
+	    messages_to_give = FALSE;
+    }
 
-	gdk_flush ();
+    mdm_kill_thingies ();
 
-	printf ("%c\n", STX);
-	fflush (stdout);
+    gdk_flush ();
 
-	/* screw gtk_main_quit, we want to make sure we definately die */
-	_exit (EXIT_SUCCESS);
-	break;
+    mdm_ctrl_ack ();
 
-    case MDM_STARTTIMER:
-	/*
-	 * Timed Login: Start Timer Loop
-	 */
+    /* screw gtk_main_quit, we want to make sure we definately die */
+    _exit (EXIT_SUCCESS);
+}
 
-	if (timed_handler_id == 0 &&
-	    mdm_config_get_bool (MDM_KEY_TIMED_LOGIN_ENABLE) &&
-	    ! ve_string_empty (mdm_config_get_string (MDM_KEY_TIMED_LOGIN)) &&
-	    mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY) > 0) {
-		mdm_timed_delay = mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY);
-		timed_handler_id  = g_timeout_add (1000, mdm_timer, NULL);
-	}
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+static void
+op_starttimer (const gchar *args)
+{
+    /*
+     * Timed Login: Start Timer Loop
+     */
 
-    case MDM_STOPTIMER:
-	/*
-	 * Timed Login: Stop Timer Loop
-	 */
+    if (timed_handler_id == 0 &&
+	mdm_config_get_bool (MDM_KEY_TIMED_LOGIN_ENABLE) &&
+	! ve_string_empty (mdm_config_get_string (MDM_KEY_TIMED_LOGIN)) &&
+	mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY) > 0) {
+	    mdm_timed_delay = mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY);
+	    timed_handler_id  = g_timeout_add (1000, mdm_timer, NULL);
+    }
+    mdm_ctrl_ack ();
+}
 
-	if (timed_handler_id != 0) {
-		g_source_remove (timed_handler_id);
-		timed_handler_id = 0;
-	}
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+static void
+op_stoptimer (const gchar *args)
+{
+    /*
+     * Timed Login: Stop Timer Loop
+     */
 
-    case MDM_DISABLE:
-	if (clock_label != NULL)
-		GTK_WIDGET_SET_FLAGS (clock_label->parent, GTK_SENSITIVE);
-	gtk_widget_set_sensitive (login, FALSE);
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+    if (timed_handler_id != 0) {
+	    g_source_remove (timed_handler_id);
+	    timed_handler_id = 0;
+    }
+    mdm_ctrl_ack ();
+}
 
-    case MDM_ENABLE:
-	gtk_widget_set_sensitive (login, TRUE);
-	if (clock_label != NULL)
-		GTK_WIDGET_UNSET_FLAGS (clock_label->parent, GTK_SENSITIVE);
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+static void
+op_disable (const gchar *args)
+{
+    if (clock_label != NULL)
+	    GTK_WIDGET_SET_FLAGS (clock_label->parent, GTK_SENSITIVE);
+    gtk_widget_set_sensitive (login, FALSE);
+    mdm_ctrl_ack ();
+}
 
-    /* These are handled separately so ignore them here and send
-     * back a NULL response so that the daemon quits sending them */
-    case MDM_NEEDPIC:
-    case MDM_READPIC:
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+static void
+op_enable (const gchar *args)
+{
+    gtk_widget_set_sensitive (login, TRUE);
+    if (clock_label != NULL)
+	    GTK_WIDGET_UNSET_FLAGS (clock_label->parent, GTK_SENSITIVE);
+    mdm_ctrl_ack ();
+}
 
-    case MDM_NOFOCUS:
-	mdm_wm_no_login_focus_push ();
-	
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+static void
+op_nofocus (const gchar *args)
+{
+    mdm_wm_no_login_focus_push ();
+    mdm_ctrl_ack ();
+}
 
-    case MDM_FOCUS:
-	mdm_wm_no_login_focus_pop ();
-	
-	printf ("%c\n", STX);
-	fflush (stdout);
-	break;
+static void
+op_focus (const gchar *args)
+{
+    mdm_wm_no_login_focus_pop ();
+    mdm_ctrl_ack ();
+}
 
-    case MDM_SAVEDIE:
-	/* Set busy cursor */
-	mdm_common_setup_cursor (GDK_WATCH);
+static void
+op_savedie (const gchar *args)
+{
+    /* Set busy cursor */
+    mdm_common_setup_cursor (GDK_WATCH);
 
-	mdm_wm_save_wm_order ();
+    mdm_wm_save_wm_order ();
 
-	mdm_kill_thingies ();
-	gdk_flush ();
+    mdm_kill_thingies ();
+    gdk_flush ();
 
-	printf ("%c\n", STX);
-	fflush (stdout);
+    mdm_ctrl_ack ();
 
-	_exit (EXIT_SUCCESS);
+    _exit (EXIT_SUCCESS);
+}
 
-    case MDM_QUERY_CAPSLOCK:
-	if (greeter_is_capslock_on ())
-	    printf ("%cY\n", STX);
-	else
-	    printf ("%c\n", STX);
-	fflush (stdout);
+static void
+op_query_capslock (const gchar *args)
+{
+    mdm_ctrl_reply (greeter_is_capslock_on () ? "Y" : "");
+}
 
-	break;
-	
-    default:
-	mdm_kill_thingies ();
-	mdm_common_fail_greeter ("Unexpected greeter command received: '%c'", op_code);
-	break;
-    }
+static void
+op_unknown (guchar op_code, const gchar *args)
+{
+    mdm_kill_thingies ();
+    mdm_common_fail_greeter ("Unexpected greeter command received: '%c'", op_code);
 }
 
+static const MdmCtrlOp ctrl_ops[] = {
+    { MDM_SETLOGIN,       op_setlogin },
+    { MDM_PROMPT,         op_prompt },
+    { MDM_NOECHO,         op_noecho },
+    { MDM_MSG,            op_msg },
+    { MDM_ERRBOX,         op_errbox },
+    { MDM_ERRDLG,         op_errdlg },
+    { MDM_SESS,           op_sess },
+    { MDM_LANG,           mdm_lang_op_lang },
+    { MDM_SLANG,          mdm_lang_op_slang },
+    { MDM_SETSESS,        op_setsess },
+    { MDM_SETLANG,        mdm_lang_op_setlang },
+    { MDM_ALWAYS_RESTART, mdm_lang_op_always_restart },
+    { MDM_RESET,          op_reset },
+    { MDM_RESETOK,        op_resetok },
+    { MDM_QUIT,           op_quit },
+    { MDM_STARTTIMER,     op_starttimer },
+    { MDM_STOPTIMER,      op_stoptimer },
+    { MDM_DISABLE,        op_disable },
+    { MDM_ENABLE,         op_enable },
+    /* These are handled separately so ignore them here and send
+     * back a NULL response so that the daemon quits sending them */
+    { MDM_NEEDPIC,        mdm_ctrl_op_ack },
+    { MDM_READPIC,        mdm_ctrl_op_ack },
+    { MDM_NOFOCUS,        op_nofocus },
+    { MDM_FOCUS,          op_focus },
+    { MDM_SAVEDIE,        op_savedie },
+    { MDM_QUERY_CAPSLOCK, op_query_capslock },
+    { 0, NULL }
+};
+
 
 static void
 mdm_login_browser_populate (void)
@@ -1657,7 +1660,7 @@ mdm_login_gui_init (void)
                       G_CALLBACK (key_press_event), NULL);
 
     if G_LIKELY ( ! DOING_MDM_DEVELOPMENT) {
-    	gtk_window_set_title (GTK_WINDOW (login), _("MDM Login"));
+    	mdm_common_translate_widget (login, N_("MDM Login"));
     }
     else {    	
     	gtk_window_set_icon_name (GTK_WINDOW (login), "mdmsetup");
@@ -1701,14 +1704,16 @@ mdm_login_gui_init (void)
 
     menu = gtk_menu_new ();
     mdm_login_session_init (menu);
-    sessmenu = gtk_menu_item_new_with_mnemonic (_("S_ession"));
+    sessmenu = gtk_menu_item_new_with_mnemonic ("");
+    mdm_common_translate_widget (sessmenu, N_("S_ession"));
     gtk_menu_shell_append (GTK_MENU_SHELL (menubar), sessmenu);
     gtk_menu_item_set_submenu (GTK_MENU_ITEM (sessmenu), menu);
     gtk_widget_show (GTK_WIDGET (sessmenu));
 
     menu = mdm_login_language_menu_new ();
     if (menu != NULL) {
-	langmenu = gtk_menu_item_new_with_mnemonic (_("_Language"));
+	langmenu = gtk_menu_item_new_with_mnemonic ("");
+	mdm_common_translate_widget (langmenu, N_("_Language"));
 	gtk_menu_shell_append (GTK_MENU_SHELL (menubar), langmenu);
 	gtk_menu_item_set_submenu (GTK_MENU_ITEM (langmenu), menu);
 	gtk_widget_show (GTK_WIDGET (langmenu));
@@ -1728,7 +1733,8 @@ mdm_login_gui_init (void)
 	if (mdm_config_get_bool (MDM_KEY_CONFIG_AVAILABLE) &&
 	    !mdm_config_get_bool (MDM_KEY_ADD_GTK_MODULES) &&
 	    bin_exists (mdm_config_get_string (MDM_KEY_CONFIGURATOR))) {
-		item = gtk_menu_item_new_with_mnemonic (_("_Configure Login Manager..."));
+		item = gtk_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (item, N_("_Configure Login Manager..."));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
 		g_signal_connect (G_OBJECT (item), "activate",
 				  G_CALLBACK (mdm_run_mdmconfig),
@@ -1739,7 +1745,8 @@ mdm_login_gui_init (void)
 
 	if (mdm_working_command_exists (mdm_config_get_string (MDM_KEY_REBOOT)) &&
 	    mdm_common_is_action_available ("REBOOT")) {
-		item = gtk_menu_item_new_with_mnemonic (_("_Restart"));
+		item = gtk_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (item, N_("_Restart"));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
 		g_signal_connect (G_OBJECT (item), "activate",
 				  G_CALLBACK (mdm_login_restart_handler), 
@@ -1750,7 +1757,8 @@ mdm_login_gui_init (void)
 	
 	if (mdm_working_command_exists (mdm_config_get_string (MDM_KEY_HALT)) &&
 	    mdm_common_is_action_available ("HALT")) {
-		item = gtk_menu_item_new_with_mnemonic (_("Shut _Down"));
+		item = gtk_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (item, N_("Shut _Down"));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
 		g_signal_connect (G_OBJECT (item), "activate",
 				  G_CALLBACK (mdm_login_halt_handler), 
@@ -1761,7 +1769,8 @@ mdm_login_gui_init (void)
 
 	if (mdm_working_command_exists (mdm_config_get_string (MDM_KEY_SUSPEND)) &&
 	    mdm_common_is_action_available ("SUSPEND")) {
-		item = gtk_menu_item_new_with_mnemonic (_("_Suspend"));
+		item = gtk_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (item, N_("_Suspend"));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
 		g_signal_connect (G_OBJECT (item), "activate",
 				  G_CALLBACK (mdm_login_suspend_handler), 
@@ -1771,7 +1780,8 @@ mdm_login_gui_init (void)
 	}	
 
 	if (got_anything) {
-		item = gtk_menu_item_new_with_mnemonic (_("_Actions"));
+		item = gtk_menu_item_new_with_mnemonic ("");
+		mdm_common_translate_widget (item, N_("_Actions"));
 		gtk_menu_shell_append (GTK_MENU_SHELL (menubar), item);
 		gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), menu);
 		gtk_widget_show (GTK_WIDGET (item));
@@ -1897,7 +1907,8 @@ mdm_login_gui_init (void)
 		      (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
 		      (GtkAttachOptions) (GTK_FILL), 0, 6);
     
-    label = gtk_label_new_with_mnemonic (_("_Username:"));
+    label = gtk_label_new (NULL);
+    mdm_common_translate_widget (label, N_("_Username:"));
     gtk_widget_ref (label);
     g_object_set_data_full (G_OBJECT (login), "label", label,
 			    (GDestroyNotify) gtk_widget_unref);
@@ -1986,7 +1997,8 @@ mdm_login_gui_init (void)
 		      entry);
     gtk_widget_show (ok_button);
 
-    start_again_button = gtk_button_new_with_mnemonic (_("_Start Again"));
+    start_again_button = gtk_button_new_with_mnemonic ("");
+    mdm_common_translate_widget (start_again_button, N_("_Start Again"));
     g_signal_connect (G_OBJECT (start_again_button), "clicked",
 		      G_CALLBACK (mdm_login_start_again_button_press),
 		      entry);
@@ -2059,72 +2071,6 @@ mdm_login_gui_init (void)
 	}
 }
 
-static GdkPixbuf *
-render_scaled_back (const GdkPixbuf *pb)
-{
-	int i;
-	int width, height;
-
-	GdkPixbuf *back = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
-					  gdk_pixbuf_get_has_alpha (pb),
-					  8,
-					  gdk_screen_width (),
-					  gdk_screen_height ());
-
-	width = gdk_pixbuf_get_width (pb);
-	height = gdk_pixbuf_get_height (pb);
-
-	for (i = 0; i < mdm_wm_num_monitors; i++) {
-		gdk_pixbuf_scale (pb, back,
-				  mdm_wm_all_monitors[i].x,
-				  mdm_wm_all_monitors[i].y,
-				  mdm_wm_all_monitors[i].width,
-				  mdm_wm_all_monitors[i].height,
-				  mdm_wm_all_monitors[i].x /* offset_x */,
-				  mdm_wm_all_monitors[i].y /* offset_y */,
-				  (double) mdm_wm_all_monitors[i].width / width,
-				  (double) mdm_wm_all_monitors[i].height / height,
-				  GDK_INTERP_BILINEAR);
-	}
-
-	return back;
-}
-
-static void
-add_color_to_pb (GdkPixbuf *pb, GdkColor *color)
-{
-	int width = gdk_pixbuf_get_width (pb);
-	int height = gdk_pixbuf_get_height (pb);
-	int rowstride = gdk_pixbuf_get_rowstride (pb);
-	guchar *pixels = gdk_pixbuf_get_pixels (pb);
-	gboolean has_alpha = gdk_pixbuf_get_has_alpha (pb);
-	int i;
-	int cr = color->red >> 8;
-	int cg = color->green >> 8;
-	int cb = color->blue >> 8;
-
-	if ( ! has_alpha)
-		return;
-
-	for (i = 0; i < height; i++) {
-		int ii;
-		guchar *p = pixels + (rowstride * i);
-		for (ii = 0; ii < width; ii++) {
-			int r = p[0];
-			int g = p[1];
-			int b = p[2];
-			int a = p[3];
-
-			p[0] = (r * a + cr * (255 - a)) >> 8;
-			p[1] = (g * a + cg * (255 - a)) >> 8;
-			p[2] = (b * a + cb * (255 - a)) >> 8;
-			p[3] = 255;
-
-			p += 4;
-		}
-	}
-}
-
 /* setup background color/image */
 static void
 setup_background (void)
@@ -2133,36 +2079,30 @@ setup_background (void)
 	GdkPixbuf *pb = NULL;
 	gchar *bg_color = mdm_config_get_string (MDM_KEY_BACKGROUND_COLOR);
 	gchar *bg_image = mdm_config_get_string (MDM_KEY_BACKGROUND_IMAGE);
-	gint   bg_type  = mdm_config_get_int    (MDM_KEY_BACKGROUND_TYPE); 
+	gint   bg_type  = mdm_config_get_int    (MDM_KEY_BACKGROUND_TYPE);
 
 	if ((bg_type == MDM_BACKGROUND_IMAGE ||
 	     bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) &&
-	    ! ve_string_empty (bg_image))
-		pb = gdk_pixbuf_new_from_file (bg_image, NULL);
+	    ! ve_string_empty (bg_image)) {
+		if (bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) {
+			if (bg_color == NULL ||
+			    bg_color[0] == '\0' ||
+			    ! gdk_color_parse (bg_color,
+				       &color)) {
+				gdk_color_parse ("#000000", &color);
+			}
+		}
+		pb = mdm_background_load (bg_image,
+		                          bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR ? &color : NULL,
+		                          mdm_wm_all_monitors,
+		                          mdm_wm_num_monitors,
+		                          mdm_config_get_string (MDM_KEY_SERV_AUTHDIR));
+	}
 
 	/* Load background image */
 	if (pb != NULL) {
-		if (gdk_pixbuf_get_has_alpha (pb)) {
-			if (bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) {
-				if (bg_color == NULL ||
-				    bg_color[0] == '\0' ||
-				    ! gdk_color_parse (bg_color,
-					       &color)) {
-					gdk_color_parse ("#000000", &color);
-				}
-				add_color_to_pb (pb, &color);
-			}
-		}
-		
-		GdkPixbuf *spb = render_scaled_back (pb);
+		mdm_common_set_root_background (pb);
 		g_object_unref (G_OBJECT (pb));
-		pb = spb;		
-
-		/* paranoia */
-		if (pb != NULL) {
-			mdm_common_set_root_background (pb);
-			g_object_unref (G_OBJECT (pb));
-		}
 	/* Load background color */
 	} else if (bg_type != MDM_BACKGROUND_NONE &&
 	           bg_type != MDM_BACKGROUND_IMAGE) {
@@ -2361,13 +2301,33 @@ lang_set_custom_callback (gchar *language)
 {
 }
 
+/*
+ * Our own strings are relabelled by mdm_common_retranslate_widgets, this
+ * redoes the texts that are put together here.
+ */
+void
+lang_relocalize_callback (void)
+{
+    struct tm *the_tm;
+    gchar *str;
+
+    mdm_set_welcomemsg ();
+
+    if (clock_label != NULL) {
+	    str = mdm_common_get_clock (&the_tm);
+	    gtk_label_set_text (GTK_LABEL (clock_label), str);
+	    g_free (str);
+    }
+
+    login_window_resize (TRUE /* force */);
+}
+
 int 
 main (int argc, char *argv[])
 {
     struct sigaction hup;
     struct sigaction term;
     sigset_t mask;
-    GIOChannel *ctrlch;
     guint sid;
 
     if (g_getenv ("DOING_MDM_DEVELOPMENT") != NULL)
@@ -2473,17 +2433,7 @@ main (int argc, char *argv[])
     back_prog_launch_after_timeout ();
 
     if G_LIKELY ( ! DOING_MDM_DEVELOPMENT) {
-	    ctrlch = g_io_channel_unix_new (STDIN_FILENO);
-	    g_io_channel_set_encoding (ctrlch, NULL, NULL);
-	    g_io_channel_set_buffered (ctrlch, TRUE);
-	    g_io_channel_set_flags (ctrlch, 
-				    g_io_channel_get_flags (ctrlch) | G_IO_FLAG_NONBLOCK,
-				    NULL);
-	    g_io_add_watch (ctrlch, 
-			    G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
-			    (GIOFunc) mdm_login_ctrl_handler,
-			    NULL);
-	    g_io_channel_unref (ctrlch);
+	    mdm_ctrl_watch (ctrl_ops, op_unknown);
     }
 
     /* if in timed mode, delay timeout on keyboard or menu
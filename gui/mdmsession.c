@@ -26,7 +26,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <dirent.h>
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 
@@ -36,6 +35,7 @@
 #include "mdmconfig.h"
 
 #include "mdm-common.h"
+#include "mdm-session-index.h"
 #include "mdm-daemon-config-keys.h"
 
 GHashTable *sessnames        = NULL;
@@ -97,152 +97,74 @@ _mdm_session_list_init (GHashTable **sessnames, GList **sessions, gchar **defaul
 {
 
     MdmSession *session = NULL;
-    gboolean some_dir_exists = FALSE;
+    MdmSessionIndex *index;
     gboolean searching_for_default = TRUE;
-    struct dirent *dent;
-    char **vec;
-    char *name;
-    DIR *sessdir;
+    const char *config_default;
+    char **files;
+    char *cache_file;
     int i;
 
     *sessnames = g_hash_table_new (g_str_hash, g_str_equal);
 
-    vec = g_strsplit (mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR),
-	 ":", -1);
-    for (i = 0; vec != NULL && vec[i] != NULL; i++) {
-	    const char *dir = vec[i];
-
-	    /* Check that session dir is readable */
-	    if G_UNLIKELY (dir == NULL || access (dir, R_OK|X_OK) != 0)
+    /* The slave keeps the index in ServAuthDir up to date, so normally
+     * this does not need to look at a single .desktop file */
+    cache_file = g_build_filename (mdm_config_get_string (MDM_KEY_SERV_AUTHDIR),
+				   MDM_SESSION_INDEX_FILE, NULL);
+    index = mdm_session_index_new (mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR),
+				   cache_file);
+    g_free (cache_file);
+    mdm_session_index_refresh (index, FALSE /* save */);
+
+    config_default = mdm_config_get_string (MDM_KEY_DEFAULT_SESSION);
+
+    files = mdm_session_index_get_files (index);
+    for (i = 0; files[i] != NULL; i++) {
+	    const char *file = files[i];
+
+	    switch (mdm_session_index_get_status (index, file)) {
+	    case MDM_SESSION_INDEX_OK:
+		    break;
+	    case MDM_SESSION_INDEX_NO_TRYEXEC:
+	    case MDM_SESSION_INDEX_INCOMPLETE:
+		    session = g_new0 (MdmSession, 1);
+		    session->name = g_strdup (file);
+		    g_hash_table_insert (*sessnames, g_strdup (file), session);
 		    continue;
+	    default:
+		    continue;
+	    }
 
-	    some_dir_exists = TRUE;
-
-	    /* Read directory entries in session dir */
-	    sessdir = opendir (dir);
-
-	    if G_LIKELY (sessdir != NULL)
-		    dent = readdir (sessdir);
-	    else
-		    dent = NULL;
-
-	    while (dent != NULL) {
-		    GKeyFile *cfg;
-		    char *exec;
-		    char *comment;
-		    char *s;
-		    char *tryexec;
-		    char *ext;
-		    gboolean hidden;
-
-		    /* ignore everything but the .desktop files */
-		    ext = strstr (dent->d_name, ".desktop");
-		    if (ext == NULL ||
-			strcmp (ext, ".desktop") != 0) {
-			    dent = readdir (sessdir);
-			    continue;
-		    }
-
-		    /* already found this session, ignore */
-		    if (g_hash_table_lookup (*sessnames, dent->d_name) != NULL) {
-			    dent = readdir (sessdir);
-			    continue;
-		    }
-
-		    s = g_strconcat (dir, "/", dent->d_name, NULL);
-		    cfg = mdm_common_config_load (s, NULL);
-		    g_free (s);
-
-		    hidden = FALSE;
-		    mdm_common_config_get_boolean (cfg, "Desktop Entry/Hidden=false", &hidden, NULL);
-		    if (hidden) {
-			    g_key_file_free (cfg);
-			    dent = readdir (sessdir);
-			    continue;
-		    }
-
-		    tryexec = NULL;
-		    mdm_common_config_get_string (cfg, "Desktop Entry/TryExec", &tryexec, NULL);
-		    if ( ! ve_string_empty (tryexec)) {
-			    char **tryexecvec = g_strsplit (tryexec, " ", -1);
-			    char *full = NULL;
-
-			    /* Do not pass any arguments to g_find_program_in_path */
-			    if (tryexecvec != NULL)
-				full = g_find_program_in_path (tryexecvec[0]);
-
-			    if (full == NULL) {
-				    session = g_new0 (MdmSession, 1);
-				    session->name      = g_strdup (dent->d_name);
-				    g_hash_table_insert (*sessnames, g_strdup (dent->d_name),
-					 session);
-				    g_free (tryexec);
-				    g_key_file_free (cfg);
-				    dent = readdir (sessdir);
-				    continue;
-			    }
-			    g_strfreev (tryexecvec);
-			    g_free (full);
-		    }
-		    g_free (tryexec);
-
-		    exec = NULL;
-		    name = NULL;
-		    comment = NULL;
-		    mdm_common_config_get_string (cfg, "Desktop Entry/Exec", &exec, NULL);
-		    mdm_common_config_get_translated_string (cfg, "Desktop Entry/Name", &name, NULL);
-		    mdm_common_config_get_translated_string (cfg, "Desktop Entry/Comment", &comment, NULL);
-		    g_key_file_free (cfg);
-
-		    if G_UNLIKELY (ve_string_empty (exec) || ve_string_empty (name)) {
-			    session = g_new0 (MdmSession, 1);
-			    session->name      = g_strdup (dent->d_name);
-			    g_hash_table_insert (*sessnames, g_strdup (dent->d_name), session);
-			    g_free (exec);
-			    g_free (name);
-			    g_free (comment);
-			    dent = readdir (sessdir);
-			    continue;
+	    /* if we found the default session */
+	    if (default_session != NULL) {
+		    if ( ! ve_string_empty (config_default) &&
+			 strcmp (file, config_default) == 0) {
+			    g_free (*default_session);
+			    *default_session = g_strdup (file);
+			    searching_for_default = FALSE;
 		    }
 
-		    /* if we found the default session */
-		    if (default_session != NULL) {
-			    if ( ! ve_string_empty (mdm_config_get_string (MDM_KEY_DEFAULT_SESSION)) &&
-				 strcmp (dent->d_name, mdm_config_get_string (MDM_KEY_DEFAULT_SESSION)) == 0) {
-				    g_free (*default_session);
-				    *default_session = g_strdup (dent->d_name);
-				    searching_for_default = FALSE;
-			    }
-
-			    /* if there is a session called Default */
-			    if (searching_for_default &&
-				g_ascii_strcasecmp (dent->d_name, "default.desktop") == 0) {
-				    g_free (*default_session);
-				    *default_session = g_strdup (dent->d_name);
-			    }
+		    /* if there is a session called Default */
+		    if (searching_for_default &&
+			g_ascii_strcasecmp (file, "default.desktop") == 0) {
+			    g_free (*default_session);
+			    *default_session = g_strdup (file);
 		    }
-
-		    session = g_new0 (MdmSession, 1);
-		    session->name      = g_strdup (name);
-		    session->comment   = g_strdup (comment);
-		    g_hash_table_insert (*sessnames, g_strdup (dent->d_name), session);
-		    g_free (exec);
-		    g_free (comment);
-		    dent = readdir (sessdir);
 	    }
 
-	    if G_LIKELY (sessdir != NULL)
-		    closedir (sessdir);
+	    session = g_new0 (MdmSession, 1);
+	    session->name      = mdm_session_index_get_name (index, file);
+	    session->comment   = mdm_session_index_get_comment (index, file);
+	    g_hash_table_insert (*sessnames, g_strdup (file), session);
     }
 
-    g_strfreev (vec);
-
     /* Check that session dir is readable */
-    if G_UNLIKELY ( ! some_dir_exists) {
+    if G_UNLIKELY ( ! mdm_session_index_has_dirs (index)) {
 	   mdm_common_error ("%s: Session directory <%s> not found!", "mdm_session_list_init", ve_sure_string (mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR)));
 	   session_dir_whacked_out = TRUE;
     }
 
+    mdm_session_index_free (index);
+
     /* Convert to list (which is unsorted) */
     g_hash_table_foreach (*sessnames, (GHFunc) mdm_session_list_from_hash_table_func, sessions);
 
@@ -24,6 +24,7 @@
 #include "config.h"
 #include <locale.h>
 #include <glib/gi18n.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -34,10 +35,14 @@
 #include "mdmcommon.h"
 #include "mdmuser.h"
 #include "mdmconfig.h"
+#include "mdmcomm.h"
 
 #include "mdm-socket-protocol.h"
 #include "mdm-daemon-config-keys.h"
 
+/* Longest list the face browser shows */
+#define MDM_MAX_USERS 1000
+
 static time_t time_started;
 
 static MdmUser * 
@@ -177,27 +182,19 @@ mdm_user_alloc (const gchar *logname,
 }
 
 static gboolean
-mdm_check_exclude (struct passwd *pwent, char **excludes, gboolean is_local)
+mdm_check_exclude_user (const char *login, uid_t uid, char **excludes)
 {
-	const char * const lockout_passes[] = { "!!", NULL };
 	gint i;
 
-        if ( ! mdm_config_get_bool (MDM_KEY_ALLOW_ROOT) && pwent->pw_uid == 0)
+        if ( ! mdm_config_get_bool (MDM_KEY_ALLOW_ROOT) && uid == 0)
                 return TRUE;       
 
-	if (pwent->pw_uid < mdm_config_get_int (MDM_KEY_MINIMAL_UID))
+	if (uid < mdm_config_get_int (MDM_KEY_MINIMAL_UID))
 		return TRUE;
 
-	for (i=0 ; lockout_passes[i] != NULL ; i++)  {
-		if (strcmp (lockout_passes[i], pwent->pw_passwd) == 0) {
-			return TRUE;
-		}
-	}
-
 	if (excludes != NULL) {
 		for (i=0 ; excludes[i] != NULL ; i++)  {
-			if (g_ascii_strcasecmp (excludes[i],
-						pwent->pw_name) == 0) {
+			if (g_ascii_strcasecmp (excludes[i], login) == 0) {
 				return TRUE;
 			}
 		}
@@ -206,6 +203,21 @@ mdm_check_exclude (struct passwd *pwent, char **excludes, gboolean is_local)
 	return FALSE;
 }
 
+static gboolean
+mdm_check_exclude (struct passwd *pwent, char **excludes, gboolean is_local)
+{
+	const char * const lockout_passes[] = { "!!", NULL };
+	gint i;
+
+	for (i=0 ; lockout_passes[i] != NULL ; i++)  {
+		if (strcmp (lockout_passes[i], pwent->pw_passwd) == 0) {
+			return TRUE;
+		}
+	}
+
+	return mdm_check_exclude_user (pwent->pw_name, pwent->pw_uid, excludes);
+}
+
 static gboolean
 mdm_check_shell (const gchar *usersh)
 {
@@ -242,6 +254,37 @@ mdm_sort_func (gpointer d1, gpointer d2)
 }
 
 
+static void
+add_user (MdmUser *user,
+	  GList **users,
+	  GList **users_string,
+	  int *size_of_users)
+{
+	if (g_list_find_custom (*users, user, (GCompareFunc) mdm_sort_func))
+		return;
+
+	*users = g_list_insert_sorted (*users, user,
+	     (GCompareFunc) mdm_sort_func);
+	*users_string = g_list_prepend (*users_string, g_strdup (user->login));
+
+	if (user->picture != NULL) {
+		*size_of_users +=
+			gdk_pixbuf_get_height (user->picture) + 2;
+	} else {
+		*size_of_users += mdm_config_get_int (MDM_KEY_MAX_ICON_HEIGHT);
+	}
+}
+
+static void
+add_too_many_users (GList **users,
+		    GList **users_string)
+{
+	*users = g_list_append (*users,
+		g_strdup (_("Too many users to list here...")));
+	*users_string = g_list_append (*users_string,
+		g_strdup (_("Too many users to list here...")));
+}
+
 static gboolean
 setup_user (struct passwd *pwent,
 	    GList **users,
@@ -268,26 +311,13 @@ setup_user (struct passwd *pwent,
 				   ve_sure_string (pwent->pw_gecos),
 				   defface, read_faces);
 
-	    if ((user) &&
-		(! g_list_find_custom (*users, user, (GCompareFunc) mdm_sort_func))) {
+	    if (user) {
 		cnt++;
-		*users = g_list_insert_sorted (*users, user,
-		     (GCompareFunc) mdm_sort_func);
-		*users_string = g_list_prepend (*users_string, g_strdup (pwent->pw_name));
-
-		if (user->picture != NULL) {
-			*size_of_users +=
-				gdk_pixbuf_get_height (user->picture) + 2;
-		} else {
-			*size_of_users += mdm_config_get_int (MDM_KEY_MAX_ICON_HEIGHT);
-		}
+		add_user (user, users, users_string, size_of_users);
 	    }
 
-	    if (cnt > 1000 || time_started + 5 <= time (NULL)) {
-		*users = g_list_append (*users,
-			g_strdup (_("Too many users to list here...")));
-		*users_string = g_list_append (*users_string,
-			g_strdup (_("Too many users to list here...")));
+	    if (cnt > MDM_MAX_USERS || time_started + 5 <= time (NULL)) {
+		add_too_many_users (users, users_string);
 
 		return (FALSE);
 	    }
@@ -329,6 +359,76 @@ get_root_user (void)
 	return root_user;
 }
 
+/*
+ * Get the user list from the index the daemon maintains, so that the
+ * passwd database (which may well be LDAP) is not enumerated by every
+ * greeter.  The daemon already applied the MinimalUID, Exclude and
+ * shell filters, and refuses displays with a configuration of their own.
+ */
+static gboolean
+users_from_daemon (GList **users,
+		   GList **users_string,
+		   char **excludes,
+		   char *exclude_user,
+		   GdkPixbuf *defface,
+		   int *size_of_users,
+		   gboolean read_faces)
+{
+    const char *display;
+    char *cmd;
+    char *ret;
+    char **fields;
+    guint total;
+    int i;
+
+    /* The daemon refuses if the display has its own Include and
+     * Exclude lists, which its index does not know about */
+    display = g_getenv ("DISPLAY");
+    if (display != NULL)
+	cmd = g_strdup_printf (MDM_SUP_GET_USERS " 0 %d %s", MDM_MAX_USERS, display);
+    else
+	cmd = g_strdup_printf (MDM_SUP_GET_USERS " 0 %d", MDM_MAX_USERS);
+    ret = mdmcomm_send_cmd_to_daemon (cmd);
+    g_free (cmd);
+
+    if (ret == NULL || strncmp (ret, "OK ", 3) != 0) {
+	g_free (ret);
+	return FALSE;
+    }
+
+    fields = g_strsplit (ret + 3, "\t", -1);
+    g_free (ret);
+
+    total = strtoul (fields[0], NULL, 10);
+
+    for (i = 1; fields[i] != NULL && fields[i+1] != NULL &&
+		fields[i+2] != NULL && fields[i+3] != NULL; i += 4) {
+	MdmUser *user;
+	char *login = g_strcompress (fields[i]);
+	uid_t uid = (uid_t) strtoul (fields[i+1], NULL, 10);
+	char *homedir = g_strcompress (fields[i+2]);
+	char *gecos = g_strcompress (fields[i+3]);
+
+	if ( ! mdm_check_exclude_user (login, uid, excludes) &&
+	    (exclude_user == NULL || strcmp (exclude_user, login) != 0)) {
+		user = mdm_user_alloc (login, uid, homedir, gecos,
+				       defface, read_faces);
+		add_user (user, users, users_string, size_of_users);
+	}
+
+	g_free (login);
+	g_free (homedir);
+	g_free (gecos);
+    }
+
+    if (total > MDM_MAX_USERS)
+	add_too_many_users (users, users_string);
+
+    g_strfreev (fields);
+
+    return TRUE;
+}
+
 void 
 mdm_users_init (GList **users,
 		GList **users_string,
@@ -357,7 +457,11 @@ mdm_users_init (GList **users,
     for (i=0 ; excludes != NULL && excludes[i] != NULL ; i++)
 	g_strstrip (excludes[i]);
 
-    if (mdm_config_get_bool (MDM_KEY_INCLUDE_ALL) == TRUE) {
+    if ((mdm_config_get_bool (MDM_KEY_INCLUDE_ALL) == TRUE || found_include == TRUE) &&
+	users_from_daemon (users, users_string, excludes, exclude_user,
+			   defface, size_of_users, read_faces)) {
+	    /* got the list from the daemon's user index */
+    } else if (mdm_config_get_bool (MDM_KEY_INCLUDE_ALL) == TRUE) {
 	    setpwent ();
 	    pwent = getpwent ();
 	    while (pwent != NULL) {
@@ -5,6 +5,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -34,7 +35,9 @@
 
 #include "mdm.h"
 #include "mdmuser.h"
+#include "mdmbackground.h"
 #include "mdmcomm.h"
+#include "mdmctrl.h"
 #include "mdmcommon.h"
 #include "mdmsession.h"
 #include "mdmlanguages.h"
@@ -82,16 +85,32 @@ enum {
     MDM_BACKGROUND_IMAGE = 3,
 };
 
-static void process_operation (guchar op_code, const gchar *args);
-static gboolean mdm_login_ctrl_handler (GIOChannel *source, GIOCondition cond, gint fd);
+static void mdm_login_ctrl_watch (void);
 
 static GHashTable *displays_hash = NULL;
+static gboolean watching_displays = FALSE;
+
+static void display_changed (const char *event, const char *name, const char *login, int vt, gpointer data);
 
 static void check_for_displays (void) {
     char  *ret;
     char **vec;
     int    i;
 
+    if (displays_hash == NULL) {
+        displays_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    if (watching_displays) {
+        return;
+    }
+
+    /* Follow logins from here on if the daemon can tell us */
+    if (mdmcomm_watch_displays (display_changed, NULL)) {
+        watching_displays = TRUE;
+        return;
+    }
+
     /*
      * Might be nice to move this call into read_config() so that it happens
      * on the same socket call as reading the configuration.
@@ -108,10 +127,6 @@ static void check_for_displays (void) {
         return;
     }
 
-    if (displays_hash == NULL) {
-        displays_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-    }
-
     for (i = 0; vec[i] != NULL; i++) {
         char **rvec;
 
@@ -142,30 +157,162 @@ static gchar * str_replace(const char *string, const char *delimiter, const char
     return ret;
 }
 
-static char * html_encode(const char *string) {
-    char * ret;
-    ret = str_replace(string, "'", "&#39");
-    ret = str_replace(ret, "\"", "&#34");
-    ret = str_replace(ret, ";", "&#59");
-    ret = str_replace(ret, "<", "&#60");
-    ret = str_replace(ret, ">", "&#62");
-    ret = str_replace(ret, "\n", "<br/>");
-    return ret;
+/* Replaces delimiter in *string, freeing the previous value */
+static void str_replace_in_place(gchar **string, const char *delimiter, const char *replacement) {
+    gchar *ret;
+    ret = str_replace(*string, delimiter, replacement);
+    g_free (*string);
+    *string = ret;
 }
 
-void webkit_execute_script(const gchar * function, const gchar * arguments) {
-    if (webkit_ready) {
-        gchar * tmp;
+static char * html_encode(const char *string) {
+    GString *ret;
+    const char *p;
+
+    ret = g_string_sized_new (strlen (string) + 16);
+    for (p = string; *p != '\0'; p++) {
+        switch (*p) {
+            case '\'': g_string_append (ret, "&#39"); break;
+            case '"':  g_string_append (ret, "&#34"); break;
+            case ';':  g_string_append (ret, "&#59"); break;
+            case '<':  g_string_append (ret, "&#60"); break;
+            case '>':  g_string_append (ret, "&#62"); break;
+            case '\n': g_string_append (ret, "<br/>"); break;
+            default:   g_string_append_c (ret, *p); break;
+        }
+    }
+    return g_string_free (ret, FALSE);
+}
 
-        if (arguments == NULL) {
-            tmp = g_strdup_printf("if ((typeof %s) === 'function') { %s(); }", function, function);
+/* Appends s as a quoted JavaScript/JSON string literal */
+static void json_append_string (GString *str, const char *s) {
+    const guchar *p;
+
+    g_string_append_c (str, '"');
+    for (p = (const guchar *) ve_sure_string (s); *p != '\0'; p++) {
+        switch (*p) {
+            case '"':  g_string_append (str, "\\\""); break;
+            case '\\': g_string_append (str, "\\\\"); break;
+            case '\n': g_string_append (str, "\\n"); break;
+            case '\r': g_string_append (str, "\\r"); break;
+            case '\t': g_string_append (str, "\\t"); break;
+            default:
+                if (*p < 0x20) {
+                    g_string_append_printf (str, "\\u%04x", *p);
+                }
+                /* U+2028 and U+2029 end a JavaScript string literal */
+                else if (p[0] == 0xe2 && p[1] == 0x80 && (p[2] == 0xa8 || p[2] == 0xa9)) {
+                    g_string_append_printf (str, "\\u%04x", p[2] == 0xa8 ? 0x2028 : 0x2029);
+                    p += 2;
+                }
+                else {
+                    g_string_append_c (str, *p);
+                }
+                break;
         }
-        else {
-            tmp = g_strdup_printf("if ((typeof %s) === 'function') { %s(\"%s\"); }", function, function, str_replace(arguments, "\n", ""));
+    }
+    g_string_append_c (str, '"');
+}
+
+/*
+ * Every call into the page costs WebKit a full parse and evaluation of the
+ * script, so scripts are collected here and handed over together once per
+ * frame.  Each one runs in its own try block so a throwing theme handler
+ * does not swallow the calls queued after it.
+ */
+#define SCRIPT_FLUSH_INTERVAL 16 /* ms, about one frame */
+
+static GString *pending_scripts = NULL;
+static guint pending_scripts_handler = 0;
+
+static gboolean webkit_flush_scripts (gpointer data) {
+    pending_scripts_handler = 0;
+
+    if (pending_scripts == NULL || pending_scripts->len == 0) {
+        return FALSE;
+    }
+
+    webkit_web_view_execute_script (webView, pending_scripts->str);
+    g_string_truncate (pending_scripts, 0);
+    return FALSE;
+}
+
+/* Runs what is still queued right away, for the _exit paths */
+static void webkit_exit (int status) {
+    if (pending_scripts_handler != 0) {
+        g_source_remove (pending_scripts_handler);
+        webkit_flush_scripts (NULL);
+    }
+    _exit (status);
+}
+
+static void webkit_queue_script (const gchar *script) {
+    if (!webkit_ready) {
+        return;
+    }
+
+    if (pending_scripts == NULL) {
+        pending_scripts = g_string_sized_new (4096);
+    }
+
+    g_string_append_printf (pending_scripts, "try { %s } catch (e) { console.log (e); }\n", script);
+
+    if (pending_scripts_handler == 0) {
+        pending_scripts_handler = g_timeout_add (SCRIPT_FLUSH_INTERVAL, webkit_flush_scripts, NULL);
+    }
+}
+
+/* Calls function in the page with the NULL terminated string arguments */
+static void webkit_execute_function(const gchar * function, ...) {
+    GString * call;
+    const gchar * arg;
+    va_list ap;
+    int n = 0;
+
+    if (!webkit_ready) {
+        return;
+    }
+
+    call = g_string_new (NULL);
+    g_string_printf (call, "if ((typeof %s) === 'function') { %s(", function, function);
+    va_start (ap, function);
+    while ((arg = va_arg (ap, const gchar *)) != NULL) {
+        gchar * line = str_replace(arg, "\n", "");
+        if (n++ > 0) {
+            g_string_append (call, ", ");
         }
-        webkit_web_view_execute_script(webView, tmp);
-        g_free (tmp);
+        json_append_string (call, line);
+        g_free (line);
+    }
+    va_end (ap);
+    g_string_append (call, "); }");
+
+    webkit_queue_script (call->str);
+    g_string_free (call, TRUE);
+}
+
+void webkit_execute_script(const gchar * function, const gchar * arguments) {
+    webkit_execute_function (function, arguments, NULL);
+}
+
+/*
+ * Hands a whole list over in one call.  items holds the comma separated
+ * JSON arrays of arguments, one per entry.  Themes may define the plural
+ * function to receive the array at once; older themes only know the
+ * singular one, which then gets called once per entry from inside the page.
+ */
+static void webkit_execute_batch (const gchar * function, const gchar * fallback, GString * items) {
+    gchar * tmp;
+
+    if (!webkit_ready || items->len == 0) {
+        return;
     }
+
+    tmp = g_strdup_printf("(function (a) { if ((typeof %s) === 'function') { %s(a); } "
+                          "else if ((typeof %s) === 'function') { for (var i = 0; i < a.length; i++) { %s.apply(null, a[i]); } } })([%s]);",
+                          function, function, fallback, fallback, items->str);
+    webkit_queue_script (tmp);
+    g_free (tmp);
 }
 
 gboolean webkit_on_message(WebKitWebView *view, WebKitWebFrame *frame, gchar *message, gpointer user_data) {
@@ -189,7 +336,7 @@ gboolean webkit_on_message(WebKitWebView *view, WebKitWebFrame *frame, gchar *me
     }
     else if (strcmp(command, "SHUTDOWN") == 0) {
         if (mdm_wm_warn_dialog (_("Are you sure you want to shut down the computer?"), "", _("Shut _Down"), NULL, TRUE) == GTK_RESPONSE_YES) {
-            _exit (DISPLAY_HALT);
+            webkit_exit (DISPLAY_HALT);
         }
     }
     else if (strcmp(command, "SUSPEND") == 0) {
@@ -200,18 +347,18 @@ gboolean webkit_on_message(WebKitWebView *view, WebKitWebFrame *frame, gchar *me
     }
     else if (strcmp(command, "RESTART") == 0) {
         if (mdm_wm_warn_dialog (_("Are you sure you want to restart the computer?"), "", _("_Restart"), NULL, TRUE) == GTK_RESPONSE_YES) {
-            _exit (DISPLAY_REBOOT);
+            webkit_exit (DISPLAY_REBOOT);
         }
     }
     else if (strcmp(command, "FORCE-SHUTDOWN") == 0) {
-        _exit (DISPLAY_HALT);
+        webkit_exit (DISPLAY_HALT);
     }
     else if (strcmp(command, "FORCE-SUSPEND") == 0) {
         printf ("%c%c%c\n", STX, BEL, MDM_INTERRUPT_SUSPEND);
         fflush (stdout);
     }
     else if (strcmp(command, "FORCE-RESTART") == 0) {
-        _exit (DISPLAY_REBOOT);
+        webkit_exit (DISPLAY_REBOOT);
     }
     else if (strcmp(command, "QUIT") == 0) {
         gtk_main_quit();
@@ -241,7 +388,6 @@ void webkit_on_resource_failed (WebKitWebView *web_view, WebKitWebFrame *web_fra
 }
 
 void webkit_on_loaded(WebKitWebView *view, WebKitWebFrame *frame, gpointer user_data) {
-    GIOChannel *ctrlch;
     webkit_ready = TRUE;
     mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM), mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE), mdm_config_get_bool   (MDM_KEY_SOUND_ON_LOGIN));
     mdm_set_welcomemsg ();
@@ -280,14 +426,10 @@ void webkit_on_loaded(WebKitWebView *view, WebKitWebFrame *frame, gpointer user_
             untranslated = mdm_lang_untranslated_name (current_lang, TRUE);
 
             if (untranslated != NULL) {
-                gchar * args = g_strdup_printf("%s\", \"%s", untranslated, current_lang);
-                webkit_execute_script("mdm_set_current_language", args);
-                g_free (args);
+                webkit_execute_function("mdm_set_current_language", untranslated, current_lang, NULL);
             }
             else {
-                gchar * args = g_strdup_printf("%s\", \"%s", name, current_lang);
-                webkit_execute_script("mdm_set_current_language", args);
-                g_free (args);
+                webkit_execute_function("mdm_set_current_language", ve_sure_string (name), current_lang, NULL);
             }
         }
         g_free (name);
@@ -295,12 +437,7 @@ void webkit_on_loaded(WebKitWebView *view, WebKitWebFrame *frame, gpointer user_
     }
 
     if G_LIKELY ( ! DOING_MDM_DEVELOPMENT) {
-        ctrlch = g_io_channel_unix_new (STDIN_FILENO);
-        g_io_channel_set_encoding (ctrlch, NULL, NULL);
-        g_io_channel_set_buffered (ctrlch, TRUE);
-        g_io_channel_set_flags (ctrlch, g_io_channel_get_flags (ctrlch) | G_IO_FLAG_NONBLOCK, NULL);
-        g_io_add_watch (ctrlch, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL, (GIOFunc) mdm_login_ctrl_handler, NULL);
-        g_io_channel_unref (ctrlch);
+        mdm_login_ctrl_watch ();
     }
 
     gtk_widget_show_all (GTK_WIDGET (login));
@@ -357,7 +494,7 @@ static gboolean delay_reaping (GSignalInvocationHint *ihint, guint  n_param_valu
 static gboolean reap_flexiserver (gpointer data) {
     int reapminutes = mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES);
     if (reapminutes > 0 && ((time (NULL) - last_reap_delay) / 60) > reapminutes) {
-        _exit (DISPLAY_REMANAGE);
+        webkit_exit (DISPLAY_REMANAGE);
     }
     return TRUE;
 }
@@ -369,11 +506,11 @@ static void mdm_login_done (int sig) {
 void mdm_login_session_init () {
     GSList *sessgrp = NULL;
     GList *tmp;
-    int num = 1;
-    char *label;
+    GString *items;
 
     current_session = NULL;
 
+    items = g_string_new (NULL);
     for (tmp = sessions; tmp != NULL; tmp = tmp->next) {
         MdmSession *session;
         char *file;
@@ -381,14 +518,17 @@ void mdm_login_session_init () {
         file = (char *) tmp->data;
         session = g_hash_table_lookup (sessnames, file);
 
-        label = g_strdup (session->name);
-        num++;
-
-        gchar * args = g_strdup_printf("%s\", \"%s", label, file);
-        webkit_execute_script("mdm_add_session", args);
-        g_free (args);
-        g_free (label);
+        if (items->len > 0) {
+            g_string_append_c (items, ',');
+        }
+        g_string_append_c (items, '[');
+        json_append_string (items, session->name);
+        g_string_append_c (items, ',');
+        json_append_string (items, file);
+        g_string_append_c (items, ']');
     }
+    webkit_execute_batch ("mdm_add_sessions", "mdm_add_session", items);
+    g_string_free (items, TRUE);
 
     /* Select the proper session */
     {
@@ -409,8 +549,10 @@ void mdm_login_session_init () {
 
 void mdm_login_lang_init (gchar * locale_file) {
     GList *list, *li;
+    GString *items;
     list = mdm_lang_read_locale_file (locale_file);
 
+    items = g_string_new (NULL);
     for (li = list; li != NULL; li = li->next) {
         char *lang = li->data;
         char *name;
@@ -427,22 +569,23 @@ void mdm_login_lang_init (gchar * locale_file) {
 
         untranslated = mdm_lang_untranslated_name (lang, TRUE);
 
-        if (untranslated != NULL) {
-            gchar * args = g_strdup_printf("%s\", \"%s", untranslated, lang);
-            webkit_execute_script("mdm_add_language", args);
-            g_free (args);
-        }
-        else {
-            gchar * args = g_strdup_printf("%s\", \"%s", name, lang);
-            webkit_execute_script("mdm_add_language", args);
-            g_free (args);
+        if (items->len > 0) {
+            g_string_append_c (items, ',');
         }
+        g_string_append_c (items, '[');
+        json_append_string (items, untranslated != NULL ? untranslated : name);
+        g_string_append_c (items, ',');
+        json_append_string (items, lang);
+        g_string_append_c (items, ']');
 
         g_free (name);
         g_free (untranslated);
         g_free (lang);
     }
     g_list_free (list);
+
+    webkit_execute_batch ("mdm_add_languages", "mdm_add_language", items);
+    g_string_free (items, TRUE);
 }
 
 static gboolean err_box_clear (gpointer data) {
@@ -461,347 +604,302 @@ static gboolean greeter_is_capslock_on (void) {
     return (states.locked_mods & LockMask) != 0;
 }
 
-static gboolean mdm_login_ctrl_handler (GIOChannel *source, GIOCondition cond, gint fd) {
-    gchar buf[PIPE_SIZE];
-    gchar *p;
-    gsize len;
+/* Set on a message, cleared when the user gets to see it */
+static gboolean replace_msg = TRUE;
+static gboolean messages_to_give = FALSE;
+
+static void op_setlogin (const gchar *args) {
+    char *tmp;
+    tmp = html_encode (args);
+    webkit_execute_script("mdm_set_current_user", tmp);
+    g_free (tmp);
+    mdm_ctrl_ack ();
+}
 
-    /* If this is not incoming i/o then return */
-    if (cond != G_IO_IN) {
-        return (TRUE);
+static void op_prompt (const gchar *args) {
+    char *tmp;
+    tmp = ve_locale_to_utf8 (args);
+    if (tmp != NULL && strcmp (tmp, _("Username:")) == 0) {
+        mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM), mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE), mdm_config_get_bool (MDM_KEY_SOUND_ON_LOGIN));
+        webkit_execute_script("mdm_prompt", _("Username:"));
+    } else {
+        if (tmp != NULL) {
+            webkit_execute_script("mdm_prompt", tmp);
+        }
     }
+    g_free (tmp);
+
+    /* replace rather then append next message string */
+    replace_msg = TRUE;
 
-    /* Read random garbage from i/o channel until STX is found */
-    do {
-        g_io_channel_read_chars (source, buf, 1, &len, NULL);
+    /* the user has seen messages */
+    messages_to_give = FALSE;
+}
 
-        if (len != 1) {
-            return (TRUE);
+static void op_noecho (const gchar *args) {
+    char *tmp;
+    tmp = ve_locale_to_utf8 (args);
+    if (tmp != NULL && strcmp (tmp, _("Password:")) == 0) {
+        webkit_execute_script("mdm_noecho", _("Password:"));
+    } else {
+        if (tmp != NULL) {
+            webkit_execute_script("mdm_noecho", tmp);
         }
-    } while (buf[0] && buf[0] != STX);
+    }
+    g_free (tmp);
 
-    memset (buf, '\0', sizeof (buf));
+    /* replace rather then append next message string */
+    replace_msg = TRUE;
 
-    if (g_io_channel_read_chars (source, buf, sizeof (buf) - 1, &len, NULL) != G_IO_STATUS_NORMAL) {
-      return TRUE;
-    }
+    /* the user has seen messages */
+    messages_to_give = FALSE;
+}
 
-    p = memchr (buf, STX, len);
+static void op_msg (const gchar *args) {
+    char *tmp;
 
-    if (p != NULL) {
-        len = p - buf;
-        g_io_channel_seek_position (source, -((sizeof (buf) - 1) - len), G_SEEK_CUR, NULL);
-        memset (buf + len, '\0', (sizeof (buf) - 1) - len);
+    /* the user has not yet seen messages */
+    messages_to_give = TRUE;
+
+    /* HAAAAAAACK.  Sometimes pam sends many many messages, SO
+     * we try to collect them until the next prompt or reset or
+     * whatnot */
+    if ( ! replace_msg && /* empty message is for clearing */ ! ve_string_empty (args)) {
+        const char *oldtext;
+        oldtext = g_strdup (mdm_msg);
+        if ( ! ve_string_empty (oldtext)) {
+            char *newtext;
+            tmp = ve_locale_to_utf8 (args);
+            newtext = g_strdup_printf ("%s\n%s", oldtext, tmp);
+            g_free (tmp);
+            mdm_msg = g_strdup (newtext);
+            g_free (newtext);
+        }
+        else {
+            tmp = ve_locale_to_utf8 (args);
+            mdm_msg = g_strdup (tmp);
+            g_free (tmp);
+        }
+    }
+    else {
+        tmp = ve_locale_to_utf8 (args);
+        mdm_msg = g_strdup (tmp);
+        g_free (tmp);
     }
-    buf[len - 1] = '\0';
+    replace_msg = FALSE;
 
-    process_operation ((guchar) buf[0], buf + 1);
+    webkit_execute_script("mdm_msg", mdm_msg);
 
-    return TRUE;
+    mdm_ctrl_ack ();
 }
 
-void process_operation (guchar op_code, const gchar *args) {
+static void op_errbox (const gchar *args) {
     char *tmp;
-    gint i, x, y;
-    GtkWidget *dlg;
-    static gboolean replace_msg = TRUE;
-    static gboolean messages_to_give = FALSE;
-    switch (op_code) {
+    tmp = ve_locale_to_utf8 (args);
+    webkit_execute_script("mdm_error", tmp);
 
-        case MDM_SETLOGIN:
-            webkit_execute_script("mdm_set_current_user", html_encode(args));
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+    g_free (tmp);
+    if (err_box_clear_handler > 0) {
+        g_source_remove (err_box_clear_handler);
+    }
+    if (ve_string_empty (args)) {
+        err_box_clear_handler = 0;
+    }
+    else {
+        err_box_clear_handler = g_timeout_add (30000, err_box_clear, NULL);
+    }
+    mdm_ctrl_ack ();
+}
 
+static void op_errdlg (const gchar *args) {
+    GtkWidget *dlg;
+    char *tmp;
+    /* we should be now fine for focusing new windows */
+    mdm_wm_focus_new_windows (TRUE);
+    tmp = ve_locale_to_utf8 (args);
+    dlg = hig_dialog_new (NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, tmp, "");
+    g_free (tmp);
+    mdm_wm_center_window (GTK_WINDOW (dlg));
+    mdm_wm_no_login_focus_push ();
+    gtk_dialog_run (GTK_DIALOG (dlg));
+    gtk_widget_destroy (dlg);
+    mdm_wm_no_login_focus_pop ();
+    mdm_ctrl_ack ();
+}
 
-        case MDM_PROMPT:
-            tmp = ve_locale_to_utf8 (args);
-            if (tmp != NULL && strcmp (tmp, _("Username:")) == 0) {
-                mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM), mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE), mdm_config_get_bool (MDM_KEY_SOUND_ON_LOGIN));
-                webkit_execute_script("mdm_prompt", _("Username:"));
-            } else {
-                if (tmp != NULL) {
-                    webkit_execute_script("mdm_prompt", tmp);
-                }
-            }
-            g_free (tmp);
+static void op_sess (const gchar *args) {
+    mdm_ctrl_reply (current_session);
+}
 
-            /* replace rather then append next message string */
-            replace_msg = TRUE;
+static void op_lang (const gchar *args) {
+    //mdm_lang_op_lang (args);
+    mdm_ctrl_reply (current_language);
+}
 
-            /* the user has seen messages */
-            messages_to_give = FALSE;
-            break;
+static void op_setsess (const gchar *args) {
+    /* args goes away once we return */
+    current_session = g_intern_string (args);
+    gchar * session_file = g_strdup_printf("%s.desktop", args);
+    webkit_execute_function("mdm_set_current_session", ve_sure_string (mdm_session_name(session_file)), session_file, NULL);
+    g_free (session_file);
+    mdm_debug("mdm_verify_set_user_settings: mdm_set_current_session '%s'.", args);
+    mdm_ctrl_ack ();
+}
 
-        case MDM_NOECHO:
-            tmp = ve_locale_to_utf8 (args);
-            if (tmp != NULL && strcmp (tmp, _("Password:")) == 0) {
-                webkit_execute_script("mdm_noecho", _("Password:"));
-            } else {
-                if (tmp != NULL) {
-                    webkit_execute_script("mdm_noecho", tmp);
-                }
-            }
-            g_free (tmp);
+static void op_setlang (const gchar *args) {
+    if (args) {
+        current_language = (gchar *) g_intern_string (args);
+        char *name = NULL;
+        char *untranslated = NULL;
+        if (mdm_common_locale_is_displayable (args)) {
+            name = mdm_lang_name (args, FALSE, TRUE, FALSE, FALSE);
 
-            /* replace rather then append next message string */
-            replace_msg = TRUE;
-
-            /* the user has seen messages */
-            messages_to_give = FALSE;
-            break;
-
-        case MDM_MSG:
-            /* the user has not yet seen messages */
-            messages_to_give = TRUE;
-
-            /* HAAAAAAACK.  Sometimes pam sends many many messages, SO
-             * we try to collect them until the next prompt or reset or
-             * whatnot */
-            if ( ! replace_msg && /* empty message is for clearing */ ! ve_string_empty (args)) {
-                const char *oldtext;
-                oldtext = g_strdup (mdm_msg);
-                if ( ! ve_string_empty (oldtext)) {
-                    char *newtext;
-                    tmp = ve_locale_to_utf8 (args);
-                    newtext = g_strdup_printf ("%s\n%s", oldtext, tmp);
-                    g_free (tmp);
-                    mdm_msg = g_strdup (newtext);
-                    g_free (newtext);
-                }
-                else {
-                    tmp = ve_locale_to_utf8 (args);
-                    mdm_msg = g_strdup (tmp);
-                    g_free (tmp);
-                }
+            untranslated = mdm_lang_untranslated_name (args, TRUE);
+
+            if (untranslated != NULL) {
+                webkit_execute_function("mdm_set_current_language", untranslated, args, NULL);
             }
             else {
-                tmp = ve_locale_to_utf8 (args);
-                mdm_msg = g_strdup (tmp);
-                g_free (tmp);
+                webkit_execute_function("mdm_set_current_language", ve_sure_string (name), args, NULL);
             }
-            replace_msg = FALSE;
+        }
+        g_free (name);
+        g_free (untranslated);
+    }
 
-            webkit_execute_script("mdm_msg", mdm_msg);
+    mdm_ctrl_ack ();
+}
 
-            printf ("%c\n", STX);
-            fflush (stdout);
+static void op_reset (const gchar *args) {
+    char *tmp;
+    tmp = ve_locale_to_utf8 (args);
+    mdm_msg = g_strdup (tmp);
+    webkit_execute_script("mdm_msg", mdm_msg);
+    g_free (tmp);
+    mdm_ctrl_ack ();
+}
 
-            break;
+static void op_quit (const gchar *args) {
+    GtkWidget *dlg;
 
-        case MDM_ERRBOX:
-            tmp = ve_locale_to_utf8 (args);
-            webkit_execute_script("mdm_error", tmp);
+    if (timed_handler_id != 0) {
+        g_source_remove (timed_handler_id);
+        timed_handler_id = 0;
+    }
 
-            g_free (tmp);
-            if (err_box_clear_handler > 0) {
-                g_source_remove (err_box_clear_handler);
-            }
-            if (ve_string_empty (args)) {
-                err_box_clear_handler = 0;
-            }
-            else {
-                err_box_clear_handler = g_timeout_add (30000, err_box_clear, NULL);
-            }
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+    /* Hide the login window now */
+    gtk_widget_hide (login);
+
+    if (messages_to_give) {
+        const char *oldtext;
+        oldtext = g_strdup (mdm_msg);
 
-        case MDM_ERRDLG:
+        if ( ! ve_string_empty (oldtext)) {
             /* we should be now fine for focusing new windows */
             mdm_wm_focus_new_windows (TRUE);
-            tmp = ve_locale_to_utf8 (args);
-            dlg = hig_dialog_new (NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, tmp, "");
-            g_free (tmp);
+            dlg = hig_dialog_new (NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_INFO, GTK_BUTTONS_OK, oldtext, "");
+            gtk_window_set_modal (GTK_WINDOW (dlg), TRUE);
             mdm_wm_center_window (GTK_WINDOW (dlg));
             mdm_wm_no_login_focus_push ();
             gtk_dialog_run (GTK_DIALOG (dlg));
             gtk_widget_destroy (dlg);
             mdm_wm_no_login_focus_pop ();
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
-
-        case MDM_SESS:
-            printf ("%c%s\n", STX, current_session);
-            fflush (stdout);
-            break;
-
-        case MDM_LANG:
-            //mdm_lang_op_lang (args);
-            printf ("%c%s\n", STX, current_language);
-            fflush (stdout);
-            break;
-
-        case MDM_SLANG:
-            //mdm_lang_op_slang (args);
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
-
-        case MDM_SETSESS:
-            current_session = args;
-            gchar * session_file = g_strdup_printf("%s.desktop", args);
-            gchar * wargs = g_strdup_printf("%s\", \"%s", mdm_session_name(session_file), session_file);
-            webkit_execute_script("mdm_set_current_session", wargs);
-            g_free (wargs);
-            mdm_debug("mdm_verify_set_user_settings: mdm_set_current_session '%s'.", args);
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
-
-        case MDM_SETLANG:
-            if (args) {
-                current_language = args;
-                char *name;
-                char *untranslated;
-                if (mdm_common_locale_is_displayable (args)) {
-                    name = mdm_lang_name (args, FALSE, TRUE, FALSE, FALSE);
-
-                    untranslated = mdm_lang_untranslated_name (args, TRUE);
-
-                    if (untranslated != NULL) {
-                        gchar * wargs = g_strdup_printf("%s\", \"%s", untranslated, args);
-                        webkit_execute_script("mdm_set_current_language", wargs);
-                        g_free (wargs);
-                    }
-                    else {
-                        gchar * wargs = g_strdup_printf("%s\", \"%s", name, args);
-                        webkit_execute_script("mdm_set_current_language", wargs);
-                        g_free (wargs);
-                    }
-                }
-                g_free (name);
-                g_free (untranslated);
-            }
-
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
-
-        case MDM_ALWAYS_RESTART:
-            mdm_lang_op_always_restart (args);
-            break;
-
-        case MDM_RESET:
-        case MDM_RESETOK:
-            tmp = ve_locale_to_utf8 (args);
-            mdm_msg = g_strdup (tmp);
-            webkit_execute_script("mdm_msg", mdm_msg);
-            g_free (tmp);
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+        }
+        messages_to_give = FALSE;
+    }
 
-        case MDM_QUIT:
-            if (timed_handler_id != 0) {
-                g_source_remove (timed_handler_id);
-                timed_handler_id = 0;
-            }
+    //gdk_flush ();
+    mdm_ctrl_ack ();
+    webkit_exit (EXIT_SUCCESS);
+}
 
-            /* Hide the login window now */
-            gtk_widget_hide (login);
-
-            if (messages_to_give) {
-                const char *oldtext;
-                oldtext = g_strdup (mdm_msg);
-
-                if ( ! ve_string_empty (oldtext)) {
-                    /* we should be now fine for focusing new windows */
-                    mdm_wm_focus_new_windows (TRUE);
-                    dlg = hig_dialog_new (NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_INFO, GTK_BUTTONS_OK, oldtext, "");
-                    gtk_window_set_modal (GTK_WINDOW (dlg), TRUE);
-                    mdm_wm_center_window (GTK_WINDOW (dlg));
-                    mdm_wm_no_login_focus_push ();
-                    gtk_dialog_run (GTK_DIALOG (dlg));
-                    gtk_widget_destroy (dlg);
-                    mdm_wm_no_login_focus_pop ();
-                }
-                messages_to_give = FALSE;
-            }
+static void op_starttimer (const gchar *args) {
+    if (timed_handler_id == 0 && mdm_config_get_bool (MDM_KEY_TIMED_LOGIN_ENABLE) && ! ve_string_empty (mdm_config_get_string (MDM_KEY_TIMED_LOGIN)) && mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY) > 0) {
+        mdm_timed_delay = mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY);
+        timed_handler_id  = g_timeout_add (1000, mdm_timer, NULL);
+    }
+    mdm_ctrl_ack ();
+}
 
-            //gdk_flush ();
-            printf ("%c\n", STX);
-            fflush (stdout);
-            _exit (EXIT_SUCCESS);
-            break;
+static void op_stoptimer (const gchar *args) {
+    if (timed_handler_id != 0) {
+        g_source_remove (timed_handler_id);
+        timed_handler_id = 0;
+    }
+    mdm_ctrl_ack ();
+}
 
-        case MDM_STARTTIMER:
-            if (timed_handler_id == 0 && mdm_config_get_bool (MDM_KEY_TIMED_LOGIN_ENABLE) && ! ve_string_empty (mdm_config_get_string (MDM_KEY_TIMED_LOGIN)) && mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY) > 0) {
-                mdm_timed_delay = mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY);
-                timed_handler_id  = g_timeout_add (1000, mdm_timer, NULL);
-            }
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+static void op_disable (const gchar *args) {
+    gtk_widget_set_sensitive (login, FALSE);
+    webkit_execute_script("mdm_disable", NULL);
+    mdm_ctrl_ack ();
+}
 
-        case MDM_STOPTIMER:
-            if (timed_handler_id != 0) {
-                g_source_remove (timed_handler_id);
-                timed_handler_id = 0;
-            }
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+static void op_enable (const gchar *args) {
+    gtk_widget_set_sensitive (login, TRUE);
+    webkit_execute_script("mdm_enable", NULL);
+    mdm_ctrl_ack ();
+}
 
-        case MDM_DISABLE:
-            gtk_widget_set_sensitive (login, FALSE);
-            webkit_execute_script("mdm_disable", NULL);
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+static void op_nofocus (const gchar *args) {
+    mdm_wm_no_login_focus_push ();
+    mdm_ctrl_ack ();
+}
 
-        case MDM_ENABLE:
-            gtk_widget_set_sensitive (login, TRUE);
-            webkit_execute_script("mdm_enable", NULL);
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+static void op_focus (const gchar *args) {
+    mdm_wm_no_login_focus_pop ();
+    mdm_ctrl_ack ();
+}
 
-        // These are handled separately so ignore them here and send back a NULL response so that the daemon quits sending them
-        case MDM_NEEDPIC:
-        case MDM_READPIC:
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+static void op_savedie (const gchar *args) {
+    /* Set busy cursor */
+    //mdm_common_setup_cursor (GDK_WATCH);
+    //mdm_wm_save_wm_order ();
+    //gdk_flush ();
+    mdm_ctrl_ack ();
+    webkit_exit (EXIT_SUCCESS);
+}
 
-        case MDM_NOFOCUS:
-            mdm_wm_no_login_focus_push ();
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
+static void op_query_capslock (const gchar *args) {
+    mdm_ctrl_reply (greeter_is_capslock_on () ? "Y" : "");
+}
 
-        case MDM_FOCUS:
-            mdm_wm_no_login_focus_pop ();
-            printf ("%c\n", STX);
-            fflush (stdout);
-            break;
-
-        case MDM_SAVEDIE:
-            /* Set busy cursor */
-            //mdm_common_setup_cursor (GDK_WATCH);
-            //mdm_wm_save_wm_order ();
-            //gdk_flush ();
-            printf ("%c\n", STX);
-            fflush (stdout);
-            _exit (EXIT_SUCCESS);
-            break;
+static void op_unknown (guchar op_code, const gchar *args) {
+    mdm_common_fail_greeter ("Unexpected greeter command received: '%c'", op_code);
+}
 
-        case MDM_QUERY_CAPSLOCK:
-            if (greeter_is_capslock_on ()) {
-                printf ("%cY\n", STX);
-            }
-            else {
-                printf ("%c\n", STX);
-            }
-            fflush (stdout);
-            break;
+static const MdmCtrlOp ctrl_ops[] = {
+    { MDM_SETLOGIN,       op_setlogin },
+    { MDM_PROMPT,         op_prompt },
+    { MDM_NOECHO,         op_noecho },
+    { MDM_MSG,            op_msg },
+    { MDM_ERRBOX,         op_errbox },
+    { MDM_ERRDLG,         op_errdlg },
+    { MDM_SESS,           op_sess },
+    { MDM_LANG,           op_lang },
+    { MDM_SLANG,          mdm_ctrl_op_ack },
+    { MDM_SETSESS,        op_setsess },
+    { MDM_SETLANG,        op_setlang },
+    { MDM_ALWAYS_RESTART, mdm_lang_op_always_restart },
+    { MDM_RESET,          op_reset },
+    { MDM_RESETOK,        op_reset },
+    { MDM_QUIT,           op_quit },
+    { MDM_STARTTIMER,     op_starttimer },
+    { MDM_STOPTIMER,      op_stoptimer },
+    { MDM_DISABLE,        op_disable },
+    { MDM_ENABLE,         op_enable },
+    // These are handled separately so ignore them here and send back a NULL response so that the daemon quits sending them
+    { MDM_NEEDPIC,        mdm_ctrl_op_ack },
+    { MDM_READPIC,        mdm_ctrl_op_ack },
+    { MDM_NOFOCUS,        op_nofocus },
+    { MDM_FOCUS,          op_focus },
+    { MDM_SAVEDIE,        op_savedie },
+    { MDM_QUERY_CAPSLOCK, op_query_capslock },
+    { 0, NULL }
+};
 
-        default:
-            mdm_common_fail_greeter ("Unexpected greeter command received: '%c'", op_code);
-            break;
-    }
+static void mdm_login_ctrl_watch (void) {
+    mdm_ctrl_watch (ctrl_ops, op_unknown);
 }
 
 
@@ -809,6 +907,9 @@ void mdm_login_browser_populate (void) {
     check_for_displays ();
 
     GList *li;
+    GString *items;
+
+    items = g_string_sized_new (128 * size_of_users + 1);
     for (li = users; li != NULL; li = li->next) {
         MdmUser *usr = li->data;
         char *login, *gecos, *status, *facefile;
@@ -816,25 +917,96 @@ void mdm_login_browser_populate (void) {
         login = mdm_common_text_to_escaped_utf8 (usr->login);
         gecos = mdm_common_text_to_escaped_utf8 (usr->gecos);
 
-        if (g_hash_table_lookup (displays_hash, usr->login)) {
+        if (displays_hash != NULL && g_hash_table_lookup (displays_hash, usr->login)) {
             status = _("Already logged in");
         }
         else {
             status = "";
         }
-        gchar * args = g_strdup_printf("%s\", \"%s\", \"%s\", \"%s", login, gecos, status, facefile);
-        webkit_execute_script("mdm_add_user", args);
-        g_free (args);
+
+        if (items->len > 0) {
+            g_string_append_c (items, ',');
+        }
+        g_string_append_c (items, '[');
+        json_append_string (items, login);
+        g_string_append_c (items, ',');
+        json_append_string (items, gecos);
+        g_string_append_c (items, ',');
+        json_append_string (items, status);
+        g_string_append_c (items, ',');
+        json_append_string (items, facefile);
+        g_string_append_c (items, ']');
+
+        g_free (facefile);
         g_free (login);
         g_free (gecos);
     }
 
-    /* we are done with the hash */
-    g_hash_table_destroy (displays_hash);
-    displays_hash = NULL;
+    webkit_execute_batch ("mdm_add_users", "mdm_add_user", items);
+    g_string_free (items, TRUE);
+
+    /* we are done with the hash, unless it is being kept current */
+    if (displays_hash != NULL && !watching_displays) {
+        g_hash_table_destroy (displays_hash);
+        displays_hash = NULL;
+    }
     return;
 }
 
+typedef struct {
+    const char *name;   /* NULL for every display */
+    GSList *logins;
+} DisplayLogins;
+
+static gboolean take_display_logins (gpointer key, gpointer value, gpointer data) {
+    DisplayLogins *dl = data;
+
+    if (dl->name != NULL && strcmp (value, dl->name) != 0) {
+        return FALSE;
+    }
+    dl->logins = g_slist_prepend (dl->logins, g_strdup (key));
+    return TRUE;
+}
+
+/* WATCH_DISPLAYS callback, keeps displays_hash and the theme's user statuses current */
+static void display_changed (const char *event, const char *name, const char *login, int vt, gpointer data) {
+    DisplayLogins dl;
+    GString *items;
+    GSList *li;
+
+    dl.name = name;
+    dl.logins = NULL;
+    g_hash_table_foreach_remove (displays_hash, take_display_logins, &dl);
+
+    if (event != NULL &&
+        strcmp (event, MDM_SUP_EVENT_REMOVED) != 0 &&
+        strcmp (event, MDM_SUP_EVENT_LOGOUT) != 0 &&
+        !ve_string_empty (login)) {
+        g_hash_table_insert (displays_hash, g_strdup (login), g_strdup (name));
+        dl.logins = g_slist_prepend (dl.logins, g_strdup (login));
+    }
+
+    items = g_string_new (NULL);
+    for (li = dl.logins; li != NULL; li = li->next) {
+        gchar *escaped = mdm_common_text_to_escaped_utf8 (li->data);
+
+        if (items->len > 0) {
+            g_string_append_c (items, ',');
+        }
+        g_string_append_c (items, '[');
+        json_append_string (items, escaped);
+        g_string_append_c (items, ',');
+        json_append_string (items, g_hash_table_lookup (displays_hash, li->data) ? _("Already logged in") : "");
+        g_string_append_c (items, ']');
+        g_free (escaped);
+    }
+
+    webkit_execute_batch ("mdm_set_user_statuses", "mdm_set_user_status", items);
+    g_string_free (items, TRUE);
+    g_slist_foreach (dl.logins, (GFunc) g_free, NULL);
+    g_slist_free (dl.logins);
+}
+
 gboolean update_clock (void) {
     struct tm *the_tm;
     gchar *str;
@@ -870,6 +1042,13 @@ static gboolean key_press_event (GtkWidget *widget, GdkEventKey *key, gpointer d
     return FALSE;
 }
 
+static void html_replace_label(gchar **html, const char *delimiter, const char *label) {
+    gchar *encoded;
+    encoded = html_encode(label);
+    str_replace_in_place(html, delimiter, encoded);
+    g_free (encoded);
+}
+
 static void webkit_init (void) {
     GError *error;
     char *html;
@@ -914,27 +1093,27 @@ static void webkit_init (void) {
     fgets(lsb_description, 255, fp);
     pclose(fp);
 
-    html = str_replace(html, "$lsb_description", lsb_description);
-    html = str_replace(html, "$login_label", html_encode(_("Login")));
-    html = str_replace(html, "$ok_label", html_encode(_("OK")));
-    html = str_replace(html, "$cancel_label", html_encode(_("Cancel")));
-    html = str_replace(html, "$enter_your_username_label", html_encode(_("Please enter your username")));
-    html = str_replace(html, "$enter_your_password_label", html_encode(_("Please enter your password")));
-    html = str_replace(html, "$hostname", g_get_host_name());
-    html = str_replace(html, "$shutdown", html_encode(_("Shutdown")));
-    html = str_replace(html, "$suspend", html_encode(_("Suspend")));
-    html = str_replace(html, "$quit", html_encode(_("Quit")));
-    html = str_replace(html, "$restart", html_encode(_("Restart")));
-    html = str_replace(html, "$session", html_encode(_("Session")));
-    html = str_replace(html, "$selectsession", html_encode(_("Select a session")));
-    html = str_replace(html, "$defaultsession", html_encode(_("Default session")));
-    html = str_replace(html, "$selectuser", html_encode(_("Please select a user.")));
-    html = str_replace(html, "$pressf1toenterusername", html_encode(_("Press F1 to enter a username.")));
-    html = str_replace(html, "$language", html_encode(_("Language")));
-    html = str_replace(html, "$selectlanguage", html_encode(_("Select a language")));
-    html = str_replace(html, "$areyousuretoquit", html_encode(_("Are you sure you want to quit?")));
-    html = str_replace(html, "$close", html_encode(_("Close")));
-    html = str_replace(html, "$locale", g_strdup (setlocale (LC_MESSAGES, NULL)));
+    str_replace_in_place(&html, "$lsb_description", lsb_description);
+    html_replace_label(&html, "$login_label", _("Login"));
+    html_replace_label(&html, "$ok_label", _("OK"));
+    html_replace_label(&html, "$cancel_label", _("Cancel"));
+    html_replace_label(&html, "$enter_your_username_label", _("Please enter your username"));
+    html_replace_label(&html, "$enter_your_password_label", _("Please enter your password"));
+    str_replace_in_place(&html, "$hostname", g_get_host_name());
+    html_replace_label(&html, "$shutdown", _("Shutdown"));
+    html_replace_label(&html, "$suspend", _("Suspend"));
+    html_replace_label(&html, "$quit", _("Quit"));
+    html_replace_label(&html, "$restart", _("Restart"));
+    html_replace_label(&html, "$session", _("Session"));
+    html_replace_label(&html, "$selectsession", _("Select a session"));
+    html_replace_label(&html, "$defaultsession", _("Default session"));
+    html_replace_label(&html, "$selectuser", _("Please select a user."));
+    html_replace_label(&html, "$pressf1toenterusername", _("Press F1 to enter a username."));
+    html_replace_label(&html, "$language", _("Language"));
+    html_replace_label(&html, "$selectlanguage", _("Select a language"));
+    html_replace_label(&html, "$areyousuretoquit", _("Are you sure you want to quit?"));
+    html_replace_label(&html, "$close", _("Close"));
+    str_replace_in_place(&html, "$locale", setlocale (LC_MESSAGES, NULL));
 
     webView = WEBKIT_WEB_VIEW(webkit_web_view_new());
 
@@ -968,6 +1147,7 @@ static void webkit_init (void) {
     webkit_web_view_set_transparent (webView, TRUE);
 
     webkit_web_view_load_string(webView, html, "text/html", "UTF-8", theme_dir);
+    g_free (html);
 
     g_signal_connect(G_OBJECT(webView), "script-alert", G_CALLBACK(webkit_on_message), NULL);
     g_signal_connect(G_OBJECT(webView), "load-finished", G_CALLBACK(webkit_on_loaded), NULL);
@@ -978,73 +1158,6 @@ static void webkit_init (void) {
 }
 
 
-static GdkPixbuf *
-render_scaled_back (const GdkPixbuf *pb)
-{
-    int i;
-    int width, height;
-
-    GdkPixbuf *back = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
-                      gdk_pixbuf_get_has_alpha (pb),
-                      8,
-                      gdk_screen_width (),
-                      gdk_screen_height ());
-
-    width = gdk_pixbuf_get_width (pb);
-    height = gdk_pixbuf_get_height (pb);
-
-    for (i = 0; i < mdm_wm_num_monitors; i++) {
-        gdk_pixbuf_scale (pb, back,
-                  mdm_wm_all_monitors[i].x,
-                  mdm_wm_all_monitors[i].y,
-                  mdm_wm_all_monitors[i].width,
-                  mdm_wm_all_monitors[i].height,
-                  mdm_wm_all_monitors[i].x /* offset_x */,
-                  mdm_wm_all_monitors[i].y /* offset_y */,
-                  (double) mdm_wm_all_monitors[i].width / width,
-                  (double) mdm_wm_all_monitors[i].height / height,
-                  GDK_INTERP_BILINEAR);
-    }
-
-    return back;
-}
-
-static void
-add_color_to_pb (GdkPixbuf *pb, GdkColor *color)
-{
-    int width = gdk_pixbuf_get_width (pb);
-    int height = gdk_pixbuf_get_height (pb);
-    int rowstride = gdk_pixbuf_get_rowstride (pb);
-    guchar *pixels = gdk_pixbuf_get_pixels (pb);
-    gboolean has_alpha = gdk_pixbuf_get_has_alpha (pb);
-    int i;
-    int cr = color->red >> 8;
-    int cg = color->green >> 8;
-    int cb = color->blue >> 8;
-
-    if ( ! has_alpha)
-        return;
-
-    for (i = 0; i < height; i++) {
-        int ii;
-        guchar *p = pixels + (rowstride * i);
-        for (ii = 0; ii < width; ii++) {
-            int r = p[0];
-            int g = p[1];
-            int b = p[2];
-            int a = p[3];
-
-            p[0] = (r * a + cr * (255 - a)) >> 8;
-            p[1] = (g * a + cg * (255 - a)) >> 8;
-            p[2] = (b * a + cb * (255 - a)) >> 8;
-            p[3] = 255;
-
-            p += 4;
-        }
-    }
-}
-
-
 /* setup background color/image */
 static void
 setup_background (void)
@@ -1057,32 +1170,26 @@ setup_background (void)
 
     if ((bg_type == MDM_BACKGROUND_IMAGE ||
          bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) &&
-        ! ve_string_empty (bg_image))
-        pb = gdk_pixbuf_new_from_file (bg_image, NULL);
-
-    /* Load background image */
-    if (pb != NULL) {
-        if (gdk_pixbuf_get_has_alpha (pb)) {
-            if (bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) {
-                if (bg_color == NULL ||
-                    bg_color[0] == '\0' ||
-                    ! gdk_color_parse (bg_color,
-                           &color)) {
-                    gdk_color_parse ("#000000", &color);
-                }
-                add_color_to_pb (pb, &color);
+        ! ve_string_empty (bg_image)) {
+        if (bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) {
+            if (bg_color == NULL ||
+                bg_color[0] == '\0' ||
+                ! gdk_color_parse (bg_color,
+                       &color)) {
+                gdk_color_parse ("#000000", &color);
             }
         }
+        pb = mdm_background_load (bg_image,
+                                  bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR ? &color : NULL,
+                                  mdm_wm_all_monitors,
+                                  mdm_wm_num_monitors,
+                                  mdm_config_get_string (MDM_KEY_SERV_AUTHDIR));
+    }
 
-        GdkPixbuf *spb = render_scaled_back (pb);
+    /* Load background image */
+    if (pb != NULL) {
+        mdm_common_set_root_background (pb);
         g_object_unref (G_OBJECT (pb));
-        pb = spb;
-
-        /* paranoia */
-        if (pb != NULL) {
-            mdm_common_set_root_background (pb);
-            g_object_unref (G_OBJECT (pb));
-        }
     /* Load background color */
     } else if (bg_type != MDM_BACKGROUND_NONE &&
                bg_type != MDM_BACKGROUND_IMAGE) {
@@ -1165,6 +1272,10 @@ static void mdm_login_gui_init (void) {
 void lang_set_custom_callback (gchar *language) {
 }
 
+// The page picks its language itself, it never changes language in place.
+void lang_relocalize_callback (void) {
+}
+
 int main (int argc, char *argv[]) {
     struct sigaction hup;
     struct sigaction term;
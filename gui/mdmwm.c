@@ -33,6 +33,10 @@
 #elif HAVE_SOLARIS_XINERAMA
 #include <X11/extensions/xinerama.h>
 #endif
+#ifdef HAVE_XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#endif
 
 #include "mdmwm.h"
 #include "mdm.h"
@@ -52,6 +56,7 @@ struct _MdmWindow {
 	gboolean center; /* do centering */
 	gboolean recenter; /* do re-centering */
         gboolean takefocus; /* permit take focus */
+	gboolean takefocus_protocol; /* WM_TAKE_FOCUS in WM_PROTOCOLS */
 
 	/* hack, when we reparent, we will get an unmap and then
 	 * an map, and we want to ignore those */
@@ -59,7 +64,9 @@ struct _MdmWindow {
 	int ignore_next_unmap;
 };
 
-static GList *windows = NULL;
+/* Our windows by client XID, and again by deco and shadow XID */
+static GHashTable *windows = NULL;
+static GHashTable *frames = NULL;
 static gboolean focus_new_windows = FALSE;
 static int no_focus_login = 0;
 static Display *wm_disp = NULL;
@@ -72,9 +79,55 @@ static Atom XA_WM_STATE = 0;
 static Atom XA_WM_TAKE_FOCUS = 0;
 static Atom XA_COMPOUND_TEXT = 0;
 static Atom XA_NET_WM_STRUT = 0;
+static Atom XA_MOTIF_WM_HINTS = 0;
 
 static int trap_depth = 0;
 
+/* Lengths in items of WM_HINTS and WM_NORMAL_HINTS, and the shortest
+ * WM_NORMAL_HINTS Xlib accepts */
+#define WM_HINTS_ELEMENTS		9
+#define WM_SIZE_HINTS_ELEMENTS		18
+#define OLD_WM_SIZE_HINTS_ELEMENTS	15
+
+#ifdef HAVE_XCB
+enum {
+	PROP_WM_HINTS,
+	PROP_NORMAL_HINTS,
+	PROP_WM_CLASS,
+	PROP_MOTIF_HINTS,
+	PROP_PROTOCOLS,
+	N_INFO_PROPERTIES
+};
+#endif
+
+/*
+ * Everything managing a window needs to know about it.  With XCB all of
+ * it is asked for at once and the replies collected afterwards, so a
+ * new window costs one round trip, as do all the windows found at
+ * startup together.  Plain Xlib has to ask for one thing at a time.
+ */
+typedef struct {
+	Window win;
+	gboolean exists;
+	gboolean override_redirect;
+	int map_state;
+	long event_mask;
+	int x, y;
+	unsigned int width, height, border;
+	gboolean no_input; /* from WM_HINTS */
+	gboolean have_size_hints;
+	long size_flags; /* from WM_NORMAL_HINTS */
+	char *res_name; /* from WM_CLASS */
+	char *res_class;
+	gboolean decorate; /* _MOTIF_WM_HINTS doesn't turn the border off */
+	gboolean takefocus_protocol;
+#ifdef HAVE_XCB
+	xcb_get_window_attributes_cookie_t attributes_cookie;
+	xcb_get_geometry_cookie_t geometry_cookie;
+	xcb_get_property_cookie_t property_cookies[N_INFO_PROPERTIES];
+#endif
+} WindowInfo;
+
 GdkRectangle *mdm_wm_all_monitors = NULL;
 int mdm_wm_num_monitors = 0;
 GdkRectangle mdm_wm_screen = {0,0,0,0}; // This is the drawing area used by the greeter
@@ -166,7 +219,11 @@ static int
 trap_pop (void)
 {
 	trap_depth --;
-	if (trap_depth <= 0)
+	/* Errors show up once the server got to the request.  When the
+	 * last request already had its reply there is nothing to wait
+	 * for. */
+	if (trap_depth <= 0 &&
+	    LastKnownRequestProcessed (wm_disp) < NextRequest (wm_disp) - 1)
 		XSync (wm_disp, False);
 	return gdk_error_trap_pop ();
 }
@@ -365,33 +422,19 @@ wm_protocol_check_support (Window xwin,
   return is_supported;
 }
 
-static GList *
-find_window_list (Window w, gboolean deco_ok)
-{
-	GList *li;
-
-	for (li = windows; li != NULL; li = li->next) {
-		MdmWindow *gw = li->data;
-
-		if (gw->win == w)
-			return li;
-		if (deco_ok &&
-		    (gw->deco == w ||
-		     gw->shadow == w))
-			return li;
-	}
-
-	return NULL;
-}
-
 static MdmWindow *
 find_window (Window w, gboolean deco_ok)
 {
-	GList *li = find_window_list (w, deco_ok);
-	if (li == NULL)
+	MdmWindow *gw;
+
+	if (windows == NULL)
 		return NULL;
-	else
-		return li->data;
+
+	gw = g_hash_table_lookup (windows, GUINT_TO_POINTER (w));
+	if (gw == NULL && deco_ok)
+		gw = g_hash_table_lookup (frames, GUINT_TO_POINTER (w));
+
+	return gw;
 }
 
 void
@@ -417,7 +460,9 @@ mdm_wm_focus_window (Window window)
 		return;
 	}
 
-	if (wm_protocol_check_support (window, XA_WM_TAKE_FOCUS)) {
+	if (win != NULL && win->win == window ?
+	    win->takefocus_protocol :
+	    wm_protocol_check_support (window, XA_WM_TAKE_FOCUS)) {
 		XEvent xevent = { 0, };
 
 		xevent.type = ClientMessage;
@@ -428,7 +473,6 @@ mdm_wm_focus_window (Window window)
 		xevent.xclient.data.l[1] = CurrentTime;
 
 		XSendEvent (wm_disp, window, False, 0, &xevent);
-		XSync (wm_disp, False);
 	}
 
 	XSetInputFocus (wm_disp,
@@ -495,44 +539,32 @@ constrain_window (MdmWindow *gw)
 static void
 constrain_all_windows (void)
 {
-	GList *winlist = windows;
+	GHashTableIter iter;
+	MdmWindow *gw;
 
-	while (winlist)
-	{
-		MdmWindow *gw = winlist->data;
+	g_hash_table_iter_init (&iter, windows);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &gw))
 		constrain_window (gw);
-		winlist = winlist->next;
-	}
 }
 
+/* x, y, width and height are the geometry of w, and are updated when
+ * it gets moved.  hint_flags are from the WM_NORMAL_HINTS of the
+ * client, if it has any. */
 static void
-center_x_window (MdmWindow *gw, Window w, Window hintwin)
+center_x_window (MdmWindow *gw, Window w,
+		 gboolean have_hints, long hint_flags,
+		 int *x, int *y, unsigned int *width, unsigned int *height)
 {
-	XSizeHints hints;
-	Status status;
-	long ret;
-	int x, y;
-	Window root;
-	unsigned int width, height, border, depth;
 	gboolean can_resize, can_reposition;
 
-	trap_push ();
-
-	status = XGetWMNormalHints (wm_disp,
-				    hintwin,
-				    &hints,
-				    &ret);
-
-	if ( ! status) {
-		trap_pop ();
+	if ( ! have_hints)
 		return;
-	}
 
 	/* allow resizing when PSize is given, just don't allow centering when
 	 * PPosition is goven */
-	can_resize = ! (hints.flags & USSize);
-	can_reposition = ! (hints.flags & USPosition ||
-			    hints.flags & PPosition);
+	can_resize = ! (hint_flags & USSize);
+	can_reposition = ! (hint_flags & USPosition ||
+			    hint_flags & PPosition);
 
 	if (can_reposition && ! gw->center)
 		can_reposition = FALSE;
@@ -543,41 +575,97 @@ center_x_window (MdmWindow *gw, Window w, Window hintwin)
 	}
 
 	if ( ! can_resize &&
-	     ! can_reposition) {
-		trap_pop ();
+	     ! can_reposition)
 		return;
-	}
-
-	XGetGeometry (wm_disp, w,
-		      &root, &x, &y, &width, &height, &border, &depth);
 
 	/* we replace the x,y and width,height with some new values */
 
 	if (can_resize) {
-		if (width > mdm_wm_screen.width)
-			width = mdm_wm_screen.width;
-		if (height > mdm_wm_screen.height)
-			height = mdm_wm_screen.height;
+		if (*width > mdm_wm_screen.width)
+			*width = mdm_wm_screen.width;
+		if (*height > mdm_wm_screen.height)
+			*height = mdm_wm_screen.height;
 	}
 
 	if (can_reposition) {
 		/* we wipe the X with some new values */
-		x = mdm_wm_screen.x + (mdm_wm_screen.width - width)/2;
-		y = mdm_wm_screen.y + (mdm_wm_screen.height - height)/2;	
+		*x = mdm_wm_screen.x + (mdm_wm_screen.width - *width)/2;
+		*y = mdm_wm_screen.y + (mdm_wm_screen.height - *height)/2;	
 
-		if (x < mdm_wm_screen.x)
-			x = mdm_wm_screen.x;
-		if (y < mdm_wm_screen.y)
-			y = mdm_wm_screen.y;
+		if (*x < mdm_wm_screen.x)
+			*x = mdm_wm_screen.x;
+		if (*y < mdm_wm_screen.y)
+			*y = mdm_wm_screen.y;
 	}
 	
-	XMoveResizeWindow (wm_disp, w, x, y, width, height);
+	trap_push ();
+	XMoveResizeWindow (wm_disp, w, *x, *y, *width, *height);
+	trap_pop ();
 
 	if (gw->center && ! gw->recenter) {
 		gw->center = FALSE;
 	}
+}
+
+/* Centers w (the client or its deco) again after the client asked to be
+ * reconfigured */
+static void
+recenter_x_window (MdmWindow *gw, Window w)
+{
+	gboolean have_hints = FALSE;
+	long hint_flags = 0;
+	int x = 0, y = 0;
+	unsigned int width = 0, height = 0;
+#ifdef HAVE_XCB
+	xcb_connection_t *c = XGetXCBConnection (wm_disp);
+	xcb_get_property_cookie_t hints_cookie;
+	xcb_get_geometry_cookie_t geometry_cookie;
+	xcb_get_property_reply_t *hints_reply;
+	xcb_get_geometry_reply_t *geometry_reply;
+
+	hints_cookie = xcb_get_property (c, FALSE, gw->win,
+					 XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS,
+					 0, WM_SIZE_HINTS_ELEMENTS);
+	geometry_cookie = xcb_get_geometry (c, w);
+
+	hints_reply = xcb_get_property_reply (c, hints_cookie, NULL);
+	geometry_reply = xcb_get_geometry_reply (c, geometry_cookie, NULL);
+
+	if (hints_reply != NULL &&
+	    hints_reply->format == 32 &&
+	    xcb_get_property_value_length (hints_reply) >= OLD_WM_SIZE_HINTS_ELEMENTS * 4) {
+		have_hints = TRUE;
+		hint_flags = ((guint32 *) xcb_get_property_value (hints_reply))[0];
+	}
+	if (geometry_reply != NULL) {
+		x = geometry_reply->x;
+		y = geometry_reply->y;
+		width = geometry_reply->width;
+		height = geometry_reply->height;
+	} else {
+		have_hints = FALSE;
+	}
 
+	free (hints_reply);
+	free (geometry_reply);
+#else
+	XSizeHints hints;
+	long ret;
+	Window root;
+	unsigned int border, depth;
+
+	trap_push ();
+	if (XGetWMNormalHints (wm_disp, gw->win, &hints, &ret) &&
+	    XGetGeometry (wm_disp, w,
+			  &root, &x, &y, &width, &height, &border, &depth)) {
+		have_hints = TRUE;
+		hint_flags = hints.flags;
+	}
 	trap_pop ();
+#endif
+
+	center_x_window (gw, w, have_hints, hint_flags,
+			 &x, &y, &width, &height);
 }
 
 #ifndef MWMUTIL_H_INCLUDED
@@ -596,10 +684,134 @@ typedef struct {
 
 #endif /* MWMUTIL_H_INCLUDED */
 
+#ifdef HAVE_XCB
+
+static void
+window_info_request (WindowInfo *info, Window w)
+{
+	xcb_connection_t *c = XGetXCBConnection (wm_disp);
+
+	memset (info, 0, sizeof (WindowInfo));
+	info->win = w;
+	info->decorate = TRUE;
+
+	/* nothing waits for an answer until window_info_collect */
+	info->attributes_cookie = xcb_get_window_attributes (c, w);
+	info->geometry_cookie = xcb_get_geometry (c, w);
+	info->property_cookies[PROP_WM_HINTS] =
+		xcb_get_property (c, FALSE, w, XA_WM_HINTS, XA_WM_HINTS,
+				  0, WM_HINTS_ELEMENTS);
+	info->property_cookies[PROP_NORMAL_HINTS] =
+		xcb_get_property (c, FALSE, w, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS,
+				  0, WM_SIZE_HINTS_ELEMENTS);
+	info->property_cookies[PROP_WM_CLASS] =
+		xcb_get_property (c, FALSE, w, XA_WM_CLASS, XA_STRING,
+				  0, 256);
+	info->property_cookies[PROP_MOTIF_HINTS] =
+		xcb_get_property (c, FALSE, w, XA_MOTIF_WM_HINTS,
+				  XCB_GET_PROPERTY_TYPE_ANY,
+				  0, sizeof (MotifWmHints) / sizeof (long));
+	/* some broken apps use WM_PROTOCOLS as the type */
+	info->property_cookies[PROP_PROTOCOLS] =
+		xcb_get_property (c, FALSE, w, XA_WM_PROTOCOLS,
+				  XCB_GET_PROPERTY_TYPE_ANY,
+				  0, 64);
+}
+
+/* The items of a format 32 property, or NULL */
+static const guint32 *
+property_values32 (xcb_get_property_reply_t *reply, int *n)
+{
+	*n = 0;
+	if (reply == NULL ||
+	    reply->type == XCB_NONE ||
+	    reply->format != 32)
+		return NULL;
+
+	*n = xcb_get_property_value_length (reply) / 4;
+	return xcb_get_property_value (reply);
+}
+
+static void
+window_info_collect (WindowInfo *info)
+{
+	xcb_connection_t *c = XGetXCBConnection (wm_disp);
+	xcb_get_window_attributes_reply_t *attributes;
+	xcb_get_geometry_reply_t *geometry;
+	xcb_get_property_reply_t *props[N_INFO_PROPERTIES];
+	xcb_get_property_reply_t *class_reply;
+	const guint32 *v;
+	int i, n;
+
+	/* Every reply has to be taken, a window that went away in the
+	 * meantime just gets NULLs */
+	attributes = xcb_get_window_attributes_reply (c, info->attributes_cookie, NULL);
+	geometry = xcb_get_geometry_reply (c, info->geometry_cookie, NULL);
+	for (i = 0; i < N_INFO_PROPERTIES; i++)
+		props[i] = xcb_get_property_reply (c, info->property_cookies[i], NULL);
+
+	if (attributes != NULL && geometry != NULL) {
+		info->exists = TRUE;
+		info->override_redirect = attributes->override_redirect;
+		info->map_state = attributes->map_state;
+		info->event_mask = attributes->your_event_mask;
+		info->x = geometry->x;
+		info->y = geometry->y;
+		info->width = geometry->width;
+		info->height = geometry->height;
+		info->border = geometry->border_width;
+	}
+
+	/* flags, input */
+	v = property_values32 (props[PROP_WM_HINTS], &n);
+	if (n >= 2 && (v[0] & InputHint) && ! v[1])
+		info->no_input = TRUE;
+
+	/* the shortest XGetWMNormalHints takes */
+	v = property_values32 (props[PROP_NORMAL_HINTS], &n);
+	if (n >= OLD_WM_SIZE_HINTS_ELEMENTS) {
+		info->have_size_hints = TRUE;
+		info->size_flags = v[0];
+	}
+
+	/* "name\0class\0" */
+	class_reply = props[PROP_WM_CLASS];
+	if (class_reply != NULL &&
+	    class_reply->type != XCB_NONE &&
+	    class_reply->format == 8) {
+		const char *s = xcb_get_property_value (class_reply);
+		int len = xcb_get_property_value_length (class_reply);
+		const char *end = memchr (s, '\0', len);
+
+		info->res_name = g_strndup (s, len);
+		if (end != NULL && end + 1 < s + len)
+			info->res_class = g_strndup (end + 1, s + len - (end + 1));
+	}
+
+	/* flags, functions, decorations */
+	v = property_values32 (props[PROP_MOTIF_HINTS], &n);
+	if (n >= 3 &&
+	    v[0] & MWM_HINTS_DECORATIONS &&
+	    ! (v[2] & MWM_DECOR_BORDER))
+		info->decorate = FALSE;
+
+	v = property_values32 (props[PROP_PROTOCOLS], &n);
+	for (i = 0; i < n; i++) {
+		if (v[i] == XA_WM_TAKE_FOCUS)
+			info->takefocus_protocol = TRUE;
+	}
+
+	free (attributes);
+	free (geometry);
+	for (i = 0; i < N_INFO_PROPERTIES; i++)
+		free (props[i]);
+}
+
+#else /* ! HAVE_XCB */
+
 static gboolean
 has_deco (Window win)
 {
-	static Atom hints_atom = None;
 	unsigned char *foo;
 	MotifWmHints *hints;
 	Atom type;
@@ -610,13 +822,10 @@ has_deco (Window win)
 
 	trap_push ();
 
-	if (hints_atom == None)
-		hints_atom = XInternAtom (wm_disp, "_MOTIF_WM_HINTS", False);
-
 	hints = NULL;
 
 	XGetWindowProperty (wm_disp, win,
-			    hints_atom, 0,
+			    XA_MOTIF_WM_HINTS, 0,
 			    sizeof (MotifWmHints) / sizeof (long),
 			    False, AnyPropertyType, &type, &format, &nitems,
 			    &bytes_after, &foo);
@@ -637,57 +846,124 @@ has_deco (Window win)
 	return border;
 }
 
+static void
+window_info_request (WindowInfo *info, Window w)
+{
+	memset (info, 0, sizeof (WindowInfo));
+	info->win = w;
+	info->decorate = TRUE;
+}
 
+/* Without XCB every one of these is a round trip of its own */
 static void
-add_deco (MdmWindow *w, gboolean is_mapped)
+window_info_collect (WindowInfo *info)
 {
-	int x, y;
-	Window root;
-	unsigned int width, height, border, depth;
 	XWindowAttributes attribs = { 0, };
+	XClassHint hint = { NULL, NULL };
+	XWMHints *wmhints;
+	XSizeHints hints;
+	long ret;
+
+	trap_push ();
+
+	if ( ! XGetWindowAttributes (wm_disp, info->win, &attribs)) {
+		trap_pop ();
+		return;
+	}
+
+	info->exists = TRUE;
+	info->override_redirect = attribs.override_redirect;
+	info->map_state = attribs.map_state;
+	info->event_mask = attribs.your_event_mask;
+	info->x = attribs.x;
+	info->y = attribs.y;
+	info->width = attribs.width;
+	info->height = attribs.height;
+	info->border = attribs.border_width;
+
+	wmhints = XGetWMHints (wm_disp, info->win);
+	if (wmhints != NULL) {
+		/* NoInput windows */
+		if ((wmhints->flags & InputHint) &&
+		    ! wmhints->input) {
+			info->no_input = TRUE;
+		}
+		XFree (wmhints);
+	}
+
+	if (XGetWMNormalHints (wm_disp, info->win, &hints, &ret)) {
+		info->have_size_hints = TRUE;
+		info->size_flags = hints.flags;
+	}
+
+	if (XGetClassHint (wm_disp, info->win, &hint)) {
+		info->res_name = g_strdup (hint.res_name);
+		info->res_class = g_strdup (hint.res_class);
+		if (hint.res_name != NULL)
+			XFree (hint.res_name);
+		if (hint.res_class != NULL)
+			XFree (hint.res_class);
+	}
+
+	info->decorate = has_deco (info->win);
+	info->takefocus_protocol = wm_protocol_check_support (info->win,
+							      XA_WM_TAKE_FOCUS);
+
+	trap_pop ();
+}
+
+#endif /* HAVE_XCB */
+
+static void
+window_info_free (WindowInfo *info)
+{
+	g_free (info->res_name);
+	g_free (info->res_class);
+}
+
+static void
+add_deco (MdmWindow *w, WindowInfo *info, gboolean is_mapped)
+{
 	int black;
 
 	trap_push ();
 
-	XGetWindowAttributes (wm_disp, w->win, &attribs);
 	XSelectInput (wm_disp, w->win,
-		      attribs.your_event_mask |
+		      info->event_mask |
 		      PropertyChangeMask);
 
-	if ( ! has_deco (w->win)) {
+	if ( ! info->decorate) {
 		trap_pop ();
 		return;
 	}
 
-	XGetGeometry (wm_disp, w->win,
-		      &root, &x, &y, &width, &height, &border, &depth);
-
 	black = BlackPixel (wm_disp, DefaultScreen (wm_disp));
 
 	/* all but the login window has shadows */
 	if (w->win != wm_login_window) {
 		w->shadow = XCreateSimpleWindow (wm_disp,
 						 wm_root,
-						 x + 4, y + 4,
-						 width + 2 + 2 * border,
-						 height + 2 + 2 * border,
+						 info->x + 4, info->y + 4,
+						 info->width + 2 + 2 * info->border,
+						 info->height + 2 + 2 * info->border,
 						 0, 
 						 black, black);
 
 		XMapWindow (wm_disp, w->shadow);
+		g_hash_table_insert (frames, GUINT_TO_POINTER (w->shadow), w);
 	}
 
 	w->deco = XCreateSimpleWindow (wm_disp,
 				       wm_root,
-				       x - 1, y - 1,
-				       width + 2 + 2 * border,
-				       height + 2 + 2 * border,
+				       info->x - 1, info->y - 1,
+				       info->width + 2 + 2 * info->border,
+				       info->height + 2 + 2 * info->border,
 				       0, 
 				       black, black);
+	g_hash_table_insert (frames, GUINT_TO_POINTER (w->deco), w);
 
-	XGetWindowAttributes (wm_disp, w->deco, &attribs);
+	/* we just made it, so we have no events selected on it yet */
 	XSelectInput (wm_disp, w->deco,
-		      attribs.your_event_mask |
 		      EnterWindowMask |
 		      PropertyChangeMask |
 		      SubstructureNotifyMask |
@@ -695,9 +971,9 @@ add_deco (MdmWindow *w, gboolean is_mapped)
 
 	XMapWindow (wm_disp, w->deco);
 
-	XSync (wm_disp, False);
 	trap_pop ();
 
+	/* The one round trip here, to know if the reparent worked */
 	trap_push ();
 	XReparentWindow (wm_disp, w->win, w->deco, 1, 1);
 	XSync (wm_disp, False);
@@ -712,101 +988,103 @@ add_deco (MdmWindow *w, gboolean is_mapped)
 }
 
 static gboolean
-is_wm_class (XClassHint *hint, const char *string, int len)
+is_wm_class (WindowInfo *info, const char *string, int len)
 {
 	if (len > 0) {
-		return ((hint->res_name != NULL &&
-			 strncmp (hint->res_name, string, len) == 0) ||
-			(hint->res_class != NULL &&
-			 strncmp (hint->res_class, string, len) == 0));
+		return ((info->res_name != NULL &&
+			 strncmp (info->res_name, string, len) == 0) ||
+			(info->res_class != NULL &&
+			 strncmp (info->res_class, string, len) == 0));
 	} else {
-		return ((hint->res_name != NULL &&
-			 strcmp (hint->res_name, string) == 0) ||
-			(hint->res_class != NULL &&
-			 strcmp (hint->res_class, string) == 0));
+		return ((info->res_name != NULL &&
+			 strcmp (info->res_name, string) == 0) ||
+			(info->res_class != NULL &&
+			 strcmp (info->res_class, string) == 0));
 	}
 }
 
 static MdmWindow *
-add_window (Window w, gboolean center, gboolean is_mapped)
+manage_window (WindowInfo *info, gboolean center, gboolean is_mapped)
 {
 	MdmWindow *gw;
+	Window w = info->win;
+	gboolean have_hints = info->have_size_hints;
+	long hint_flags = info->size_flags;
 
-	gw = find_window (w, FALSE);
-	if (gw == NULL) {
-		XClassHint hint = { NULL, NULL };
-		XWMHints *wmhints;
-		int x, y;
-		Window root;
-		unsigned int width, height, border, depth;
-
-		gw = g_new0 (MdmWindow, 1);
-		gw->win = w;
-		windows = g_list_prepend (windows, gw);
+	gw = g_new0 (MdmWindow, 1);
+	gw->win = w;
+	g_hash_table_insert (windows, GUINT_TO_POINTER (w), gw);
 
-		trap_push ();
+	trap_push ();
 
-		/* add "centering" */
-		gw->ignore_size_hints = FALSE;
-		gw->center = center;
+	/* add "centering" */
+	gw->ignore_size_hints = FALSE;
+	gw->center = center;
+	gw->recenter = FALSE;
+	/* NoInput windows */
+	gw->takefocus = ! info->no_input;
+	gw->takefocus_protocol = info->takefocus_protocol;
+
+	gw->ignore_next_map = 0;
+	gw->ignore_next_unmap = 0;
+
+	/* hack, set USpos/size on login window */
+	if (w == wm_login_window) {
+		long ret;
+		XSizeHints hints;
+		XGetWMNormalHints (wm_disp, w, &hints, &ret);
+		hints.flags |= USPosition | USSize;
+		XSetWMNormalHints (wm_disp, w, &hints);
+		have_hints = TRUE;
+		hint_flags = hints.flags;
+		gw->center = FALSE;
 		gw->recenter = FALSE;
-		gw->takefocus = TRUE;
-
-		gw->ignore_next_map = 0;
-		gw->ignore_next_unmap = 0;
-
-		wmhints = XGetWMHints (wm_disp, w);
-		if (wmhints != NULL) {
-			/* NoInput windows */
-			if ((wmhints->flags & InputHint) &&
-			    ! wmhints->input) {
-				gw->takefocus = FALSE;
-			}
-			XFree (wmhints);
-		}
-
-		/* hack, set USpos/size on login window */
-		if (w == wm_login_window) {
-			long ret;
-			XSizeHints hints;
-			XGetWMNormalHints (wm_disp, w, &hints, &ret);
-			hints.flags |= USPosition | USSize;
-			XSetWMNormalHints (wm_disp, w, &hints);
+	} else if (info->res_name != NULL || info->res_class != NULL) {
+		if (is_wm_class (info, "mdm", 3)) {
+			gw->ignore_size_hints = TRUE;
+			gw->center = TRUE;
+			gw->recenter = TRUE;
+		} else if (is_wm_class (info, "gkrellm", 0)) {
+			/* hack, gkrell is stupid and doesn't set
+			 * right hints, such as USPosition and other
+			 * such stuff */
 			gw->center = FALSE;
 			gw->recenter = FALSE;
-		} else if (XGetClassHint (wm_disp, w, &hint)) {
-			if (is_wm_class (&hint, "mdm", 3)) {
-				gw->ignore_size_hints = TRUE;
-				gw->center = TRUE;
-				gw->recenter = TRUE;
-			} else if (is_wm_class (&hint, "gkrellm", 0)) {
-				/* hack, gkrell is stupid and doesn't set
-				 * right hints, such as USPosition and other
-				 * such stuff */
-				gw->center = FALSE;
-				gw->recenter = FALSE;
-			} else if (is_wm_class (&hint, "xscribble", 0)) {
-				/* hack, xscribble mustn't take focus */
-				gw->takefocus = FALSE;
-			}
-			if (hint.res_name != NULL)
-				XFree (hint.res_name);
-			if (hint.res_class != NULL)
-				XFree (hint.res_class);
+		} else if (is_wm_class (info, "xscribble", 0)) {
+			/* hack, xscribble mustn't take focus */
+			gw->takefocus = FALSE;
 		}
+	}
 
-		XGetGeometry (wm_disp, w,
-			      &root, &x, &y, &width, &height, &border, &depth);
+	gw->x = info->x;
+	gw->y = info->y;
 
-		gw->x = x;
-		gw->y = x;
+	center_x_window (gw, w, have_hints, hint_flags,
+			 &info->x, &info->y, &info->width, &info->height);
+	add_deco (gw, info, is_mapped);
 
-		center_x_window (gw, w, w);
-		add_deco (gw, is_mapped);
+	XAddToSaveSet (wm_disp, w);
 
-		XAddToSaveSet (wm_disp, w);
+	trap_pop ();
 
-		trap_pop ();
+	return gw;
+}
+
+static MdmWindow *
+add_window (Window w, gboolean center, gboolean is_mapped)
+{
+	MdmWindow *gw;
+
+	gw = find_window (w, FALSE);
+	if (gw == NULL) {
+		WindowInfo info;
+
+		window_info_request (&info, w);
+		window_info_collect (&info);
+		/* it may be gone already */
+		if (info.exists)
+			gw = manage_window (&info, center, is_mapped);
+		window_info_free (&info);
 	}
 	return gw;
 }
@@ -814,36 +1092,30 @@ add_window (Window w, gboolean center, gboolean is_mapped)
 static void
 remove_window (Window w)
 {
-	GList *li = find_window_list (w, FALSE);
+	MdmWindow *gw = find_window (w, FALSE);
 
 	if (w == wm_focus_window)
 		wm_focus_window = None;
 
-	if (li != NULL) {
-		MdmWindow *gw = li->data;
-
-		li->data = NULL;
-
+	if (gw != NULL) {
 		trap_push ();
 
 		XRemoveFromSaveSet (wm_disp, w);
 
-		gw->win = None;
-
 		if (gw->deco != None) {
+			g_hash_table_remove (frames, GUINT_TO_POINTER (gw->deco));
 			XDestroyWindow (wm_disp, gw->deco);
 			gw->deco = None;
 		}
 		if (gw->shadow != None) {
+			g_hash_table_remove (frames, GUINT_TO_POINTER (gw->shadow));
 			XDestroyWindow (wm_disp, gw->shadow);
 			gw->shadow = None;
 		}
 		trap_pop ();
 
-		windows = g_list_remove_link (windows, li);
-		g_list_free_1 (li);
-
-		g_free (gw);
+		/* frees gw */
+		g_hash_table_remove (windows, GUINT_TO_POINTER (w));
 	}
 }
 
@@ -874,22 +1146,28 @@ add_all_current_windows (void)
 			&xparent,
 			&children,
 			&size)) {
+		WindowInfo *infos;
 		int i;
 
-		for (i = 0; i < size; i++) {
-			XWindowAttributes attribs = {0};
-
-			XGetWindowAttributes (wm_disp,
-					      children[i],
-					      &attribs);
+		/* Ask about all of them before waiting for any answer */
+		infos = g_new (WindowInfo, size);
+		for (i = 0; i < size; i++)
+			window_info_request (&infos[i], children[i]);
+		for (i = 0; i < size; i++)
+			window_info_collect (&infos[i]);
 
-			if ( ! attribs.override_redirect &&
-			    attribs.map_state != IsUnmapped) {
-				add_window (children[i],
-					    FALSE /*center*/,
-					    TRUE /* is_mapped */);
+		for (i = 0; i < size; i++) {
+			if (infos[i].exists &&
+			    ! infos[i].override_redirect &&
+			    infos[i].map_state != IsUnmapped &&
+			    find_window (children[i], FALSE) == NULL) {
+				manage_window (&infos[i],
+					       FALSE /*center*/,
+					       TRUE /* is_mapped */);
 			}
+			window_info_free (&infos[i]);
 		}
+		g_free (infos);
 
 		if (children != NULL)
 			XFree (children);
@@ -997,9 +1275,9 @@ event_process (XEvent *ev)
 						  gw->deco,
 						  ev->xconfigurerequest.value_mask,
 						  &wchanges);
-				center_x_window (gw, gw->deco, gw->win);
+				recenter_x_window (gw, gw->deco);
 			} else {
-				center_x_window (gw, gw->win, gw->win);
+				recenter_x_window (gw, gw->win);
 			}
 			shadow_follow (gw);
 		}
@@ -1090,6 +1368,14 @@ event_process (XEvent *ev)
 					      ev->xproperty.window);
 			constrain_all_windows ();
 		}
+		else if (ev->xproperty.atom == XA_WM_PROTOCOLS)
+		{
+			gw = find_window (ev->xproperty.window, FALSE);
+			if (gw != NULL)
+				gw->takefocus_protocol =
+					wm_protocol_check_support (gw->win,
+								   XA_WM_TAKE_FOCUS);
+		}
 		break;
 	default:
 		break;
@@ -1158,6 +1444,9 @@ mdm_wm_init (Window login_window)
 		return;
 	}
 
+	windows = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+	frames = g_hash_table_new (NULL, NULL);
+
 	display = gdk_get_display ();
 	wm_disp = XOpenDisplay (display);
 	g_free (display);
@@ -1175,6 +1464,7 @@ mdm_wm_init (Window login_window)
 
 	XA_COMPOUND_TEXT = XInternAtom (wm_disp, "COMPOUND_TEXT", False);
 	XA_NET_WM_STRUT = XInternAtom (wm_disp, "_NET_WM_STRUT", False);
+	XA_MOTIF_WM_HINTS = XInternAtom (wm_disp, "_MOTIF_WM_HINTS", False);
 
 	wm_root = DefaultRootWindow (wm_disp);
 
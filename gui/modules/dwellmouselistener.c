@@ -79,9 +79,14 @@ typedef struct {
          guint32 time;
 } Crossings;
 
+#define N_BORDERS 4
+
 static int lineno = 0;
 static GSList *binding_list = NULL;
 
+/* binding_list split up by the border each binding ends on */
+static GSList *bindings_by_border[N_BORDERS];
+
 extern char **environ;
 
 static guint enter_signal_id = 0;
@@ -412,6 +417,33 @@ load_bindings(gchar *path)
 	fclose (fp);
 }
 
+/*
+ * A binding can only complete on a crossing of its last border, so file
+ * each one under that border and only look at those on every crossing.
+ * Bindings without borders go everywhere.  List order is kept.
+ */
+static void
+index_bindings (void)
+{
+	GSList *li;
+	int i;
+
+	for (li = binding_list; li != NULL; li = li->next) {
+		Binding *binding = li->data;
+		int n = binding->input.num_gestures;
+
+		for (i = 0; i < N_BORDERS; i++) {
+			if (n == 0 ||
+			    binding->input.gesture[n - 1] == (BindingType) (1 << i))
+				bindings_by_border[i] =
+					g_slist_prepend (bindings_by_border[i], binding);
+		}
+	}
+
+	for (i = 0; i < N_BORDERS; i++)
+		bindings_by_border[i] = g_slist_reverse (bindings_by_border[i]);
+}
+
 static gboolean
 change_cursor_back (gpointer data)
 {
@@ -500,8 +532,13 @@ leave_enter_emission_hook (GSignalInvocationHint        *ihint,
 
 	crossings[cross_pos].time = event->time;
 
+	if (debug_gestures) {
+		syslog (LOG_WARNING, "Checking against registered gestures");
+	}
+
 	/* Check to see if a gesture has been completed */
-	for (li=binding_list; li != NULL; li = li->next) {
+	for (li = bindings_by_border[g_bit_nth_lsf (crossings[cross_pos].type, -1)];
+	     li != NULL; li = li->next) {
 		Binding *curr_binding = (Binding *) li->data;
 		GSList *act_li;
 		gboolean retval;
@@ -510,10 +547,6 @@ leave_enter_emission_hook (GSignalInvocationHint        *ihint,
 		int start_pos = (cross_pos - curr_binding->input.num_gestures + 1 +
 			max_crossings) % max_crossings;
 
-		if (debug_gestures) {
-			syslog (LOG_WARNING, "Checking against registered gestures");
-		}
-
 		/* being anal here */
 		if (start_pos < 0)
 			start_pos = 0;
@@ -610,6 +643,7 @@ create_event_watcher (void)
 		return;
 
 	load_bindings(CONFIGFILE);
+	index_bindings ();
 
 	crossings = g_new0(Crossings, max_crossings);
 
@@ -0,0 +1,165 @@
+/* MDM - The MDM Display Manager
+ *
+ * Replays a recorded stream of key and button events through the
+ * keymouselistener gesture filter and reports what each event costs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Usage: gesture-replay GESTURES-FILE STREAM-FILE [ROUNDS]
+ *
+ * GESTURES-FILE is in the AccessKeyMouseEvents format.  Every line of
+ * STREAM-FILE is one event:
+ *
+ *	TIME KeyPress|KeyRelease ACCELERATOR
+ *	TIME ButtonPress|ButtonRelease BUTTON
+ *
+ * where TIME is in milliseconds and ACCELERATOR is as understood by
+ * gtk_accelerator_parse, e.g. "<Control>k".  Blank lines and lines
+ * starting with '#' are skipped.  Needs an X display for the keymap.
+ *
+ * The filter's own code is compiled in, with actions replaced by a
+ * counter, so nothing gets spawned.
+ */
+
+#define GESTURE_REPLAY
+#include "keymouselistener.c"
+
+static gboolean
+parse_event (Display *dpy, gchar *line, XEvent *xev)
+{
+	gchar **fields;
+	gboolean ret = FALSE;
+	guint time;
+
+	fields = g_strsplit_set (g_strstrip (line), " \t", 3);
+	if (g_strv_length (fields) != 3)
+		goto out;
+
+	memset (xev, 0, sizeof (XEvent));
+	time = strtoul (fields[0], NULL, 10);
+
+	if (strcmp (fields[1], "KeyPress") == 0 ||
+	    strcmp (fields[1], "KeyRelease") == 0) {
+		guint keysym;
+		GdkModifierType state;
+
+		gtk_accelerator_parse (fields[2], &keysym, &state);
+		if (keysym == 0)
+			goto out;
+
+		xev->type = (fields[1][3] == 'P') ? KeyPress : KeyRelease;
+		xev->xkey.display = dpy;
+		xev->xkey.root = DefaultRootWindow (dpy);
+		xev->xkey.time = time;
+		xev->xkey.state = state;
+		xev->xkey.keycode = XKeysymToKeycode (dpy, keysym);
+		ret = (xev->xkey.keycode != 0);
+	} else if (strcmp (fields[1], "ButtonPress") == 0 ||
+		   strcmp (fields[1], "ButtonRelease") == 0) {
+		xev->type = (fields[1][6] == 'P') ? ButtonPress : ButtonRelease;
+		xev->xbutton.display = dpy;
+		xev->xbutton.root = DefaultRootWindow (dpy);
+		xev->xbutton.time = time;
+		xev->xbutton.button = strtoul (fields[2], NULL, 10);
+		ret = (xev->xbutton.button != 0);
+	}
+
+ out:
+	g_strfreev (fields);
+	return ret;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GArray *events;
+	Display *dpy;
+	gchar *contents;
+	gchar **lines;
+	gint64 start, elapsed;
+	guint rounds = 1000;
+	guint i, j;
+	GError *error = NULL;
+
+	if (argc < 3) {
+		g_printerr ("Usage: %s GESTURES-FILE STREAM-FILE [ROUNDS]\n",
+			    argv[0]);
+		return 1;
+	}
+	if (argc > 3)
+		rounds = MAX (1, atoi (argv[3]));
+
+	if ( ! gtk_init_check (&argc, &argv)) {
+		g_printerr ("%s: cannot open display\n", argv[0]);
+		return 77;
+	}
+	dpy = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+
+	load_gestures (argv[1]);
+	if (gesture_list == NULL) {
+		g_printerr ("%s: no gestures in %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	if ( ! g_file_get_contents (argv[2], &contents, NULL, &error)) {
+		g_printerr ("%s: %s\n", argv[0], error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	events = g_array_new (FALSE, FALSE, sizeof (XEvent));
+	lines = g_strsplit (contents, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		XEvent xev;
+
+		if (lines[i][0] == '#' || lines[i][strspn (lines[i], " \t")] == '\0')
+			continue;
+		if ( ! parse_event (dpy, lines[i], &xev)) {
+			g_printerr ("%s:%u: bad event\n", argv[2], i + 1);
+			return 1;
+		}
+		g_array_append_val (events, xev);
+	}
+	g_strfreev (lines);
+	g_free (contents);
+
+	if (events->len == 0) {
+		g_printerr ("%s: no events in %s\n", argv[0], argv[2]);
+		return 1;
+	}
+
+	/* Build the index outside the timed loop */
+	gesture_index_build ();
+
+	start = g_get_monotonic_time ();
+	for (j = 0; j < rounds; j++) {
+		for (i = 0; i < events->len; i++)
+			gestures_filter ((GdkXEvent *) &g_array_index (events, XEvent, i),
+					 NULL, NULL);
+	}
+	elapsed = g_get_monotonic_time () - start;
+
+	g_print ("gestures: %u\n", g_slist_length (gesture_list));
+	g_print ("events: %u x %u rounds\n", events->len, rounds);
+	g_print ("completed: %u\n", gestures_completed);
+	g_print ("ns/event: %.1f\n",
+		 (elapsed * 1000.0) / ((gdouble) events->len * rounds));
+
+	g_array_free (events, TRUE);
+
+	return 0;
+}
@@ -102,6 +102,18 @@ static gboolean debug_gestures = FALSE;
 static GSList   *gesture_list  = NULL;
 static int      lineno         = 0;
 
+/*
+ * gesture_list indexed by (class, keycode or button, modifiers).  Built
+ * on the first gesture event, once XKB is up, and again whenever the
+ * keymap changes.
+ */
+static GHashTable *gesture_index       = NULL;
+static gboolean    gesture_index_dirty = TRUE;
+
+#ifdef GESTURE_REPLAY
+static guint gestures_completed = 0;
+#endif
+
 static gchar * screen_exec_display_string (GdkScreen *screen, const char *old);
 static void create_event_watcher (void);
 static void load_gestures(gchar *path);
@@ -110,8 +122,7 @@ static Gesture * parse_line(gchar *buf);
 static GdkFilterReturn gestures_filter (GdkXEvent *gdk_xevent, GdkEvent *event, gpointer data);
 static gint is_mouseX (const gchar *string);
 static gint is_switchX (const gchar *string);
-
-#define gesture_list_get_matches(a, b, c) (g_slist_find_custom (a, b, c))
+static void gesture_keys_changed (GdkKeymap *keymap, gpointer data);
 
 static void
 free_gesture (Gesture *gesture)
@@ -236,6 +247,9 @@ static void create_event_watcher (void)
 	init_xinput (display, gdk_screen_get_root_window (
 		gdk_display_get_default_screen (display)));
 
+	g_signal_connect (gdk_keymap_get_for_display (display), "keys-changed",
+			  G_CALLBACK (gesture_keys_changed), NULL);
+
 	gdk_window_add_filter (NULL, gestures_filter, NULL);
 
 	return;
@@ -576,60 +590,111 @@ keycodes_equal (XEvent *ev1, XEvent *ev2)
 	return FALSE;
 }
 
-static gint
-key_gesture_compare_func (gconstpointer a, gconstpointer b)
+/* Event classes used in the gesture index key */
+#define GESTURE_CLASS_KEY	1
+#define GESTURE_CLASS_MOUSE	2
+#define GESTURE_CLASS_SWITCH	3
+
+#define gesture_index_key(class, code, state) \
+	GUINT_TO_POINTER (((class) << 28) | (((code) & 0xfffff) << 8) | \
+			  ((state) & USED_MODS))
+
+static void
+gesture_keys_changed (GdkKeymap *keymap, gpointer data)
 {
-	Gesture *gesture   = a;
-	const XEvent  *xev = b;
+	gesture_index_dirty = TRUE;
+}
 
-	if (gesture->type == GESTURE_TYPE_KEY) 
-	{
-	    /*
-	     * Using some Xservers, the parse_line function fails to get the
-	     * keycode because XKB is not initialized when mdmlogin starts.
-	     * If the keycode value is 0, try to set it again.
-	     */
-	    if (gesture->input.key.keycode == 0) {
-		static GdkDisplay *display = NULL;
-
-		if (!display)
-		    display = gdk_display_get_default();
-
-		if (display) {
-		    gesture->input.key.keycode =
-			XKeysymToKeycode (GDK_DISPLAY_XDISPLAY (display),
-			gesture->input.key.keysym);
+static void
+gesture_index_build (void)
+{
+	GdkDisplay *display = gdk_display_get_default ();
+	GSList *li;
 
-		    if (debug_gestures)
-			syslog (LOG_WARNING, "Reset keycode to a real value");
-		} else if (debug_gestures) {
-		   syslog (LOG_WARNING, "Failed to reset keycode to a real value");
+	if (gesture_index == NULL)
+		gesture_index = g_hash_table_new (NULL, NULL);
+	else
+		g_hash_table_remove_all (gesture_index);
+
+	for (li = gesture_list; li != NULL; li = li->next) {
+		Gesture *gesture = li->data;
+		gpointer key;
+
+		if (gesture->type == GESTURE_TYPE_KEY) {
+			/*
+			 * Using some Xservers, the parse_line function fails
+			 * to get the keycode because XKB is not initialized
+			 * when mdmlogin starts, so resolve it again here.
+			 */
+			if (display != NULL)
+				gesture->input.key.keycode =
+					XKeysymToKeycode (GDK_DISPLAY_XDISPLAY (display),
+					gesture->input.key.keysym);
+
+			/* Modifiers outside USED_MODS can never match */
+			if (gesture->input.key.keycode == 0 ||
+			    (gesture->input.key.state & ~USED_MODS) != 0) {
+				if (debug_gestures)
+					syslog (LOG_WARNING,
+						"No keycode for gesture %s",
+						gesture->gesture_str);
+				continue;
+			}
+			key = gesture_index_key (GESTURE_CLASS_KEY,
+						 gesture->input.key.keycode,
+						 gesture->input.key.state);
+		} else if (gesture->type == GESTURE_TYPE_MOUSE) {
+			key = gesture_index_key (GESTURE_CLASS_MOUSE,
+						 gesture->input.button.number, 0);
+		} else if (gesture->type == GESTURE_TYPE_BUTTON) {
+			key = gesture_index_key (GESTURE_CLASS_SWITCH,
+						 gesture->input.button.number, 0);
+		} else {
+			continue;
 		}
-	    }
 
-	    if (((xev->type == KeyPress) || (xev->type == KeyRelease)) &&
-		(xev->xkey.keycode == gesture->input.key.keycode) &&
-		((xev->xkey.state & USED_MODS) == gesture->input.key.state))
-		return 0;
-	    else if (((xev->type == xinput_types[XINPUT_TYPE_KEY_PRESS]) ||
-		     (xev->type == xinput_types[XINPUT_TYPE_KEY_RELEASE])) &&
-		     (xev->xkey.keycode == gesture->input.key.keycode) &&
-		     ((xev->xkey.state & USED_MODS) == gesture->input.key.state))
-		return 0;
-	    else
-		return 1;
+		/* The first gesture in the file wins, as it always has */
+		if (g_hash_table_lookup (gesture_index, key) == NULL)
+			g_hash_table_insert (gesture_index, key, gesture);
 	}
-	else if ((gesture->type == GESTURE_TYPE_MOUSE) &&
-		 ((xev->type == ButtonPress) || (xev->type == ButtonRelease)) &&
-		 (xev->xbutton.button == gesture->input.button.number))
-		return 0;
-	else if ((gesture->type == GESTURE_TYPE_BUTTON) &&
-		 ((xev->type == xinput_types[XINPUT_TYPE_BUTTON_PRESS]) ||
-		  (xev->type == xinput_types[XINPUT_TYPE_BUTTON_RELEASE])) &&
-		 ((XDeviceButtonEvent *) xev)->button == gesture->input.button.number)
-		return 0;
+
+	gesture_index_dirty = FALSE;
+
+	if (debug_gestures)
+		syslog (LOG_WARNING, "Indexed %d gestures",
+			g_hash_table_size (gesture_index));
+}
+
+/* Find the gesture bound to this key or button event, if any */
+static Gesture *
+gesture_lookup (XEvent *xev)
+{
+	gpointer key;
+
+	if (gesture_index_dirty)
+		gesture_index_build ();
+
+	if (xev->type == KeyPress || xev->type == KeyRelease)
+		key = gesture_index_key (GESTURE_CLASS_KEY,
+					 xev->xkey.keycode, xev->xkey.state);
+	else if (xev->type == ButtonPress || xev->type == ButtonRelease)
+		key = gesture_index_key (GESTURE_CLASS_MOUSE,
+					 xev->xbutton.button, 0);
+#ifdef HAVE_XINPUT
+	else if (xev->type == xinput_types[XINPUT_TYPE_KEY_PRESS] ||
+		 xev->type == xinput_types[XINPUT_TYPE_KEY_RELEASE])
+		key = gesture_index_key (GESTURE_CLASS_KEY,
+					 ((XDeviceKeyEvent *) xev)->keycode,
+					 ((XDeviceKeyEvent *) xev)->state);
+	else if (xev->type == xinput_types[XINPUT_TYPE_BUTTON_PRESS] ||
+		 xev->type == xinput_types[XINPUT_TYPE_BUTTON_RELEASE])
+		key = gesture_index_key (GESTURE_CLASS_SWITCH,
+					 ((XDeviceButtonEvent *) xev)->button, 0);
+#endif
 	else
-		return 1;
+		return NULL;
+
+	return g_hash_table_lookup (gesture_index, key);
 }
 
 #define event_is_gesture_type(xevent) (xevent->type == KeyPress ||\
@@ -647,7 +712,7 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		 gpointer data)
 {
 	XEvent  *xevent = (XEvent *)gdk_xevent;
-	GSList  *li, *act_li;
+	GSList  *act_li;
 	Gesture *curr_gesture = NULL;
 	XID xinput_device = None;
 	
@@ -695,11 +760,9 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		}
 
 		/* Find the associated gesture for this keycode & state */
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
+		curr_gesture = gesture_lookup (xevent);
 
-		if (li) {
-			curr_gesture = li->data;
+		if (curr_gesture) {
 			if (debug_gestures)
 			    syslog (LOG_WARNING,
 				"found a press match [%s]",
@@ -747,12 +810,9 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		 * otherwise key gestures based on modifier keys such as
 		 * Control_R won't work.
 		 */
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
-
-	        if (li) {
-			curr_gesture = li->data;
+		curr_gesture = gesture_lookup (xevent);
 
+	        if (curr_gesture) {
 			if (debug_gestures)
 		 	   syslog (LOG_WARNING, "found a release match [%s]",
 				 curr_gesture->gesture_str);
@@ -811,14 +871,11 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		/*
 		 * Find the associated gesture for this button.
 		 */
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
-		if (li) {
+		curr_gesture = gesture_lookup (xevent);
+		if (curr_gesture) {
 			if (debug_gestures)
 				syslog (LOG_WARNING, "found match for press");
 
-			curr_gesture = li->data;
-
 			if (curr_gesture->timeout > 0 && seq_count > 0) {
 
 				/* xevent time values are in milliseconds. */
@@ -876,13 +933,11 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		}
 #endif
 
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
+		curr_gesture = gesture_lookup (xevent);
 
-		if (li) {
+		if (curr_gesture) {
 			if (debug_gestures)
 			    syslog (LOG_WARNING, "found match for release");
-			curr_gesture = li->data;
 			if ((curr_gesture->duration > 0) &&
 			    (elapsed_time (last_event, xevent) < curr_gesture->duration)) {
 				seq_count = 0;
@@ -922,6 +977,11 @@ gestures_filter (GdkXEvent *gdk_xevent,
 				syslog (LOG_WARNING, "gesture complete!");
 
 			seq_count = 0;
+#ifdef GESTURE_REPLAY
+			/* The replay benchmark only counts completions */
+			gestures_completed++;
+			return GDK_FILTER_CONTINUE;
+#endif
 			for (act_li = curr_gesture->actions;
 			     act_li != NULL; act_li = act_li->next) {
 				gchar *action = (gchar *)act_li->data;
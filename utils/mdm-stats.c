@@ -0,0 +1,221 @@
+/* MDM - The MDM Display Manager
+ *
+ * Prints the daemon's counters and latency histograms, as returned by
+ * the STATS supervisor command.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <locale.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "mdm-socket-protocol.h"
+#include "mdm-stats.h"
+
+static gboolean json = FALSE;
+
+static GOptionEntry options[] = {
+	{
+		"json", 0, 0, G_OPTION_ARG_NONE, &json,
+		N_("Print the statistics as JSON"),
+		NULL
+	},
+	{ NULL }
+};
+
+/* Sends cmd and returns the answer line without the newline, or NULL */
+static char *
+sup_call (int fd, const char *cmd)
+{
+	GString *answer;
+	char *line;
+	char c;
+
+	line = g_strconcat (cmd, "\n", NULL);
+	if (write (fd, line, strlen (line)) != (ssize_t) strlen (line)) {
+		g_free (line);
+		return NULL;
+	}
+	g_free (line);
+
+	answer = g_string_new (NULL);
+	while (read (fd, &c, 1) == 1 && c != '\n')
+		g_string_append_c (answer, c);
+
+	return g_string_free (answer, FALSE);
+}
+
+static char *
+get_stats (void)
+{
+	struct sockaddr_un addr;
+	char *version, *stats = NULL;
+	int fd;
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return NULL;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, MDM_SUP_SOCKET);
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		close (fd);
+		return NULL;
+	}
+
+	version = sup_call (fd, MDM_SUP_VERSION);
+	if (version != NULL && strncmp (version, "MDM ", 4) == 0)
+		stats = sup_call (fd, MDM_SUP_STATS);
+	g_free (version);
+
+	g_free (sup_call (fd, MDM_SUP_CLOSE));
+	close (fd);
+
+	return stats;
+}
+
+/* Upper bound of the bucket holding the given fraction of the samples,
+ * in ms.  The last bucket has no bound, max is used instead. */
+static double
+percentile (guint64 *buckets, guint64 count, guint64 max, double fraction)
+{
+	guint64 seen = 0;
+	int i;
+
+	for (i = 0; i < MDM_STATS_BUCKETS - 1; i++) {
+		seen += buckets[i];
+		if (seen >= count * fraction)
+			return (64 << i) / 1000.0;
+	}
+
+	return max / 1000.0;
+}
+
+static void
+print_histogram (const char *name, char **values)
+{
+	guint64 count, sum, max;
+	guint64 buckets[MDM_STATS_BUCKETS];
+	int i;
+
+	if (g_strv_length (values) != 3 + MDM_STATS_BUCKETS) {
+		if (json)
+			g_print ("null");
+		return;
+	}
+
+	count = g_ascii_strtoull (values[0], NULL, 10);
+	sum = g_ascii_strtoull (values[1], NULL, 10);
+	max = g_ascii_strtoull (values[2], NULL, 10);
+	for (i = 0; i < MDM_STATS_BUCKETS; i++)
+		buckets[i] = g_ascii_strtoull (values[3 + i], NULL, 10);
+
+	if (json) {
+		g_print ("{ \"count\": %" G_GUINT64_FORMAT
+			 ", \"sum_usec\": %" G_GUINT64_FORMAT
+			 ", \"max_usec\": %" G_GUINT64_FORMAT
+			 ", \"buckets\": [", count, sum, max);
+		for (i = 0; i < MDM_STATS_BUCKETS; i++)
+			g_print ("%s%" G_GUINT64_FORMAT, i > 0 ? ", " : "", buckets[i]);
+		g_print ("] }");
+	} else {
+		g_print ("%-40s %8" G_GUINT64_FORMAT " calls, mean %.2f ms, "
+			 "p50 <%.2f ms, p99 <%.2f ms, max %.2f ms\n",
+			 name, count, count > 0 ? sum / 1000.0 / count : 0.0,
+			 percentile (buckets, count, max, 0.5),
+			 percentile (buckets, count, max, 0.99),
+			 max / 1000.0);
+	}
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *ctx;
+	GError *error = NULL;
+	char *stats;
+	char **fields;
+	int i;
+
+	setlocale (LC_ALL, "");
+	bindtextdomain (GETTEXT_PACKAGE, GNOMELOCALEDIR);
+	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+	textdomain (GETTEXT_PACKAGE);
+
+	ctx = g_option_context_new (_("- show display manager statistics"));
+	g_option_context_add_main_entries (ctx, options, GETTEXT_PACKAGE);
+	if ( ! g_option_context_parse (ctx, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (ctx);
+
+	stats = get_stats ();
+	if (stats == NULL) {
+		g_printerr (_("Cannot talk to the display manager\n"));
+		return 1;
+	}
+	if (strncmp (stats, "OK ", 3) != 0) {
+		g_printerr ("%s\n", stats);
+		g_free (stats);
+		return 1;
+	}
+
+	if (json)
+		g_print ("{\n");
+
+	fields = g_strsplit (stats + 3, ";", -1);
+	for (i = 0; fields[i] != NULL; i++) {
+		char *value = strchr (fields[i], '=');
+
+		if (value == NULL)
+			continue;
+		*value++ = '\0';
+
+		if (json)
+			g_print ("%s  \"%s\": ", i > 0 ? ",\n" : "", fields[i]);
+
+		if (strchr (value, ',') != NULL) {
+			char **values = g_strsplit (value, ",", -1);
+
+			print_histogram (fields[i], values);
+			g_strfreev (values);
+		} else if (json) {
+			g_print ("%s", value);
+		} else {
+			g_print ("%-40s %8s\n", fields[i], value);
+		}
+	}
+	g_strfreev (fields);
+	g_free (stats);
+
+	if (json)
+		g_print ("\n}\n");
+
+	return 0;
+}